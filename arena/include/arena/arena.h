@@ -0,0 +1,32 @@
+#ifndef ARENA_ARENA_H_
+#define ARENA_ARENA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct ArenaBlock ArenaBlock;
+
+// A bump-pointer allocator. Allocations are never freed one by one; freeing
+// the arena releases every block at once. Blocks start small and double in
+// size, so a short-lived arena costs one malloc and a large one a handful.
+typedef struct {
+  ArenaBlock* head;
+  uint64_t next_block_size;
+  // Bytes handed out and bytes reserved from malloc, for statistics.
+  uint64_t used;
+  uint64_t reserved;
+} Arena;
+
+#define ARENA_NEW(Arena, T) ((T*)ArenaAlloc(Arena, sizeof(T)))
+#define ARENA_NEW_ARRAY(Arena, T, Count) \
+  ((T*)ArenaAlloc(Arena, sizeof(T) * (Count)))
+
+void ArenaInit(Arena* arena);
+// Returns zeroed memory aligned for any object, or NULL when out of memory.
+void* ArenaAlloc(Arena* arena, uint64_t size);
+// Moves every block of `other` into `arena`, which frees them from then on;
+// `other` is left empty. Allocations from either keep their addresses.
+void ArenaAdopt(Arena* arena, Arena* other);
+void ArenaFree(Arena* arena);
+
+#endif  // ARENA_ARENA_H_
@@ -0,0 +1,104 @@
+#include "arena/arena.h"
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+  kFirstBlockSize = 4 * 1024,
+  kMaxBlockSize = 1024 * 1024,
+  kAlignment = alignof(max_align_t),
+};
+
+struct ArenaBlock {
+  ArenaBlock* next;
+  uint64_t size;
+  uint64_t used;
+  alignas(max_align_t) unsigned char data[];
+};
+
+static ArenaBlock* ArenaGrow(Arena* arena, uint64_t size);
+
+void ArenaInit(Arena* arena) {
+  *arena = (Arena){.next_block_size = kFirstBlockSize};
+}
+
+void* ArenaAlloc(Arena* arena, uint64_t size) {
+  size = (size + kAlignment - 1) & ~(uint64_t)(kAlignment - 1);
+  ArenaBlock* block = arena->head;
+  if (block == NULL || block->size - block->used < size) {
+    block = ArenaGrow(arena, size);
+    if (block == NULL) {
+      return NULL;
+    }
+  }
+  void* result = &block->data[block->used];
+  block->used += size;
+  arena->used += size;
+  memset(result, 0, size);
+  return result;
+}
+
+// The adopted blocks go behind the head, which keeps serving allocations.
+void ArenaAdopt(Arena* arena, Arena* other) {
+  ArenaBlock* first = other->head;
+  if (first == NULL) {
+    return;
+  }
+  ArenaBlock* last = first;
+  while (last->next != NULL) {
+    last = last->next;
+  }
+  if (arena->head == NULL) {
+    arena->head = first;
+  } else {
+    last->next = arena->head->next;
+    arena->head->next = first;
+  }
+  arena->used += other->used;
+  arena->reserved += other->reserved;
+  ArenaInit(other);
+}
+
+void ArenaFree(Arena* arena) {
+  ArenaBlock* block = arena->head;
+  while (block != NULL) {
+    ArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  ArenaInit(arena);
+}
+
+// Requests larger than a regular block get a block of their own, linked
+// behind the head so that the head keeps serving small allocations.
+// Otherwise the space left in the old head is abandoned, which with doubling
+// block sizes wastes at most about half of the last block.
+ArenaBlock* ArenaGrow(Arena* arena, uint64_t size) {
+  if (arena->next_block_size == 0) {
+    arena->next_block_size = kFirstBlockSize;
+  }
+  bool oversized = size > arena->next_block_size;
+  uint64_t block_size = oversized ? size : arena->next_block_size;
+  ArenaBlock* block = malloc(sizeof(ArenaBlock) + block_size);
+  if (block == NULL) {
+    return NULL;
+  }
+  block->size = block_size;
+  block->used = 0;
+  arena->reserved += block_size;
+  if (oversized && arena->head != NULL) {
+    block->next = arena->head->next;
+    arena->head->next = block;
+    return block;
+  }
+  block->next = arena->head;
+  arena->head = block;
+  if (arena->next_block_size < kMaxBlockSize) {
+    arena->next_block_size *= 2;
+  }
+  return block;
+}
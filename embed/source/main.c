@@ -2,7 +2,6 @@
 #include <ctype.h>
 #include <errno.h>
 #include <nonstd/strdup.h>
-#include <nonstd/strtok.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -115,22 +114,26 @@ int main(int argc, const char** argv) {
     }
   }
   fprintf(outp, "const char %s[] =\n", symbol_name);
-  char* saveptr;
-  for (char* line = NonstdStringTokenizeReentrant(input, "\n", &saveptr);
-       line != NULL;
-       line = NonstdStringTokenizeReentrant(NULL, "\n", &saveptr)) {
-    fputs("\"", outp);
-    for (char* c = line; *c != '\0'; ++c) {
-      if (*c == '"') {
-        fputs("\\\"", outp);
-      } else if (*c == '\\') {
-        fputs("\\\\", outp);
-      } else {
-        fputc(*c, outp);
-      }
+  // Emits the input byte for byte, one string literal per line, so that the
+  // array holds exactly inlen bytes before its terminator.
+  fputs("\"", outp);
+  for (int i = 0; i < inlen; ++i) {
+    char c = input[i];
+    if (c == '"') {
+      fputs("\\\"", outp);
+    } else if (c == '\\') {
+      fputs("\\\\", outp);
+    } else if (c == '\t') {
+      fputs("\\t", outp);
+    } else if (c == '\r') {
+      fputs("\\r", outp);
+    } else if (c == '\n') {
+      fputs(i + 1 < inlen ? "\\n\"\n\"" : "\\n", outp);
+    } else {
+      fputc(c, outp);
     }
-    fputs("\\n\"\n", outp);
   }
+  fputs("\"\n", outp);
   fprintf(outp, ";\n");
   fprintf(outp, "const size_t %s_size = %d;\n", symbol_name, inlen);
   fclose(outp);
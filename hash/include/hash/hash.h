@@ -56,6 +56,8 @@ typedef enum {
 #define HASH_GET(Hash, Key, OutValue) \
   HashGet(HASH_UNPACK(Hash), HashCreateKey(Key), (uint8_t*)(OutValue))
 
+// The 64-bit FNV-1a hash of `size` bytes, which is what keys hash with.
+uint64_t HashFnv1a(const void* data, uint64_t size);
 HashAddResult HashAdd(HashUnpacked hash, HashKeyView key, const uint8_t* value);
 HashKeyView HashCreateKey(HashKeySpan key);
 void HashFree(HashUnpacked hash);
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Capacities are powers of two, so that a hash is reduced to a slot by masking.
 enum { kInitialCapacity = 16, kMaxLoad = 0xBF };
 
 static bool HashRehash(HashUnpacked hash, uint64_t new_capacity);
@@ -11,6 +12,18 @@ static bool HashKeyVecEqualSpan(HashKeyVec a, HashKeySpan b);
 static uint64_t HashKeySpanHash(HashKeySpan key);
 static HashKey HashOwnKey(HashKeyView key);
 
+uint64_t HashFnv1a(const void* data, uint64_t size) {
+  // FNV-1a 64-bit hash
+  // https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+  const uint8_t* bytes = data;
+  uint64_t hash = 0xcbf29ce484222325;
+  for (uint64_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
 HashAddResult HashAdd(HashUnpacked hash,
                       HashKeyView key,
                       const uint8_t* value) {
@@ -21,7 +34,7 @@ HashAddResult HashAdd(HashUnpacked hash,
     }
   }
 
-  uint64_t index = key.hash % *hash.capacity;
+  uint64_t index = key.hash & (*hash.capacity - 1);
   while ((*hash.keys)[index].vec.size != 0) {
     if ((*hash.keys)[index].hash == key.hash &&
         HashKeyVecEqualSpan((*hash.keys)[index].vec, key.span)) {
@@ -29,12 +42,12 @@ HashAddResult HashAdd(HashUnpacked hash,
              hash.sizeof_value);
       return kHashAddReplace;
     }
-    index = (index + 1) % *hash.capacity;
+    index = (index + 1) & (*hash.capacity - 1);
   }
 
   (*hash.keys)[index] = HashOwnKey(key);
   memcpy(&(*hash.values)[index * hash.sizeof_value], value, hash.sizeof_value);
-  hash.size++;
+  (*hash.size)++;
   return kHashAddSuccess;
 }
 
@@ -56,7 +69,10 @@ void HashFree(HashUnpacked hash) {
 }
 
 bool HashGet(HashUnpacked hash, HashKeyView key, uint8_t* out_value) {
-  uint64_t index = key.hash % *hash.capacity;
+  if (*hash.capacity == 0) {
+    return false;
+  }
+  uint64_t index = key.hash & (*hash.capacity - 1);
   while ((*hash.keys)[index].vec.size != 0) {
     if ((*hash.keys)[index].hash == key.hash &&
         HashKeyVecEqualSpan((*hash.keys)[index].vec, key.span)) {
@@ -64,7 +80,7 @@ bool HashGet(HashUnpacked hash, HashKeyView key, uint8_t* out_value) {
              hash.sizeof_value);
       return true;
     }
-    index = (index + 1) % *hash.capacity;
+    index = (index + 1) & (*hash.capacity - 1);
   }
   return false;
 }
@@ -83,9 +99,9 @@ bool HashRehash(HashUnpacked hash, uint64_t new_capacity) {
 
   for (uint64_t i = 0; i < *hash.capacity; i++) {
     if ((*hash.keys)[i].vec.size != 0) {
-      uint64_t index = (*hash.keys)[i].hash % new_capacity;
+      uint64_t index = (*hash.keys)[i].hash & (new_capacity - 1);
       while (new_keys[index].vec.size != 0) {
-        index = (index + 1) % new_capacity;
+        index = (index + 1) & (new_capacity - 1);
       }
       new_keys[index] = (*hash.keys)[i];
       memcpy(&new_values[index * hash.sizeof_value],
@@ -106,14 +122,7 @@ bool HashKeyVecEqualSpan(HashKeyVec a, HashKeySpan b) {
 }
 
 uint64_t HashKeySpanHash(HashKeySpan key) {
-  // FNV-1a 64-bit hash
-  // https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
-  uint64_t hash = 0xcbf29ce484222325;
-  for (uint64_t i = 0; i < SPAN_SIZE(&key); i++) {
-    hash ^= key.begin[i];
-    hash *= 0x100000001b3;
-  }
-  return hash;
+  return HashFnv1a(key.begin, SPAN_SIZE(&key));
 }
 
 HashKey HashOwnKey(HashKeyView key) {
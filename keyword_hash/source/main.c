@@ -0,0 +1,218 @@
+#include <argparse.h>
+#include <errno.h>
+#include <nonstd/strdup.h>
+#include <nonstd/strtok.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Generates a collision-free hash over a fixed keyword list. Slots are picked
+// by (a * first byte + b * last byte + length) & (table size - 1); the search
+// tries the smallest power-of-two table first and grows it until some (a, b)
+// pair separates every keyword.
+
+enum {
+  kMaxKeywords = 64,
+  kMaxTableSize = 256,
+  kMaxMultiplier = 256,
+};
+
+typedef struct {
+  char* text;
+  size_t size;
+  char* kind;
+} Keyword;
+
+typedef struct {
+  uint32_t a;
+  uint32_t b;
+  uint32_t table_size;
+} HashParams;
+
+static const char* const kUsage[] = {
+    "keyword_hash <FILE> [options]",
+    NULL,
+};
+
+static uint32_t Slot(HashParams params, const char* text, size_t size) {
+  return (params.a * (uint8_t)text[0] + params.b * (uint8_t)text[size - 1] +
+          (uint32_t)size) &
+         (params.table_size - 1);
+}
+
+static bool FindParams(const Keyword* keywords,
+                       size_t count,
+                       HashParams* out_params) {
+  uint32_t table_size = 1;
+  while (table_size < count) {
+    table_size *= 2;
+  }
+  for (; table_size <= kMaxTableSize; table_size *= 2) {
+    for (uint32_t a = 1; a < kMaxMultiplier; ++a) {
+      for (uint32_t b = 0; b < kMaxMultiplier; ++b) {
+        HashParams params = {.a = a, .b = b, .table_size = table_size};
+        bool used[kMaxTableSize] = {0};
+        bool collision = false;
+        for (size_t i = 0; i < count && !collision; ++i) {
+          uint32_t slot = Slot(params, keywords[i].text, keywords[i].size);
+          collision = used[slot];
+          used[slot] = true;
+        }
+        if (!collision) {
+          *out_params = params;
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+int main(int argc, const char** argv) {
+  char* output_path = NULL;
+  char* function_name = "MkLookupIdent";
+  char* header = "monkey/token.h";
+  char* type_name = "MkTokenType";
+  char* prefix = "kMkToken";
+  char* fallback = "Ident";
+  struct argparse_option options[] = {
+      OPT_HELP(),
+      OPT_GROUP("Basic options"),
+      OPT_STRING('o', "output", &output_path, "path to write"),
+      OPT_STRING('f', "function", &function_name,
+                 "name of the lookup function (default MkLookupIdent)"),
+      OPT_STRING('i', "include", &header,
+                 "header declaring the lookup (default monkey/token.h)"),
+      OPT_STRING('t', "type", &type_name,
+                 "return type of the lookup (default MkTokenType)"),
+      OPT_STRING('p', "prefix", &prefix,
+                 "prefix of the kind constants (default kMkToken)"),
+      OPT_STRING('d', "default", &fallback,
+                 "kind returned for non-keywords (default Ident)"),
+      OPT_END(),
+  };
+  struct argparse argp;
+  argparse_init(&argp, options, kUsage, 0);
+  argparse_describe(&argp, "Generates a perfect hash lookup for keywords",
+                    "Each line of FILE is a keyword followed by its kind.");
+  argc = argparse_parse(&argp, argc, argv);
+
+  if (argc < 1 || output_path == NULL) {
+    fprintf(stderr, "required arguments not passed: <FILE> -o <OUTPUT>\n");
+    argparse_usage(&argp);
+    return 1;
+  }
+
+  FILE* inp = fopen(argv[0], "r");
+  if (inp == NULL) {
+    fprintf(stderr, "could not open %s for reading: %s\n", argv[0],
+            strerror(errno));
+    return 1;
+  }
+  fseek(inp, 0, SEEK_END);
+  long inlen = ftell(inp);
+  fseek(inp, 0, SEEK_SET);
+  char* input = malloc(inlen + 1);
+  size_t nread = fread(input, 1, inlen, inp);
+  fclose(inp);
+  input[nread] = '\0';
+
+  Keyword keywords[kMaxKeywords];
+  size_t count = 0;
+  size_t min_size = SIZE_MAX;
+  size_t max_size = 0;
+  char* line_save;
+  for (char* line = NonstdStringTokenizeReentrant(input, "\n", &line_save);
+       line != NULL;
+       line = NonstdStringTokenizeReentrant(NULL, "\n", &line_save)) {
+    char* word_save;
+    char* text = NonstdStringTokenizeReentrant(line, " \t\r", &word_save);
+    if (text == NULL) {
+      continue;
+    }
+    char* kind = NonstdStringTokenizeReentrant(NULL, " \t\r", &word_save);
+    if (kind == NULL) {
+      fprintf(stderr, "keyword '%s' has no kind\n", text);
+      return 1;
+    }
+    if (count == kMaxKeywords) {
+      fprintf(stderr, "too many keywords (max %d)\n", kMaxKeywords);
+      return 1;
+    }
+    keywords[count] = (Keyword){
+        .text = text,
+        .size = strlen(text),
+        .kind = kind,
+    };
+    if (keywords[count].size < min_size) {
+      min_size = keywords[count].size;
+    }
+    if (keywords[count].size > max_size) {
+      max_size = keywords[count].size;
+    }
+    ++count;
+  }
+  if (count == 0) {
+    fprintf(stderr, "%s has no keywords\n", argv[0]);
+    return 1;
+  }
+
+  HashParams params;
+  if (!FindParams(keywords, count, &params)) {
+    fprintf(stderr, "no collision-free hash found for %s\n", argv[0]);
+    return 1;
+  }
+
+  const Keyword* by_slot[kMaxTableSize] = {0};
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t slot = Slot(params, keywords[i].text, keywords[i].size);
+    by_slot[slot] = &keywords[i];
+  }
+
+  FILE* outp = fopen(output_path, "w");
+  if (outp == NULL) {
+    fprintf(stderr, "could not open %s for writing: %s\n", output_path,
+            strerror(errno));
+    return 1;
+  }
+  const char* input_name = strrchr(argv[0], '/');
+  fprintf(outp, "// Generated by keyword_hash from %s. Do not edit.\n",
+          input_name != NULL ? input_name + 1 : argv[0]);
+  fprintf(outp, "#include \"%s\"\n\n", header);
+  fputs("#include <stdint.h>\n#include <string.h>\n\n", outp);
+  fputs("static const struct {\n", outp);
+  fputs("  const char* text;\n", outp);
+  fputs("  uint64_t size;\n", outp);
+  fprintf(outp, "  %s type;\n", type_name);
+  fprintf(outp, "} kKeywordTable[%u] = {\n", params.table_size);
+  for (uint32_t slot = 0; slot < params.table_size; ++slot) {
+    if (by_slot[slot] != NULL) {
+      fprintf(outp, "    [%u] = {\"%s\", %zu, %s%s},\n", slot,
+              by_slot[slot]->text, by_slot[slot]->size, prefix,
+              by_slot[slot]->kind);
+    }
+  }
+  fputs("};\n\n", outp);
+  fprintf(outp, "%s %s(StringView ident) {\n", type_name, function_name);
+  fputs("  uint64_t size = (uint64_t)(ident.end - ident.begin);\n", outp);
+  fprintf(outp, "  if (size < %zu || size > %zu) {\n", min_size, max_size);
+  fprintf(outp, "    return %s%s;\n", prefix, fallback);
+  fputs("  }\n", outp);
+  fputs("  const uint8_t* text = (const uint8_t*)ident.begin;\n", outp);
+  fprintf(outp,
+          "  uint64_t slot = (%uu * text[0] + %uu * text[size - 1] + size) & "
+          "%uu;\n",
+          params.a, params.b, params.table_size - 1);
+  fputs("  if (kKeywordTable[slot].size == size &&\n", outp);
+  fputs("      memcmp(kKeywordTable[slot].text, text, size) == 0) {\n", outp);
+  fputs("    return kKeywordTable[slot].type;\n", outp);
+  fputs("  }\n", outp);
+  fprintf(outp, "  return %s%s;\n", prefix, fallback);
+  fputs("}\n", outp);
+  fclose(outp);
+  free(input);
+  return 0;
+}
@@ -1,6 +1,10 @@
 #ifndef MONKEY_AST_H_
 #define MONKEY_AST_H_
 
+#include <arena/arena.h>
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "monkey/token.h"
 #include "string/string.h"
 #include "vec/vec.h"
@@ -19,7 +23,11 @@ typedef struct {
   MkAstNodeType type;
 } MkAstNode;
 
-#define MK_AST_STATEMENTS_ X(Let)
+#define MK_AST_STATEMENTS_ \
+  X(Let)                   \
+  X(Return)                \
+  X(Expression)            \
+  X(Block)
 
 typedef enum {
 #define X(x) kMkAstStatement##x,
@@ -32,7 +40,15 @@ typedef struct {
   MkAstStatementType type;
 } MkAstStatement;
 
-#define MK_AST_EXPRESSIONS_ X(Identifier)
+#define MK_AST_EXPRESSIONS_ \
+  X(Identifier)             \
+  X(IntegerLiteral)         \
+  X(Boolean)                \
+  X(Prefix)                 \
+  X(Infix)                  \
+  X(If)                     \
+  X(FunctionLiteral)        \
+  X(Call)
 
 typedef enum {
 #define X(x) kMkAstExpression##x,
@@ -45,17 +61,73 @@ typedef struct {
   MkAstExpressionType type;
 } MkAstExpression;
 
+typedef VEC_TYPE(MkAstStatement*) MkAstStatements;
+typedef VEC_TYPE(MkAstExpression*) MkAstExpressions;
+
+enum { kMkAstUnresolved = UINT32_MAX };
+
+// The most expressions any path down a program passes through. Whatever walks
+// a program by recursion relies on it for a bounded stack and does not check:
+// MkAstNodeCount, MkAstNodeString, MkResolveProgram and the evaluator among
+// them. The parser and MkFlatAstToProgram refuse taller programs.
+enum { kMkAstMaxHeight = 2048 };
+
+// The variables of a function or of the program, as MkResolveProgram numbers
+// them: the symbols of the names bound there, sorted, each held in the slot
+// of its index. `captured` is set when closures can be created in the body,
+// and so keep its variables alive after a call returns.
+typedef struct {
+  uint32_t* symbols;
+  uint32_t size;
+  bool captured;
+} MkAstScope;
+
+// A stretch of top-level statements, from `begin` up to the next stretch or
+// the end, that MkParserReparse kept without moving: their offsets are `delta`
+// bytes short of where the tokens are now, and when `rebase` is set their
+// literals still point into an older buffer of the source.
+typedef struct {
+  uint64_t begin;
+  int64_t delta;
+  bool rebase;
+} MkAstShift;
+
+typedef VEC_TYPE(MkAstShift) MkAstShifts;
+
+// Every node of a program, and every list in it, lives in the program's arena.
+// Lists are allocated at their final size, so `capacity` equals `size`, except
+// for the statements of a program updated by MkParserReparse. `node_count` is
+// the number of statements and expressions reachable from the program, as
+// MkAstNodeCount would find, and `parsed_size` the bytes of the arena in use
+// when the program was last parsed from scratch. `scope` holds its top-level
+// variables once resolved. `shifts` covers all the statements, in order, while
+// any of them has a move onto `source` pending, and is empty otherwise.
 typedef struct {
   MkAstNode base;
-  VEC_TYPE(MkAstStatement*) statements;
+  MkAstStatements statements;
+  uint64_t node_count;
+  uint64_t parsed_size;
+  MkAstScope scope;
+  MkAstShifts shifts;
+  StringView source;
+  Arena arena;
 } MkAstProgram;
 
+// `symbol` is the name interned by the parser's interner; names compare equal
+// exactly when their symbols do. MkResolveProgram sets `depth` and `slot`:
+// the variable is slot `slot` of the scope `depth` functions out from the one
+// the identifier appears in. The depth is kMkAstUnresolved until then, and
+// when no enclosing scope binds the name.
 typedef struct {
   MkAstExpression base;
   MkToken token;
-  String value;
+  uint32_t symbol;
+  uint32_t depth;
+  uint32_t slot;
 } MkAstIdentifier;
 
+typedef VEC_TYPE(MkAstIdentifier*) MkAstIdentifiers;
+
 typedef struct {
   MkAstStatement base;
   MkToken token;
@@ -63,7 +135,98 @@ typedef struct {
   MkAstExpression* value;
 } MkAstLetStatement;
 
+typedef struct {
+  MkAstStatement base;
+  MkToken token;
+  MkAstExpression* return_value;
+} MkAstReturnStatement;
+
+typedef struct {
+  MkAstStatement base;
+  MkToken token;
+  MkAstExpression* expression;
+} MkAstExpressionStatement;
+
+typedef struct {
+  MkAstStatement base;
+  MkToken token;
+  MkAstStatements statements;
+} MkAstBlockStatement;
+
+typedef struct {
+  MkAstExpression base;
+  MkToken token;
+  int64_t value;
+} MkAstIntegerLiteral;
+
+typedef struct {
+  MkAstExpression base;
+  MkToken token;
+  bool value;
+} MkAstBoolean;
+
+// `token` is the operator, so its type is what evaluation dispatches on.
+typedef struct {
+  MkAstExpression base;
+  MkToken token;
+  MkAstExpression* right;
+} MkAstPrefixExpression;
+
+typedef struct {
+  MkAstExpression base;
+  MkToken token;
+  MkAstExpression* left;
+  MkAstExpression* right;
+} MkAstInfixExpression;
+
+// `alternative` is NULL when there is no else branch.
+typedef struct {
+  MkAstExpression base;
+  MkToken token;
+  MkAstExpression* condition;
+  MkAstBlockStatement* consequence;
+  MkAstBlockStatement* alternative;
+} MkAstIfExpression;
+
+typedef struct {
+  MkAstExpression base;
+  MkToken token;
+  MkAstIdentifiers parameters;
+  MkAstBlockStatement* body;
+  MkAstScope scope;
+} MkAstFunctionLiteral;
+
+// `token` is the '(' that starts the argument list.
+typedef struct {
+  MkAstExpression base;
+  MkToken token;
+  MkAstExpression* function;
+  MkAstExpressions arguments;
+} MkAstCallExpression;
+
 String MkAstNodeTokenLiteral(MkAstNode* node);
+// Renders the node back as source, with every prefix and infix expression
+// parenthesized so that the parsed precedence is visible.
+String MkAstNodeString(MkAstNode* node);
+// Counts the statements and expressions in `node` and below it, the node
+// itself included unless it is a program. A let statement's name counts.
+uint64_t MkAstNodeCount(MkAstNode* node);
+// Moves a statement onto the same text `delta` bytes further along in
+// `source`: every token offset shifts by `delta`, and every literal is pointed
+// into `source` at its new offset.
+void MkAstStatementMove(MkAstStatement* stmt, StringView source, int64_t delta);
+// How many bytes the offsets in top-level statement `index` of `program` are
+// short of where its tokens are now.
+int64_t MkAstProgramShift(const MkAstProgram* program, uint64_t index);
+// Applies the moves MkParserReparse left pending, which has to happen before
+// the tokens of a program it updated are read.
+void MkAstProgramSettle(MkAstProgram* program);
+// Gives every identifier in a statement the symbol `symbols[s]` in place of
+// its symbol `s`, when it has one.
+void MkAstStatementRenumber(MkAstStatement* stmt, const uint32_t* symbols);
+// Freeing a program releases its arena, and with it every node, and its
+// shifts; the program struct itself is the caller's. Other nodes own nothing,
+// so freeing them does nothing.
 void MkAstNodeFree(MkAstNode* node);
 
 #endif  // MONKEY_AST_H_
@@ -0,0 +1,69 @@
+#ifndef MONKEY_AST_CACHE_H_
+#define MONKEY_AST_CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string/string.h>
+
+#include "monkey/flat_ast.h"
+#include "monkey/parser.h"
+#include "monkey/token.h"
+
+// A parsed program as one pointer-free block of bytes: its flat AST, its
+// token buffer and its parse errors. Everything in it is a count or an index,
+// so the bytes mean the same wherever they are loaded, and a decoded image
+// uses them in place. The arrays of `flat`, `tokens` and `errors` point into
+// the image and must not be freed or grown.
+typedef struct {
+  MkFlatAst flat;
+  MkTokenBuffer tokens;
+  MkErrors errors;
+  // The file mapping the arrays point into, for an image loaded from a cache.
+  void* mapping;
+  uint64_t mapping_size;
+} MkAstImage;
+
+// Parse images stored in a directory, one file per source, named after the
+// FNV-1a hash of the source bytes.
+typedef struct {
+  String directory;
+} MkAstCache;
+
+// Appends the image of a program parsed from `source` to `out`. Fails when
+// out of memory or if `flat` has no root.
+bool MkAstImageEncode(String* out,
+                      StringView source,
+                      const MkFlatAst* flat,
+                      const MkTokenBuffer* tokens,
+                      const MkErrors* errors);
+// Points `image` at the image in `bytes`, which must be 8-byte aligned and
+// outlive it. Fails unless the bytes are an image of `source` that is
+// consistent throughout, so that damaged files are turned away instead of
+// read out of bounds.
+bool MkAstImageDecode(MkAstImage* image,
+                      const void* bytes,
+                      uint64_t size,
+                      StringView source);
+// Unmaps an image loaded from a cache; decoded images own nothing.
+void MkAstImageFree(MkAstImage* image);
+
+// Creates `directory` if it does not exist yet.
+bool MkAstCacheInit(MkAstCache* cache, const char* directory);
+// The path of the file that holds the image of `source`.
+String MkAstCachePath(const MkAstCache* cache, StringView source);
+// Maps the image of `source` into `image`. Fails on a miss, and on a file
+// that does not decode.
+bool MkAstCacheLoad(const MkAstCache* cache,
+                    StringView source,
+                    MkAstImage* image);
+// Writes the image of a program parsed from `source`. The file is written
+// under a temporary name and renamed into place, so readers never see a
+// partial one.
+bool MkAstCacheStore(const MkAstCache* cache,
+                     StringView source,
+                     const MkFlatAst* flat,
+                     const MkTokenBuffer* tokens,
+                     const MkErrors* errors);
+void MkAstCacheFree(MkAstCache* cache);
+
+#endif  // MONKEY_AST_CACHE_H_
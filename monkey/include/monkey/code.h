@@ -0,0 +1,98 @@
+#ifndef MONKEY_CODE_H_
+#define MONKEY_CODE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string/string.h>
+#include <vec/vec.h>
+
+#include "monkey/ast.h"
+#include "monkey/heap.h"
+#include "monkey/token.h"
+#include "monkey/value.h"
+
+// The instructions of the VM, with the number of 16-bit operands each takes.
+// Operands are stored little-endian right after the opcode byte.
+//
+//   Constant            index in `constants`
+//   Jump, JumpIfFalse   bytes to skip forward from the next instruction;
+//                       JumpIfFalse pops the condition
+//   GetLocal, SetLocal  slot in the scope of the function; SetLocal pops
+//   GetOuter            environments up from the function's, then slot
+//   NotFound            (an identifier the resolver found no binding for)
+//   Closure             index in `functions`
+//   Call                argument count; the callee is below the arguments
+//   Return              (returns the value on top of the stack)
+#define MK_OPCODES_    \
+  X(Constant, 1)       \
+  X(Null, 0)           \
+  X(True, 0)           \
+  X(False, 0)          \
+  X(Pop, 0)            \
+  X(Add, 0)            \
+  X(Sub, 0)            \
+  X(Mul, 0)            \
+  X(Div, 0)            \
+  X(Eq, 0)             \
+  X(NotEq, 0)          \
+  X(Lt, 0)             \
+  X(Gt, 0)             \
+  X(Minus, 0)          \
+  X(Bang, 0)           \
+  X(Jump, 1)           \
+  X(JumpIfFalse, 1)    \
+  X(GetLocal, 1)       \
+  X(SetLocal, 1)       \
+  X(GetOuter, 2)       \
+  X(NotFound, 0)       \
+  X(Closure, 1)        \
+  X(Call, 1)           \
+  X(Return, 0)
+
+typedef enum {
+#define X(x, operands) kMkOp##x,
+  MK_OPCODES_
+#undef X
+      kMkOpCount,
+} MkOpcode;
+
+// Which token an instruction came from, for the instructions starting at
+// `code` up to the next position.
+typedef struct {
+  uint32_t code;
+  MkToken token;
+} MkCodePosition;
+
+// A compiled function body, or the program. `parameter_slots` are the slots
+// the arguments of a call go to, in order. `max_stack` is the most values its
+// instructions keep on the stack at once, so that a call can check for room
+// up front.
+typedef struct MkFunctionCode {
+  VEC_TYPE(uint8_t) code;
+  VEC_TYPE(MkCodePosition) positions;
+  VEC_TYPE(uint32_t) parameter_slots;
+  const MkAstScope* scope;
+  const MkAstFunctionLiteral* function;
+  uint32_t arity;
+  uint32_t max_stack;
+} MkFunctionCode;
+
+// A compiled program; functions[0] is its top level. The scopes and function
+// literals it points to belong to the program's AST, which must outlive it.
+// `heap` holds the integers in `constants` too wide to be held inline.
+typedef struct {
+  VEC_TYPE(MkValue) constants;
+  VEC_TYPE(MkFunctionCode) functions;
+  MkHeap heap;
+} MkBytecode;
+
+const char* MkOpcodeName(MkOpcode op);
+uint32_t MkOpcodeOperandCount(MkOpcode op);
+// The token the instruction at `offset` of `function` came from.
+MkToken MkFunctionCodeToken(const MkFunctionCode* function, uint32_t offset);
+// One instruction per line, as "0003 GetOuter 1 2", with a header line per
+// function.
+String MkBytecodeDisassemble(const MkBytecode* bytecode);
+void MkBytecodeFree(MkBytecode* bytecode);
+
+#endif  // MONKEY_CODE_H_
@@ -0,0 +1,20 @@
+#ifndef MONKEY_COMPILER_H_
+#define MONKEY_COMPILER_H_
+
+#include <stdbool.h>
+#include <string/string.h>
+
+#include "monkey/ast.h"
+#include "monkey/code.h"
+
+// Compiles `program`, which must have parsed without errors and been resolved
+// by MkResolveProgram, into `bytecode`. Variables keep the slots the resolver
+// gave them, so the VM reads them as the evaluator does. Fails with `error`
+// set when out of memory, when the program is too big for 16-bit operands,
+// such as one with more than 65536 distinct integer literals, or when it is
+// taller than kMkAstMaxHeight, which a parsed program never is.
+bool MkCompileProgram(MkBytecode* bytecode,
+                      const MkAstProgram* program,
+                      String* error);
+
+#endif  // MONKEY_COMPILER_H_
@@ -0,0 +1,52 @@
+#ifndef MONKEY_EVALUATOR_H_
+#define MONKEY_EVALUATOR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string/string.h>
+
+#include "monkey/ast.h"
+#include "monkey/heap.h"
+#include "monkey/value.h"
+
+enum {
+  // Calls in progress at once; deeper recursion fails instead of exhausting
+  // the C stack.
+  kMkEvaluatorMaxDepth = 4096,
+  // Variable slots of the calls in progress whose variables no closure can
+  // capture.
+  kMkEvaluatorStackSize = 64 * 1024,
+};
+
+// Walks the AST of a resolved program. Variables are read by (depth, slot):
+// `depth` parent links up from the current environment, then one array
+// index, whatever else is in scope. Calls of functions that create no
+// closures keep their variables on `stack` and give them back on return;
+// other environments and all closures are objects of `heap`. The stack holds
+// everything a collection must keep: the program's environment, the callee,
+// arguments and environment of each call in progress, and the left operands
+// of infix expressions whose right ones are being evaluated.
+typedef struct {
+  MkHeap heap;
+  MkValue* stack;
+  uint64_t stack_size;
+  uint32_t depth;
+  uint64_t calls;
+
+  // Why the last run failed, and the offset in the source of the token it
+  // failed on.
+  String error;
+  uint32_t error_offset;
+} MkEvaluator;
+
+void MkEvaluatorInit(MkEvaluator* evaluator);
+// Runs `program`, which must have parsed without errors and been resolved by
+// MkResolveProgram. The result is the value of the `return` that ended it, or
+// else of its last statement, where a `let` counts as null, and is valid
+// until the next run. Fails with `error` set.
+bool MkEvaluatorRun(MkEvaluator* evaluator,
+                    const MkAstProgram* program,
+                    MkValue* result);
+void MkEvaluatorFree(MkEvaluator* evaluator);
+
+#endif  // MONKEY_EVALUATOR_H_
@@ -0,0 +1,100 @@
+#ifndef MONKEY_FLAT_AST_H_
+#define MONKEY_FLAT_AST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string/string.h>
+#include <vec/vec.h>
+
+#include "monkey/ast.h"
+#include "monkey/intern.h"
+#include "monkey/token.h"
+
+// A program as one array of fixed-size nodes. Children are referred to by
+// index instead of by pointer, and lists live in a side array of indices.
+// Nodes are stored in post-order, so every child comes before its parent, the
+// root comes last, and a forward scan is a bottom-up traversal.
+//
+// What `a` and `b` hold depends on the kind; `token` indexes the token buffer
+// the program was parsed from, and "list" means an index into `extra` where a
+// count is followed by that many node indices.
+//
+//   Program, Block        a: statement list
+//   Let                   a: name (Identifier)      b: value
+//   Return, Expression    a: value
+//   Identifier            (the token is the name)
+//   IntegerLiteral        a: low 32 bits            b: high 32 bits
+//   Boolean               a: 1 if true
+//   Prefix                a: operand                (the token is the operator)
+//   Infix                 a: left   b: right        (the token is the operator)
+//   If                    a: condition   b: index in extra of the consequence,
+//                         followed by the alternative or kMkFlatNone
+//   FunctionLiteral       a: parameter list         b: body (Block)
+//   Call                  a: function               b: argument list
+#define MK_FLAT_NODES_ \
+  X(Program)           \
+  X(Let)               \
+  X(Return)            \
+  X(Expression)        \
+  X(Block)             \
+  X(Identifier)        \
+  X(IntegerLiteral)    \
+  X(Boolean)           \
+  X(Prefix)            \
+  X(Infix)             \
+  X(If)                \
+  X(FunctionLiteral)   \
+  X(Call)
+
+typedef enum {
+#define X(x) kMkFlat##x,
+  MK_FLAT_NODES_
+#undef X
+      kMkFlatNodeKindCount,
+} MkFlatNodeKind;
+
+enum { kMkFlatNone = UINT32_MAX };
+
+typedef struct {
+  uint32_t kind;
+  uint32_t token;
+  uint32_t a;
+  uint32_t b;
+} MkFlatNode;
+
+typedef struct {
+  VEC_TYPE(MkFlatNode) nodes;
+  VEC_TYPE(uint32_t) extra;
+  uint32_t root;
+} MkFlatAst;
+
+// Lowers `program`, parsed from `tokens`, into `flat`, replacing its contents.
+// Fails when out of memory or if a token of the program is not in `tokens`.
+bool MkFlatAstFromProgram(MkFlatAst* flat,
+                          const MkAstProgram* program,
+                          const MkTokenBuffer* tokens);
+// Builds the pointer AST that `flat` was lowered from, over `tokens` lexed
+// from `source`, as parsing would have left it: identifiers are interned into
+// `symbols` in source order and left unresolved. Returns NULL when out of
+// memory, when a child is not of a kind its parent can hold, and when the
+// program is taller than kMkAstMaxHeight, all of which parsing would catch.
+MkAstProgram* MkFlatAstToProgram(const MkFlatAst* flat,
+                                 const MkTokenBuffer* tokens,
+                                 StringView source,
+                                 MkInterner* symbols);
+void MkFlatAstFree(MkFlatAst* flat);
+const char* MkFlatNodeKindName(MkFlatNodeKind kind);
+int64_t MkFlatIntegerValue(MkFlatNode node);
+
+// The flat counterparts of MkAstNodeTokenLiteral and MkAstNodeString; the
+// strings match what the pointer AST produces.
+String MkFlatAstTokenLiteral(const MkFlatAst* flat,
+                             const MkTokenBuffer* tokens,
+                             StringView source,
+                             uint32_t node);
+String MkFlatAstString(const MkFlatAst* flat,
+                       const MkTokenBuffer* tokens,
+                       StringView source,
+                       uint32_t node);
+
+#endif  // MONKEY_FLAT_AST_H_
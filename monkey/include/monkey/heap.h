@@ -0,0 +1,142 @@
+#ifndef MONKEY_HEAP_H_
+#define MONKEY_HEAP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vec/vec.h>
+
+#include "monkey/ast.h"
+#include "monkey/value.h"
+
+enum {
+  // Objects up to kMkHeapSizeClasses * kMkHeapSizeClassStep bytes are carved
+  // from chunks and reused through a free list per size; larger ones, which
+  // only environments of big scopes are, go to malloc.
+  kMkHeapSizeClassStep = 16,
+  kMkHeapSizeClasses = 16,
+  kMkHeapChunkSize = 64 * 1024,
+  // Bytes of objects an incremental collection traces or sweeps per byte
+  // allocated while it runs, which is enough to finish before the heap
+  // doubles again.
+  kMkHeapWorkPerByte = 4,
+};
+
+// What the heap allocates before its first collection, how far past the
+// bytes that survive one it lets the next start, and how many bytes an
+// incremental collection lets be allocated between its steps. Zero in MkHeap
+// picks these.
+#define kMkHeapDefaultInitialBytes ((uint64_t)1 << 20)
+#define kMkHeapDefaultGrowthFactor 2.0
+#define kMkHeapDefaultStepBytes ((uint64_t)32 << 10)
+
+typedef enum {
+  // A collection marks and sweeps the whole heap in one pause.
+  kMkHeapStopTheWorld,
+  // A collection marks the roots in one pause, and then marks and sweeps the
+  // rest a step at a time as the program allocates, so that no pause grows
+  // with the heap. Stores into objects go through MK_HEAP_WRITE_BARRIER, and
+  // the roots are marked again once nothing is left to trace.
+  kMkHeapIncremental,
+} MkHeapMode;
+
+typedef enum {
+  kMkHeapIdle,
+  kMkHeapMarking,
+  kMkHeapSweeping,
+} MkHeapPhase;
+
+typedef struct {
+  // Objects made, including those freed since.
+  uint64_t allocations;
+  uint64_t collections;
+  uint64_t objects_freed;
+  uint64_t bytes_freed;
+  // Times the program was stopped to collect, which is once per collection
+  // unless it is incremental, and for how long in all and at most.
+  uint64_t pauses;
+  double pause_seconds;
+  double max_pause_seconds;
+} MkHeapStats;
+
+typedef struct MkHeap MkHeap;
+
+// Marks what the program can still reach, with MkHeapMarkValue and
+// MkHeapMarkObject.
+typedef void (*MkHeapMarkRoots)(MkHeap* heap, void* context);
+
+// The objects made while programs run. With `mark_roots` set, an allocation
+// that takes the heap past `threshold` bytes starts a collection: everything
+// reachable from the roots is marked, and everything else is freed to the
+// free list of its size. Without it the heap only grows, as for the
+// constants of bytecode.
+struct MkHeap {
+  // Tunables, which may be set after the heap is zeroed. With
+  // `record_pauses`, the length of each pause is appended to `pause_log`.
+  MkHeapMode mode;
+  uint64_t initial_bytes;
+  double growth_factor;
+  uint64_t step_bytes;
+  bool record_pauses;
+
+  MkHeapMarkRoots mark_roots;
+  void* roots;
+
+  // Every live object, and their number and size in bytes.
+  MkObject* objects;
+  uint64_t object_count;
+  uint64_t bytes;
+  // The size the heap collects at; zero until the first allocation.
+  uint64_t threshold;
+
+  MkObject* free_lists[kMkHeapSizeClasses];
+  VEC_TYPE(void*) chunks;
+  uint8_t* cursor;
+  uint8_t* limit;
+  // Marked objects whose children are not marked yet.
+  VEC_TYPE(MkObject*) gray;
+  bool gray_overflowed;
+
+  // Where a collection is: while marking, objects are allocated marked; while
+  // sweeping, `sweep_link` points to the link to the next object to sweep.
+  MkHeapPhase phase;
+  MkObject** sweep_link;
+  // Allocated since the last step of an incremental collection.
+  uint64_t unstepped_bytes;
+
+  MkHeapStats stats;
+  VEC_TYPE(double) pause_log;
+};
+
+// Stores of values into the slots of objects pass them through here first.
+// While a collection is marking, the value is marked, so that an object that
+// has been traced already cannot hide one that has not.
+#define MK_HEAP_WRITE_BARRIER(Heap, Value) \
+  do {                                     \
+    if ((Heap)->phase == kMkHeapMarking) { \
+      MkHeapMarkValue((Heap), (Value));    \
+    }                                      \
+  } while (false)
+
+// An environment with every slot of `scope` unset. Both return NULL when out
+// of memory.
+MkEnvironment* MkHeapNewEnvironment(MkHeap* heap,
+                                    MkEnvironment* parent,
+                                    const MkAstScope* scope);
+MkClosure* MkHeapNewClosure(MkHeap* heap,
+                            const MkAstFunctionLiteral* function,
+                            const struct MkFunctionCode* code,
+                            MkEnvironment* environment);
+// `value` as a value, boxed if it is outside the small range. Returns unset
+// when out of memory.
+MkValue MkHeapInteger(MkHeap* heap, int64_t value);
+
+// For `mark_roots`. Objects of another heap may be marked too; they stay
+// marked, which only keeps them from being traced again.
+void MkHeapMarkValue(MkHeap* heap, MkValue value);
+void MkHeapMarkObject(MkHeap* heap, MkObject* object);
+// Collects now, whatever the threshold, finishing any collection under way
+// first. Does nothing without `mark_roots`.
+void MkHeapCollect(MkHeap* heap);
+void MkHeapFree(MkHeap* heap);
+
+#endif  // MONKEY_HEAP_H_
@@ -0,0 +1,51 @@
+#ifndef MONKEY_INTERN_H_
+#define MONKEY_INTERN_H_
+
+#include <stdint.h>
+#include <string/string.h>
+#include <vec/vec.h>
+
+enum { kMkSymbolNone = UINT32_MAX };
+
+// Identifier names, each stored once and numbered from 0 in the order they
+// were first interned, so that equal names get equal symbols and tables keyed
+// by symbol can be arrays. An interner is used by one thread at a time; work
+// split across threads interns into one each and merges them.
+typedef struct {
+  // Open addressing with linear probing on the hash of each name. A slot holds
+  // a symbol, or kMkSymbolNone when empty; the names themselves are only kept
+  // in `text`. The capacity is a power of two, or 0 before the first name.
+  uint32_t* slots;
+  uint64_t capacity;
+  // The names back to back. Name i runs from starts[i] to starts[i + 1].
+  String text;
+  VEC_TYPE(uint32_t) starts;
+  // The low 32 bits of each name's hash, which the table is grown with and
+  // probed against before names are compared.
+  VEC_TYPE(uint32_t) hashes;
+  // Names looked up, those already interned, and their bytes, which would
+  // have been copies without the interner.
+  uint64_t lookups;
+  uint64_t hits;
+  uint64_t hit_bytes;
+} MkInterner;
+
+void MkInternerInit(MkInterner* interner);
+// The interner parsers use unless given another, which lives as long as the
+// process.
+MkInterner* MkInternerGlobal(void);
+// The symbol of `name`, which is added if it is new, or kMkSymbolNone when
+// out of memory or if `name` is empty; identifiers never are.
+uint32_t MkInternerIntern(MkInterner* interner, StringView name);
+// Interns the names of `from` in order, as though its lookups had been made
+// here, and stores the symbol name i gets in `symbols[i]`. A name that cannot
+// be added, when out of memory, gets kMkSymbolNone.
+void MkInternerMerge(MkInterner* interner,
+                     const MkInterner* from,
+                     uint32_t* symbols);
+uint32_t MkInternerCount(const MkInterner* interner);
+// The name of `symbol`, valid until the next name is added.
+StringView MkInternerName(const MkInterner* interner, uint32_t symbol);
+void MkInternerFree(MkInterner* interner);
+
+#endif  // MONKEY_INTERN_H_
@@ -1,8 +1,11 @@
 #ifndef MONKEY_LEXER_H_
 #define MONKEY_LEXER_H_
 
+#include <pool/pool.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <string/string.h>
+
 #include "monkey/token.h"
 
 typedef struct {
@@ -12,7 +15,30 @@ typedef struct {
   uint8_t ch;
 } MkLexer;
 
+// A text edit in the coordinates of the source before it: `removed` bytes at
+// `offset` were replaced by `inserted`.
+typedef struct {
+  uint64_t offset;
+  uint64_t removed;
+  StringView inserted;
+} MkEdit;
+
 void MkLexerInit(MkLexer* lexer, StringView source);
 MkToken MkLexerNextToken(MkLexer* lexer);
+// Lexes all of `source` into `tokens`, replacing its contents. Fails if the
+// source is too large for 32-bit offsets or an allocation fails.
+bool MkLexerTokenizeAll(StringView source, MkTokenBuffer* tokens);
+// Same result as MkLexerTokenizeAll, with the source split into chunks of at
+// least `min_chunk_size` bytes (0 picks a default) that are lexed on `pool`.
+bool MkLexerTokenizeParallel(StringView source,
+                             MkTokenBuffer* tokens,
+                             ThreadPool* pool,
+                             uint64_t min_chunk_size);
+// Updates `tokens`, lexed from the source before `edit`, to match `source`,
+// the text after it. Lexing restarts after the last token that ends before
+// the edit and stops as soon as a token starts after the inserted text at a
+// position where an old token started; from there on the old tokens are kept
+// and only their offsets shift. Fails like MkLexerTokenizeAll.
+bool MkLexerRelex(StringView source, MkTokenBuffer* tokens, MkEdit edit);
 
 #endif  // MONKEY_LEXER_H_
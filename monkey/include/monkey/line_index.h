@@ -0,0 +1,30 @@
+#ifndef MONKEY_LINE_INDEX_H_
+#define MONKEY_LINE_INDEX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string/string.h>
+
+#include "monkey/scan.h"
+
+// 1-based line and column of a byte offset; columns count bytes. A zero line
+// means the position is unknown.
+typedef struct {
+  uint32_t line;
+  uint32_t column;
+} MkSourcePosition;
+
+// Maps byte offsets to lines and columns. Nothing is scanned until the first
+// lookup, so sources that never report a diagnostic never pay for the index.
+typedef struct {
+  StringView source;
+  MkLineStarts starts;
+  bool built;
+  bool failed;
+} MkLineIndex;
+
+void MkLineIndexInit(MkLineIndex* index, StringView source);
+MkSourcePosition MkLineIndexLookup(MkLineIndex* index, uint64_t offset);
+void MkLineIndexFree(MkLineIndex* index);
+
+#endif  // MONKEY_LINE_INDEX_H_
@@ -0,0 +1,42 @@
+#ifndef MONKEY_OPTIMIZER_H_
+#define MONKEY_OPTIMIZER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "monkey/ast.h"
+
+// What MkOptimizeProgram did: the prefix and infix expressions it replaced by
+// a literal, the `if` expressions whose condition it found constant, and the
+// statements and expressions it took out of the program, as MkAstNodeCount
+// counts them.
+typedef struct {
+  uint64_t folded;
+  uint64_t pruned;
+  uint64_t removed;
+} MkOptimizeStats;
+
+// Rewrites `program`, which must have parsed without errors, into one that
+// evaluates to the same value or fails with the same error at the same token,
+// limits on depth aside:
+//
+// - A prefix or infix expression on integer or boolean literals becomes the
+//   literal it evaluates to, with 64-bit wrapping as at run time. One that
+//   would fail, such as a division by zero, is kept.
+// - An `if` with a literal condition loses the branch that cannot run. As a
+//   statement it becomes the block of the other, and as an expression it
+//   becomes that branch's expression if that is all the branch is.
+// - Statements after a `return`, or after a block that ends in one, go.
+//
+// Folded literals are allocated in the program's arena and have no source
+// text of their own, so the program cannot be moved by MkParserReparse or
+// stored in an AST cache afterwards. It may be resolved before or after; a
+// `let` that is taken out only ever bound a slot that stayed unset. Updates
+// `node_count`, and settles a program MkParserReparse left moves pending on.
+// Folding recurses on the tree, so it relies on the program being within
+// kMkAstMaxHeight, as a parsed one is; a folded program is never taller.
+// Fails when out of memory, leaving the program valid but perhaps only partly
+// optimized.
+bool MkOptimizeProgram(MkAstProgram* program, MkOptimizeStats* stats);
+
+#endif  // MONKEY_OPTIMIZER_H_
@@ -1,25 +1,145 @@
 #ifndef MONKEY_PARSER_H_
 #define MONKEY_PARSER_H_
 
+#include <arena/arena.h>
+#include <pool/pool.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <string/string.h>
 #include <vec/vec.h>
 
 #include "monkey/ast.h"
+#include "monkey/intern.h"
 #include "monkey/lexer.h"
+#include "monkey/line_index.h"
 
-typedef VEC_TYPE(String) MkErrors;
+#define MK_PARSE_ERRORS_ \
+  X(Tokenize)            \
+  X(UnexpectedToken)     \
+  X(NoPrefix)            \
+  X(IntegerOverflow)     \
+  X(TooDeep)
+
+typedef enum {
+#define X(x) kMkParseError##x,
+  MK_PARSE_ERRORS_
+#undef X
+} MkParseErrorKind;
+
+// An error as recorded while parsing; MkParserErrorString renders it. `got` is
+// the type of the offending token at `offset`, and `expected` is only set for
+// kMkParseErrorUnexpectedToken.
+typedef struct {
+  uint8_t kind;
+  uint8_t expected;
+  uint8_t got;
+  uint32_t offset;
+} MkParseError;
+
+typedef VEC_TYPE(MkParseError) MkErrors;
+
+// The most tokens the parser can look ahead, counting the current one. The
+// window holds twice that, so that it is refilled once per several tokens.
+enum {
+  kMkParserMaxLookahead = 16,
+  kMkParserWindowSize = 2 * kMkParserMaxLookahead,
+};
 
 typedef struct {
-  MkLexer lexer;
+  StringView source;
+  MkTokenBuffer tokens;
+  bool tokens_borrowed;
+  uint64_t index;
+  // Where MkParserParseProgram stops: the EOF token, unless the parser was
+  // given a range.
+  uint64_t end;
+  // Recursion depth of expression parsing, and the height of the tallest
+  // expression completed since the innermost one being parsed began.
+  uint32_t depth;
+  uint32_t height;
 
   MkErrors errors;
+  MkLineIndex lines;
+
+  // The arena of the program being parsed. Lists are collected on `scratch`,
+  // which nested lists share as a stack, and copied into the arena once
+  // complete.
+  Arena* arena;
+  VEC_TYPE(void*) scratch;
+  uint64_t node_count;
+  // Where identifiers are interned: MkInternerGlobal() unless set after
+  // initialization.
+  MkInterner* symbols;
 
-  MkToken current_token;
-  MkToken peek_token;
+  // Tokens are decoded from `tokens` into a window in batches, ahead of the
+  // parser. The current token is `window[head]`, and at least `lookahead`
+  // tokens from there on, and never fewer than 2, are always decoded; `next`
+  // is the position in `tokens` of the first token after the window.
+  MkToken window[kMkParserWindowSize];
+  uint32_t head;
+  uint32_t count;
+  uint32_t lookahead;
+  uint64_t next;
 } MkParser;
 
+// What MkParserReparse kept and what it parsed again, in top-level statements
+// and in nodes as MkAstNodeCount counts them.
+typedef struct {
+  uint64_t reused_statements;
+  uint64_t reused_nodes;
+  uint64_t parsed_statements;
+  uint64_t parsed_nodes;
+} MkReparseStats;
+
 void MkParserInit(MkParser* parser, MkLexer lexer);
+// Parses a token buffer lexed from `source`; the buffer is borrowed and must
+// outlive the parser.
+void MkParserInitTokens(MkParser* parser,
+                        StringView source,
+                        const MkTokenBuffer* tokens);
+// Parses only the tokens from `begin` up to `end`, which must lie on statement
+// boundaries of the whole buffer for the result to match parsing all of it.
+void MkParserInitRange(MkParser* parser,
+                       StringView source,
+                       const MkTokenBuffer* tokens,
+                       uint64_t begin,
+                       uint64_t end);
+// Same program and errors as MkParserParseProgram, with the top-level
+// statements split into ranges of at least `min_range_tokens` tokens (0 picks
+// a default) that are parsed on `pool` and merged in order.
+MkAstProgram* MkParserParseProgramParallel(MkParser* parser,
+                                           ThreadPool* pool,
+                                           uint64_t min_range_tokens);
+// Sets how many tokens MkParserPeekToken can see, from 1 to
+// kMkParserMaxLookahead; the grammar itself needs 2. Fails if out of range.
+bool MkParserSetLookahead(MkParser* parser, uint32_t depth);
+// The token `n` ahead of the current one, for `n` below the lookahead depth.
+// Past the end of the input, that is the EOF token.
+MkToken MkParserPeekToken(const MkParser* parser, uint32_t n);
+// A statement that fails to parse records one error and is skipped up to the
+// next statement boundary, and parsing carries on from there.
 MkAstProgram* MkParserParseProgram(MkParser* parser);
+// Updates `program`, parsed by `parser` from the source before `edit`, to
+// match `source`, the text after it, lexed into `tokens` (which MkLexerRelex
+// keeps up to date). Parsing restarts at the last top-level statement whose
+// first token ends before the edit, and stops at the first statement start
+// after the edit where an old statement started too; the statements outside
+// that stretch are kept, and only recorded in `program->shifts` as to be
+// moved onto `source`, so that an edit costs the statements it parses again
+// rather than all those after it. The program and the errors end up as a full
+// parse of `source` would leave them once MkAstProgramSettle has made those
+// moves, which has to happen before its tokens are read; MkResolveProgram
+// does it. `tokens` is borrowed as in MkParserInitTokens. The statements
+// dropped stay in the program's arena, which is why the program is parsed
+// from scratch once they have doubled its size. `stats` may be NULL.
+void MkParserReparse(MkParser* parser,
+                     MkAstProgram* program,
+                     StringView source,
+                     const MkTokenBuffer* tokens,
+                     MkEdit edit,
+                     MkReparseStats* stats);
+// Formats `error` as "line:column: message".
+String MkParserErrorString(MkParser* parser, MkParseError error);
 void MkParserFree(MkParser parser);
 
 #endif  // MONKEY_PARSER_H_
@@ -0,0 +1,23 @@
+#ifndef MONKEY_RESOLVER_H_
+#define MONKEY_RESOLVER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "monkey/ast.h"
+
+// Numbers the variables of `program`, so that the variables of a function
+// call, or of the program, can be an array of slots. A function's scope binds
+// its parameters and every name a `let` in its body binds outside nested
+// functions; blocks do not open scopes, and the program's scope is that of its
+// top-level statements. Each identifier gets the innermost enclosing scope
+// that binds its name, wherever in that scope the binding is, so a variable
+// read before its `let` has run finds an empty slot. Scopes are allocated in
+// the program's arena, and a program updated by MkParserReparse has to be
+// resolved again, which settles it first. Fails when out of memory.
+bool MkResolveProgram(MkAstProgram* program);
+// The slot of `symbol` in `scope`, or kMkAstUnresolved if it binds no such
+// name.
+uint32_t MkAstScopeFind(const MkAstScope* scope, uint32_t symbol);
+
+#endif  // MONKEY_RESOLVER_H_
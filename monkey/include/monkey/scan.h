@@ -0,0 +1,43 @@
+#ifndef MONKEY_SCAN_H_
+#define MONKEY_SCAN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string/string.h>
+#include <vec/vec.h>
+
+// Scanning kernels used by the lexer to skip over runs of a character class.
+// Each returns the index of the first byte at or after `position` that is not
+// in the class, or the source size if the run reaches the end.
+
+#define MK_SCAN_LEVELS_ \
+  X(Scalar, "scalar")   \
+  X(Sse2, "sse2")       \
+  X(Avx2, "avx2")
+
+typedef enum {
+#define X(x, name) kMkScan##x,
+  MK_SCAN_LEVELS_
+#undef X
+      kMkScanLevelCount,
+} MkScanLevel;
+
+uint64_t MkScanWhitespace(StringView source, uint64_t position);
+uint64_t MkScanLetters(StringView source, uint64_t position);
+uint64_t MkScanDigits(StringView source, uint64_t position);
+
+typedef VEC_TYPE(uint32_t) MkLineStarts;
+
+// Appends the offset just past every '\n' in `source` to `starts`, in one pass
+// over the bytes. Fails if the source is 4 GiB or larger or if growing
+// `starts` fails.
+bool MkScanLineStarts(StringView source, MkLineStarts* starts);
+
+// The best supported level is picked on first use. Tests and benchmarks may
+// force a lower one; forcing an unsupported level fails and changes nothing.
+bool MkScanLevelSupported(MkScanLevel level);
+bool MkScanSetLevel(MkScanLevel level);
+MkScanLevel MkScanGetLevel(void);
+const char* MkScanLevelName(MkScanLevel level);
+
+#endif  // MONKEY_SCAN_H_
@@ -0,0 +1,47 @@
+#ifndef MONKEY_STREAM_H_
+#define MONKEY_STREAM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "monkey/token.h"
+
+// Reads up to `capacity` bytes into `buffer`. Returns the number of bytes
+// read, 0 at the end of the input, or a negative value on error.
+typedef int64_t (*MkStreamRefill)(void* context,
+                                  char* buffer,
+                                  uint64_t capacity);
+
+// Lexes input pulled through a refill callback in fixed-size chunks. Only the
+// unconsumed tail of the input is buffered, so memory stays around twice the
+// chunk size (or twice the longest token, if that is larger).
+//
+// Token literals point into the lexer's window and are only valid until the
+// next call to MkStreamLexerNextToken. Token offsets count from the start of
+// the stream and saturate at UINT32_MAX past 4 GiB.
+typedef struct {
+  MkStreamRefill refill;
+  void* context;
+  char* buffer;
+  uint64_t capacity;
+  uint64_t chunk_size;
+  uint64_t begin;
+  uint64_t end;
+  uint64_t offset;
+  bool eof;
+  bool failed;
+} MkStreamLexer;
+
+void MkStreamLexerInit(MkStreamLexer* lexer,
+                       MkStreamRefill refill,
+                       void* context,
+                       uint64_t chunk_size);
+MkToken MkStreamLexerNextToken(MkStreamLexer* lexer);
+void MkStreamLexerFree(MkStreamLexer* lexer);
+
+// Refill callbacks for a FILE* and for a pointer to a file descriptor.
+int64_t MkStreamRefillFile(void* context, char* buffer, uint64_t capacity);
+int64_t MkStreamRefillFd(void* context, char* buffer, uint64_t capacity);
+
+#endif  // MONKEY_STREAM_H_
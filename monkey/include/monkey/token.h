@@ -1,62 +1,81 @@
 #ifndef MONKEY_TOKEN_H_
 #define MONKEY_TOKEN_H_
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string/string.h>
 #include <vec/vec.h>
 
-typedef String MkTokenType;
+#define MK_TOKEN_TYPES_ \
+  X(Illegal, "ILLEGAL")   \
+  X(Eof, "EOF")           \
+  X(Ident, "IDENT")       \
+  X(Int, "INT")           \
+  X(Assign, "=")          \
+  X(Plus, "+")            \
+  X(Minus, "-")           \
+  X(Bang, "!")            \
+  X(Asterisk, "*")        \
+  X(Slash, "/")           \
+  X(Lt, "<")              \
+  X(Gt, ">")              \
+  X(Eq, "==")             \
+  X(NotEq, "!=")          \
+  X(Comma, ",")           \
+  X(Semicolon, ";")       \
+  X(Lparen, "(")          \
+  X(Rparen, ")")          \
+  X(Lbrace, "{")          \
+  X(Rbrace, "}")          \
+  X(Function, "FUNCTION") \
+  X(Let, "LET")           \
+  X(If, "IF")             \
+  X(Else, "ELSE")         \
+  X(Return, "RETURN")     \
+  X(True, "TRUE")         \
+  X(False, "FALSE")
 
+typedef enum {
+#define X(x, name) kMkToken##x,
+  MK_TOKEN_TYPES_
+#undef X
+      kMkTokenTypeCount,
+} MkTokenType;
+
+// The literal borrows from the source buffer handed to MkLexerInit; tokens
+// stay valid for as long as that buffer does. `offset` is the byte position of
+// the literal in that source; it fills what would otherwise be padding, so
+// tokens are no larger for carrying it.
 typedef struct {
   MkTokenType type;
-  String literal;
+  uint32_t offset;
+  StringView literal;
 } MkToken;
 
-extern MkTokenType mk_token_illegal;
-extern MkTokenType mk_token_eof;
-
-extern MkTokenType mk_token_ident;
-extern MkTokenType mk_token_int;
-
-extern MkTokenType mk_token_assign;
-extern MkTokenType mk_token_plus;
-extern MkTokenType mk_token_minus;
-extern MkTokenType mk_token_bang;
-extern MkTokenType mk_token_asterisk;
-extern MkTokenType mk_token_slash;
-
-extern MkTokenType mk_token_lt;
-extern MkTokenType mk_token_gt;
-
-extern MkTokenType mk_token_eq;
-extern MkTokenType mk_token_not_eq;
-
-extern MkTokenType mk_token_comma;
-extern MkTokenType mk_token_semicolon;
-
-extern MkTokenType mk_token_lparen;
-extern MkTokenType mk_token_rparen;
-extern MkTokenType mk_token_lbrace;
-extern MkTokenType mk_token_rbrace;
-
-extern MkTokenType mk_token_function;
-extern MkTokenType mk_token_let;
-extern MkTokenType mk_token_if;
-extern MkTokenType mk_token_else;
-extern MkTokenType mk_token_return;
-extern MkTokenType mk_token_true;
-extern MkTokenType mk_token_false;
-
-typedef enum {
-  kTokenTypesInit,
-  kTokenTypesFree,
-} MkTokenTypesAction;
-
-void MkTokenTypesManage(MkTokenTypesAction action);
+// A whole token stream laid out as parallel arrays, ending with an EOF token.
+// Offsets and lengths are byte positions in the source the buffer was lexed
+// from. Clearing keeps the allocation, so a buffer can be reused across runs.
+typedef struct {
+  uint8_t* kinds;
+  uint32_t* offsets;
+  uint32_t* lengths;
+  uint64_t size;
+  uint64_t capacity;
+} MkTokenBuffer;
 
-void MkTokenFree(MkToken tok);
+const char* MkTokenTypeName(MkTokenType type);
 MkTokenType MkLookupIdent(StringView ident);
 void MkTokenPrint(FILE* fp, MkToken tok);
-MkToken MkTokenDuplicate(const MkToken tok);
+bool MkTokenBufferReserve(MkTokenBuffer* tokens, uint64_t capacity);
+bool MkTokenBufferPush(MkTokenBuffer* tokens,
+                       MkTokenType type,
+                       uint32_t offset,
+                       uint32_t length);
+void MkTokenBufferClear(MkTokenBuffer* tokens);
+void MkTokenBufferFree(MkTokenBuffer* tokens);
+MkToken MkTokenBufferGet(const MkTokenBuffer* tokens,
+                         StringView source,
+                         uint64_t index);
 
 #endif  // MONKEY_TOKEN_H_
@@ -0,0 +1,140 @@
+#ifndef MONKEY_VALUE_H_
+#define MONKEY_VALUE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string/string.h>
+
+#include "monkey/ast.h"
+
+// Unset marks a variable slot that no `let` has assigned yet; no expression
+// evaluates to it.
+#define MK_VALUE_TYPES_        \
+  X(Null, "NULL")              \
+  X(Integer, "INTEGER")        \
+  X(Boolean, "BOOLEAN")        \
+  X(Function, "FUNCTION")      \
+  X(Unset, "UNSET")
+
+typedef enum {
+#define X(x, name) kMkValue##x,
+  MK_VALUE_TYPES_
+#undef X
+} MkValueType;
+
+#define MK_OBJECT_KINDS_ \
+  X(Environment)         \
+  X(Closure)             \
+  X(Integer)
+
+typedef enum {
+#define X(x) kMkObject##x,
+  MK_OBJECT_KINDS_
+#undef X
+} MkObjectKind;
+
+// The header of everything allocated while a program runs. `next` links the
+// live objects of a heap, or the cells of one of its free lists.
+typedef struct MkObject {
+  struct MkObject* next;
+  // Bytes taken, including what rounding up to a size class adds.
+  uint32_t size;
+  // An MkObjectKind.
+  uint8_t kind;
+  bool marked;
+} MkObject;
+
+typedef struct MkClosure MkClosure;
+struct MkFunctionCode;
+
+// A value is one 64-bit word, told apart by its low bits:
+//
+//   .......1  an integer from kMkSmallIntegerMin to kMkSmallIntegerMax,
+//             shifted left by one
+//   .....000  a pointer to an MkObject, which malloc aligns to 8; the null
+//             pointer is null
+//   .....010  false
+//   .....110  true
+//   .....100  unset
+//
+// An integer outside that range is boxed in an MkInteger, so arithmetic still
+// wraps at 64 bits, but only a result that needs the 64th bit allocates.
+typedef struct {
+  uint64_t bits;
+} MkValue;
+
+#define kMkSmallIntegerMax ((int64_t)(UINT64_MAX >> 2))
+#define kMkSmallIntegerMin (-kMkSmallIntegerMax - 1)
+
+#define MK_NULL ((MkValue){0})
+#define MK_UNSET ((MkValue){0x4})
+#define MK_BOOLEAN(Value) ((MkValue){0x2 | (uint64_t)(bool)(Value) << 2})
+// `Value` must be in the small range; MkHeapInteger takes any integer.
+#define MK_SMALL_INTEGER(Value) ((MkValue){(uint64_t)(Value) << 1 | 1})
+#define MK_OBJECT(Object) ((MkValue){(uint64_t)(uintptr_t)(Object)})
+
+#define MK_IS_NULL(Value) ((Value).bits == 0)
+#define MK_IS_UNSET(Value) ((Value).bits == 0x4)
+#define MK_IS_BOOLEAN(Value) (((Value).bits & 0x3) == 0x2)
+#define MK_IS_SMALL_INTEGER(Value) (((Value).bits & 0x1) != 0)
+#define MK_IS_OBJECT(Value) (((Value).bits & 0x7) == 0 && (Value).bits != 0)
+#define MK_IS_OBJECT_KIND(Value, Kind) \
+  (MK_IS_OBJECT(Value) && MK_AS_OBJECT(Value)->kind == (Kind))
+#define MK_IS_INTEGER(Value) \
+  (MK_IS_SMALL_INTEGER(Value) || MK_IS_OBJECT_KIND(Value, kMkObjectInteger))
+#define MK_IS_FUNCTION(Value) MK_IS_OBJECT_KIND(Value, kMkObjectClosure)
+// Null, false and unset are false; everything else is true, zero included.
+#define MK_TRUTHY(Value) ((Value).bits > 0x4 || ((Value).bits & 0x1) != 0)
+#define MK_FITS_SMALL_INTEGER(Integer) \
+  ((Integer) >= kMkSmallIntegerMin && (Integer) <= kMkSmallIntegerMax)
+
+#define MK_AS_BOOLEAN(Value) (((Value).bits & 0x4) != 0)
+// An arithmetic shift, which brings the sign back.
+#define MK_AS_SMALL_INTEGER(Value) ((int64_t)(Value).bits >> 1)
+#define MK_AS_OBJECT(Value) ((MkObject*)(uintptr_t)(Value).bits)
+#define MK_AS_CLOSURE(Value) ((MkClosure*)MK_AS_OBJECT(Value))
+
+// The variables of a function call or of the program, one slot each as laid
+// out by `scope`. `parent` holds those of the code around the function.
+typedef struct MkEnvironment {
+  MkObject object;
+  struct MkEnvironment* parent;
+  const MkAstScope* scope;
+  MkValue* slots;
+} MkEnvironment;
+
+// A function literal together with the environment it was evaluated in.
+// `code` is its compiled body when the VM made it, and NULL when the
+// evaluator did.
+struct MkClosure {
+  MkObject object;
+  const MkAstFunctionLiteral* function;
+  const struct MkFunctionCode* code;
+  MkEnvironment* environment;
+};
+
+// An integer too wide to be held in a value.
+typedef struct {
+  MkObject object;
+  int64_t value;
+} MkInteger;
+
+const char* MkValueTypeName(MkValueType type);
+MkValueType MkValueTypeOf(MkValue value);
+// The integer `value` holds, boxed or not.
+int64_t MkValueInteger(MkValue value);
+// MK_TRUTHY as a function.
+bool MkValueTruthy(MkValue value);
+// Whether two values are the same: equal integers or booleans, or the same
+// function.
+bool MkValueIdentical(MkValue a, MkValue b);
+// Renders `value` as the REPL shows it.
+String MkValueInspect(MkValue value);
+
+// Finds the innermost of `environment` and its parents with `symbol` set in
+// its scope. Reads of a slot no `let` has assigned yet fall back on this.
+bool MkEnvironmentLookup(const MkEnvironment* environment,
+                         uint32_t symbol,
+                         MkValue* out);
+
+#endif  // MONKEY_VALUE_H_
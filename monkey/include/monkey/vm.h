@@ -0,0 +1,48 @@
+#ifndef MONKEY_VM_H_
+#define MONKEY_VM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string/string.h>
+
+#include "monkey/code.h"
+#include "monkey/heap.h"
+#include "monkey/value.h"
+
+enum {
+  // Calls in progress at once, as for the evaluator.
+  kMkVmMaxFrames = 4096,
+  // Values on the stack: the operands of every call in progress, and the
+  // variables of those whose functions create no closures.
+  kMkVmStackSize = 64 * 1024,
+};
+
+typedef struct MkVmFrame MkVmFrame;
+
+// Runs bytecode on a stack of values. Variables live where the evaluator
+// keeps them, so a program gives the same results, and fails with the same
+// errors at the same tokens, on both.
+typedef struct {
+  MkHeap heap;
+  MkValue* stack;
+  MkVmFrame* frames;
+  uint64_t calls;
+  // The top of the stack and the innermost frame as of the last instruction
+  // that allocates, which is when `heap` may collect. Everything below the
+  // one and in the others is a root.
+  MkValue* stack_top;
+  MkVmFrame* frame_top;
+
+  // Why the last run failed, and the offset in the source of the token it
+  // failed on.
+  String error;
+  uint32_t error_offset;
+} MkVm;
+
+void MkVmInit(MkVm* vm);
+// Runs `bytecode` from MkCompileProgram. The result is as for
+// MkEvaluatorRun, and valid until the next run. Fails with `error` set.
+bool MkVmRun(MkVm* vm, const MkBytecode* bytecode, MkValue* result);
+void MkVmFree(MkVm* vm);
+
+#endif  // MONKEY_VM_H_
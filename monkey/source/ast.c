@@ -1,17 +1,40 @@
 #include "monkey/ast.h"
 
+#include <arena/arena.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string/string.h>
+#include <vec/vec.h>
 
+#include "monkey/intern.h"
 #include "monkey/token.h"
 
+// A traversal that counts the nodes it visits and, when `move` is set, moves
+// their tokens as MkAstStatementMove describes. Identifiers are renumbered
+// through `symbols` when it is set.
+typedef struct {
+  uint64_t count;
+  bool move;
+  StringView source;
+  int64_t delta;
+  const uint32_t* symbols;
+} Walk;
+
 static String ProgramTokenLiteral(MkAstProgram* prog);
 static String StatementTokenLiteral(MkAstStatement* stmt);
 static String ExpressionTokenLiteral(MkAstExpression* expr);
-static void ProgramFree(MkAstProgram* prog);
-static void StatementFree(MkAstStatement* stmt);
-static void ExpressionFree(MkAstExpression* expr);
+static void WriteNode(String* out, MkAstNode* node);
+static void WriteStatements(String* out, MkAstStatements* statements);
+static void WriteStatement(String* out, MkAstStatement* stmt);
+static void WriteExpression(String* out, MkAstExpression* expr);
+static void WalkStatement(Walk* walk, MkAstStatement* stmt);
+static void WalkExpression(Walk* walk, MkAstExpression* expr);
+static void WalkIdentifier(Walk* walk, MkAstIdentifier* identifier);
+static void MoveToken(const Walk* walk, MkToken* token);
+static void WriteView(String* out, StringView view);
+static void WriteC(String* out, const char* cstr);
 
 String MkAstNodeTokenLiteral(MkAstNode* node) {
   switch (node->type) {
@@ -26,21 +49,83 @@ String MkAstNodeTokenLiteral(MkAstNode* node) {
   return StringFromC("invalid node");
 }
 
-void MkAstNodeFree(MkAstNode* node) {
-  if (node == NULL) {
-    return;
-  }
+String MkAstNodeString(MkAstNode* node) {
+  String result = {0};
+  WriteNode(&result, node);
+  return result;
+}
+
+uint64_t MkAstNodeCount(MkAstNode* node) {
+  Walk walk = {0};
   switch (node->type) {
-    case kMkAstNodeProgram:
-      ProgramFree((MkAstProgram*)node);
-      break;
+    case kMkAstNodeProgram: {
+      MkAstStatements* statements = &((MkAstProgram*)node)->statements;
+      for (uint64_t i = 0; i < statements->size; ++i) {
+        WalkStatement(&walk, statements->data[i]);
+      }
+    } break;
     case kMkAstNodeStatement:
-      StatementFree((MkAstStatement*)node);
+      WalkStatement(&walk, (MkAstStatement*)node);
       break;
     case kMkAstNodeExpression:
-      ExpressionFree((MkAstExpression*)node);
+      WalkExpression(&walk, (MkAstExpression*)node);
       break;
   }
+  return walk.count;
+}
+
+void MkAstStatementMove(MkAstStatement* stmt,
+                        StringView source,
+                        int64_t delta) {
+  Walk walk = {.move = true, .source = source, .delta = delta};
+  WalkStatement(&walk, stmt);
+}
+
+int64_t MkAstProgramShift(const MkAstProgram* program, uint64_t index) {
+  const MkAstShifts* shifts = &program->shifts;
+  uint64_t lo = 0;
+  uint64_t hi = shifts->size;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (shifts->data[mid].begin <= index) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo > 0 ? shifts->data[lo - 1].delta : 0;
+}
+
+void MkAstProgramSettle(MkAstProgram* program) {
+  MkAstShifts* shifts = &program->shifts;
+  for (uint64_t i = 0; i < shifts->size; ++i) {
+    MkAstShift shift = shifts->data[i];
+    if (shift.delta == 0 && !shift.rebase) {
+      continue;
+    }
+    uint64_t end = i + 1 < shifts->size ? shifts->data[i + 1].begin
+                                        : program->statements.size;
+    for (uint64_t j = shift.begin; j < end; ++j) {
+      MkAstStatementMove(program->statements.data[j], program->source,
+                         shift.delta);
+    }
+  }
+  shifts->size = 0;
+}
+
+void MkAstStatementRenumber(MkAstStatement* stmt, const uint32_t* symbols) {
+  Walk walk = {.symbols = symbols};
+  WalkStatement(&walk, stmt);
+}
+
+void MkAstNodeFree(MkAstNode* node) {
+  if (node == NULL || node->type != kMkAstNodeProgram) {
+    return;
+  }
+  MkAstProgram* prog = (MkAstProgram*)node;
+  ArenaFree(&prog->arena);
+  prog->statements = (MkAstStatements){0};
+  VEC_FREE(&prog->shifts);
 }
 
 String ProgramTokenLiteral(MkAstProgram* prog) {
@@ -57,7 +142,13 @@ String ProgramTokenLiteral(MkAstProgram* prog) {
 String StatementTokenLiteral(MkAstStatement* stmt) {
   switch (stmt->type) {
     case kMkAstStatementLet:
-      return StringDuplicate(((MkAstLetStatement*)stmt)->token.literal);
+      return StringFromSpan(((MkAstLetStatement*)stmt)->token.literal);
+    case kMkAstStatementReturn:
+      return StringFromSpan(((MkAstReturnStatement*)stmt)->token.literal);
+    case kMkAstStatementExpression:
+      return StringFromSpan(((MkAstExpressionStatement*)stmt)->token.literal);
+    case kMkAstStatementBlock:
+      return StringFromSpan(((MkAstBlockStatement*)stmt)->token.literal);
   }
 
   return StringFromC("invalid statement");
@@ -66,47 +157,255 @@ String StatementTokenLiteral(MkAstStatement* stmt) {
 String ExpressionTokenLiteral(MkAstExpression* expr) {
   switch (expr->type) {
     case kMkAstExpressionIdentifier:
-      return StringDuplicate(((MkAstIdentifier*)expr)->token.literal);
+      return StringFromSpan(((MkAstIdentifier*)expr)->token.literal);
+    case kMkAstExpressionIntegerLiteral:
+      return StringFromSpan(((MkAstIntegerLiteral*)expr)->token.literal);
+    case kMkAstExpressionBoolean:
+      return StringFromSpan(((MkAstBoolean*)expr)->token.literal);
+    case kMkAstExpressionPrefix:
+      return StringFromSpan(((MkAstPrefixExpression*)expr)->token.literal);
+    case kMkAstExpressionInfix:
+      return StringFromSpan(((MkAstInfixExpression*)expr)->token.literal);
+    case kMkAstExpressionIf:
+      return StringFromSpan(((MkAstIfExpression*)expr)->token.literal);
+    case kMkAstExpressionFunctionLiteral:
+      return StringFromSpan(((MkAstFunctionLiteral*)expr)->token.literal);
+    case kMkAstExpressionCall:
+      return StringFromSpan(((MkAstCallExpression*)expr)->token.literal);
   }
 
   return StringFromC("invalid expression");
 }
 
-void ProgramFree(MkAstProgram* prog) {
-  if (prog == NULL) {
-    return;
+void WalkStatement(Walk* walk, MkAstStatement* stmt) {
+  ++walk->count;
+  switch (stmt->type) {
+    case kMkAstStatementLet: {
+      MkAstLetStatement* let_stmt = (MkAstLetStatement*)stmt;
+      MoveToken(walk, &let_stmt->token);
+      WalkIdentifier(walk, &let_stmt->name);
+      if (let_stmt->value != NULL) {
+        WalkExpression(walk, let_stmt->value);
+      }
+    } break;
+    case kMkAstStatementReturn: {
+      MkAstReturnStatement* return_stmt = (MkAstReturnStatement*)stmt;
+      MoveToken(walk, &return_stmt->token);
+      if (return_stmt->return_value != NULL) {
+        WalkExpression(walk, return_stmt->return_value);
+      }
+    } break;
+    case kMkAstStatementExpression: {
+      MkAstExpressionStatement* expr_stmt = (MkAstExpressionStatement*)stmt;
+      MoveToken(walk, &expr_stmt->token);
+      if (expr_stmt->expression != NULL) {
+        WalkExpression(walk, expr_stmt->expression);
+      }
+    } break;
+    case kMkAstStatementBlock: {
+      MkAstBlockStatement* block = (MkAstBlockStatement*)stmt;
+      MoveToken(walk, &block->token);
+      for (uint64_t i = 0; i < block->statements.size; ++i) {
+        WalkStatement(walk, block->statements.data[i]);
+      }
+    } break;
+  }
+}
+
+void WalkExpression(Walk* walk, MkAstExpression* expr) {
+  switch (expr->type) {
+    case kMkAstExpressionIdentifier:
+      WalkIdentifier(walk, (MkAstIdentifier*)expr);
+      return;
+    case kMkAstExpressionIntegerLiteral:
+      MoveToken(walk, &((MkAstIntegerLiteral*)expr)->token);
+      break;
+    case kMkAstExpressionBoolean:
+      MoveToken(walk, &((MkAstBoolean*)expr)->token);
+      break;
+    case kMkAstExpressionPrefix: {
+      MkAstPrefixExpression* prefix = (MkAstPrefixExpression*)expr;
+      MoveToken(walk, &prefix->token);
+      WalkExpression(walk, prefix->right);
+    } break;
+    case kMkAstExpressionInfix: {
+      MkAstInfixExpression* infix = (MkAstInfixExpression*)expr;
+      MoveToken(walk, &infix->token);
+      WalkExpression(walk, infix->left);
+      WalkExpression(walk, infix->right);
+    } break;
+    case kMkAstExpressionIf: {
+      MkAstIfExpression* if_expr = (MkAstIfExpression*)expr;
+      MoveToken(walk, &if_expr->token);
+      WalkExpression(walk, if_expr->condition);
+      WalkStatement(walk, &if_expr->consequence->base);
+      if (if_expr->alternative != NULL) {
+        WalkStatement(walk, &if_expr->alternative->base);
+      }
+    } break;
+    case kMkAstExpressionFunctionLiteral: {
+      MkAstFunctionLiteral* function = (MkAstFunctionLiteral*)expr;
+      MoveToken(walk, &function->token);
+      for (uint64_t i = 0; i < function->parameters.size; ++i) {
+        WalkIdentifier(walk, function->parameters.data[i]);
+      }
+      WalkStatement(walk, &function->body->base);
+    } break;
+    case kMkAstExpressionCall: {
+      MkAstCallExpression* call = (MkAstCallExpression*)expr;
+      MoveToken(walk, &call->token);
+      WalkExpression(walk, call->function);
+      for (uint64_t i = 0; i < call->arguments.size; ++i) {
+        WalkExpression(walk, call->arguments.data[i]);
+      }
+    } break;
   }
-  for (uint64_t i = 0; i < prog->statements.size; i++) {
-    StatementFree(prog->statements.data[i]);
-    free(prog->statements.data[i]);
+  ++walk->count;
+}
+
+void WalkIdentifier(Walk* walk, MkAstIdentifier* identifier) {
+  ++walk->count;
+  MoveToken(walk, &identifier->token);
+  if (walk->symbols != NULL && identifier->symbol != kMkSymbolNone) {
+    identifier->symbol = walk->symbols[identifier->symbol];
   }
-  VEC_FREE(&prog->statements);
 }
 
-void StatementFree(MkAstStatement* stmt) {
-  if (stmt == NULL) {
+void MoveToken(const Walk* walk, MkToken* token) {
+  if (!walk->move) {
     return;
   }
+  uint64_t length = (uint64_t)(token->literal.end - token->literal.begin);
+  token->offset = (uint32_t)((int64_t)token->offset + walk->delta);
+  token->literal.begin = walk->source.begin + token->offset;
+  token->literal.end = token->literal.begin + length;
+}
+
+void WriteNode(String* out, MkAstNode* node) {
+  switch (node->type) {
+    case kMkAstNodeProgram:
+      WriteStatements(out, &((MkAstProgram*)node)->statements);
+      break;
+    case kMkAstNodeStatement:
+      WriteStatement(out, (MkAstStatement*)node);
+      break;
+    case kMkAstNodeExpression:
+      WriteExpression(out, (MkAstExpression*)node);
+      break;
+  }
+}
+
+void WriteStatements(String* out, MkAstStatements* statements) {
+  for (uint64_t i = 0; i < statements->size; ++i) {
+    WriteStatement(out, statements->data[i]);
+  }
+}
+
+void WriteStatement(String* out, MkAstStatement* stmt) {
   switch (stmt->type) {
     case kMkAstStatementLet: {
       MkAstLetStatement* let_stmt = (MkAstLetStatement*)stmt;
-      MkTokenFree(let_stmt->token);
-      ExpressionFree(&let_stmt->name.base);
-      ExpressionFree(let_stmt->value);
-      free(let_stmt->value);
+      WriteView(out, let_stmt->token.literal);
+      WriteC(out, " ");
+      WriteView(out, let_stmt->name.token.literal);
+      WriteC(out, " = ");
+      if (let_stmt->value != NULL) {
+        WriteExpression(out, let_stmt->value);
+      }
+      WriteC(out, ";");
+    } break;
+    case kMkAstStatementReturn: {
+      MkAstReturnStatement* return_stmt = (MkAstReturnStatement*)stmt;
+      WriteView(out, return_stmt->token.literal);
+      WriteC(out, " ");
+      if (return_stmt->return_value != NULL) {
+        WriteExpression(out, return_stmt->return_value);
+      }
+      WriteC(out, ";");
+    } break;
+    case kMkAstStatementExpression: {
+      MkAstExpressionStatement* expr_stmt = (MkAstExpressionStatement*)stmt;
+      if (expr_stmt->expression != NULL) {
+        WriteExpression(out, expr_stmt->expression);
+      }
     } break;
+    case kMkAstStatementBlock:
+      WriteStatements(out, &((MkAstBlockStatement*)stmt)->statements);
+      break;
   }
 }
 
-void ExpressionFree(MkAstExpression* expr) {
-  if (expr == NULL) {
-    return;
-  }
+void WriteExpression(String* out, MkAstExpression* expr) {
   switch (expr->type) {
-    case kMkAstExpressionIdentifier: {
-      MkAstIdentifier* ident = (MkAstIdentifier*)expr;
-      MkTokenFree(ident->token);
-      VEC_FREE(&ident->value);
+    case kMkAstExpressionIdentifier:
+      WriteView(out, ((MkAstIdentifier*)expr)->token.literal);
+      break;
+    case kMkAstExpressionIntegerLiteral:
+      WriteView(out, ((MkAstIntegerLiteral*)expr)->token.literal);
+      break;
+    case kMkAstExpressionBoolean:
+      WriteView(out, ((MkAstBoolean*)expr)->token.literal);
+      break;
+    case kMkAstExpressionPrefix: {
+      MkAstPrefixExpression* prefix = (MkAstPrefixExpression*)expr;
+      WriteC(out, "(");
+      WriteView(out, prefix->token.literal);
+      WriteExpression(out, prefix->right);
+      WriteC(out, ")");
+    } break;
+    case kMkAstExpressionInfix: {
+      MkAstInfixExpression* infix = (MkAstInfixExpression*)expr;
+      WriteC(out, "(");
+      WriteExpression(out, infix->left);
+      WriteC(out, " ");
+      WriteView(out, infix->token.literal);
+      WriteC(out, " ");
+      WriteExpression(out, infix->right);
+      WriteC(out, ")");
+    } break;
+    case kMkAstExpressionIf: {
+      MkAstIfExpression* if_expr = (MkAstIfExpression*)expr;
+      WriteC(out, "if");
+      WriteExpression(out, if_expr->condition);
+      WriteC(out, " ");
+      WriteStatement(out, &if_expr->consequence->base);
+      if (if_expr->alternative != NULL) {
+        WriteC(out, "else ");
+        WriteStatement(out, &if_expr->alternative->base);
+      }
+    } break;
+    case kMkAstExpressionFunctionLiteral: {
+      MkAstFunctionLiteral* function = (MkAstFunctionLiteral*)expr;
+      WriteView(out, function->token.literal);
+      WriteC(out, "(");
+      for (uint64_t i = 0; i < function->parameters.size; ++i) {
+        if (i > 0) {
+          WriteC(out, ", ");
+        }
+        WriteView(out, function->parameters.data[i]->token.literal);
+      }
+      WriteC(out, ") ");
+      WriteStatement(out, &function->body->base);
+    } break;
+    case kMkAstExpressionCall: {
+      MkAstCallExpression* call = (MkAstCallExpression*)expr;
+      WriteExpression(out, call->function);
+      WriteC(out, "(");
+      for (uint64_t i = 0; i < call->arguments.size; ++i) {
+        if (i > 0) {
+          WriteC(out, ", ");
+        }
+        WriteExpression(out, call->arguments.data[i]);
+      }
+      WriteC(out, ")");
     } break;
   }
 }
+
+void WriteView(String* out, StringView view) {
+  VEC_APPEND(out, view.begin, (uint64_t)(view.end - view.begin));
+}
+
+void WriteC(String* out, const char* cstr) {
+  VEC_APPEND(out, cstr, strlen(cstr));
+}
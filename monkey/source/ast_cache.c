@@ -0,0 +1,388 @@
+#include "monkey/ast_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <hash/hash.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string/string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vec/vec.h>
+
+#include "monkey/flat_ast.h"
+#include "monkey/parser.h"
+#include "monkey/token.h"
+
+// Changes whenever the layout or the meaning of a field does, so that images
+// written by another version are misses rather than misreads.
+static const char kImageMagic[8] = {'M', 'K', 'A', 'S', 'T', 0, 0, 1};
+
+enum {
+#define X(x) +1
+  kParseErrorKindCount = 0 MK_PARSE_ERRORS_,
+#undef X
+};
+
+// An image is this header followed by the nodes, the extra array, the errors
+// and the token offsets, lengths and kinds, each starting on a multiple of 8
+// bytes. The counts determine where everything is, so the header holds no
+// offsets of its own.
+typedef struct {
+  char magic[8];
+  uint64_t source_hash;
+  uint64_t source_size;
+  uint32_t node_count;
+  uint32_t extra_count;
+  uint32_t error_count;
+  uint32_t token_count;
+  uint32_t root;
+  uint32_t reserved;
+} ImageHeader;
+
+typedef struct {
+  uint64_t nodes;
+  uint64_t extra;
+  uint64_t errors;
+  uint64_t offsets;
+  uint64_t lengths;
+  uint64_t kinds;
+  uint64_t size;
+} ImageLayout;
+
+static bool Decode(MkAstImage* image,
+                   const void* bytes,
+                   uint64_t size,
+                   StringView source,
+                   uint64_t source_hash);
+static String CachePath(const MkAstCache* cache, uint64_t source_hash);
+static ImageLayout Layout(const ImageHeader* header);
+static uint64_t Align8(uint64_t size);
+static bool ValidTokens(const MkTokenBuffer* tokens, uint64_t source_size);
+static bool ValidErrors(const MkErrors* errors, uint64_t source_size);
+static bool ValidNode(const MkAstImage* image, uint32_t index);
+static bool ValidList(const MkFlatAst* flat, uint32_t list, uint32_t below);
+static bool WriteAll(int fd, const char* data, uint64_t size);
+
+bool MkAstImageEncode(String* out,
+                      StringView source,
+                      const MkFlatAst* flat,
+                      const MkTokenBuffer* tokens,
+                      const MkErrors* errors) {
+  if (flat->root == kMkFlatNone) {
+    return false;
+  }
+  uint64_t source_size = (uint64_t)(source.end - source.begin);
+  ImageHeader header = {
+      .source_hash = HashFnv1a(source.begin, source_size),
+      .source_size = source_size,
+      .node_count = (uint32_t)flat->nodes.size,
+      .extra_count = (uint32_t)flat->extra.size,
+      .error_count = (uint32_t)errors->size,
+      .token_count = (uint32_t)tokens->size,
+      .root = flat->root,
+  };
+  memcpy(header.magic, kImageMagic, sizeof(kImageMagic));
+  ImageLayout layout = Layout(&header);
+  uint64_t start = out->size;
+  if (!VEC_RESERVE(out, start + layout.size)) {
+    return false;
+  }
+  char* image = &out->data[start];
+  memset(image, 0, layout.size);
+  memcpy(image, &header, sizeof(header));
+  if (header.node_count > 0) {
+    memcpy(&image[layout.nodes], flat->nodes.data,
+           header.node_count * sizeof(MkFlatNode));
+  }
+  if (header.extra_count > 0) {
+    memcpy(&image[layout.extra], flat->extra.data,
+           header.extra_count * sizeof(uint32_t));
+  }
+  // Copied field by field, so that no padding bytes reach the file.
+  MkParseError* error_out = (MkParseError*)&image[layout.errors];
+  for (uint32_t i = 0; i < header.error_count; ++i) {
+    error_out[i].kind = errors->data[i].kind;
+    error_out[i].expected = errors->data[i].expected;
+    error_out[i].got = errors->data[i].got;
+    error_out[i].offset = errors->data[i].offset;
+  }
+  if (header.token_count > 0) {
+    memcpy(&image[layout.offsets], tokens->offsets,
+           header.token_count * sizeof(uint32_t));
+    memcpy(&image[layout.lengths], tokens->lengths,
+           header.token_count * sizeof(uint32_t));
+    memcpy(&image[layout.kinds], tokens->kinds,
+           header.token_count * sizeof(uint8_t));
+  }
+  out->size = start + layout.size;
+  return true;
+}
+
+bool MkAstImageDecode(MkAstImage* image,
+                      const void* bytes,
+                      uint64_t size,
+                      StringView source) {
+  uint64_t source_size = (uint64_t)(source.end - source.begin);
+  return Decode(image, bytes, size, source,
+                HashFnv1a(source.begin, source_size));
+}
+
+void MkAstImageFree(MkAstImage* image) {
+  if (image->mapping != NULL) {
+    munmap(image->mapping, image->mapping_size);
+  }
+  *image = (MkAstImage){.flat = {.root = kMkFlatNone}};
+}
+
+bool MkAstCacheInit(MkAstCache* cache, const char* directory) {
+  if (mkdir(directory, 0755) == -1 && errno != EEXIST) {
+    return false;
+  }
+  cache->directory = StringFromC(directory);
+  return true;
+}
+
+String MkAstCachePath(const MkAstCache* cache, StringView source) {
+  uint64_t size = (uint64_t)(source.end - source.begin);
+  return CachePath(cache, HashFnv1a(source.begin, size));
+}
+
+bool MkAstCacheLoad(const MkAstCache* cache,
+                    StringView source,
+                    MkAstImage* image) {
+  // The hash names the file and is checked against the header, so it is
+  // only computed once.
+  uint64_t size = (uint64_t)(source.end - source.begin);
+  uint64_t hash = HashFnv1a(source.begin, size);
+  String path = CachePath(cache, hash);
+  int fd = open(path.data, O_RDONLY);
+  VEC_FREE(&path);
+  if (fd == -1) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (uint64_t)st.st_size < sizeof(ImageHeader)) {
+    close(fd);
+    return false;
+  }
+  uint64_t mapping_size = (uint64_t)st.st_size;
+  void* mapping = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  if (!Decode(image, mapping, mapping_size, source, hash)) {
+    munmap(mapping, mapping_size);
+    return false;
+  }
+  image->mapping = mapping;
+  image->mapping_size = mapping_size;
+  return true;
+}
+
+bool MkAstCacheStore(const MkAstCache* cache,
+                     StringView source,
+                     const MkFlatAst* flat,
+                     const MkTokenBuffer* tokens,
+                     const MkErrors* errors) {
+  String bytes = {0};
+  if (!MkAstImageEncode(&bytes, source, flat, tokens, errors)) {
+    VEC_FREE(&bytes);
+    return false;
+  }
+  String path = MkAstCachePath(cache, source);
+  String temporary = StringFormat("%" STRING_FMT ".%ld.tmp",
+                                  STRING_PRINT(path), (long)getpid());
+  int fd = open(temporary.data, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool ok = fd != -1;
+  if (ok) {
+    ok = WriteAll(fd, bytes.data, bytes.size);
+    ok = close(fd) == 0 && ok;
+    ok = ok && rename(temporary.data, path.data) == 0;
+    if (!ok) {
+      unlink(temporary.data);
+    }
+  }
+  VEC_FREE(&temporary);
+  VEC_FREE(&path);
+  VEC_FREE(&bytes);
+  return ok;
+}
+
+void MkAstCacheFree(MkAstCache* cache) {
+  VEC_FREE(&cache->directory);
+}
+
+bool Decode(MkAstImage* image,
+            const void* bytes,
+            uint64_t size,
+            StringView source,
+            uint64_t source_hash) {
+  ImageHeader header;
+  uint64_t source_size = (uint64_t)(source.end - source.begin);
+  if (size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, bytes, sizeof(header));
+  if (memcmp(header.magic, kImageMagic, sizeof(kImageMagic)) != 0 ||
+      header.source_size != source_size || header.source_hash != source_hash) {
+    return false;
+  }
+  ImageLayout layout = Layout(&header);
+  if (layout.size != size || header.node_count == 0 ||
+      header.root != header.node_count - 1 || header.token_count == 0) {
+    return false;
+  }
+  char* base = (char*)bytes;
+  *image = (MkAstImage){
+      .flat = {.nodes = {.data = (MkFlatNode*)&base[layout.nodes],
+                         .size = header.node_count,
+                         .capacity = header.node_count},
+               .extra = {.data = (uint32_t*)&base[layout.extra],
+                         .size = header.extra_count,
+                         .capacity = header.extra_count},
+               .root = header.root},
+      .tokens = {.kinds = (uint8_t*)&base[layout.kinds],
+                 .offsets = (uint32_t*)&base[layout.offsets],
+                 .lengths = (uint32_t*)&base[layout.lengths],
+                 .size = header.token_count,
+                 .capacity = header.token_count},
+      .errors = {.data = (MkParseError*)&base[layout.errors],
+                 .size = header.error_count,
+                 .capacity = header.error_count},
+  };
+  if (!ValidTokens(&image->tokens, source_size) ||
+      !ValidErrors(&image->errors, source_size)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < header.node_count; ++i) {
+    if (!ValidNode(image, i)) {
+      return false;
+    }
+  }
+  return image->flat.nodes.data[header.root].kind == kMkFlatProgram;
+}
+
+String CachePath(const MkAstCache* cache, uint64_t source_hash) {
+  return StringFormat("%" STRING_FMT "/%016" PRIx64 ".mkast",
+                      STRING_PRINT(cache->directory), source_hash);
+}
+
+ImageLayout Layout(const ImageHeader* header) {
+  ImageLayout layout;
+  layout.nodes = sizeof(ImageHeader);
+  layout.extra =
+      Align8(layout.nodes + (uint64_t)header->node_count * sizeof(MkFlatNode));
+  layout.errors =
+      Align8(layout.extra + (uint64_t)header->extra_count * sizeof(uint32_t));
+  layout.offsets = Align8(layout.errors + (uint64_t)header->error_count *
+                                              sizeof(MkParseError));
+  layout.lengths = Align8(layout.offsets +
+                          (uint64_t)header->token_count * sizeof(uint32_t));
+  layout.kinds = Align8(layout.lengths +
+                        (uint64_t)header->token_count * sizeof(uint32_t));
+  layout.size = layout.kinds + header->token_count;
+  return layout;
+}
+
+uint64_t Align8(uint64_t size) {
+  return (size + 7) & ~(uint64_t)7;
+}
+
+// Every token lies within the source, and the last one is EOF, which the
+// parser and the flat AST functions rely on.
+bool ValidTokens(const MkTokenBuffer* tokens, uint64_t source_size) {
+  for (uint64_t i = 0; i < tokens->size; ++i) {
+    if (tokens->kinds[i] >= kMkTokenTypeCount ||
+        tokens->offsets[i] > source_size ||
+        tokens->lengths[i] > source_size - tokens->offsets[i]) {
+      return false;
+    }
+  }
+  return tokens->kinds[tokens->size - 1] == kMkTokenEof;
+}
+
+bool ValidErrors(const MkErrors* errors, uint64_t source_size) {
+  for (uint64_t i = 0; i < errors->size; ++i) {
+    MkParseError error = errors->data[i];
+    if (error.kind >= kParseErrorKindCount ||
+        error.expected >= kMkTokenTypeCount ||
+        error.got >= kMkTokenTypeCount || error.offset > source_size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Checks what the flat AST functions read through a node: its token, and
+// children that come before it, as post-order puts them.
+bool ValidNode(const MkAstImage* image, uint32_t index) {
+  const MkFlatAst* flat = &image->flat;
+  MkFlatNode node = flat->nodes.data[index];
+  if (node.token >= image->tokens.size) {
+    return false;
+  }
+  switch ((MkFlatNodeKind)node.kind) {
+    case kMkFlatProgram:
+    case kMkFlatBlock:
+      return ValidList(flat, node.a, index);
+    case kMkFlatLet:
+    case kMkFlatInfix:
+      return node.a < index && node.b < index;
+    case kMkFlatReturn:
+    case kMkFlatExpression:
+    case kMkFlatPrefix:
+      return node.a < index;
+    case kMkFlatIdentifier:
+    case kMkFlatIntegerLiteral:
+    case kMkFlatBoolean:
+      return true;
+    case kMkFlatIf:
+      return node.a < index && node.b < flat->extra.size &&
+             flat->extra.size - node.b >= 2 &&
+             flat->extra.data[node.b] < index &&
+             (flat->extra.data[node.b + 1] < index ||
+              flat->extra.data[node.b + 1] == kMkFlatNone);
+    case kMkFlatFunctionLiteral:
+      return ValidList(flat, node.a, index) && node.b < index;
+    case kMkFlatCall:
+      return node.a < index && ValidList(flat, node.b, index);
+    case kMkFlatNodeKindCount:
+      break;
+  }
+  return false;
+}
+
+// A list is a count followed by that many node indices, all below `below`.
+bool ValidList(const MkFlatAst* flat, uint32_t list, uint32_t below) {
+  if (list >= flat->extra.size ||
+      flat->extra.data[list] > flat->extra.size - list - 1) {
+    return false;
+  }
+  for (uint32_t i = 1; i <= flat->extra.data[list]; ++i) {
+    if (flat->extra.data[list + i] >= below) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool WriteAll(int fd, const char* data, uint64_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= (uint64_t)written;
+  }
+  return true;
+}
@@ -0,0 +1,95 @@
+#include "monkey/code.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string/string.h>
+#include <vec/vec.h>
+
+#include "monkey/token.h"
+#include "monkey/value.h"
+
+static void Append(String* out, String text);
+
+static const struct {
+  const char* name;
+  uint32_t operands;
+} kOpcodes[] = {
+#define X(x, operands) {#x, operands},
+    MK_OPCODES_
+#undef X
+};
+
+const char* MkOpcodeName(MkOpcode op) {
+  if ((uint32_t)op >= kMkOpCount) {
+    return "Invalid";
+  }
+  return kOpcodes[op].name;
+}
+
+uint32_t MkOpcodeOperandCount(MkOpcode op) {
+  if ((uint32_t)op >= kMkOpCount) {
+    return 0;
+  }
+  return kOpcodes[op].operands;
+}
+
+MkToken MkFunctionCodeToken(const MkFunctionCode* function, uint32_t offset) {
+  // The last position at or before `offset`.
+  uint64_t lo = 0;
+  uint64_t hi = function->positions.size;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (function->positions.data[mid].code <= offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) {
+    return (MkToken){0};
+  }
+  return function->positions.data[lo - 1].token;
+}
+
+String MkBytecodeDisassemble(const MkBytecode* bytecode) {
+  String out = {0};
+  for (uint64_t f = 0; f < bytecode->functions.size; ++f) {
+    const MkFunctionCode* function = &bytecode->functions.data[f];
+    Append(&out, StringFormat("fn %" PRIu64 " (%" PRIu32 " args, %" PRIu32
+                              " slots, %" PRIu32 " stack)\n",
+                              f, function->arity, function->scope->size,
+                              function->max_stack));
+    const uint8_t* code = function->code.data;
+    uint64_t offset = 0;
+    while (offset < function->code.size) {
+      MkOpcode op = code[offset];
+      Append(&out, StringFormat("%04" PRIu64 " %s", offset, MkOpcodeName(op)));
+      ++offset;
+      for (uint32_t i = 0; i < MkOpcodeOperandCount(op); ++i) {
+        uint32_t operand = code[offset] | (uint32_t)code[offset + 1] << 8;
+        Append(&out, StringFormat(" %" PRIu32, operand));
+        offset += 2;
+      }
+      VEC_PUSH(&out, '\n');
+    }
+  }
+  return out;
+}
+
+void MkBytecodeFree(MkBytecode* bytecode) {
+  for (uint64_t i = 0; i < bytecode->functions.size; ++i) {
+    VEC_FREE(&bytecode->functions.data[i].code);
+    VEC_FREE(&bytecode->functions.data[i].positions);
+    VEC_FREE(&bytecode->functions.data[i].parameter_slots);
+  }
+  VEC_FREE(&bytecode->functions);
+  VEC_FREE(&bytecode->constants);
+  MkHeapFree(&bytecode->heap);
+}
+
+void Append(String* out, String text) {
+  VEC_APPEND(out, text.data, text.size);
+  VEC_FREE(&text);
+}
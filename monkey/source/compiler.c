@@ -0,0 +1,411 @@
+#include "monkey/compiler.h"
+
+#include <hash/hash.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string/string.h>
+#include <vec/vec.h>
+
+#include "monkey/ast.h"
+#include "monkey/code.h"
+#include "monkey/heap.h"
+#include "monkey/token.h"
+#include "monkey/value.h"
+
+enum { kMaxOperand = UINT16_MAX };
+
+typedef struct {
+  MkBytecode* bytecode;
+  // The function being compiled, as an index since compiling a nested one
+  // may move the array.
+  uint32_t function;
+  // Values on the stack at this point of the function.
+  uint32_t stack;
+  // Expressions being compiled, each inside the one before.
+  uint32_t depth;
+  // Where each integer is in the constant pool.
+  HASH_TYPE(uint16_t) constant_indices;
+  String* error;
+  bool failed;
+} Compiler;
+
+static uint32_t CompileFunction(Compiler* compiler,
+                                const MkAstScope* scope,
+                                const MkAstFunctionLiteral* function,
+                                const MkAstStatements* body);
+static void CompileBlock(Compiler* compiler, const MkAstStatements* statements);
+static void CompileStatement(Compiler* compiler,
+                             const MkAstStatement* stmt,
+                             bool last);
+static void CompileExpression(Compiler* compiler, const MkAstExpression* expr);
+static void CompileExpressionNode(Compiler* compiler,
+                                  const MkAstExpression* expr);
+static void CompileIf(Compiler* compiler, const MkAstIfExpression* if_expr);
+static uint32_t AddConstant(Compiler* compiler, int64_t value);
+static uint32_t Emit(Compiler* compiler,
+                     MkToken token,
+                     MkOpcode op,
+                     uint32_t a,
+                     uint32_t b);
+static void PatchJump(Compiler* compiler, uint32_t jump);
+static MkFunctionCode* Current(Compiler* compiler);
+static void Fail(Compiler* compiler, const char* message);
+
+bool MkCompileProgram(MkBytecode* bytecode,
+                      const MkAstProgram* program,
+                      String* error) {
+  *bytecode = (MkBytecode){0};
+  Compiler compiler = {.bytecode = bytecode, .error = error};
+  CompileFunction(&compiler, &program->scope, NULL, &program->statements);
+  HASH_FREE(&compiler.constant_indices);
+  if (compiler.failed) {
+    MkBytecodeFree(bytecode);
+    return false;
+  }
+  return true;
+}
+
+uint32_t CompileFunction(Compiler* compiler,
+                         const MkAstScope* scope,
+                         const MkAstFunctionLiteral* function,
+                         const MkAstStatements* body) {
+  uint32_t index = (uint32_t)compiler->bytecode->functions.size;
+  MkFunctionCode code = {
+      .scope = scope,
+      .function = function,
+      .arity = function == NULL ? 0 : (uint32_t)function->parameters.size,
+  };
+  if (index > kMaxOperand) {
+    Fail(compiler, "too many functions");
+    return 0;
+  }
+  for (uint32_t i = 0; i < code.arity; ++i) {
+    if (!VEC_PUSH(&code.parameter_slots, function->parameters.data[i]->slot)) {
+      Fail(compiler, "out of memory");
+    }
+  }
+  if (!VEC_PUSH(&compiler->bytecode->functions, code)) {
+    VEC_FREE(&code.parameter_slots);
+    Fail(compiler, "out of memory");
+    return 0;
+  }
+  uint32_t enclosing = compiler->function;
+  uint32_t enclosing_stack = compiler->stack;
+  compiler->function = index;
+  compiler->stack = 0;
+  CompileBlock(compiler, body);
+  Emit(compiler, (MkToken){0}, kMkOpReturn, 0, 0);
+  compiler->function = enclosing;
+  compiler->stack = enclosing_stack;
+  return index;
+}
+
+// Leaves the value of the block on the stack: that of its last statement,
+// where a `let` counts as null, or null if it is empty.
+void CompileBlock(Compiler* compiler, const MkAstStatements* statements) {
+  if (statements->size == 0) {
+    Emit(compiler, (MkToken){0}, kMkOpNull, 0, 0);
+    return;
+  }
+  for (uint64_t i = 0; i < statements->size; ++i) {
+    CompileStatement(compiler, statements->data[i],
+                     i + 1 == statements->size);
+  }
+}
+
+// Leaves a value on the stack only for the `last` statement of a block.
+void CompileStatement(Compiler* compiler,
+                      const MkAstStatement* stmt,
+                      bool last) {
+  switch (stmt->type) {
+    case kMkAstStatementLet: {
+      const MkAstLetStatement* let_stmt = (const MkAstLetStatement*)stmt;
+      CompileExpression(compiler, let_stmt->value);
+      // The resolver binds every `let` in the scope it appears in.
+      if (let_stmt->name.depth != 0) {
+        Fail(compiler, "unresolved variable");
+        return;
+      }
+      Emit(compiler, let_stmt->name.token, kMkOpSetLocal, let_stmt->name.slot,
+           0);
+      if (last) {
+        Emit(compiler, (MkToken){0}, kMkOpNull, 0, 0);
+      }
+    } break;
+    case kMkAstStatementReturn:
+      CompileExpression(compiler,
+                        ((const MkAstReturnStatement*)stmt)->return_value);
+      Emit(compiler, (MkToken){0}, kMkOpReturn, 0, 0);
+      if (last) {
+        // Never reached, but the code after it counts on a value.
+        ++compiler->stack;
+      }
+      break;
+    case kMkAstStatementExpression:
+      CompileExpression(compiler,
+                        ((const MkAstExpressionStatement*)stmt)->expression);
+      if (!last) {
+        Emit(compiler, (MkToken){0}, kMkOpPop, 0, 0);
+      }
+      break;
+    case kMkAstStatementBlock:
+      CompileBlock(compiler, &((const MkAstBlockStatement*)stmt)->statements);
+      if (!last) {
+        Emit(compiler, (MkToken){0}, kMkOpPop, 0, 0);
+      }
+      break;
+  }
+}
+
+// Compiling recurses on the tree. A parsed program is within kMkAstMaxHeight,
+// so the check only stops one built some other way from running off the end
+// of the stack.
+void CompileExpression(Compiler* compiler, const MkAstExpression* expr) {
+  if (compiler->depth == kMkAstMaxHeight) {
+    Fail(compiler, "expression nested too deep");
+    return;
+  }
+  ++compiler->depth;
+  CompileExpressionNode(compiler, expr);
+  --compiler->depth;
+}
+
+void CompileExpressionNode(Compiler* compiler, const MkAstExpression* expr) {
+  if (expr == NULL) {
+    Fail(compiler, "invalid program");
+    return;
+  }
+  switch (expr->type) {
+    case kMkAstExpressionIdentifier: {
+      const MkAstIdentifier* identifier = (const MkAstIdentifier*)expr;
+      if (identifier->depth == kMkAstUnresolved) {
+        Emit(compiler, identifier->token, kMkOpNotFound, 0, 0);
+      } else if (identifier->depth == 0) {
+        Emit(compiler, identifier->token, kMkOpGetLocal, identifier->slot, 0);
+      } else {
+        Emit(compiler, identifier->token, kMkOpGetOuter, identifier->depth,
+             identifier->slot);
+      }
+    } break;
+    case kMkAstExpressionIntegerLiteral: {
+      const MkAstIntegerLiteral* literal = (const MkAstIntegerLiteral*)expr;
+      Emit(compiler, literal->token, kMkOpConstant,
+           AddConstant(compiler, literal->value), 0);
+    } break;
+    case kMkAstExpressionBoolean:
+      Emit(compiler, (MkToken){0},
+           ((const MkAstBoolean*)expr)->value ? kMkOpTrue : kMkOpFalse, 0, 0);
+      break;
+    case kMkAstExpressionPrefix: {
+      const MkAstPrefixExpression* prefix = (const MkAstPrefixExpression*)expr;
+      CompileExpression(compiler, prefix->right);
+      switch (prefix->token.type) {
+        case kMkTokenBang:
+          Emit(compiler, prefix->token, kMkOpBang, 0, 0);
+          break;
+        case kMkTokenMinus:
+          Emit(compiler, prefix->token, kMkOpMinus, 0, 0);
+          break;
+        default:
+          Fail(compiler, "unknown prefix operator");
+          break;
+      }
+    } break;
+    case kMkAstExpressionInfix: {
+      const MkAstInfixExpression* infix = (const MkAstInfixExpression*)expr;
+      CompileExpression(compiler, infix->left);
+      CompileExpression(compiler, infix->right);
+      MkOpcode op;
+      switch (infix->token.type) {
+        case kMkTokenPlus:
+          op = kMkOpAdd;
+          break;
+        case kMkTokenMinus:
+          op = kMkOpSub;
+          break;
+        case kMkTokenAsterisk:
+          op = kMkOpMul;
+          break;
+        case kMkTokenSlash:
+          op = kMkOpDiv;
+          break;
+        case kMkTokenEq:
+          op = kMkOpEq;
+          break;
+        case kMkTokenNotEq:
+          op = kMkOpNotEq;
+          break;
+        case kMkTokenLt:
+          op = kMkOpLt;
+          break;
+        case kMkTokenGt:
+          op = kMkOpGt;
+          break;
+        default:
+          Fail(compiler, "unknown infix operator");
+          return;
+      }
+      Emit(compiler, infix->token, op, 0, 0);
+    } break;
+    case kMkAstExpressionIf:
+      CompileIf(compiler, (const MkAstIfExpression*)expr);
+      break;
+    case kMkAstExpressionFunctionLiteral: {
+      const MkAstFunctionLiteral* function = (const MkAstFunctionLiteral*)expr;
+      uint32_t index = CompileFunction(compiler, &function->scope, function,
+                                       &function->body->statements);
+      Emit(compiler, function->token, kMkOpClosure, index, 0);
+    } break;
+    case kMkAstExpressionCall: {
+      const MkAstCallExpression* call = (const MkAstCallExpression*)expr;
+      CompileExpression(compiler, call->function);
+      for (uint64_t i = 0; i < call->arguments.size; ++i) {
+        CompileExpression(compiler, call->arguments.data[i]);
+      }
+      if (call->arguments.size > kMaxOperand) {
+        Fail(compiler, "too many arguments");
+        return;
+      }
+      Emit(compiler, call->token, kMkOpCall, (uint32_t)call->arguments.size,
+           0);
+    } break;
+  }
+}
+
+void CompileIf(Compiler* compiler, const MkAstIfExpression* if_expr) {
+  CompileExpression(compiler, if_expr->condition);
+  uint32_t to_alternative =
+      Emit(compiler, (MkToken){0}, kMkOpJumpIfFalse, 0, 0);
+  CompileBlock(compiler, &if_expr->consequence->statements);
+  uint32_t to_end = Emit(compiler, (MkToken){0}, kMkOpJump, 0, 0);
+  PatchJump(compiler, to_alternative);
+  // The alternative starts with the stack as the consequence did.
+  --compiler->stack;
+  if (if_expr->alternative != NULL) {
+    CompileBlock(compiler, &if_expr->alternative->statements);
+  } else {
+    Emit(compiler, (MkToken){0}, kMkOpNull, 0, 0);
+  }
+  PatchJump(compiler, to_end);
+}
+
+uint32_t AddConstant(Compiler* compiler, int64_t value) {
+  HashKeySpan key = {.begin = (const uint8_t*)&value,
+                     .end = (const uint8_t*)(&value + 1)};
+  uint16_t index;
+  if (HASH_GET(&compiler->constant_indices, key, &index)) {
+    return index;
+  }
+  MkBytecode* bytecode = compiler->bytecode;
+  if (bytecode->constants.size > kMaxOperand) {
+    Fail(compiler, "too many constants");
+    return 0;
+  }
+  index = (uint16_t)bytecode->constants.size;
+  MkValue constant = MkHeapInteger(&bytecode->heap, value);
+  if (MK_IS_UNSET(constant) || !VEC_PUSH(&bytecode->constants, constant) ||
+      HASH_ADD(&compiler->constant_indices, key, index) != kHashAddSuccess) {
+    Fail(compiler, "out of memory");
+    return 0;
+  }
+  return index;
+}
+
+// Appends an instruction and returns its offset. Instructions from a token
+// that an error could be reported at record it; the others pass a zero one.
+uint32_t Emit(Compiler* compiler,
+              MkToken token,
+              MkOpcode op,
+              uint32_t a,
+              uint32_t b) {
+  if (compiler->failed) {
+    return 0;
+  }
+  MkFunctionCode* function = Current(compiler);
+  uint32_t offset = (uint32_t)function->code.size;
+  if (a > kMaxOperand || b > kMaxOperand || offset > UINT32_MAX - 8) {
+    Fail(compiler, "operand out of range");
+    return offset;
+  }
+  if (token.literal.begin != NULL &&
+      (function->positions.size == 0 ||
+       function->positions.data[function->positions.size - 1].token.offset !=
+           token.offset)) {
+    MkCodePosition position = {.code = offset, .token = token};
+    if (!VEC_PUSH(&function->positions, position)) {
+      Fail(compiler, "out of memory");
+      return offset;
+    }
+  }
+  uint8_t bytes[] = {op, a & 0xff, a >> 8, b & 0xff, b >> 8};
+  if (!VEC_APPEND(&function->code, bytes, 1 + 2 * MkOpcodeOperandCount(op))) {
+    Fail(compiler, "out of memory");
+    return offset;
+  }
+
+  switch (op) {
+    case kMkOpConstant:
+    case kMkOpNull:
+    case kMkOpTrue:
+    case kMkOpFalse:
+    case kMkOpGetLocal:
+    case kMkOpGetOuter:
+    case kMkOpNotFound:
+    case kMkOpClosure:
+      ++compiler->stack;
+      break;
+    case kMkOpPop:
+    case kMkOpAdd:
+    case kMkOpSub:
+    case kMkOpMul:
+    case kMkOpDiv:
+    case kMkOpEq:
+    case kMkOpNotEq:
+    case kMkOpLt:
+    case kMkOpGt:
+    case kMkOpJumpIfFalse:
+    case kMkOpSetLocal:
+    case kMkOpReturn:
+      --compiler->stack;
+      break;
+    case kMkOpCall:
+      compiler->stack -= a;
+      break;
+    case kMkOpMinus:
+    case kMkOpBang:
+    case kMkOpJump:
+    case kMkOpCount:
+      break;
+  }
+  if (compiler->stack > function->max_stack) {
+    function->max_stack = compiler->stack;
+  }
+  return offset;
+}
+
+// Points the jump at `jump` to the next instruction.
+void PatchJump(Compiler* compiler, uint32_t jump) {
+  if (compiler->failed) {
+    return;
+  }
+  MkFunctionCode* function = Current(compiler);
+  uint64_t distance = function->code.size - (jump + 3);
+  if (distance > kMaxOperand) {
+    Fail(compiler, "jump too far");
+    return;
+  }
+  function->code.data[jump + 1] = distance & 0xff;
+  function->code.data[jump + 2] = (uint8_t)(distance >> 8);
+}
+
+MkFunctionCode* Current(Compiler* compiler) {
+  return &compiler->bytecode->functions.data[compiler->function];
+}
+
+void Fail(Compiler* compiler, const char* message) {
+  if (!compiler->failed) {
+    compiler->failed = true;
+    *compiler->error = StringFromC(message);
+  }
+}
@@ -0,0 +1,464 @@
+#include "monkey/evaluator.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string/string.h>
+#include <vec/vec.h>
+
+#include "monkey/ast.h"
+#include "monkey/resolver.h"
+#include "monkey/token.h"
+#include "monkey/value.h"
+
+// How evaluation leaves a statement or an expression: a `return` unwinds to
+// the end of the call or of the program, and an error to the end of the run.
+typedef enum {
+  kFlowNormal,
+  kFlowReturn,
+  kFlowError,
+} Flow;
+
+static Flow EvalStatements(MkEvaluator* evaluator,
+                           const MkAstStatements* statements,
+                           MkEnvironment* environment,
+                           MkValue* out);
+static Flow EvalStatement(MkEvaluator* evaluator,
+                          const MkAstStatement* stmt,
+                          MkEnvironment* environment,
+                          MkValue* out);
+static Flow EvalExpression(MkEvaluator* evaluator,
+                           const MkAstExpression* expr,
+                           MkEnvironment* environment,
+                           MkValue* out);
+static Flow EvalIdentifier(MkEvaluator* evaluator,
+                           const MkAstIdentifier* identifier,
+                           MkEnvironment* environment,
+                           MkValue* out);
+static Flow EvalPrefix(MkEvaluator* evaluator,
+                       const MkAstPrefixExpression* prefix,
+                       MkValue right,
+                       MkValue* out);
+static Flow EvalInfix(MkEvaluator* evaluator,
+                      const MkAstInfixExpression* infix,
+                      MkValue left,
+                      MkValue right,
+                      MkValue* out);
+static Flow EvalCall(MkEvaluator* evaluator,
+                     const MkAstCallExpression* call,
+                     MkEnvironment* environment,
+                     MkValue* out);
+static Flow Integer(MkEvaluator* evaluator,
+                    MkToken token,
+                    int64_t value,
+                    MkValue* out);
+static Flow Fail(MkEvaluator* evaluator, MkToken token, String message);
+static void MarkRoots(MkHeap* heap, void* context);
+
+void MkEvaluatorInit(MkEvaluator* evaluator) {
+  *evaluator = (MkEvaluator){0};
+}
+
+bool MkEvaluatorRun(MkEvaluator* evaluator,
+                    const MkAstProgram* program,
+                    MkValue* result) {
+  VEC_FREE(&evaluator->error);
+  evaluator->error_offset = 0;
+  if (evaluator->stack == NULL) {
+    evaluator->stack = malloc(kMkEvaluatorStackSize * sizeof(MkValue));
+  }
+  evaluator->heap.mark_roots = MarkRoots;
+  evaluator->heap.roots = evaluator;
+  evaluator->stack_size = 0;
+  MkEnvironment* globals = NULL;
+  if (evaluator->stack != NULL) {
+    globals = MkHeapNewEnvironment(&evaluator->heap, NULL, &program->scope);
+  }
+  if (globals == NULL) {
+    evaluator->error = StringFromC("out of memory");
+    return false;
+  }
+  evaluator->stack[evaluator->stack_size++] = MK_OBJECT(globals);
+  MkValue value = MK_NULL;
+  Flow flow =
+      EvalStatements(evaluator, &program->statements, globals, &value);
+  evaluator->depth = 0;
+  evaluator->stack_size = 0;
+  if (flow == kFlowError) {
+    return false;
+  }
+  *result = value;
+  return true;
+}
+
+void MkEvaluatorFree(MkEvaluator* evaluator) {
+  MkHeapFree(&evaluator->heap);
+  free(evaluator->stack);
+  VEC_FREE(&evaluator->error);
+  *evaluator = (MkEvaluator){0};
+}
+
+Flow EvalStatements(MkEvaluator* evaluator,
+                    const MkAstStatements* statements,
+                    MkEnvironment* environment,
+                    MkValue* out) {
+  *out = MK_NULL;
+  for (uint64_t i = 0; i < statements->size; ++i) {
+    Flow flow = EvalStatement(evaluator, statements->data[i], environment, out);
+    if (flow != kFlowNormal) {
+      return flow;
+    }
+  }
+  return kFlowNormal;
+}
+
+Flow EvalStatement(MkEvaluator* evaluator,
+                   const MkAstStatement* stmt,
+                   MkEnvironment* environment,
+                   MkValue* out) {
+  switch (stmt->type) {
+    case kMkAstStatementLet: {
+      const MkAstLetStatement* let_stmt = (const MkAstLetStatement*)stmt;
+      MkValue value;
+      Flow flow =
+          EvalExpression(evaluator, let_stmt->value, environment, &value);
+      if (flow != kFlowNormal) {
+        return flow;
+      }
+      // The resolver binds every `let` in the scope it appears in.
+      if (let_stmt->name.depth != 0) {
+        return Fail(evaluator, let_stmt->name.token,
+                    StringFromC("unresolved variable"));
+      }
+      MK_HEAP_WRITE_BARRIER(&evaluator->heap, value);
+      environment->slots[let_stmt->name.slot] = value;
+      *out = MK_NULL;
+      return kFlowNormal;
+    }
+    case kMkAstStatementReturn: {
+      Flow flow = EvalExpression(
+          evaluator, ((const MkAstReturnStatement*)stmt)->return_value,
+          environment, out);
+      return flow == kFlowNormal ? kFlowReturn : flow;
+    }
+    case kMkAstStatementExpression:
+      return EvalExpression(
+          evaluator, ((const MkAstExpressionStatement*)stmt)->expression,
+          environment, out);
+    case kMkAstStatementBlock:
+      return EvalStatements(evaluator,
+                            &((const MkAstBlockStatement*)stmt)->statements,
+                            environment, out);
+  }
+  return Fail(evaluator, (MkToken){0}, StringFromC("invalid statement"));
+}
+
+Flow EvalExpression(MkEvaluator* evaluator,
+                    const MkAstExpression* expr,
+                    MkEnvironment* environment,
+                    MkValue* out) {
+  if (expr == NULL) {
+    return Fail(evaluator, (MkToken){0}, StringFromC("invalid program"));
+  }
+  switch (expr->type) {
+    case kMkAstExpressionIdentifier:
+      return EvalIdentifier(evaluator, (const MkAstIdentifier*)expr,
+                            environment, out);
+    case kMkAstExpressionIntegerLiteral: {
+      const MkAstIntegerLiteral* literal = (const MkAstIntegerLiteral*)expr;
+      return Integer(evaluator, literal->token, literal->value, out);
+    }
+    case kMkAstExpressionBoolean:
+      *out = MK_BOOLEAN(((const MkAstBoolean*)expr)->value);
+      return kFlowNormal;
+    case kMkAstExpressionPrefix: {
+      const MkAstPrefixExpression* prefix =
+          (const MkAstPrefixExpression*)expr;
+      MkValue right;
+      Flow flow = EvalExpression(evaluator, prefix->right, environment, &right);
+      if (flow != kFlowNormal) {
+        return flow;
+      }
+      return EvalPrefix(evaluator, prefix, right, out);
+    }
+    case kMkAstExpressionInfix: {
+      const MkAstInfixExpression* infix = (const MkAstInfixExpression*)expr;
+      MkValue left;
+      MkValue right;
+      Flow flow = EvalExpression(evaluator, infix->left, environment, &left);
+      if (flow != kFlowNormal) {
+        return flow;
+      }
+      if (evaluator->stack_size == kMkEvaluatorStackSize) {
+        return Fail(evaluator, infix->token, StringFromC("stack overflow"));
+      }
+      evaluator->stack[evaluator->stack_size++] = left;
+      flow = EvalExpression(evaluator, infix->right, environment, &right);
+      --evaluator->stack_size;
+      if (flow != kFlowNormal) {
+        return flow;
+      }
+      return EvalInfix(evaluator, infix, left, right, out);
+    }
+    case kMkAstExpressionIf: {
+      const MkAstIfExpression* if_expr = (const MkAstIfExpression*)expr;
+      MkValue condition;
+      Flow flow = EvalExpression(evaluator, if_expr->condition, environment,
+                                 &condition);
+      if (flow != kFlowNormal) {
+        return flow;
+      }
+      if (MkValueTruthy(condition)) {
+        return EvalStatements(evaluator, &if_expr->consequence->statements,
+                              environment, out);
+      }
+      if (if_expr->alternative != NULL) {
+        return EvalStatements(evaluator, &if_expr->alternative->statements,
+                              environment, out);
+      }
+      *out = MK_NULL;
+      return kFlowNormal;
+    }
+    case kMkAstExpressionFunctionLiteral: {
+      const MkAstFunctionLiteral* function = (const MkAstFunctionLiteral*)expr;
+      MkClosure* closure =
+          MkHeapNewClosure(&evaluator->heap, function, NULL, environment);
+      if (closure == NULL) {
+        return Fail(evaluator, function->token, StringFromC("out of memory"));
+      }
+      *out = MK_OBJECT(closure);
+      return kFlowNormal;
+    }
+    case kMkAstExpressionCall:
+      return EvalCall(evaluator, (const MkAstCallExpression*)expr, environment,
+                      out);
+  }
+  return Fail(evaluator, (MkToken){0}, StringFromC("invalid expression"));
+}
+
+Flow EvalIdentifier(MkEvaluator* evaluator,
+                    const MkAstIdentifier* identifier,
+                    MkEnvironment* environment,
+                    MkValue* out) {
+  if (identifier->depth != kMkAstUnresolved) {
+    MkEnvironment* scope = environment;
+    for (uint32_t depth = identifier->depth; depth > 0; --depth) {
+      scope = scope->parent;
+    }
+    *out = scope->slots[identifier->slot];
+    if (!MK_IS_UNSET(*out)) {
+      return kFlowNormal;
+    }
+    // Until the `let` in its own scope has run, the name refers to whatever
+    // outer scope has a variable of that name set.
+    if (MkEnvironmentLookup(scope->parent, identifier->symbol, out)) {
+      return kFlowNormal;
+    }
+  }
+  return Fail(evaluator, identifier->token,
+              StringFormat("identifier not found: %" STRING_FMT,
+                           STRING_VIEW_PRINT(identifier->token.literal)));
+}
+
+Flow EvalPrefix(MkEvaluator* evaluator,
+                const MkAstPrefixExpression* prefix,
+                MkValue right,
+                MkValue* out) {
+  switch (prefix->token.type) {
+    case kMkTokenBang:
+      *out = MK_BOOLEAN(!MkValueTruthy(right));
+      return kFlowNormal;
+    case kMkTokenMinus:
+      if (MK_IS_INTEGER(right)) {
+        // Negation wraps like the other arithmetic, so -INT64_MIN is itself.
+        return Integer(evaluator, prefix->token,
+                       (int64_t)(0 - (uint64_t)MkValueInteger(right)), out);
+      }
+      break;
+    default:
+      break;
+  }
+  return Fail(evaluator, prefix->token,
+              StringFormat("unknown operator: %s%s",
+                           MkTokenTypeName(prefix->token.type),
+                           MkValueTypeName(MkValueTypeOf(right))));
+}
+
+Flow EvalInfix(MkEvaluator* evaluator,
+               const MkAstInfixExpression* infix,
+               MkValue left,
+               MkValue right,
+               MkValue* out) {
+  MkTokenType op = infix->token.type;
+  if (MK_IS_INTEGER(left) && MK_IS_INTEGER(right)) {
+    // Arithmetic is done unsigned, where overflow wraps instead of being
+    // undefined.
+    int64_t a = MkValueInteger(left);
+    int64_t b = MkValueInteger(right);
+    switch (op) {
+      case kMkTokenPlus:
+        return Integer(evaluator, infix->token,
+                       (int64_t)((uint64_t)a + (uint64_t)b), out);
+      case kMkTokenMinus:
+        return Integer(evaluator, infix->token,
+                       (int64_t)((uint64_t)a - (uint64_t)b), out);
+      case kMkTokenAsterisk:
+        return Integer(evaluator, infix->token,
+                       (int64_t)((uint64_t)a * (uint64_t)b), out);
+      case kMkTokenSlash:
+        if (b == 0) {
+          return Fail(evaluator, infix->token,
+                      StringFromC("division by zero"));
+        }
+        return Integer(evaluator, infix->token,
+                       b == -1 ? (int64_t)(0 - (uint64_t)a) : a / b, out);
+      case kMkTokenLt:
+        *out = MK_BOOLEAN(a < b);
+        return kFlowNormal;
+      case kMkTokenGt:
+        *out = MK_BOOLEAN(a > b);
+        return kFlowNormal;
+      case kMkTokenEq:
+        *out = MK_BOOLEAN(a == b);
+        return kFlowNormal;
+      case kMkTokenNotEq:
+        *out = MK_BOOLEAN(a != b);
+        return kFlowNormal;
+      default:
+        break;
+    }
+  } else if (op == kMkTokenEq) {
+    *out = MK_BOOLEAN(MkValueIdentical(left, right));
+    return kFlowNormal;
+  } else if (op == kMkTokenNotEq) {
+    *out = MK_BOOLEAN(!MkValueIdentical(left, right));
+    return kFlowNormal;
+  }
+  MkValueType left_type = MkValueTypeOf(left);
+  MkValueType right_type = MkValueTypeOf(right);
+  return Fail(evaluator, infix->token,
+              StringFormat("%s: %s %s %s",
+                           left_type == right_type ? "unknown operator"
+                                                   : "type mismatch",
+                           MkValueTypeName(left_type), MkTokenTypeName(op),
+                           MkValueTypeName(right_type)));
+}
+
+Flow EvalCall(MkEvaluator* evaluator,
+              const MkAstCallExpression* call,
+              MkEnvironment* environment,
+              MkValue* out) {
+  MkValue callee;
+  Flow flow = EvalExpression(evaluator, call->function, environment, &callee);
+  if (flow != kFlowNormal) {
+    return flow;
+  }
+  // The arguments are evaluated before the callee is checked, as the VM
+  // does, and wait on the stack above it until the frame is made.
+  uint64_t base = evaluator->stack_size;
+  uint64_t argument_count = call->arguments.size;
+  if (argument_count >= kMkEvaluatorStackSize - base) {
+    return Fail(evaluator, call->token, StringFromC("stack overflow"));
+  }
+  evaluator->stack[evaluator->stack_size++] = callee;
+  for (uint64_t i = 0; i < argument_count; ++i) {
+    MkValue argument;
+    flow = EvalExpression(evaluator, call->arguments.data[i], environment,
+                          &argument);
+    if (flow != kFlowNormal) {
+      evaluator->stack_size = base;
+      return flow;
+    }
+    evaluator->stack[evaluator->stack_size++] = argument;
+  }
+  const MkValue* arguments = &evaluator->stack[base + 1];
+
+  if (!MK_IS_FUNCTION(callee)) {
+    evaluator->stack_size = base;
+    return Fail(evaluator, call->token,
+                StringFormat("not a function: %s",
+                             MkValueTypeName(MkValueTypeOf(callee))));
+  }
+  MkClosure* closure = MK_AS_CLOSURE(callee);
+  const MkAstFunctionLiteral* function = closure->function;
+  if (argument_count != function->parameters.size) {
+    evaluator->stack_size = base;
+    return Fail(evaluator, call->token,
+                StringFormat("wrong number of arguments: want=%" PRIu64
+                             ", got=%" PRIu64,
+                             function->parameters.size, argument_count));
+  }
+  // The frame's slots go above the arguments, or else the environment that
+  // holds them, so that a collection finds it.
+  const MkAstScope* scope = &function->scope;
+  uint64_t top = base + 1 + argument_count;
+  if (evaluator->depth == kMkEvaluatorMaxDepth ||
+      (scope->captured ? 1 : scope->size) > kMkEvaluatorStackSize - top) {
+    evaluator->stack_size = base;
+    return Fail(evaluator, call->token, StringFromC("stack overflow"));
+  }
+  MkEnvironment frame;
+  MkEnvironment* callee_environment = &frame;
+  if (scope->captured) {
+    callee_environment =
+        MkHeapNewEnvironment(&evaluator->heap, closure->environment, scope);
+    if (callee_environment == NULL) {
+      evaluator->stack_size = base;
+      return Fail(evaluator, call->token, StringFromC("out of memory"));
+    }
+    evaluator->stack[top] = MK_OBJECT(callee_environment);
+    evaluator->stack_size = top + 1;
+  } else {
+    frame = (MkEnvironment){.parent = closure->environment,
+                            .scope = scope,
+                            .slots = &evaluator->stack[top]};
+    for (uint32_t i = 0; i < scope->size; ++i) {
+      frame.slots[i] = MK_UNSET;
+    }
+    evaluator->stack_size = top + scope->size;
+  }
+  for (uint64_t i = 0; i < argument_count; ++i) {
+    MK_HEAP_WRITE_BARRIER(&evaluator->heap, arguments[i]);
+    callee_environment->slots[function->parameters.data[i]->slot] =
+        arguments[i];
+  }
+  ++evaluator->depth;
+  ++evaluator->calls;
+  flow = EvalStatements(evaluator, &function->body->statements,
+                        callee_environment, out);
+  --evaluator->depth;
+  evaluator->stack_size = base;
+  return flow == kFlowError ? flow : kFlowNormal;
+}
+
+// Small integers are made in place; only the others allocate.
+Flow Integer(MkEvaluator* evaluator,
+             MkToken token,
+             int64_t value,
+             MkValue* out) {
+  if (MK_FITS_SMALL_INTEGER(value)) {
+    *out = MK_SMALL_INTEGER(value);
+    return kFlowNormal;
+  }
+  *out = MkHeapInteger(&evaluator->heap, value);
+  if (MK_IS_UNSET(*out)) {
+    return Fail(evaluator, token, StringFromC("out of memory"));
+  }
+  return kFlowNormal;
+}
+
+Flow Fail(MkEvaluator* evaluator, MkToken token, String message) {
+  VEC_FREE(&evaluator->error);
+  evaluator->error = message;
+  evaluator->error_offset = token.offset;
+  return kFlowError;
+}
+
+// The stack holds every root; see MkEvaluator.
+void MarkRoots(MkHeap* heap, void* context) {
+  const MkEvaluator* evaluator = context;
+  for (uint64_t i = 0; i < evaluator->stack_size; ++i) {
+    MkHeapMarkValue(heap, evaluator->stack[i]);
+  }
+}
@@ -0,0 +1,839 @@
+#include "monkey/flat_ast.h"
+
+#include <arena/arena.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string/string.h>
+#include <vec/vec.h>
+
+#include "monkey/ast.h"
+#include "monkey/intern.h"
+#include "monkey/token.h"
+
+typedef struct {
+  MkFlatAst* flat;
+  const MkTokenBuffer* tokens;
+  // Child indices of the lists being lowered, shared as a stack.
+  VEC_TYPE(uint32_t) scratch;
+  bool failed;
+} Lowering;
+
+typedef struct {
+  const MkFlatAst* flat;
+  const MkTokenBuffer* tokens;
+  StringView source;
+  MkInterner* symbols;
+  Arena* arena;
+  // The node built for each flat node so far, which post-order makes every
+  // child's, and how many expressions the longest path down it passes
+  // through.
+  void** built;
+  uint32_t* heights;
+} Building;
+
+static const char* const kFlatNodeKindNames[] = {
+#define X(x) #x,
+    MK_FLAT_NODES_
+#undef X
+};
+
+static uint32_t Push(Lowering* lowering, MkFlatNode node);
+static uint32_t Emit(Lowering* lowering,
+                     MkFlatNodeKind kind,
+                     MkToken token,
+                     uint32_t a,
+                     uint32_t b);
+static uint32_t TokenIndex(Lowering* lowering, MkToken token);
+static uint32_t EmitList(Lowering* lowering, uint64_t start);
+static uint32_t LowerStatements(Lowering* lowering,
+                                const MkAstStatements* statements);
+static uint32_t LowerStatement(Lowering* lowering, const MkAstStatement* stmt);
+static uint32_t LowerExpression(Lowering* lowering,
+                                const MkAstExpression* expr);
+static uint32_t LowerIdentifier(Lowering* lowering,
+                                const MkAstIdentifier* identifier);
+static void* BuildNode(Building* building, uint32_t index);
+static bool MeasureNode(Building* building, uint32_t index);
+static MkToken BuildToken(const Building* building, uint32_t node);
+static bool BuildStatements(Building* building,
+                            uint32_t list,
+                            MkAstStatements* statements);
+static MkAstStatement* BuiltStatement(const Building* building,
+                                      uint32_t node);
+static MkAstExpression* BuiltExpression(const Building* building,
+                                        uint32_t node);
+static MkAstBlockStatement* BuiltBlock(const Building* building,
+                                       uint32_t node);
+static MkAstIdentifier* BuiltIdentifier(const Building* building,
+                                        uint32_t node);
+static void WriteNode(String* out,
+                      const MkFlatAst* flat,
+                      const MkTokenBuffer* tokens,
+                      StringView source,
+                      uint32_t node);
+static void WriteList(String* out,
+                      const MkFlatAst* flat,
+                      const MkTokenBuffer* tokens,
+                      StringView source,
+                      uint32_t list,
+                      const char* separator);
+static void WriteToken(String* out,
+                       const MkTokenBuffer* tokens,
+                       StringView source,
+                       uint32_t token);
+static void WriteC(String* out, const char* cstr);
+
+bool MkFlatAstFromProgram(MkFlatAst* flat,
+                          const MkAstProgram* program,
+                          const MkTokenBuffer* tokens) {
+  flat->nodes.size = 0;
+  flat->extra.size = 0;
+  flat->root = kMkFlatNone;
+  Lowering lowering = {.flat = flat, .tokens = tokens};
+  uint32_t statements = LowerStatements(&lowering, &program->statements);
+  // The program has no token of its own; its first statement's stands in.
+  uint32_t token = 0;
+  if (!lowering.failed && program->statements.size > 0) {
+    token = flat->nodes.data[flat->extra.data[statements + 1]].token;
+  }
+  flat->root = Push(&lowering, (MkFlatNode){.kind = kMkFlatProgram,
+                                             .token = token,
+                                             .a = statements});
+  VEC_FREE(&lowering.scratch);
+  if (lowering.failed) {
+    flat->root = kMkFlatNone;
+    return false;
+  }
+  return true;
+}
+
+MkAstProgram* MkFlatAstToProgram(const MkFlatAst* flat,
+                                 const MkTokenBuffer* tokens,
+                                 StringView source,
+                                 MkInterner* symbols) {
+  if (flat->root == kMkFlatNone) {
+    return NULL;
+  }
+  MkAstProgram* program = calloc(sizeof(MkAstProgram), 1);
+  void** built = calloc(flat->nodes.size, sizeof(void*));
+  uint32_t* heights = calloc(flat->nodes.size, sizeof(uint32_t));
+  if (program == NULL || built == NULL || heights == NULL) {
+    free(program);
+    free(built);
+    free(heights);
+    return NULL;
+  }
+  program->base.type = kMkAstNodeProgram;
+  ArenaInit(&program->arena);
+  Building building = {
+      .flat = flat,
+      .tokens = tokens,
+      .source = source,
+      .symbols = symbols,
+      .arena = &program->arena,
+      .built = built,
+      .heights = heights,
+  };
+  bool ok = true;
+  for (uint32_t i = 0; ok && i < flat->nodes.size; ++i) {
+    if (i != flat->root) {
+      built[i] = BuildNode(&building, i);
+      ok = built[i] != NULL && MeasureNode(&building, i);
+    }
+  }
+  ok = ok && BuildStatements(&building, flat->nodes.data[flat->root].a,
+                             &program->statements);
+  free(built);
+  free(heights);
+  if (!ok) {
+    MkAstNodeFree(&program->base);
+    free(program);
+    return NULL;
+  }
+  // Every flat node but the program's stands for one that MkAstNodeCount
+  // counts.
+  program->node_count = flat->nodes.size - 1;
+  program->parsed_size = program->arena.used;
+  return program;
+}
+
+void MkFlatAstFree(MkFlatAst* flat) {
+  VEC_FREE(&flat->nodes);
+  VEC_FREE(&flat->extra);
+  flat->root = kMkFlatNone;
+}
+
+const char* MkFlatNodeKindName(MkFlatNodeKind kind) {
+  if (kind >= kMkFlatNodeKindCount) {
+    return "invalid";
+  }
+  return kFlatNodeKindNames[kind];
+}
+
+int64_t MkFlatIntegerValue(MkFlatNode node) {
+  return (int64_t)((uint64_t)node.b << 32 | node.a);
+}
+
+String MkFlatAstTokenLiteral(const MkFlatAst* flat,
+                             const MkTokenBuffer* tokens,
+                             StringView source,
+                             uint32_t node) {
+  String result = {0};
+  MkFlatNode n = flat->nodes.data[node];
+  if (n.kind == kMkFlatProgram) {
+    const uint32_t* list = &flat->extra.data[n.a];
+    for (uint32_t i = 1; i <= list[0]; ++i) {
+      WriteToken(&result, tokens, source, flat->nodes.data[list[i]].token);
+    }
+  } else {
+    WriteToken(&result, tokens, source, n.token);
+  }
+  return result;
+}
+
+String MkFlatAstString(const MkFlatAst* flat,
+                       const MkTokenBuffer* tokens,
+                       StringView source,
+                       uint32_t node) {
+  String result = {0};
+  WriteNode(&result, flat, tokens, source, node);
+  return result;
+}
+
+uint32_t Push(Lowering* lowering, MkFlatNode node) {
+  uint64_t index = lowering->flat->nodes.size;
+  if (index >= kMkFlatNone || !VEC_PUSH(&lowering->flat->nodes, node)) {
+    lowering->failed = true;
+    return kMkFlatNone;
+  }
+  return (uint32_t)index;
+}
+
+uint32_t Emit(Lowering* lowering,
+              MkFlatNodeKind kind,
+              MkToken token,
+              uint32_t a,
+              uint32_t b) {
+  return Push(lowering, (MkFlatNode){.kind = kind,
+                                     .token = TokenIndex(lowering, token),
+                                     .a = a,
+                                     .b = b});
+}
+
+// Tokens are sorted by offset and no two share one, except the EOF token,
+// which no node refers to.
+uint32_t TokenIndex(Lowering* lowering, MkToken token) {
+  const MkTokenBuffer* tokens = lowering->tokens;
+  uint64_t lo = 0;
+  uint64_t hi = tokens->size;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (tokens->offsets[mid] < token.offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == tokens->size || tokens->offsets[lo] != token.offset) {
+    lowering->failed = true;
+    return kMkFlatNone;
+  }
+  return (uint32_t)lo;
+}
+
+// Moves the child indices pushed since `start` into `extra` as a counted list
+// and returns where it starts.
+uint32_t EmitList(Lowering* lowering, uint64_t start) {
+  MkFlatAst* flat = lowering->flat;
+  uint64_t count = lowering->scratch.size - start;
+  uint64_t index = flat->extra.size;
+  if (index + count + 1 >= kMkFlatNone ||
+      !VEC_PUSH(&flat->extra, (uint32_t)count) ||
+      !VEC_APPEND(&flat->extra, &lowering->scratch.data[start], count)) {
+    lowering->failed = true;
+    lowering->scratch.size = start;
+    return kMkFlatNone;
+  }
+  lowering->scratch.size = start;
+  return (uint32_t)index;
+}
+
+uint32_t LowerStatements(Lowering* lowering,
+                         const MkAstStatements* statements) {
+  uint64_t start = lowering->scratch.size;
+  for (uint64_t i = 0; i < statements->size; ++i) {
+    uint32_t stmt = LowerStatement(lowering, statements->data[i]);
+    if (!VEC_PUSH(&lowering->scratch, stmt)) {
+      lowering->failed = true;
+    }
+  }
+  return EmitList(lowering, start);
+}
+
+uint32_t LowerStatement(Lowering* lowering, const MkAstStatement* stmt) {
+  switch (stmt->type) {
+    case kMkAstStatementLet: {
+      const MkAstLetStatement* let_stmt = (const MkAstLetStatement*)stmt;
+      uint32_t name = LowerIdentifier(lowering, &let_stmt->name);
+      uint32_t value = LowerExpression(lowering, let_stmt->value);
+      return Emit(lowering, kMkFlatLet, let_stmt->token, name, value);
+    }
+    case kMkAstStatementReturn: {
+      const MkAstReturnStatement* return_stmt =
+          (const MkAstReturnStatement*)stmt;
+      uint32_t value = LowerExpression(lowering, return_stmt->return_value);
+      return Emit(lowering, kMkFlatReturn, return_stmt->token, value, 0);
+    }
+    case kMkAstStatementExpression: {
+      const MkAstExpressionStatement* expr_stmt =
+          (const MkAstExpressionStatement*)stmt;
+      uint32_t value = LowerExpression(lowering, expr_stmt->expression);
+      return Emit(lowering, kMkFlatExpression, expr_stmt->token, value, 0);
+    }
+    case kMkAstStatementBlock: {
+      const MkAstBlockStatement* block = (const MkAstBlockStatement*)stmt;
+      uint32_t statements = LowerStatements(lowering, &block->statements);
+      return Emit(lowering, kMkFlatBlock, block->token, statements, 0);
+    }
+  }
+  lowering->failed = true;
+  return kMkFlatNone;
+}
+
+uint32_t LowerExpression(Lowering* lowering, const MkAstExpression* expr) {
+  // Only a program with parse errors has holes; lowering one is refused.
+  if (expr == NULL) {
+    lowering->failed = true;
+    return kMkFlatNone;
+  }
+  switch (expr->type) {
+    case kMkAstExpressionIdentifier:
+      return LowerIdentifier(lowering, (const MkAstIdentifier*)expr);
+    case kMkAstExpressionIntegerLiteral: {
+      const MkAstIntegerLiteral* integer = (const MkAstIntegerLiteral*)expr;
+      uint64_t value = (uint64_t)integer->value;
+      return Emit(lowering, kMkFlatIntegerLiteral, integer->token,
+                  (uint32_t)value, (uint32_t)(value >> 32));
+    }
+    case kMkAstExpressionBoolean: {
+      const MkAstBoolean* boolean = (const MkAstBoolean*)expr;
+      return Emit(lowering, kMkFlatBoolean, boolean->token, boolean->value,
+                  0);
+    }
+    case kMkAstExpressionPrefix: {
+      const MkAstPrefixExpression* prefix =
+          (const MkAstPrefixExpression*)expr;
+      uint32_t right = LowerExpression(lowering, prefix->right);
+      return Emit(lowering, kMkFlatPrefix, prefix->token, right, 0);
+    }
+    case kMkAstExpressionInfix: {
+      const MkAstInfixExpression* infix = (const MkAstInfixExpression*)expr;
+      uint32_t left = LowerExpression(lowering, infix->left);
+      uint32_t right = LowerExpression(lowering, infix->right);
+      return Emit(lowering, kMkFlatInfix, infix->token, left, right);
+    }
+    case kMkAstExpressionIf: {
+      const MkAstIfExpression* if_expr = (const MkAstIfExpression*)expr;
+      uint32_t condition = LowerExpression(lowering, if_expr->condition);
+      uint64_t start = lowering->scratch.size;
+      uint32_t consequence =
+          LowerStatement(lowering, &if_expr->consequence->base);
+      uint32_t alternative =
+          if_expr->alternative != NULL
+              ? LowerStatement(lowering, &if_expr->alternative->base)
+              : kMkFlatNone;
+      // The pair is stored like a two-element list, minus the count.
+      if (!VEC_PUSH(&lowering->scratch, consequence) ||
+          !VEC_PUSH(&lowering->scratch, alternative)) {
+        lowering->failed = true;
+      }
+      uint32_t branches = EmitList(lowering, start);
+      return Emit(lowering, kMkFlatIf, if_expr->token, condition,
+                  branches == kMkFlatNone ? kMkFlatNone : branches + 1);
+    }
+    case kMkAstExpressionFunctionLiteral: {
+      const MkAstFunctionLiteral* function =
+          (const MkAstFunctionLiteral*)expr;
+      uint64_t start = lowering->scratch.size;
+      for (uint64_t i = 0; i < function->parameters.size; ++i) {
+        uint32_t parameter =
+            LowerIdentifier(lowering, function->parameters.data[i]);
+        if (!VEC_PUSH(&lowering->scratch, parameter)) {
+          lowering->failed = true;
+        }
+      }
+      uint32_t parameters = EmitList(lowering, start);
+      uint32_t body = LowerStatement(lowering, &function->body->base);
+      return Emit(lowering, kMkFlatFunctionLiteral, function->token,
+                  parameters, body);
+    }
+    case kMkAstExpressionCall: {
+      const MkAstCallExpression* call = (const MkAstCallExpression*)expr;
+      uint32_t callee = LowerExpression(lowering, call->function);
+      uint64_t start = lowering->scratch.size;
+      for (uint64_t i = 0; i < call->arguments.size; ++i) {
+        uint32_t argument = LowerExpression(lowering, call->arguments.data[i]);
+        if (!VEC_PUSH(&lowering->scratch, argument)) {
+          lowering->failed = true;
+        }
+      }
+      uint32_t arguments = EmitList(lowering, start);
+      return Emit(lowering, kMkFlatCall, call->token, callee, arguments);
+    }
+  }
+  lowering->failed = true;
+  return kMkFlatNone;
+}
+
+uint32_t LowerIdentifier(Lowering* lowering,
+                         const MkAstIdentifier* identifier) {
+  return Emit(lowering, kMkFlatIdentifier, identifier->token, 0, 0);
+}
+
+// Allocates the node for flat node `index` and links in its children. Fails
+// when out of memory or on a child of the wrong kind.
+void* BuildNode(Building* building, uint32_t index) {
+  MkFlatNode node = building->flat->nodes.data[index];
+  Arena* arena = building->arena;
+  switch ((MkFlatNodeKind)node.kind) {
+    case kMkFlatLet: {
+      MkAstLetStatement* let_stmt = ARENA_NEW(arena, MkAstLetStatement);
+      MkAstIdentifier* name = BuiltIdentifier(building, node.a);
+      if (let_stmt == NULL || name == NULL) {
+        return NULL;
+      }
+      let_stmt->base = (MkAstStatement){.base = {kMkAstNodeStatement},
+                                        .type = kMkAstStatementLet};
+      let_stmt->token = BuildToken(building, index);
+      let_stmt->name = *name;
+      let_stmt->value = BuiltExpression(building, node.b);
+      return let_stmt->value != NULL ? let_stmt : NULL;
+    }
+    case kMkFlatReturn: {
+      MkAstReturnStatement* return_stmt =
+          ARENA_NEW(arena, MkAstReturnStatement);
+      if (return_stmt == NULL) {
+        return NULL;
+      }
+      return_stmt->base = (MkAstStatement){.base = {kMkAstNodeStatement},
+                                           .type = kMkAstStatementReturn};
+      return_stmt->token = BuildToken(building, index);
+      return_stmt->return_value = BuiltExpression(building, node.a);
+      return return_stmt->return_value != NULL ? return_stmt : NULL;
+    }
+    case kMkFlatExpression: {
+      MkAstExpressionStatement* expr_stmt =
+          ARENA_NEW(arena, MkAstExpressionStatement);
+      if (expr_stmt == NULL) {
+        return NULL;
+      }
+      expr_stmt->base = (MkAstStatement){.base = {kMkAstNodeStatement},
+                                         .type = kMkAstStatementExpression};
+      expr_stmt->token = BuildToken(building, index);
+      expr_stmt->expression = BuiltExpression(building, node.a);
+      return expr_stmt->expression != NULL ? expr_stmt : NULL;
+    }
+    case kMkFlatBlock: {
+      MkAstBlockStatement* block = ARENA_NEW(arena, MkAstBlockStatement);
+      if (block == NULL) {
+        return NULL;
+      }
+      block->base = (MkAstStatement){.base = {kMkAstNodeStatement},
+                                     .type = kMkAstStatementBlock};
+      block->token = BuildToken(building, index);
+      return BuildStatements(building, node.a, &block->statements) ? block
+                                                                    : NULL;
+    }
+    case kMkFlatIdentifier: {
+      MkAstIdentifier* identifier = ARENA_NEW(arena, MkAstIdentifier);
+      if (identifier == NULL) {
+        return NULL;
+      }
+      identifier->base = (MkAstExpression){.base = {kMkAstNodeExpression},
+                                           .type = kMkAstExpressionIdentifier};
+      identifier->token = BuildToken(building, index);
+      identifier->symbol =
+          MkInternerIntern(building->symbols, identifier->token.literal);
+      identifier->depth = kMkAstUnresolved;
+      return identifier;
+    }
+    case kMkFlatIntegerLiteral: {
+      MkAstIntegerLiteral* integer = ARENA_NEW(arena, MkAstIntegerLiteral);
+      if (integer == NULL) {
+        return NULL;
+      }
+      integer->base =
+          (MkAstExpression){.base = {kMkAstNodeExpression},
+                            .type = kMkAstExpressionIntegerLiteral};
+      integer->token = BuildToken(building, index);
+      integer->value = MkFlatIntegerValue(node);
+      return integer;
+    }
+    case kMkFlatBoolean: {
+      MkAstBoolean* boolean = ARENA_NEW(arena, MkAstBoolean);
+      if (boolean == NULL) {
+        return NULL;
+      }
+      boolean->base = (MkAstExpression){.base = {kMkAstNodeExpression},
+                                        .type = kMkAstExpressionBoolean};
+      boolean->token = BuildToken(building, index);
+      boolean->value = node.a != 0;
+      return boolean;
+    }
+    case kMkFlatPrefix: {
+      MkAstPrefixExpression* prefix = ARENA_NEW(arena, MkAstPrefixExpression);
+      if (prefix == NULL) {
+        return NULL;
+      }
+      prefix->base = (MkAstExpression){.base = {kMkAstNodeExpression},
+                                       .type = kMkAstExpressionPrefix};
+      prefix->token = BuildToken(building, index);
+      prefix->right = BuiltExpression(building, node.a);
+      return prefix->right != NULL ? prefix : NULL;
+    }
+    case kMkFlatInfix: {
+      MkAstInfixExpression* infix = ARENA_NEW(arena, MkAstInfixExpression);
+      if (infix == NULL) {
+        return NULL;
+      }
+      infix->base = (MkAstExpression){.base = {kMkAstNodeExpression},
+                                      .type = kMkAstExpressionInfix};
+      infix->token = BuildToken(building, index);
+      infix->left = BuiltExpression(building, node.a);
+      infix->right = BuiltExpression(building, node.b);
+      return infix->left != NULL && infix->right != NULL ? infix : NULL;
+    }
+    case kMkFlatIf: {
+      MkAstIfExpression* if_expr = ARENA_NEW(arena, MkAstIfExpression);
+      if (if_expr == NULL) {
+        return NULL;
+      }
+      const uint32_t* branches = &building->flat->extra.data[node.b];
+      if_expr->base = (MkAstExpression){.base = {kMkAstNodeExpression},
+                                        .type = kMkAstExpressionIf};
+      if_expr->token = BuildToken(building, index);
+      if_expr->condition = BuiltExpression(building, node.a);
+      if_expr->consequence = BuiltBlock(building, branches[0]);
+      if (branches[1] != kMkFlatNone) {
+        if_expr->alternative = BuiltBlock(building, branches[1]);
+        if (if_expr->alternative == NULL) {
+          return NULL;
+        }
+      }
+      return if_expr->condition != NULL && if_expr->consequence != NULL
+                 ? if_expr
+                 : NULL;
+    }
+    case kMkFlatFunctionLiteral: {
+      MkAstFunctionLiteral* function = ARENA_NEW(arena, MkAstFunctionLiteral);
+      if (function == NULL) {
+        return NULL;
+      }
+      const uint32_t* list = &building->flat->extra.data[node.a];
+      function->base =
+          (MkAstExpression){.base = {kMkAstNodeExpression},
+                            .type = kMkAstExpressionFunctionLiteral};
+      function->token = BuildToken(building, index);
+      if (list[0] > 0) {
+        function->parameters.data =
+            ARENA_NEW_ARRAY(arena, MkAstIdentifier*, list[0]);
+        if (function->parameters.data == NULL) {
+          return NULL;
+        }
+      }
+      for (uint32_t i = 1; i <= list[0]; ++i) {
+        MkAstIdentifier* parameter = BuiltIdentifier(building, list[i]);
+        if (parameter == NULL) {
+          return NULL;
+        }
+        function->parameters.data[function->parameters.size++] = parameter;
+      }
+      function->parameters.capacity = function->parameters.size;
+      function->body = BuiltBlock(building, node.b);
+      return function->body != NULL ? function : NULL;
+    }
+    case kMkFlatCall: {
+      MkAstCallExpression* call = ARENA_NEW(arena, MkAstCallExpression);
+      if (call == NULL) {
+        return NULL;
+      }
+      const uint32_t* list = &building->flat->extra.data[node.b];
+      call->base = (MkAstExpression){.base = {kMkAstNodeExpression},
+                                     .type = kMkAstExpressionCall};
+      call->token = BuildToken(building, index);
+      call->function = BuiltExpression(building, node.a);
+      if (call->function == NULL) {
+        return NULL;
+      }
+      if (list[0] > 0) {
+        call->arguments.data =
+            ARENA_NEW_ARRAY(arena, MkAstExpression*, list[0]);
+        if (call->arguments.data == NULL) {
+          return NULL;
+        }
+      }
+      for (uint32_t i = 1; i <= list[0]; ++i) {
+        MkAstExpression* argument = BuiltExpression(building, list[i]);
+        if (argument == NULL) {
+          return NULL;
+        }
+        call->arguments.data[call->arguments.size++] = argument;
+      }
+      call->arguments.capacity = call->arguments.size;
+      return call;
+    }
+    case kMkFlatProgram:
+    case kMkFlatNodeKindCount:
+      break;
+  }
+  return NULL;
+}
+
+// Records the height of built node `index`, counting expressions only, as
+// the parser does. Fails past kMkAstMaxHeight, which the parser would not
+// have built.
+bool MeasureNode(Building* building, uint32_t index) {
+  const MkFlatAst* flat = building->flat;
+  const uint32_t* heights = building->heights;
+  MkFlatNode node = flat->nodes.data[index];
+  uint32_t children[3] = {kMkFlatNone, kMkFlatNone, kMkFlatNone};
+  uint32_t list = kMkFlatNone;
+  bool expression = true;
+  switch ((MkFlatNodeKind)node.kind) {
+    case kMkFlatLet:
+      expression = false;
+      children[0] = node.a;
+      children[1] = node.b;
+      break;
+    case kMkFlatReturn:
+    case kMkFlatExpression:
+      expression = false;
+      children[0] = node.a;
+      break;
+    case kMkFlatBlock:
+      expression = false;
+      list = node.a;
+      break;
+    case kMkFlatPrefix:
+      children[0] = node.a;
+      break;
+    case kMkFlatInfix:
+      children[0] = node.a;
+      children[1] = node.b;
+      break;
+    case kMkFlatIf:
+      children[0] = node.a;
+      children[1] = flat->extra.data[node.b];
+      children[2] = flat->extra.data[node.b + 1];
+      break;
+    case kMkFlatFunctionLiteral:
+      children[0] = node.b;
+      list = node.a;
+      break;
+    case kMkFlatCall:
+      children[0] = node.a;
+      list = node.b;
+      break;
+    default:
+      break;
+  }
+  uint32_t height = 0;
+  for (int i = 0; i < 3; ++i) {
+    if (children[i] != kMkFlatNone && heights[children[i]] > height) {
+      height = heights[children[i]];
+    }
+  }
+  if (list != kMkFlatNone) {
+    const uint32_t* items = &flat->extra.data[list];
+    for (uint32_t i = 1; i <= items[0]; ++i) {
+      if (heights[items[i]] > height) {
+        height = heights[items[i]];
+      }
+    }
+  }
+  building->heights[index] = height + (expression ? 1 : 0);
+  return building->heights[index] <= kMkAstMaxHeight;
+}
+
+MkToken BuildToken(const Building* building, uint32_t node) {
+  const MkTokenBuffer* tokens = building->tokens;
+  uint32_t token = building->flat->nodes.data[node].token;
+  const char* begin = building->source.begin + tokens->offsets[token];
+  return (MkToken){
+      .type = (MkTokenType)tokens->kinds[token],
+      .offset = tokens->offsets[token],
+      .literal = {.begin = begin, .end = begin + tokens->lengths[token]},
+  };
+}
+
+bool BuildStatements(Building* building,
+                     uint32_t list,
+                     MkAstStatements* statements) {
+  const uint32_t* items = &building->flat->extra.data[list];
+  *statements = (MkAstStatements){0};
+  if (items[0] == 0) {
+    return true;
+  }
+  statements->data =
+      ARENA_NEW_ARRAY(building->arena, MkAstStatement*, items[0]);
+  if (statements->data == NULL) {
+    return false;
+  }
+  for (uint32_t i = 1; i <= items[0]; ++i) {
+    MkAstStatement* stmt = BuiltStatement(building, items[i]);
+    if (stmt == NULL) {
+      return false;
+    }
+    statements->data[statements->size++] = stmt;
+  }
+  statements->capacity = statements->size;
+  return true;
+}
+
+// The built node of flat node `node` if it is a statement, and NULL if not.
+// The other Built functions do the same for their kinds.
+MkAstStatement* BuiltStatement(const Building* building, uint32_t node) {
+  switch ((MkFlatNodeKind)building->flat->nodes.data[node].kind) {
+    case kMkFlatLet:
+    case kMkFlatReturn:
+    case kMkFlatExpression:
+    case kMkFlatBlock:
+      return building->built[node];
+    default:
+      return NULL;
+  }
+}
+
+MkAstExpression* BuiltExpression(const Building* building, uint32_t node) {
+  switch ((MkFlatNodeKind)building->flat->nodes.data[node].kind) {
+    case kMkFlatIdentifier:
+    case kMkFlatIntegerLiteral:
+    case kMkFlatBoolean:
+    case kMkFlatPrefix:
+    case kMkFlatInfix:
+    case kMkFlatIf:
+    case kMkFlatFunctionLiteral:
+    case kMkFlatCall:
+      return building->built[node];
+    default:
+      return NULL;
+  }
+}
+
+MkAstBlockStatement* BuiltBlock(const Building* building, uint32_t node) {
+  return building->flat->nodes.data[node].kind == kMkFlatBlock
+             ? building->built[node]
+             : NULL;
+}
+
+MkAstIdentifier* BuiltIdentifier(const Building* building, uint32_t node) {
+  return building->flat->nodes.data[node].kind == kMkFlatIdentifier
+             ? building->built[node]
+             : NULL;
+}
+
+void WriteNode(String* out,
+               const MkFlatAst* flat,
+               const MkTokenBuffer* tokens,
+               StringView source,
+               uint32_t node) {
+  MkFlatNode n = flat->nodes.data[node];
+  switch ((MkFlatNodeKind)n.kind) {
+    case kMkFlatProgram:
+    case kMkFlatBlock:
+      WriteList(out, flat, tokens, source, n.a, "");
+      break;
+    case kMkFlatLet:
+      WriteToken(out, tokens, source, n.token);
+      WriteC(out, " ");
+      WriteNode(out, flat, tokens, source, n.a);
+      WriteC(out, " = ");
+      WriteNode(out, flat, tokens, source, n.b);
+      WriteC(out, ";");
+      break;
+    case kMkFlatReturn:
+      WriteToken(out, tokens, source, n.token);
+      WriteC(out, " ");
+      WriteNode(out, flat, tokens, source, n.a);
+      WriteC(out, ";");
+      break;
+    case kMkFlatExpression:
+      WriteNode(out, flat, tokens, source, n.a);
+      break;
+    case kMkFlatIdentifier:
+    case kMkFlatIntegerLiteral:
+    case kMkFlatBoolean:
+      WriteToken(out, tokens, source, n.token);
+      break;
+    case kMkFlatPrefix:
+      WriteC(out, "(");
+      WriteToken(out, tokens, source, n.token);
+      WriteNode(out, flat, tokens, source, n.a);
+      WriteC(out, ")");
+      break;
+    case kMkFlatInfix:
+      WriteC(out, "(");
+      WriteNode(out, flat, tokens, source, n.a);
+      WriteC(out, " ");
+      WriteToken(out, tokens, source, n.token);
+      WriteC(out, " ");
+      WriteNode(out, flat, tokens, source, n.b);
+      WriteC(out, ")");
+      break;
+    case kMkFlatIf: {
+      uint32_t alternative = flat->extra.data[n.b + 1];
+      WriteC(out, "if");
+      WriteNode(out, flat, tokens, source, n.a);
+      WriteC(out, " ");
+      WriteNode(out, flat, tokens, source, flat->extra.data[n.b]);
+      if (alternative != kMkFlatNone) {
+        WriteC(out, "else ");
+        WriteNode(out, flat, tokens, source, alternative);
+      }
+    } break;
+    case kMkFlatFunctionLiteral:
+      WriteToken(out, tokens, source, n.token);
+      WriteC(out, "(");
+      WriteList(out, flat, tokens, source, n.a, ", ");
+      WriteC(out, ") ");
+      WriteNode(out, flat, tokens, source, n.b);
+      break;
+    case kMkFlatCall:
+      WriteNode(out, flat, tokens, source, n.a);
+      WriteC(out, "(");
+      WriteList(out, flat, tokens, source, n.b, ", ");
+      WriteC(out, ")");
+      break;
+    case kMkFlatNodeKindCount:
+      break;
+  }
+}
+
+void WriteList(String* out,
+               const MkFlatAst* flat,
+               const MkTokenBuffer* tokens,
+               StringView source,
+               uint32_t list,
+               const char* separator) {
+  const uint32_t* items = &flat->extra.data[list];
+  for (uint32_t i = 1; i <= items[0]; ++i) {
+    if (i > 1) {
+      WriteC(out, separator);
+    }
+    WriteNode(out, flat, tokens, source, items[i]);
+  }
+}
+
+void WriteToken(String* out,
+                const MkTokenBuffer* tokens,
+                StringView source,
+                uint32_t token) {
+  VEC_APPEND(out, source.begin + tokens->offsets[token],
+             tokens->lengths[token]);
+}
+
+void WriteC(String* out, const char* cstr) {
+  VEC_APPEND(out, cstr, strlen(cstr));
+}
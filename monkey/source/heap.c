@@ -0,0 +1,348 @@
+#include "monkey/heap.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vec/vec.h>
+
+#include "monkey/ast.h"
+#include "monkey/value.h"
+
+static MkObject* Allocate(MkHeap* heap, uint64_t size, MkObjectKind kind);
+static MkObject* AllocateCell(MkHeap* heap, uint64_t size_class);
+static void StartCollection(MkHeap* heap);
+static bool Mark(MkHeap* heap, uint64_t* budget);
+static bool Sweep(MkHeap* heap, uint64_t* budget);
+static uint64_t Trace(MkHeap* heap, MkObject* object);
+static void TraceAll(MkHeap* heap);
+static void RecordPause(MkHeap* heap, double start);
+static double Now(void);
+
+MkEnvironment* MkHeapNewEnvironment(MkHeap* heap,
+                                    MkEnvironment* parent,
+                                    const MkAstScope* scope) {
+  MkEnvironment* environment = (MkEnvironment*)Allocate(
+      heap, sizeof(MkEnvironment) + scope->size * sizeof(MkValue),
+      kMkObjectEnvironment);
+  if (environment == NULL) {
+    return NULL;
+  }
+  // A new object is already marked if a collection is marking, so what it
+  // points to is marked too.
+  MK_HEAP_WRITE_BARRIER(heap, MK_OBJECT(parent));
+  environment->parent = parent;
+  environment->scope = scope;
+  environment->slots = (MkValue*)(environment + 1);
+  for (uint32_t i = 0; i < scope->size; ++i) {
+    environment->slots[i] = MK_UNSET;
+  }
+  return environment;
+}
+
+MkClosure* MkHeapNewClosure(MkHeap* heap,
+                            const MkAstFunctionLiteral* function,
+                            const struct MkFunctionCode* code,
+                            MkEnvironment* environment) {
+  MkClosure* closure =
+      (MkClosure*)Allocate(heap, sizeof(MkClosure), kMkObjectClosure);
+  if (closure == NULL) {
+    return NULL;
+  }
+  MK_HEAP_WRITE_BARRIER(heap, MK_OBJECT(environment));
+  closure->function = function;
+  closure->code = code;
+  closure->environment = environment;
+  return closure;
+}
+
+MkValue MkHeapInteger(MkHeap* heap, int64_t value) {
+  if (MK_FITS_SMALL_INTEGER(value)) {
+    return MK_SMALL_INTEGER(value);
+  }
+  MkInteger* integer =
+      (MkInteger*)Allocate(heap, sizeof(MkInteger), kMkObjectInteger);
+  if (integer == NULL) {
+    return MK_UNSET;
+  }
+  integer->value = value;
+  return MK_OBJECT(integer);
+}
+
+void MkHeapMarkValue(MkHeap* heap, MkValue value) {
+  if (MK_IS_OBJECT(value)) {
+    MkHeapMarkObject(heap, MK_AS_OBJECT(value));
+  }
+}
+
+void MkHeapMarkObject(MkHeap* heap, MkObject* object) {
+  if (object == NULL || object->marked) {
+    return;
+  }
+  object->marked = true;
+  if (object->kind != kMkObjectInteger && !VEC_PUSH(&heap->gray, object)) {
+    heap->gray_overflowed = true;
+  }
+}
+
+void MkHeapCollect(MkHeap* heap) {
+  if (heap->mark_roots == NULL) {
+    return;
+  }
+  double start = Now();
+  uint64_t budget = UINT64_MAX;
+  // A sweep under way has already marked everything it keeps; marking again
+  // would skip what it has not unmarked yet, and not trace it.
+  if (heap->phase == kMkHeapMarking) {
+    Mark(heap, &budget);
+  }
+  if (heap->phase == kMkHeapSweeping) {
+    Sweep(heap, &budget);
+  }
+  StartCollection(heap);
+  Mark(heap, &budget);
+  Sweep(heap, &budget);
+  RecordPause(heap, start);
+}
+
+void MkHeapFree(MkHeap* heap) {
+  // Pooled objects go with their chunks.
+  MkObject* object = heap->objects;
+  while (object != NULL) {
+    MkObject* next = object->next;
+    if (object->size > kMkHeapSizeClasses * kMkHeapSizeClassStep) {
+      free(object);
+    }
+    object = next;
+  }
+  for (uint64_t i = 0; i < heap->chunks.size; ++i) {
+    free(heap->chunks.data[i]);
+  }
+  VEC_FREE(&heap->chunks);
+  VEC_FREE(&heap->gray);
+  VEC_FREE(&heap->pause_log);
+  *heap = (MkHeap){0};
+}
+
+// Starts a collection first if the heap is due one, or takes the next step
+// of an incremental one. `object_count` and `bytes` count the object from
+// here on.
+MkObject* Allocate(MkHeap* heap, uint64_t size, MkObjectKind kind) {
+  if (heap->threshold == 0) {
+    heap->threshold = heap->initial_bytes > 0 ? heap->initial_bytes
+                                              : kMkHeapDefaultInitialBytes;
+  }
+  if (heap->phase != kMkHeapIdle) {
+    uint64_t step_bytes =
+        heap->step_bytes > 0 ? heap->step_bytes : kMkHeapDefaultStepBytes;
+    heap->unstepped_bytes += size;
+    if (heap->unstepped_bytes >= step_bytes) {
+      double start = Now();
+      uint64_t budget = heap->unstepped_bytes * kMkHeapWorkPerByte;
+      heap->unstepped_bytes = 0;
+      if (heap->phase == kMkHeapMarking) {
+        Mark(heap, &budget);
+      }
+      if (heap->phase == kMkHeapSweeping) {
+        Sweep(heap, &budget);
+      }
+      RecordPause(heap, start);
+    }
+  } else if (heap->mark_roots != NULL &&
+             heap->bytes + size > heap->threshold) {
+    if (heap->mode == kMkHeapIncremental) {
+      double start = Now();
+      StartCollection(heap);
+      RecordPause(heap, start);
+    } else {
+      MkHeapCollect(heap);
+    }
+  }
+
+  uint64_t size_class = (size - 1) / kMkHeapSizeClassStep;
+  MkObject* object;
+  if (size_class < kMkHeapSizeClasses) {
+    size = (size_class + 1) * kMkHeapSizeClassStep;
+    object = AllocateCell(heap, size_class);
+  } else if (size <= UINT32_MAX) {
+    object = malloc(size);
+  } else {
+    object = NULL;
+  }
+  if (object == NULL) {
+    return NULL;
+  }
+  // Objects made while marking are not traced, so they are made marked; the
+  // others are made unmarked, and in front of where a sweep has got to.
+  *object = (MkObject){
+      .next = heap->objects,
+      .size = (uint32_t)size,
+      .kind = (uint8_t)kind,
+      .marked = heap->phase == kMkHeapMarking,
+  };
+  if (heap->sweep_link == &heap->objects) {
+    heap->sweep_link = &object->next;
+  }
+  heap->objects = object;
+  ++heap->object_count;
+  heap->bytes += size;
+  ++heap->stats.allocations;
+  return object;
+}
+
+// A cell off the free list of `size_class`, or else the next one carved from
+// the current chunk. What is left of a chunk too small for the cell is not
+// used.
+MkObject* AllocateCell(MkHeap* heap, uint64_t size_class) {
+  MkObject* cell = heap->free_lists[size_class];
+  if (cell != NULL) {
+    heap->free_lists[size_class] = cell->next;
+    return cell;
+  }
+  uint64_t size = (size_class + 1) * kMkHeapSizeClassStep;
+  if ((uint64_t)(heap->limit - heap->cursor) < size) {
+    uint8_t* chunk = malloc(kMkHeapChunkSize);
+    if (chunk == NULL || !VEC_PUSH(&heap->chunks, chunk)) {
+      free(chunk);
+      return NULL;
+    }
+    heap->cursor = chunk;
+    heap->limit = chunk + kMkHeapChunkSize;
+  }
+  cell = (MkObject*)heap->cursor;
+  heap->cursor += size;
+  return cell;
+}
+
+void StartCollection(MkHeap* heap) {
+  heap->phase = kMkHeapMarking;
+  heap->unstepped_bytes = 0;
+  heap->gray_overflowed = false;
+  heap->mark_roots(heap, heap->roots);
+}
+
+// Traces marked objects until `budget` bytes of them are done or none is
+// left. Then the roots, which change without barriers, are marked again and
+// what they lead to traced in one go, and sweeping starts. Returns whether
+// it got that far.
+bool Mark(MkHeap* heap, uint64_t* budget) {
+  while (heap->gray.size > 0) {
+    if (*budget == 0) {
+      return false;
+    }
+    uint64_t work = Trace(heap, VEC_POP(&heap->gray));
+    *budget = work < *budget ? *budget - work : 0;
+  }
+  heap->mark_roots(heap, heap->roots);
+  TraceAll(heap);
+  heap->phase = kMkHeapSweeping;
+  heap->sweep_link = &heap->objects;
+  return true;
+}
+
+// Frees unmarked objects, and unmarks the others for the next collection,
+// until `budget` bytes of them are done or the sweep reaches the end of the
+// heap. There the collection ends. Returns whether it did.
+bool Sweep(MkHeap* heap, uint64_t* budget) {
+  MkObject** link = heap->sweep_link;
+  while (*link != NULL) {
+    if (*budget == 0) {
+      heap->sweep_link = link;
+      return false;
+    }
+    MkObject* object = *link;
+    *budget = object->size < *budget ? *budget - object->size : 0;
+    if (object->marked) {
+      object->marked = false;
+      link = &object->next;
+      continue;
+    }
+    *link = object->next;
+    --heap->object_count;
+    heap->bytes -= object->size;
+    ++heap->stats.objects_freed;
+    heap->stats.bytes_freed += object->size;
+    uint64_t size_class = (object->size - 1) / kMkHeapSizeClassStep;
+    if (size_class < kMkHeapSizeClasses) {
+      object->next = heap->free_lists[size_class];
+      heap->free_lists[size_class] = object;
+    } else {
+      free(object);
+    }
+  }
+  heap->phase = kMkHeapIdle;
+  heap->sweep_link = NULL;
+  ++heap->stats.collections;
+
+  uint64_t initial_bytes = heap->initial_bytes > 0
+                               ? heap->initial_bytes
+                               : kMkHeapDefaultInitialBytes;
+  double growth_factor = heap->growth_factor > 0 ? heap->growth_factor
+                                                 : kMkHeapDefaultGrowthFactor;
+  heap->threshold = (uint64_t)((double)heap->bytes * growth_factor);
+  if (heap->threshold < initial_bytes) {
+    heap->threshold = initial_bytes;
+  }
+  return true;
+}
+
+// Marks the objects `object` refers to. Returns the bytes it took.
+uint64_t Trace(MkHeap* heap, MkObject* object) {
+  switch ((MkObjectKind)object->kind) {
+    case kMkObjectEnvironment: {
+      MkEnvironment* environment = (MkEnvironment*)object;
+      MkHeapMarkObject(heap, (MkObject*)environment->parent);
+      for (uint32_t i = 0; i < environment->scope->size; ++i) {
+        MkHeapMarkValue(heap, environment->slots[i]);
+      }
+      break;
+    }
+    case kMkObjectClosure:
+      MkHeapMarkObject(heap, (MkObject*)((MkClosure*)object)->environment);
+      break;
+    case kMkObjectInteger:
+      break;
+  }
+  return object->size;
+}
+
+// Traces until nothing marked is left untraced. An object marked while the
+// gray stack could not grow still has children to mark, so then every marked
+// object is traced again.
+void TraceAll(MkHeap* heap) {
+  for (;;) {
+    while (heap->gray.size > 0) {
+      Trace(heap, VEC_POP(&heap->gray));
+    }
+    if (!heap->gray_overflowed) {
+      return;
+    }
+    heap->gray_overflowed = false;
+    for (MkObject* object = heap->objects; object != NULL;
+         object = object->next) {
+      if (object->marked) {
+        Trace(heap, object);
+      }
+    }
+  }
+}
+
+void RecordPause(MkHeap* heap, double start) {
+  double pause = Now() - start;
+  MkHeapStats* stats = &heap->stats;
+  ++stats->pauses;
+  stats->pause_seconds += pause;
+  if (pause > stats->max_pause_seconds) {
+    stats->max_pause_seconds = pause;
+  }
+  if (heap->record_pauses) {
+    // A pause that cannot be logged is still counted.
+    (void)VEC_PUSH(&heap->pause_log, pause);
+  }
+}
+
+double Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,177 @@
+#include "monkey/intern.h"
+
+#include <hash/hash.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string/string.h>
+#include <vec/vec.h>
+
+// As in the hash library: a table starts with 16 slots and doubles once more
+// than 0xBF/0x100 of them are full.
+enum { kInitialCapacity = 16, kMaxLoad = 0xBF };
+
+static MkInterner global_interner = {0};
+
+static uint32_t Insert(MkInterner* interner,
+                       StringView name,
+                       uint32_t hash,
+                       bool* hit);
+static uint64_t FindSlot(const MkInterner* interner,
+                         StringView name,
+                         uint32_t hash);
+static uint32_t Add(MkInterner* interner,
+                    StringView name,
+                    uint32_t hash,
+                    uint64_t slot);
+static bool Grow(MkInterner* interner);
+
+void MkInternerInit(MkInterner* interner) {
+  *interner = (MkInterner){0};
+}
+
+MkInterner* MkInternerGlobal(void) {
+  return &global_interner;
+}
+
+uint32_t MkInternerIntern(MkInterner* interner, StringView name) {
+  uint64_t size = (uint64_t)(name.end - name.begin);
+  bool hit;
+  uint32_t symbol =
+      Insert(interner, name, (uint32_t)HashFnv1a(name.begin, size), &hit);
+  ++interner->lookups;
+  if (hit) {
+    ++interner->hits;
+    interner->hit_bytes += size;
+  }
+  return symbol;
+}
+
+void MkInternerMerge(MkInterner* interner,
+                     const MkInterner* from,
+                     uint32_t* symbols) {
+  for (uint32_t i = 0; i < MkInternerCount(from); ++i) {
+    StringView name = MkInternerName(from, i);
+    bool hit;
+    symbols[i] = Insert(interner, name, from->hashes.data[i], &hit);
+    // The first lookup of the name in `from` was a miss there.
+    if (hit) {
+      ++interner->hits;
+      interner->hit_bytes += (uint64_t)(name.end - name.begin);
+    }
+  }
+  interner->lookups += from->lookups;
+  interner->hits += from->hits;
+  interner->hit_bytes += from->hit_bytes;
+}
+
+uint32_t MkInternerCount(const MkInterner* interner) {
+  return (uint32_t)interner->hashes.size;
+}
+
+StringView MkInternerName(const MkInterner* interner, uint32_t symbol) {
+  const char* text = interner->text.data;
+  return (StringView){.begin = text + interner->starts.data[symbol],
+                      .end = text + interner->starts.data[symbol + 1]};
+}
+
+void MkInternerFree(MkInterner* interner) {
+  free(interner->slots);
+  interner->slots = NULL;
+  interner->capacity = 0;
+  VEC_FREE(&interner->text);
+  VEC_FREE(&interner->starts);
+  VEC_FREE(&interner->hashes);
+}
+
+// The symbol of `name`, added if it is new, with `hit` set if it was not.
+uint32_t Insert(MkInterner* interner,
+                StringView name,
+                uint32_t hash,
+                bool* hit) {
+  uint64_t slot = 0;
+  uint32_t symbol = kMkSymbolNone;
+  if (interner->capacity > 0) {
+    slot = FindSlot(interner, name, hash);
+    symbol = interner->slots[slot];
+  }
+  *hit = symbol != kMkSymbolNone;
+  return *hit ? symbol : Add(interner, name, hash, slot);
+}
+
+// The slot holding `name`, or the empty one it would be added in. The table
+// must have a slot.
+uint64_t FindSlot(const MkInterner* interner, StringView name, uint32_t hash) {
+  uint64_t size = (uint64_t)(name.end - name.begin);
+  uint64_t mask = interner->capacity - 1;
+  uint64_t slot = hash & mask;
+  for (;; slot = (slot + 1) & mask) {
+    uint32_t symbol = interner->slots[slot];
+    if (symbol == kMkSymbolNone) {
+      return slot;
+    }
+    if (interner->hashes.data[symbol] != hash) {
+      continue;
+    }
+    StringView existing = MkInternerName(interner, symbol);
+    if ((uint64_t)(existing.end - existing.begin) == size &&
+        memcmp(existing.begin, name.begin, size) == 0) {
+      return slot;
+    }
+  }
+}
+
+// Adds `name` in the empty slot `slot`, or wherever it goes once the table
+// has grown.
+uint32_t Add(MkInterner* interner,
+             StringView name,
+             uint32_t hash,
+             uint64_t slot) {
+  uint64_t size = (uint64_t)(name.end - name.begin);
+  uint32_t symbol = MkInternerCount(interner);
+  if (size == 0 || symbol == kMkSymbolNone - 1 ||
+      interner->text.size + size > UINT32_MAX ||
+      !VEC_RESERVE(&interner->starts, (uint64_t)symbol + 2) ||
+      !VEC_RESERVE(&interner->hashes, (uint64_t)symbol + 1) ||
+      !VEC_RESERVE(&interner->text, interner->text.size + size)) {
+    return kMkSymbolNone;
+  }
+  if (interner->capacity == 0 ||
+      (uint64_t)(symbol + 1) * 0x100 / interner->capacity > kMaxLoad) {
+    if (!Grow(interner)) {
+      return kMkSymbolNone;
+    }
+    slot = FindSlot(interner, name, hash);
+  }
+  if (interner->starts.size == 0) {
+    VEC_PUSH(&interner->starts, 0);
+  }
+  interner->slots[slot] = symbol;
+  VEC_PUSH(&interner->hashes, hash);
+  VEC_APPEND(&interner->text, name.begin, size);
+  VEC_PUSH(&interner->starts, (uint32_t)interner->text.size);
+  return symbol;
+}
+
+// Doubles the table, placing every name again by its stored hash.
+bool Grow(MkInterner* interner) {
+  uint64_t capacity =
+      interner->capacity > 0 ? interner->capacity * 2 : kInitialCapacity;
+  uint32_t* slots = malloc(capacity * sizeof(uint32_t));
+  if (slots == NULL) {
+    return false;
+  }
+  memset(slots, 0xFF, capacity * sizeof(uint32_t));
+  for (uint32_t symbol = 0; symbol < MkInternerCount(interner); ++symbol) {
+    uint64_t slot = interner->hashes.data[symbol] & (capacity - 1);
+    while (slots[slot] != kMkSymbolNone) {
+      slot = (slot + 1) & (capacity - 1);
+    }
+    slots[slot] = symbol;
+  }
+  free(interner->slots);
+  interner->slots = slots;
+  interner->capacity = capacity;
+  return true;
+}
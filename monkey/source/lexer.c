@@ -4,15 +4,19 @@
 #include <stdint.h>
 #include <string/string.h>
 
+#include "monkey/scan.h"
 #include "monkey/token.h"
 
+static uint64_t SourceSize(const MkLexer* lexer);
 static void ReadChar(MkLexer* lexer);
+static void SeekChar(MkLexer* lexer, uint64_t position);
 static char PeekChar(MkLexer* lexer);
-static String ReadIdentifier(MkLexer* lexer);
-static String ReadNumber(MkLexer* lexer);
+static StringView ReadIdentifier(MkLexer* lexer);
+static StringView ReadNumber(MkLexer* lexer);
 static void SkipWhitespace(MkLexer* lexer);
-static MkToken SingleCharToken(MkTokenType type, uint8_t literal);
-static MkToken TwoCharToken(MkTokenType type, uint8_t c1, uint8_t c2);
+static MkToken SingleCharToken(MkLexer* lexer, MkTokenType type);
+static MkToken TwoCharToken(MkLexer* lexer, MkTokenType type);
+static bool IsWhitespace(uint8_t ch);
 static bool IsLetter(uint8_t ch);
 static bool IsDigit(uint8_t ch);
 
@@ -29,81 +33,120 @@ MkToken MkLexerNextToken(MkLexer* lexer) {
   switch (lexer->ch) {
     case '=':
       if (PeekChar(lexer) == '=') {
-        tok = TwoCharToken(mk_token_eq, lexer->ch, PeekChar(lexer));
+        tok = TwoCharToken(lexer, kMkTokenEq);
         ReadChar(lexer);
       } else {
-        tok = SingleCharToken(mk_token_assign, lexer->ch);
+        tok = SingleCharToken(lexer, kMkTokenAssign);
       }
       break;
     case ';':
-      tok = SingleCharToken(mk_token_semicolon, lexer->ch);
+      tok = SingleCharToken(lexer, kMkTokenSemicolon);
       break;
     case '(':
-      tok = SingleCharToken(mk_token_lparen, lexer->ch);
+      tok = SingleCharToken(lexer, kMkTokenLparen);
       break;
     case ')':
-      tok = SingleCharToken(mk_token_rparen, lexer->ch);
+      tok = SingleCharToken(lexer, kMkTokenRparen);
       break;
     case ',':
-      tok = SingleCharToken(mk_token_comma, lexer->ch);
+      tok = SingleCharToken(lexer, kMkTokenComma);
       break;
     case '+':
-      tok = SingleCharToken(mk_token_plus, lexer->ch);
+      tok = SingleCharToken(lexer, kMkTokenPlus);
       break;
     case '{':
-      tok = SingleCharToken(mk_token_lbrace, lexer->ch);
+      tok = SingleCharToken(lexer, kMkTokenLbrace);
       break;
     case '}':
-      tok = SingleCharToken(mk_token_rbrace, lexer->ch);
+      tok = SingleCharToken(lexer, kMkTokenRbrace);
       break;
     case '-':
-      tok = SingleCharToken(mk_token_minus, lexer->ch);
+      tok = SingleCharToken(lexer, kMkTokenMinus);
       break;
     case '!':
       if (PeekChar(lexer) == '=') {
-        tok = TwoCharToken(mk_token_not_eq, lexer->ch, PeekChar(lexer));
+        tok = TwoCharToken(lexer, kMkTokenNotEq);
         ReadChar(lexer);
       } else {
-        tok = SingleCharToken(mk_token_bang, lexer->ch);
+        tok = SingleCharToken(lexer, kMkTokenBang);
       }
       break;
     case '*':
-      tok = SingleCharToken(mk_token_asterisk, lexer->ch);
+      tok = SingleCharToken(lexer, kMkTokenAsterisk);
       break;
     case '/':
-      tok = SingleCharToken(mk_token_slash, lexer->ch);
+      tok = SingleCharToken(lexer, kMkTokenSlash);
       break;
     case '<':
-      tok = SingleCharToken(mk_token_lt, lexer->ch);
+      tok = SingleCharToken(lexer, kMkTokenLt);
       break;
     case '>':
-      tok = SingleCharToken(mk_token_gt, lexer->ch);
-      break;
-    case '\0':
-      tok.type = mk_token_eof;
+      tok = SingleCharToken(lexer, kMkTokenGt);
       break;
+    case '\0': {
+      uint64_t end = lexer->position < SourceSize(lexer) ? lexer->position
+                                                         : SourceSize(lexer);
+      tok.type = kMkTokenEof;
+      tok.offset = (uint32_t)end;
+      tok.literal.begin = tok.literal.end = &lexer->source.begin[end];
+    } break;
     default:
       if (IsLetter(lexer->ch)) {
+        tok.offset = (uint32_t)lexer->position;
         tok.literal = ReadIdentifier(lexer);
-        tok.type = MkLookupIdent((StringView){
-            .begin = tok.literal.data,
-            .end = tok.literal.data + tok.literal.size,
-        });
+        tok.type = MkLookupIdent(tok.literal);
         return tok;
       } else if (IsDigit(lexer->ch)) {
+        tok.offset = (uint32_t)lexer->position;
         tok.literal = ReadNumber(lexer);
-        tok.type = mk_token_int;
+        tok.type = kMkTokenInt;
         return tok;
       } else {
-        tok = SingleCharToken(mk_token_illegal, lexer->ch);
+        tok = SingleCharToken(lexer, kMkTokenIllegal);
       }
   }
   ReadChar(lexer);
   return tok;
 }
 
+// Open-coded rather than SPAN_SIZE, which is an out-of-line call and sits on
+// the per-byte path.
+uint64_t SourceSize(const MkLexer* lexer) {
+  return (uint64_t)(lexer->source.end - lexer->source.begin);
+}
+
+bool MkLexerTokenizeAll(StringView source, MkTokenBuffer* tokens) {
+  MkTokenBufferClear(tokens);
+  uint64_t size = (uint64_t)(source.end - source.begin);
+  if (size >= UINT32_MAX) {
+    return false;
+  }
+  // Monkey averages a token every few bytes; reserving up front keeps the
+  // loop free of most regrowth on the first run over a source.
+  if (!MkTokenBufferReserve(tokens, size / 4 + 1)) {
+    return false;
+  }
+  MkLexer lexer;
+  MkLexerInit(&lexer, source);
+  while (true) {
+    MkToken tok = MkLexerNextToken(&lexer);
+    if (tokens->size == tokens->capacity &&
+        !MkTokenBufferReserve(tokens, tokens->capacity * 2)) {
+      return false;
+    }
+    tokens->kinds[tokens->size] = (uint8_t)tok.type;
+    tokens->offsets[tokens->size] = tok.offset;
+    tokens->lengths[tokens->size] =
+        (uint32_t)(tok.literal.end - tok.literal.begin);
+    ++tokens->size;
+    if (tok.type == kMkTokenEof) {
+      return true;
+    }
+  }
+}
+
 void ReadChar(MkLexer* lexer) {
-  if (lexer->read_position >= SPAN_SIZE(&lexer->source)) {
+  if (lexer->read_position >= SourceSize(lexer)) {
     lexer->ch = 0;
   } else {
     lexer->ch = lexer->source.begin[lexer->read_position];
@@ -112,62 +155,78 @@ void ReadChar(MkLexer* lexer) {
   lexer->read_position += 1;
 }
 
+void SeekChar(MkLexer* lexer, uint64_t position) {
+  lexer->read_position = position;
+  ReadChar(lexer);
+}
+
 char PeekChar(MkLexer* lexer) {
-  if (lexer->read_position >= SPAN_SIZE(&lexer->source)) {
+  if (lexer->read_position >= SourceSize(lexer)) {
     return '\0';
   } else {
     return lexer->source.begin[lexer->read_position];
   }
 }
 
-String ReadIdentifier(MkLexer* lexer) {
+StringView ReadIdentifier(MkLexer* lexer) {
   StringView ident = {0};
   ident.begin = &lexer->source.begin[lexer->position];
-  while (IsLetter(lexer->ch)) {
-    ReadChar(lexer);
+  ReadChar(lexer);
+  if (IsLetter(lexer->ch)) {
+    SeekChar(lexer, MkScanLetters(lexer->source, lexer->position));
   }
   ident.end = &lexer->source.begin[lexer->position];
-  return StringFromSpan(ident);
+  return ident;
 }
 
-String ReadNumber(MkLexer* lexer) {
+StringView ReadNumber(MkLexer* lexer) {
   StringView number = {0};
   number.begin = &lexer->source.begin[lexer->position];
-  while (IsDigit(lexer->ch)) {
-    ReadChar(lexer);
+  ReadChar(lexer);
+  if (IsDigit(lexer->ch)) {
+    SeekChar(lexer, MkScanDigits(lexer->source, lexer->position));
   }
   number.end = &lexer->source.begin[lexer->position];
-  return StringFromSpan(number);
+  return number;
 }
 
 void SkipWhitespace(MkLexer* lexer) {
-  while (lexer->ch == ' ' || lexer->ch == '\t' || lexer->ch == '\n' ||
-         lexer->ch == '\r') {
+  if (IsWhitespace(lexer->ch)) {
     ReadChar(lexer);
+    if (IsWhitespace(lexer->ch)) {
+      SeekChar(lexer, MkScanWhitespace(lexer->source, lexer->position));
+    }
   }
 }
 
-MkToken SingleCharToken(MkTokenType type, uint8_t literal) {
+MkToken SingleCharToken(MkLexer* lexer, MkTokenType type) {
   return (MkToken){
       .type = type,
-      .literal = StringFromSpan((StringView){
-          .begin = (const char*)&literal,
-          .end = (const char*)&literal + 1,
-      }),
+      .offset = (uint32_t)lexer->position,
+      .literal =
+          {
+              .begin = &lexer->source.begin[lexer->position],
+              .end = &lexer->source.begin[lexer->position + 1],
+          },
   };
 }
 
-MkToken TwoCharToken(MkTokenType type, uint8_t c1, uint8_t c2) {
-  const char chars[] = {c1, c2};
+MkToken TwoCharToken(MkLexer* lexer, MkTokenType type) {
   return (MkToken){
       .type = type,
-      .literal = StringFromSpan((StringView){
-          .begin = chars,
-          .end = chars + 2,
-      }),
+      .offset = (uint32_t)lexer->position,
+      .literal =
+          {
+              .begin = &lexer->source.begin[lexer->position],
+              .end = &lexer->source.begin[lexer->position + 2],
+          },
   };
 }
 
+bool IsWhitespace(uint8_t ch) {
+  return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
 bool IsLetter(uint8_t ch) {
   return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
 }
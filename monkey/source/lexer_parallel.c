@@ -0,0 +1,147 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string/string.h>
+
+#include "monkey/lexer.h"
+#include "monkey/token.h"
+#include "pool/pool.h"
+
+enum {
+  kDefaultMinChunkSize = 256 * 1024,
+  kChunksPerThread = 4,
+};
+
+typedef struct {
+  StringView source;
+  uint64_t* bounds;
+  MkTokenBuffer* chunks;
+  uint64_t* starts;
+  MkTokenBuffer* tokens;
+  atomic_bool failed;
+} ParallelLex;
+
+static bool IsWhitespace(uint8_t ch);
+static void LexChunk(void* context, uint64_t index);
+static void CopyChunk(void* context, uint64_t index);
+
+// Chunks are cut at whitespace. No Monkey token contains whitespace, and a
+// whitespace byte ends any token before it (including '=' before '='), so
+// each chunk lexes exactly as it would inside the whole source. The serial
+// lexer stops at the first NUL byte, so everything after it is dropped first.
+bool MkLexerTokenizeParallel(StringView source,
+                             MkTokenBuffer* tokens,
+                             ThreadPool* pool,
+                             uint64_t min_chunk_size) {
+  uint64_t size = SPAN_SIZE(&source);
+  const char* nul = size > 0 ? memchr(source.begin, '\0', size) : NULL;
+  if (nul != NULL) {
+    source.end = nul;
+    size = SPAN_SIZE(&source);
+  }
+  if (size >= UINT32_MAX) {
+    MkTokenBufferClear(tokens);
+    return false;
+  }
+  if (min_chunk_size == 0) {
+    min_chunk_size = kDefaultMinChunkSize;
+  }
+  uint64_t chunk_count = (uint64_t)pool->thread_count * kChunksPerThread;
+  if (chunk_count > size / min_chunk_size) {
+    chunk_count = size / min_chunk_size;
+  }
+  if (pool->thread_count < 2 || chunk_count < 2) {
+    return MkLexerTokenizeAll(source, tokens);
+  }
+
+  ParallelLex lex = {
+      .source = source,
+      .bounds = calloc(chunk_count + 1, sizeof(uint64_t)),
+      .chunks = calloc(chunk_count, sizeof(MkTokenBuffer)),
+      .starts = calloc(chunk_count + 1, sizeof(uint64_t)),
+      .tokens = tokens,
+  };
+  bool ok = lex.bounds != NULL && lex.chunks != NULL && lex.starts != NULL;
+  if (ok) {
+    uint64_t used = 0;
+    for (uint64_t i = 1; i < chunk_count; ++i) {
+      uint64_t cut = size * i / chunk_count;
+      if (cut < lex.bounds[used]) {
+        continue;
+      }
+      while (cut < size && !IsWhitespace(source.begin[cut])) {
+        ++cut;
+      }
+      if (cut < size && cut > lex.bounds[used]) {
+        lex.bounds[++used] = cut;
+      }
+    }
+    lex.bounds[++used] = size;
+    chunk_count = used;
+
+    ThreadPoolRun(pool, LexChunk, &lex, chunk_count);
+    ok = !atomic_load(&lex.failed);
+  }
+  if (ok) {
+    for (uint64_t i = 0; i < chunk_count; ++i) {
+      lex.starts[i + 1] = lex.starts[i] + lex.chunks[i].size;
+    }
+    MkTokenBufferClear(tokens);
+    ok = MkTokenBufferReserve(tokens, lex.starts[chunk_count] + 1);
+  }
+  if (ok) {
+    ThreadPoolRun(pool, CopyChunk, &lex, chunk_count);
+    tokens->size = lex.starts[chunk_count];
+    ok = MkTokenBufferPush(tokens, kMkTokenEof, (uint32_t)size, 0);
+  }
+
+  if (lex.chunks != NULL) {
+    for (uint64_t i = 0; i < chunk_count; ++i) {
+      MkTokenBufferFree(&lex.chunks[i]);
+    }
+  }
+  free(lex.bounds);
+  free(lex.chunks);
+  free(lex.starts);
+  if (!ok) {
+    MkTokenBufferClear(tokens);
+  }
+  return ok;
+}
+
+bool IsWhitespace(uint8_t ch) {
+  return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+// Lexes one chunk without its EOF token and rebases the offsets onto the
+// whole source.
+void LexChunk(void* context, uint64_t index) {
+  ParallelLex* lex = context;
+  uint64_t begin = lex->bounds[index];
+  MkTokenBuffer* chunk = &lex->chunks[index];
+  if (!MkLexerTokenizeAll((StringView){.begin = lex->source.begin + begin,
+                                       .end = lex->source.begin +
+                                              lex->bounds[index + 1]},
+                          chunk)) {
+    atomic_store(&lex->failed, true);
+    return;
+  }
+  --chunk->size;
+  for (uint64_t i = 0; i < chunk->size; ++i) {
+    chunk->offsets[i] += (uint32_t)begin;
+  }
+}
+
+void CopyChunk(void* context, uint64_t index) {
+  ParallelLex* lex = context;
+  const MkTokenBuffer* chunk = &lex->chunks[index];
+  uint64_t start = lex->starts[index];
+  memcpy(&lex->tokens->kinds[start], chunk->kinds,
+         chunk->size * sizeof(uint8_t));
+  memcpy(&lex->tokens->offsets[start], chunk->offsets,
+         chunk->size * sizeof(uint32_t));
+  memcpy(&lex->tokens->lengths[start], chunk->lengths,
+         chunk->size * sizeof(uint32_t));
+}
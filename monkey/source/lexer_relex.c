@@ -0,0 +1,116 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <string/string.h>
+
+#include "monkey/lexer.h"
+#include "monkey/token.h"
+
+static uint64_t FirstTokenEndingAtOrAfter(const MkTokenBuffer* tokens,
+                                          uint64_t offset);
+
+bool MkLexerRelex(StringView source, MkTokenBuffer* tokens, MkEdit edit) {
+  uint64_t size = SPAN_SIZE(&source);
+  if (size >= UINT32_MAX) {
+    MkTokenBufferClear(tokens);
+    return false;
+  }
+  uint64_t inserted = SPAN_SIZE(&edit.inserted);
+  uint64_t old_edit_end = edit.offset + edit.removed;
+  uint64_t new_edit_end = edit.offset + inserted;
+  int64_t delta = (int64_t)inserted - (int64_t)edit.removed;
+
+  // A token that ends exactly at the edit can grow into the inserted text,
+  // so the damage starts at the first token ending at or after the offset.
+  // An edit past a NUL byte still has to relex from the EOF token there.
+  uint64_t first = FirstTokenEndingAtOrAfter(tokens, edit.offset);
+  if (first == tokens->size && first > 0) {
+    --first;
+  }
+  uint64_t start = first > 0 ? (uint64_t)tokens->offsets[first - 1] +
+                                   tokens->lengths[first - 1]
+                             : 0;
+
+  MkTokenBuffer fresh = {0};
+  MkLexer lexer;
+  MkLexerInit(&lexer, (StringView){.begin = source.begin + start,
+                                   .end = source.end});
+  uint64_t old = first;
+  bool ok = true;
+  while (true) {
+    MkToken tok = MkLexerNextToken(&lexer);
+    uint64_t offset = (uint64_t)(tok.literal.begin - source.begin);
+    if (offset >= new_edit_end) {
+      while (old < tokens->size &&
+             (tokens->offsets[old] < old_edit_end ||
+              (int64_t)tokens->offsets[old] + delta < (int64_t)offset)) {
+        ++old;
+      }
+      if (old < tokens->size &&
+          (int64_t)tokens->offsets[old] + delta == (int64_t)offset) {
+        break;
+      }
+    }
+    if (!MkTokenBufferPush(&fresh, tok.type, (uint32_t)offset,
+                           (uint32_t)(tok.literal.end - tok.literal.begin))) {
+      ok = false;
+      break;
+    }
+    if (tok.type == kMkTokenEof) {
+      old = tokens->size;
+      break;
+    }
+  }
+
+  // Splice: tokens[0, first) stay, `fresh` replaces tokens[first, old), and
+  // tokens[old, size) move and shift by `delta`.
+  uint64_t tail = tokens->size - old;
+  uint64_t new_size = first + fresh.size + tail;
+  if (ok) {
+    ok = MkTokenBufferReserve(tokens, new_size);
+  }
+  if (!ok) {
+    MkTokenBufferFree(&fresh);
+    MkTokenBufferClear(tokens);
+    return false;
+  }
+  uint64_t to = first + fresh.size;
+  if (to != old) {
+    memmove(&tokens->kinds[to], &tokens->kinds[old], tail * sizeof(uint8_t));
+    memmove(&tokens->offsets[to], &tokens->offsets[old],
+            tail * sizeof(uint32_t));
+    memmove(&tokens->lengths[to], &tokens->lengths[old],
+            tail * sizeof(uint32_t));
+  }
+  if (fresh.size > 0) {
+    memcpy(&tokens->kinds[first], fresh.kinds, fresh.size * sizeof(uint8_t));
+    memcpy(&tokens->offsets[first], fresh.offsets,
+           fresh.size * sizeof(uint32_t));
+    memcpy(&tokens->lengths[first], fresh.lengths,
+           fresh.size * sizeof(uint32_t));
+  }
+  if (delta != 0) {
+    uint32_t shift = (uint32_t)delta;
+    for (uint64_t i = to; i < new_size; ++i) {
+      tokens->offsets[i] += shift;
+    }
+  }
+  tokens->size = new_size;
+  MkTokenBufferFree(&fresh);
+  return true;
+}
+
+uint64_t FirstTokenEndingAtOrAfter(const MkTokenBuffer* tokens,
+                                   uint64_t offset) {
+  uint64_t lo = 0;
+  uint64_t hi = tokens->size;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if ((uint64_t)tokens->offsets[mid] + tokens->lengths[mid] < offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
@@ -0,0 +1,56 @@
+#include "monkey/line_index.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string/string.h>
+#include <vec/vec.h>
+
+#include "monkey/scan.h"
+
+static bool LineIndexBuild(MkLineIndex* index);
+
+void MkLineIndexInit(MkLineIndex* index, StringView source) {
+  *index = (MkLineIndex){.source = source};
+}
+
+MkSourcePosition MkLineIndexLookup(MkLineIndex* index, uint64_t offset) {
+  if (!LineIndexBuild(index)) {
+    return (MkSourcePosition){0};
+  }
+  // Finds the last line starting at or before `offset`; starts[0] is 0, so
+  // there always is one.
+  uint64_t lo = 0;
+  uint64_t hi = index->starts.size;
+  while (hi - lo > 1) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (index->starts.data[mid] <= offset) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return (MkSourcePosition){
+      .line = (uint32_t)(lo + 1),
+      .column = (uint32_t)(offset - index->starts.data[lo] + 1),
+  };
+}
+
+void MkLineIndexFree(MkLineIndex* index) {
+  VEC_FREE(&index->starts);
+  *index = (MkLineIndex){0};
+}
+
+bool LineIndexBuild(MkLineIndex* index) {
+  if (index->built || index->failed) {
+    return index->built;
+  }
+  if (!VEC_PUSH(&index->starts, 0) ||
+      !MkScanLineStarts(index->source, &index->starts)) {
+    VEC_FREE(&index->starts);
+    index->failed = true;
+    return false;
+  }
+  index->built = true;
+  return true;
+}
@@ -0,0 +1,326 @@
+#include "monkey/optimizer.h"
+
+#include <arena/arena.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string/string.h>
+
+#include "monkey/ast.h"
+#include "monkey/token.h"
+
+// Enough for INT64_MIN and its terminator.
+enum { kMaxIntegerText = 21 };
+
+typedef struct {
+  Arena* arena;
+  MkOptimizeStats* stats;
+  bool failed;
+} Optimizer;
+
+static void OptimizeStatements(Optimizer* optimizer,
+                               MkAstStatements* statements);
+static MkAstStatement* OptimizeStatement(Optimizer* optimizer,
+                                         MkAstStatement* stmt);
+static MkAstExpression* OptimizeExpression(Optimizer* optimizer,
+                                           MkAstExpression* expr);
+static MkAstExpression* FoldPrefix(Optimizer* optimizer,
+                                   MkAstPrefixExpression* prefix);
+static MkAstExpression* FoldInfix(Optimizer* optimizer,
+                                  MkAstInfixExpression* infix);
+static MkAstExpression* PruneIf(Optimizer* optimizer,
+                                MkAstIfExpression* if_expr);
+static MkAstBlockStatement* LiveBranch(const MkAstIfExpression* if_expr);
+static bool IsLiteral(const MkAstExpression* expr);
+static bool LiteralTruthy(const MkAstExpression* expr);
+static bool Returns(const MkAstStatement* stmt);
+static MkAstExpression* NewInteger(Optimizer* optimizer,
+                                   MkToken token,
+                                   int64_t value);
+static MkAstExpression* NewBoolean(Optimizer* optimizer,
+                                   MkToken token,
+                                   bool value);
+
+bool MkOptimizeProgram(MkAstProgram* program, MkOptimizeStats* stats) {
+  *stats = (MkOptimizeStats){0};
+  MkAstProgramSettle(program);
+  Optimizer optimizer = {.arena = &program->arena, .stats = stats};
+  OptimizeStatements(&optimizer, &program->statements);
+  uint64_t node_count = MkAstNodeCount(&program->base);
+  stats->removed = program->node_count - node_count;
+  program->node_count = node_count;
+  return !optimizer.failed;
+}
+
+// Optimizes each statement and drops those that cannot run, or that leave
+// nothing behind: an empty block is kept only as the last statement, whose
+// value is the list's.
+void OptimizeStatements(Optimizer* optimizer, MkAstStatements* statements) {
+  uint64_t kept = 0;
+  for (uint64_t i = 0; i < statements->size; ++i) {
+    MkAstStatement* stmt = OptimizeStatement(optimizer, statements->data[i]);
+    bool last = i + 1 == statements->size;
+    if (!last && stmt->type == kMkAstStatementBlock &&
+        ((MkAstBlockStatement*)stmt)->statements.size == 0) {
+      continue;
+    }
+    statements->data[kept++] = stmt;
+    if (Returns(stmt)) {
+      break;
+    }
+  }
+  statements->size = kept;
+}
+
+// Returns the statement to put in place of `stmt`, which may be `stmt`.
+MkAstStatement* OptimizeStatement(Optimizer* optimizer, MkAstStatement* stmt) {
+  switch (stmt->type) {
+    case kMkAstStatementLet: {
+      MkAstLetStatement* let_stmt = (MkAstLetStatement*)stmt;
+      let_stmt->value = OptimizeExpression(optimizer, let_stmt->value);
+    } break;
+    case kMkAstStatementReturn: {
+      MkAstReturnStatement* return_stmt = (MkAstReturnStatement*)stmt;
+      return_stmt->return_value =
+          OptimizeExpression(optimizer, return_stmt->return_value);
+    } break;
+    case kMkAstStatementExpression: {
+      MkAstExpressionStatement* expr_stmt = (MkAstExpressionStatement*)stmt;
+      MkAstExpression* expr =
+          OptimizeExpression(optimizer, expr_stmt->expression);
+      expr_stmt->expression = expr;
+      // A block has the value an `if` would, and a statement's value is not
+      // used as an operand, so the `if` itself can go.
+      if (expr != NULL && expr->type == kMkAstExpressionIf &&
+          IsLiteral(((MkAstIfExpression*)expr)->condition)) {
+        return &LiveBranch((MkAstIfExpression*)expr)->base;
+      }
+    } break;
+    case kMkAstStatementBlock:
+      OptimizeStatements(optimizer, &((MkAstBlockStatement*)stmt)->statements);
+      break;
+  }
+  return stmt;
+}
+
+// Returns the expression to put in place of `expr`, which may be `expr`.
+MkAstExpression* OptimizeExpression(Optimizer* optimizer,
+                                    MkAstExpression* expr) {
+  if (expr == NULL) {
+    return NULL;
+  }
+  switch (expr->type) {
+    case kMkAstExpressionIdentifier:
+    case kMkAstExpressionIntegerLiteral:
+    case kMkAstExpressionBoolean:
+      break;
+    case kMkAstExpressionPrefix:
+      return FoldPrefix(optimizer, (MkAstPrefixExpression*)expr);
+    case kMkAstExpressionInfix:
+      return FoldInfix(optimizer, (MkAstInfixExpression*)expr);
+    case kMkAstExpressionIf:
+      return PruneIf(optimizer, (MkAstIfExpression*)expr);
+    case kMkAstExpressionFunctionLiteral:
+      OptimizeStatements(
+          optimizer, &((MkAstFunctionLiteral*)expr)->body->statements);
+      break;
+    case kMkAstExpressionCall: {
+      MkAstCallExpression* call = (MkAstCallExpression*)expr;
+      call->function = OptimizeExpression(optimizer, call->function);
+      for (uint64_t i = 0; i < call->arguments.size; ++i) {
+        call->arguments.data[i] =
+            OptimizeExpression(optimizer, call->arguments.data[i]);
+      }
+    } break;
+  }
+  return expr;
+}
+
+MkAstExpression* FoldPrefix(Optimizer* optimizer,
+                            MkAstPrefixExpression* prefix) {
+  MkAstExpression* right = OptimizeExpression(optimizer, prefix->right);
+  prefix->right = right;
+  if (!IsLiteral(right)) {
+    return &prefix->base;
+  }
+  MkAstExpression* folded = NULL;
+  switch (prefix->token.type) {
+    case kMkTokenBang:
+      folded = NewBoolean(optimizer, prefix->token, !LiteralTruthy(right));
+      break;
+    case kMkTokenMinus:
+      if (right->type == kMkAstExpressionIntegerLiteral) {
+        uint64_t value = ((MkAstIntegerLiteral*)right)->value;
+        folded = NewInteger(optimizer, prefix->token, (int64_t)(0 - value));
+      }
+      break;
+    default:
+      break;
+  }
+  return folded != NULL ? folded : &prefix->base;
+}
+
+MkAstExpression* FoldInfix(Optimizer* optimizer, MkAstInfixExpression* infix) {
+  MkAstExpression* left = OptimizeExpression(optimizer, infix->left);
+  MkAstExpression* right = OptimizeExpression(optimizer, infix->right);
+  infix->left = left;
+  infix->right = right;
+  if (left == NULL || right == NULL || left->type != right->type) {
+    return &infix->base;
+  }
+  MkAstExpression* folded = NULL;
+  if (left->type == kMkAstExpressionIntegerLiteral) {
+    const MkAstIntegerLiteral* a = (const MkAstIntegerLiteral*)left;
+    const MkAstIntegerLiteral* b = (const MkAstIntegerLiteral*)right;
+    // Unsigned, so that overflow wraps as it does at run time.
+    uint64_t x = (uint64_t)a->value;
+    uint64_t y = (uint64_t)b->value;
+    switch (infix->token.type) {
+      case kMkTokenPlus:
+        folded = NewInteger(optimizer, a->token, (int64_t)(x + y));
+        break;
+      case kMkTokenMinus:
+        folded = NewInteger(optimizer, a->token, (int64_t)(x - y));
+        break;
+      case kMkTokenAsterisk:
+        folded = NewInteger(optimizer, a->token, (int64_t)(x * y));
+        break;
+      case kMkTokenSlash:
+        // Division by zero is an error to report at the operator.
+        if (b->value == -1) {
+          folded = NewInteger(optimizer, a->token, (int64_t)(0 - x));
+        } else if (b->value != 0) {
+          folded = NewInteger(optimizer, a->token, a->value / b->value);
+        }
+        break;
+      case kMkTokenLt:
+        folded = NewBoolean(optimizer, a->token, a->value < b->value);
+        break;
+      case kMkTokenGt:
+        folded = NewBoolean(optimizer, a->token, a->value > b->value);
+        break;
+      case kMkTokenEq:
+        folded = NewBoolean(optimizer, a->token, a->value == b->value);
+        break;
+      case kMkTokenNotEq:
+        folded = NewBoolean(optimizer, a->token, a->value != b->value);
+        break;
+      default:
+        break;
+    }
+  } else if (left->type == kMkAstExpressionBoolean) {
+    const MkAstBoolean* a = (const MkAstBoolean*)left;
+    const MkAstBoolean* b = (const MkAstBoolean*)right;
+    // Other operators on booleans are errors.
+    if (infix->token.type == kMkTokenEq) {
+      folded = NewBoolean(optimizer, a->token, a->value == b->value);
+    } else if (infix->token.type == kMkTokenNotEq) {
+      folded = NewBoolean(optimizer, a->token, a->value != b->value);
+    }
+  }
+  return folded != NULL ? folded : &infix->base;
+}
+
+// Empties the branch that cannot run when the condition is a literal. The
+// `if` then stays for OptimizeStatement to replace, unless the other branch
+// is one expression, which takes its place.
+MkAstExpression* PruneIf(Optimizer* optimizer, MkAstIfExpression* if_expr) {
+  if_expr->condition = OptimizeExpression(optimizer, if_expr->condition);
+  OptimizeStatements(optimizer, &if_expr->consequence->statements);
+  if (if_expr->alternative != NULL) {
+    OptimizeStatements(optimizer, &if_expr->alternative->statements);
+  }
+  if (!IsLiteral(if_expr->condition)) {
+    return &if_expr->base;
+  }
+  ++optimizer->stats->pruned;
+  if (LiteralTruthy(if_expr->condition)) {
+    if_expr->alternative = NULL;
+  } else {
+    // With no alternative, the empty consequence leaves null, as the `if`
+    // did.
+    if_expr->consequence->statements.size = 0;
+  }
+  MkAstStatements* live = &LiveBranch(if_expr)->statements;
+  if (live->size == 1 && live->data[0]->type == kMkAstStatementExpression) {
+    return ((MkAstExpressionStatement*)live->data[0])->expression;
+  }
+  return &if_expr->base;
+}
+
+// The branch of an `if` pruned by PruneIf that still runs.
+MkAstBlockStatement* LiveBranch(const MkAstIfExpression* if_expr) {
+  if (!LiteralTruthy(if_expr->condition) && if_expr->alternative != NULL) {
+    return if_expr->alternative;
+  }
+  return if_expr->consequence;
+}
+
+bool IsLiteral(const MkAstExpression* expr) {
+  return expr != NULL && (expr->type == kMkAstExpressionIntegerLiteral ||
+                          expr->type == kMkAstExpressionBoolean);
+}
+
+// Every integer is truthy, zero included.
+bool LiteralTruthy(const MkAstExpression* expr) {
+  return expr->type != kMkAstExpressionBoolean ||
+         ((const MkAstBoolean*)expr)->value;
+}
+
+// Whether running `stmt` always returns, so that what follows cannot run.
+bool Returns(const MkAstStatement* stmt) {
+  if (stmt->type == kMkAstStatementReturn) {
+    return true;
+  }
+  if (stmt->type != kMkAstStatementBlock) {
+    return false;
+  }
+  const MkAstStatements* statements =
+      &((const MkAstBlockStatement*)stmt)->statements;
+  return statements->size > 0 &&
+         Returns(statements->data[statements->size - 1]);
+}
+
+// A literal at the offset of `token`, with its value written out as its
+// text. Returns NULL when out of memory.
+MkAstExpression* NewInteger(Optimizer* optimizer,
+                            MkToken token,
+                            int64_t value) {
+  MkAstIntegerLiteral* integer =
+      ARENA_NEW(optimizer->arena, MkAstIntegerLiteral);
+  char* text = ARENA_NEW_ARRAY(optimizer->arena, char, kMaxIntegerText);
+  if (integer == NULL || text == NULL) {
+    optimizer->failed = true;
+    return NULL;
+  }
+  int length = snprintf(text, kMaxIntegerText, "%" PRId64, value);
+  integer->base.base.type = kMkAstNodeExpression;
+  integer->base.type = kMkAstExpressionIntegerLiteral;
+  integer->token = (MkToken){
+      .type = kMkTokenInt,
+      .offset = token.offset,
+      .literal = {.begin = text, .end = text + length},
+  };
+  integer->value = value;
+  ++optimizer->stats->folded;
+  return &integer->base;
+}
+
+MkAstExpression* NewBoolean(Optimizer* optimizer, MkToken token, bool value) {
+  MkAstBoolean* boolean = ARENA_NEW(optimizer->arena, MkAstBoolean);
+  if (boolean == NULL) {
+    optimizer->failed = true;
+    return NULL;
+  }
+  boolean->base.base.type = kMkAstNodeExpression;
+  boolean->base.type = kMkAstExpressionBoolean;
+  boolean->token = (MkToken){
+      .type = value ? kMkTokenTrue : kMkTokenFalse,
+      .offset = token.offset,
+      .literal = StringViewFromC(value ? "true" : "false"),
+  };
+  boolean->value = value;
+  ++optimizer->stats->folded;
+  return &boolean->base;
+}
@@ -1,54 +1,623 @@
 #include "monkey/parser.h"
 
+#include <arena/arena.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "monkey/ast.h"
+#include "monkey/line_index.h"
 #include "monkey/token.h"
 #include "string/string.h"
 
+typedef enum {
+  kPrecedenceLowest,
+  kPrecedenceEquals,
+  kPrecedenceLessGreater,
+  kPrecedenceSum,
+  kPrecedenceProduct,
+  kPrecedencePrefix,
+  kPrecedenceCall,
+} Precedence;
+
+// Nodes are counted as they are allocated. A statement that fails takes its
+// count back, so that only nodes the program can reach are counted.
+#define NEW_NODE(parser, T) ((T*)NewNode(parser, sizeof(T)))
+
+typedef MkAstExpression* (*PrefixParseFn)(MkParser* parser);
+typedef MkAstExpression* (*InfixParseFn)(MkParser* parser,
+                                         MkAstExpression* left);
+
+typedef struct {
+  PrefixParseFn prefix;
+  InfixParseFn infix;
+  Precedence precedence;
+} ParseRule;
+
+// Where MkParserReparse can stop: the old top-level statements of `program`
+// from `next` on that have not been passed yet, and the shift from old offsets
+// to new ones for text after the edit, which ends at `edit_end` in the new
+// source.
+typedef struct {
+  const MkAstProgram* program;
+  uint64_t next;
+  uint64_t edit_end;
+  int64_t delta;
+} Resync;
+
+static bool AtResyncPoint(MkParser* parser, Resync* resync);
+static MkToken StatementToken(const MkAstStatement* stmt);
+static uint64_t StatementOffset(const MkAstProgram* program, uint64_t index);
+static bool RecordShifts(MkAstProgram* program,
+                         uint64_t first,
+                         uint64_t last,
+                         uint64_t parsed,
+                         int64_t delta,
+                         bool source_moved);
+static bool PushShift(MkAstShifts* shifts, MkAstShift shift);
+static uint64_t TokenAtOffset(const MkTokenBuffer* tokens, uint64_t offset);
+static void ParserLoadTokens(MkParser* parser);
+static void ParserFillWindow(MkParser* parser);
 static void ParserNextToken(MkParser* parser);
+static uint32_t WindowAhead(const MkParser* parser);
+static MkToken CurrentToken(const MkParser* parser);
+static MkToken PeekToken(const MkParser* parser);
 static bool ExpectPeek(MkParser* parser, MkTokenType type);
 static void PeekError(MkParser* parser, MkTokenType type);
+static void TokenError(MkParser* parser, MkToken token, MkTokenType type);
+static void ParserError(MkParser* parser,
+                        MkParseErrorKind kind,
+                        MkToken token,
+                        MkTokenType expected);
+static void Synchronize(MkParser* parser, uint64_t start);
+static void ParseTopLevelStatement(MkParser* parser);
 static MkAstStatement* ParseStatement(MkParser* parser);
 static MkAstStatement* ParseLetStatement(MkParser* parser);
-static MkAstExpression* ParseExpression(MkParser* parser);
+static MkAstStatement* ParseReturnStatement(MkParser* parser);
+static MkAstStatement* ParseExpressionStatement(MkParser* parser);
+static MkAstBlockStatement* ParseBlockStatement(MkParser* parser);
+static MkAstExpression* ParseExpression(MkParser* parser,
+                                        Precedence precedence);
+static MkAstExpression* ParseIdentifier(MkParser* parser);
+static MkAstExpression* ParseIntegerLiteral(MkParser* parser);
+static MkAstExpression* ParseBoolean(MkParser* parser);
+static MkAstExpression* ParsePrefixExpression(MkParser* parser);
+static MkAstExpression* ParseGroupedExpression(MkParser* parser);
+static MkAstExpression* ParseIfExpression(MkParser* parser);
+static MkAstExpression* ParseFunctionLiteral(MkParser* parser);
+static bool ParseFunctionParameters(MkParser* parser,
+                                    MkAstIdentifiers* parameters);
+static MkAstExpression* ParseInfixExpression(MkParser* parser,
+                                             MkAstExpression* left);
+static MkAstExpression* ParseCallExpression(MkParser* parser,
+                                            MkAstExpression* function);
+static bool ParseCallArguments(MkParser* parser, MkAstExpressions* arguments);
+static MkAstIdentifier* NewIdentifier(MkParser* parser, MkToken token);
+static void* NewNode(MkParser* parser, uint64_t size);
+static void* ScratchToArena(MkParser* parser, uint64_t start, uint64_t* size);
+
+// Indexed by token kind. Only tokens that can continue an expression have an
+// infix handler, and only those have a precedence above kPrecedenceLowest, so
+// the expression loop stops at ';', ')' and every other terminator without
+// checking for them.
+static const ParseRule kParseRules[kMkTokenTypeCount] = {
+    [kMkTokenIdent] = {.prefix = ParseIdentifier},
+    [kMkTokenInt] = {.prefix = ParseIntegerLiteral},
+    [kMkTokenTrue] = {.prefix = ParseBoolean},
+    [kMkTokenFalse] = {.prefix = ParseBoolean},
+    [kMkTokenBang] = {.prefix = ParsePrefixExpression},
+    [kMkTokenMinus] = {.prefix = ParsePrefixExpression,
+                       .infix = ParseInfixExpression,
+                       .precedence = kPrecedenceSum},
+    [kMkTokenPlus] = {.infix = ParseInfixExpression,
+                      .precedence = kPrecedenceSum},
+    [kMkTokenAsterisk] = {.infix = ParseInfixExpression,
+                          .precedence = kPrecedenceProduct},
+    [kMkTokenSlash] = {.infix = ParseInfixExpression,
+                       .precedence = kPrecedenceProduct},
+    [kMkTokenLt] = {.infix = ParseInfixExpression,
+                    .precedence = kPrecedenceLessGreater},
+    [kMkTokenGt] = {.infix = ParseInfixExpression,
+                    .precedence = kPrecedenceLessGreater},
+    [kMkTokenEq] = {.infix = ParseInfixExpression,
+                    .precedence = kPrecedenceEquals},
+    [kMkTokenNotEq] = {.infix = ParseInfixExpression,
+                       .precedence = kPrecedenceEquals},
+    [kMkTokenLparen] = {.prefix = ParseGroupedExpression,
+                        .infix = ParseCallExpression,
+                        .precedence = kPrecedenceCall},
+    [kMkTokenIf] = {.prefix = ParseIfExpression},
+    [kMkTokenFunction] = {.prefix = ParseFunctionLiteral},
+};
 
 void MkParserInit(MkParser* parser, MkLexer lexer) {
-  parser->lexer = lexer;
+  parser->source = lexer.source;
+  parser->tokens = (MkTokenBuffer){0};
+  parser->tokens_borrowed = false;
+  parser->index = 0;
+  parser->depth = 0;
+  parser->height = 0;
   parser->errors = (MkErrors){0};
-  ParserNextToken(parser);
-  ParserNextToken(parser);
+  MkLineIndexInit(&parser->lines, lexer.source);
+  parser->arena = NULL;
+  parser->scratch.data = NULL;
+  parser->scratch.size = parser->scratch.capacity = 0;
+  parser->node_count = 0;
+  parser->symbols = MkInternerGlobal();
+  parser->lookahead = 2;
+  if (!MkLexerTokenizeAll(lexer.source, &parser->tokens)) {
+    VEC_PUSH(&parser->errors,
+             ((MkParseError){.kind = kMkParseErrorTokenize}));
+    MkTokenBufferClear(&parser->tokens);
+    MkTokenBufferPush(&parser->tokens, kMkTokenEof, 0, 0);
+  }
+  parser->end = parser->tokens.size - 1;
+  ParserLoadTokens(parser);
+}
+
+void MkParserInitTokens(MkParser* parser,
+                        StringView source,
+                        const MkTokenBuffer* tokens) {
+  MkParserInitRange(parser, source, tokens, 0, tokens->size - 1);
+}
+
+void MkParserInitRange(MkParser* parser,
+                       StringView source,
+                       const MkTokenBuffer* tokens,
+                       uint64_t begin,
+                       uint64_t end) {
+  parser->source = source;
+  parser->tokens = *tokens;
+  parser->tokens_borrowed = true;
+  parser->index = begin;
+  parser->end = end;
+  parser->depth = 0;
+  parser->height = 0;
+  parser->errors = (MkErrors){0};
+  MkLineIndexInit(&parser->lines, source);
+  parser->arena = NULL;
+  parser->scratch.data = NULL;
+  parser->scratch.size = parser->scratch.capacity = 0;
+  parser->node_count = 0;
+  parser->symbols = MkInternerGlobal();
+  parser->lookahead = 2;
+  ParserLoadTokens(parser);
 }
 
 MkAstProgram* MkParserParseProgram(MkParser* parser) {
   MkAstProgram* program = calloc(sizeof(MkAstProgram), 1);
-  while (!StringEqual(parser->current_token.type, mk_token_eof)) {
-    MkAstStatement* stmt = ParseStatement(parser);
-    if (stmt != NULL) {
-      VEC_PUSH(&program->statements, stmt);
-    }
-    ParserNextToken(parser);
+  program->base.type = kMkAstNodeProgram;
+  ArenaInit(&program->arena);
+  parser->arena = &program->arena;
+  parser->node_count = 0;
+  uint64_t start = parser->scratch.size;
+  while (parser->index < parser->end) {
+    ParseTopLevelStatement(parser);
   }
+  program->statements.data =
+      ScratchToArena(parser, start, &program->statements.size);
+  program->statements.capacity = program->statements.size;
+  program->node_count = parser->node_count;
+  program->parsed_size = program->arena.used;
+  parser->arena = NULL;
   return program;
 }
 
-void MkParserFree(MkParser parser) {
-  for (uint64_t i = 0; i < parser.errors.size; ++i) {
-    VEC_FREE(&parser.errors.data[i]);
+void MkParserReparse(MkParser* parser,
+                     MkAstProgram* program,
+                     StringView source,
+                     const MkTokenBuffer* tokens,
+                     MkEdit edit,
+                     MkReparseStats* stats) {
+  // Dropped statements stay in the arena, so once they have doubled it the
+  // program is parsed again from scratch into a fresh one. Each such parse
+  // follows at least as much parsing of edits, which pays for it.
+  if (program->arena.used > 2 * program->parsed_size) {
+    uint32_t lookahead = parser->lookahead;
+    MkInterner* symbols = parser->symbols;
+    MkParserFree(*parser);
+    MkParserInitTokens(parser, source, tokens);
+    MkParserSetLookahead(parser, lookahead);
+    parser->symbols = symbols;
+    MkAstProgram* fresh = MkParserParseProgram(parser);
+    MkAstNodeFree(&program->base);
+    *program = *fresh;
+    free(fresh);
+    if (stats != NULL) {
+      *stats = (MkReparseStats){
+          .parsed_statements = program->statements.size,
+          .parsed_nodes = program->node_count,
+      };
+    }
+    return;
+  }
+
+  int64_t inserted = edit.inserted.end - edit.inserted.begin;
+  int64_t delta = inserted - (int64_t)edit.removed;
+  bool source_moved = source.begin != parser->source.begin;
+  MkAstStatements* statements = &program->statements;
+
+  // Everything up to the end of the first token of the restart statement is
+  // lexed and parsed as before, and the parser holds no state between
+  // top-level statements. Without such a statement, all of it is parsed again.
+  uint64_t lo = 0;
+  uint64_t hi = statements->size;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    MkToken token = StatementToken(statements->data[mid]);
+    uint64_t length = (uint64_t)(token.literal.end - token.literal.begin);
+    if (StatementOffset(program, mid) + length < edit.offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  uint64_t first = lo > 0 ? lo - 1 : 0;
+  uint64_t restart = 0;
+  if (lo > 0) {
+    restart = StatementOffset(program, first);
+  }
+
+  MkErrors old_errors = parser->errors;
+  uint32_t lookahead = parser->lookahead;
+  MkInterner* symbols = parser->symbols;
+  parser->errors = (MkErrors){0};
+  MkParserFree(*parser);
+  MkParserInitRange(parser, source, tokens,
+                    lo > 0 ? TokenAtOffset(tokens, restart) : 0,
+                    tokens->size - 1);
+  MkParserSetLookahead(parser, lookahead);
+  parser->symbols = symbols;
+  // Errors come in source order, and one at the restart offset is reported
+  // by the statement before, on the token it peeked at.
+  for (uint64_t i = 0; lo > 0 && i < old_errors.size; ++i) {
+    if (old_errors.data[i].offset <= restart) {
+      VEC_PUSH(&parser->errors, old_errors.data[i]);
+    }
+  }
+
+  Resync resync = {
+      .program = program,
+      .next = first,
+      .edit_end = edit.offset + (uint64_t)inserted,
+      .delta = delta,
+  };
+  parser->arena = &program->arena;
+  bool resynced = false;
+  while (parser->index < parser->end) {
+    if (AtResyncPoint(parser, &resync)) {
+      resynced = true;
+      break;
+    }
+    ParseTopLevelStatement(parser);
+  }
+  uint64_t parsed = parser->scratch.size;
+  uint64_t last = resynced ? resync.next : statements->size;
+
+  if (resynced) {
+    uint64_t resume = StatementOffset(program, last);
+    for (uint64_t i = 0; i < old_errors.size; ++i) {
+      MkParseError error = old_errors.data[i];
+      if (error.offset > resume) {
+        error.offset = (uint32_t)((int64_t)error.offset + delta);
+        VEC_PUSH(&parser->errors, error);
+      }
+    }
+  }
+  VEC_FREE(&old_errors);
+
+  uint64_t removed_nodes = 0;
+  for (uint64_t i = first; i < last; ++i) {
+    removed_nodes += MkAstNodeCount(&statements->data[i]->base);
+  }
+  // The statements kept are only recorded as shifted, so that an edit costs
+  // the statements around it however long the program is. Without memory for
+  // that, every pending move is made now instead.
+  if (!RecordShifts(program, first, last, parsed, delta, source_moved)) {
+    MkAstProgramSettle(program);
+    if (source_moved) {
+      for (uint64_t i = 0; i < first; ++i) {
+        MkAstStatementMove(statements->data[i], source, 0);
+      }
+    }
+    if (source_moved || delta != 0) {
+      for (uint64_t i = last; i < statements->size; ++i) {
+        MkAstStatementMove(statements->data[i], source, delta);
+      }
+    }
+  }
+  program->source = source;
+
+  // The list grows in place while it has room, and otherwise moves to a
+  // bigger array in the arena, with some slack for the next edits.
+  uint64_t tail = statements->size - last;
+  uint64_t size = first + parsed + tail;
+  MkAstStatement** data = statements->data;
+  if (size > statements->capacity) {
+    statements->capacity = size + size / 4;
+    data = ARENA_NEW_ARRAY(&program->arena, MkAstStatement*,
+                           statements->capacity);
+    if (first > 0) {
+      memcpy(data, statements->data, first * sizeof(MkAstStatement*));
+    }
+  }
+  if (tail > 0) {
+    memmove(&data[first + parsed], &statements->data[last],
+            tail * sizeof(MkAstStatement*));
+  }
+  if (parsed > 0) {
+    memcpy(&data[first], parser->scratch.data,
+           parsed * sizeof(MkAstStatement*));
+  }
+  statements->data = data;
+  statements->size = size;
+  program->node_count += parser->node_count - removed_nodes;
+
+  if (stats != NULL) {
+    *stats = (MkReparseStats){
+        .reused_statements = first + tail,
+        .reused_nodes = program->node_count - parser->node_count,
+        .parsed_statements = parsed,
+        .parsed_nodes = parser->node_count,
+    };
+  }
+  parser->scratch.size = 0;
+  parser->arena = NULL;
+  // Leaves the parser on the EOF token, as a full parse would.
+  parser->index = parser->end;
+  parser->next = parser->end;
+  parser->head = parser->count = 0;
+  MkParserSetLookahead(parser, parser->lookahead);
+}
+
+bool MkParserSetLookahead(MkParser* parser, uint32_t depth) {
+  if (depth == 0 || depth > kMkParserMaxLookahead) {
+    return false;
+  }
+  parser->lookahead = depth;
+  if (parser->head + WindowAhead(parser) > parser->count) {
+    ParserFillWindow(parser);
+  }
+  return true;
+}
+
+MkToken MkParserPeekToken(const MkParser* parser, uint32_t n) {
+  return parser->window[parser->head + n];
+}
+
+String MkParserErrorString(MkParser* parser, MkParseError error) {
+  String message = {0};
+  switch ((MkParseErrorKind)error.kind) {
+    case kMkParseErrorTokenize:
+      return StringFromC("could not tokenize source");
+    case kMkParseErrorUnexpectedToken:
+      message = StringFormat("expected next token to be %s, got %s instead",
+                             MkTokenTypeName(error.expected),
+                             MkTokenTypeName(error.got));
+      break;
+    case kMkParseErrorNoPrefix:
+      message = StringFormat("no prefix parse function for %s found",
+                             MkTokenTypeName(error.got));
+      break;
+    case kMkParseErrorIntegerOverflow: {
+      // Integer literals are runs of digits, so the literal is recovered
+      // from the source rather than kept in the record.
+      const char* begin = parser->source.begin + error.offset;
+      const char* end = begin;
+      while (end < parser->source.end && *end >= '0' && *end <= '9') {
+        ++end;
+      }
+      message = StringFormat("could not parse %.*s as integer",
+                             (int)(end - begin), begin);
+    } break;
+    case kMkParseErrorTooDeep:
+      message = StringFormat("expression nested more than %d deep",
+                             kMkAstMaxHeight);
+      break;
   }
+  MkSourcePosition position = MkLineIndexLookup(&parser->lines, error.offset);
+  String result = StringFormat("%" PRIu32 ":%" PRIu32 ": %" STRING_FMT,
+                               position.line, position.column,
+                               STRING_PRINT(message));
+  VEC_FREE(&message);
+  return result;
+}
+
+void MkParserFree(MkParser parser) {
   VEC_FREE(&parser.errors);
-  MkTokenFree(parser.current_token);
-  MkTokenFree(parser.peek_token);
+  MkLineIndexFree(&parser.lines);
+  VEC_FREE(&parser.scratch);
+  if (!parser.tokens_borrowed) {
+    MkTokenBufferFree(&parser.tokens);
+  }
+}
+
+// True when the parser is at the start of a statement after the edit where
+// an old statement started too. Both parses then see the same tokens from
+// there on, with no state carried over, so the rest of the old program is
+// what parsing on would produce.
+bool AtResyncPoint(MkParser* parser, Resync* resync) {
+  MkToken token = CurrentToken(parser);
+  if (token.type == kMkTokenEof || token.offset < resync->edit_end) {
+    return false;
+  }
+  int64_t offset = (int64_t)token.offset - resync->delta;
+  uint64_t size = resync->program->statements.size;
+  while (resync->next < size &&
+         (int64_t)StatementOffset(resync->program, resync->next) < offset) {
+    ++resync->next;
+  }
+  return resync->next < size &&
+         (int64_t)StatementOffset(resync->program, resync->next) == offset;
+}
+
+// The token a statement starts on.
+MkToken StatementToken(const MkAstStatement* stmt) {
+  switch (stmt->type) {
+    case kMkAstStatementLet:
+      return ((const MkAstLetStatement*)stmt)->token;
+    case kMkAstStatementReturn:
+      return ((const MkAstReturnStatement*)stmt)->token;
+    case kMkAstStatementExpression:
+      return ((const MkAstExpressionStatement*)stmt)->token;
+    case kMkAstStatementBlock:
+      return ((const MkAstBlockStatement*)stmt)->token;
+  }
+  return (MkToken){0};
+}
+
+// The offset top-level statement `index` of `program` starts at, with its
+// pending shift applied.
+uint64_t StatementOffset(const MkAstProgram* program, uint64_t index) {
+  MkToken token = StatementToken(program->statements.data[index]);
+  return (uint64_t)((int64_t)token.offset + MkAstProgramShift(program, index));
+}
+
+// Replaces the shifts of `program` by those that hold once its statements
+// [first, last) are replaced by `parsed` new ones: the statements kept after
+// them shift by `delta` more, and all those kept need rebasing if the source
+// moved. Fails when out of memory, changing nothing.
+bool RecordShifts(MkAstProgram* program,
+                  uint64_t first,
+                  uint64_t last,
+                  uint64_t parsed,
+                  int64_t delta,
+                  bool source_moved) {
+  if (program->shifts.size == 0 && delta == 0 && !source_moved) {
+    return true;
+  }
+  // No shifts stand for one that covers everything and moves nothing.
+  MkAstShift none = {0};
+  const MkAstShift* old = program->shifts.size > 0 ? program->shifts.data
+                                                   : &none;
+  uint64_t old_size = program->shifts.size > 0 ? program->shifts.size : 1;
+  MkAstShifts shifts = {0};
+  bool ok = true;
+  uint64_t i = 0;
+  for (; ok && i < old_size && old[i].begin < first; ++i) {
+    ok = PushShift(&shifts, (MkAstShift){.begin = old[i].begin,
+                                         .delta = old[i].delta,
+                                         .rebase = old[i].rebase ||
+                                                   source_moved});
+  }
+  ok = ok && PushShift(&shifts, (MkAstShift){.begin = first});
+  if (last < program->statements.size) {
+    // From the shift that covers `last` on.
+    uint64_t k = i > 0 ? i - 1 : 0;
+    while (k + 1 < old_size && old[k + 1].begin <= last) {
+      ++k;
+    }
+    for (; ok && k < old_size; ++k) {
+      uint64_t begin = old[k].begin > last ? old[k].begin : last;
+      ok = PushShift(&shifts, (MkAstShift){.begin = begin - last + first +
+                                                    parsed,
+                                           .delta = old[k].delta + delta,
+                                           .rebase = old[k].rebase ||
+                                                     source_moved});
+    }
+  }
+  if (!ok) {
+    VEC_FREE(&shifts);
+    return false;
+  }
+  if (shifts.size == 1 && shifts.data[0].delta == 0 &&
+      !shifts.data[0].rebase) {
+    shifts.size = 0;
+  }
+  VEC_FREE(&program->shifts);
+  program->shifts = shifts;
+  return true;
+}
+
+// Appends `shift`, in place of a last one that would cover nothing, and not
+// at all if the last one shifts the same way.
+bool PushShift(MkAstShifts* shifts, MkAstShift shift) {
+  if (shifts->size > 0 && shifts->data[shifts->size - 1].begin == shift.begin) {
+    --shifts->size;
+  }
+  if (shifts->size > 0) {
+    MkAstShift last = shifts->data[shifts->size - 1];
+    if (last.delta == shift.delta && last.rebase == shift.rebase) {
+      return true;
+    }
+  }
+  return VEC_PUSH(shifts, shift);
+}
+
+// The position of the token that starts at `offset`, which must exist.
+uint64_t TokenAtOffset(const MkTokenBuffer* tokens, uint64_t offset) {
+  uint64_t lo = 0;
+  uint64_t hi = tokens->size;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (tokens->offsets[mid] < offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+void ParserLoadTokens(MkParser* parser) {
+  parser->head = 0;
+  parser->count = 0;
+  parser->next = parser->index;
+  ParserFillWindow(parser);
+}
+
+// Moves the tokens still ahead to the front of the window and decodes as many
+// more as fit in one go. The buffer always ends with EOF, so positions past
+// the end decode to that token.
+void ParserFillWindow(MkParser* parser) {
+  uint32_t ahead = parser->count - parser->head;
+  memmove(parser->window, &parser->window[parser->head],
+          ahead * sizeof(MkToken));
+  const MkTokenBuffer* tokens = &parser->tokens;
+  uint64_t last = tokens->size - 1;
+  for (uint32_t i = ahead; i < kMkParserWindowSize; ++i) {
+    uint64_t position = parser->next < last ? parser->next : last;
+    const char* begin = parser->source.begin + tokens->offsets[position];
+    parser->window[i] = (MkToken){
+        .type = (MkTokenType)tokens->kinds[position],
+        .offset = tokens->offsets[position],
+        .literal = {.begin = begin, .end = begin + tokens->lengths[position]},
+    };
+    ++parser->next;
+  }
+  parser->head = 0;
+  parser->count = kMkParserWindowSize;
+}
+
+// The tokens from the current one on that have to be decoded: the lookahead
+// depth, but never fewer than the 2 PeekToken reads.
+uint32_t WindowAhead(const MkParser* parser) {
+  return parser->lookahead > 2 ? parser->lookahead : 2;
 }
 
+// The index stops on the EOF token, so the window keeps returning it.
 void ParserNextToken(MkParser* parser) {
-  MkTokenFree(parser->current_token);
-  parser->current_token = parser->peek_token;
-  parser->peek_token = MkLexerNextToken(&parser->lexer);
+  if (parser->index < parser->tokens.size - 1) {
+    ++parser->index;
+    ++parser->head;
+    if (parser->head + WindowAhead(parser) > parser->count) {
+      ParserFillWindow(parser);
+    }
+  }
+}
+
+MkToken CurrentToken(const MkParser* parser) {
+  return parser->window[parser->head];
+}
+
+MkToken PeekToken(const MkParser* parser) {
+  return parser->window[parser->head + 1];
 }
 
 bool ExpectPeek(MkParser* parser, MkTokenType type) {
-  if (StringEqual(parser->peek_token.type, type)) {
+  if (PeekToken(parser).type == type) {
     ParserNextToken(parser);
     return true;
   }
@@ -57,45 +626,430 @@ bool ExpectPeek(MkParser* parser, MkTokenType type) {
 }
 
 void PeekError(MkParser* parser, MkTokenType type) {
-  String error = StringFormat(
-      "expected next token to be %" STRING_FMT ", got %" STRING_FMT " instead",
-      STRING_PRINT(type), STRING_PRINT(parser->peek_token.type));
-  VEC_PUSH(&parser->errors, error);
+  TokenError(parser, PeekToken(parser), type);
+}
+
+void TokenError(MkParser* parser, MkToken token, MkTokenType type) {
+  ParserError(parser, kMkParseErrorUnexpectedToken, token, type);
+}
+
+void ParserError(MkParser* parser,
+                 MkParseErrorKind kind,
+                 MkToken token,
+                 MkTokenType expected) {
+  VEC_PUSH(&parser->errors, ((MkParseError){
+                                .kind = kind,
+                                .expected = expected,
+                                .got = token.type,
+                                .offset = token.offset,
+                            }));
+}
+
+// Skips the rest of a statement that failed to parse, so that one mistake
+// reports one error. Stops after the ';' that ends it, or on the next 'let',
+// 'return' or '}' of an enclosing block, stepping over braces opened along the
+// way. `start` is where the statement began: the search starts from where it
+// failed, which may already be on such a token, but always moves past the
+// first token of the statement, so that parsing makes progress.
+void Synchronize(MkParser* parser, uint64_t start) {
+  uint32_t braces = 0;
+  while (CurrentToken(parser).type != kMkTokenEof) {
+    switch (CurrentToken(parser).type) {
+      case kMkTokenSemicolon:
+        if (braces == 0) {
+          ParserNextToken(parser);
+          return;
+        }
+        break;
+      case kMkTokenLbrace:
+        ++braces;
+        break;
+      case kMkTokenRbrace:
+        if (braces == 0 && parser->index != start) {
+          return;
+        }
+        braces -= braces > 0;
+        break;
+      case kMkTokenLet:
+      case kMkTokenReturn:
+        if (braces == 0 && parser->index != start) {
+          return;
+        }
+        break;
+      default:
+        break;
+    }
+    ParserNextToken(parser);
+  }
+}
+
+// Parses one statement of the program onto the scratch stack, or skips it if
+// it fails.
+void ParseTopLevelStatement(MkParser* parser) {
+  uint64_t start = parser->index;
+  uint64_t node_count = parser->node_count;
+  MkAstStatement* stmt = ParseStatement(parser);
+  if (stmt == NULL) {
+    parser->node_count = node_count;
+    Synchronize(parser, start);
+    return;
+  }
+  VEC_PUSH(&parser->scratch, stmt);
+  ParserNextToken(parser);
 }
 
 MkAstStatement* ParseStatement(MkParser* parser) {
-  if (StringEqual(parser->current_token.type, mk_token_let)) {
-    return ParseLetStatement(parser);
+  switch (CurrentToken(parser).type) {
+    case kMkTokenLet:
+      return ParseLetStatement(parser);
+    case kMkTokenReturn:
+      return ParseReturnStatement(parser);
+    default:
+      return ParseExpressionStatement(parser);
   }
-  return NULL;
 }
 
 MkAstStatement* ParseLetStatement(MkParser* parser) {
-  MkAstLetStatement* let_statement = calloc(sizeof(MkAstLetStatement), 1);
+  MkAstLetStatement* let_statement = NEW_NODE(parser, MkAstLetStatement);
   let_statement->base.base.type = kMkAstNodeStatement;
   let_statement->base.type = kMkAstStatementLet;
-  let_statement->token = MkTokenDuplicate(parser->current_token);
-  if (!ExpectPeek(parser, mk_token_ident)) {
-    MkTokenFree(let_statement->token);
-    free(let_statement);
+  let_statement->token = CurrentToken(parser);
+  if (!ExpectPeek(parser, kMkTokenIdent)) {
     return NULL;
   }
   let_statement->name = (MkAstIdentifier){
       .base = {.base = {.type = kMkAstNodeExpression},
                .type = kMkAstExpressionIdentifier},
-      .token = MkTokenDuplicate(parser->current_token),
-      .value = StringDuplicate(parser->current_token.literal),
+      .token = CurrentToken(parser),
+      .symbol = MkInternerIntern(parser->symbols, CurrentToken(parser).literal),
+      .depth = kMkAstUnresolved,
   };
-  if (!ExpectPeek(parser, mk_token_assign)) {
-    MkAstNodeFree(&let_statement->name.base.base);
-    MkTokenFree(let_statement->token);
-    free(let_statement);
+  ++parser->node_count;
+  if (!ExpectPeek(parser, kMkTokenAssign)) {
     return NULL;
   }
   ParserNextToken(parser);
-  // TODO
-  while (!StringEqual(parser->current_token.type, mk_token_semicolon)) {
+  let_statement->value = ParseExpression(parser, kPrecedenceLowest);
+  if (let_statement->value == NULL) {
+    return NULL;
+  }
+  if (PeekToken(parser).type == kMkTokenSemicolon) {
     ParserNextToken(parser);
   }
   return (MkAstStatement*)let_statement;
 }
+
+MkAstStatement* ParseReturnStatement(MkParser* parser) {
+  MkAstReturnStatement* return_statement =
+      NEW_NODE(parser, MkAstReturnStatement);
+  return_statement->base.base.type = kMkAstNodeStatement;
+  return_statement->base.type = kMkAstStatementReturn;
+  return_statement->token = CurrentToken(parser);
+  ParserNextToken(parser);
+  return_statement->return_value = ParseExpression(parser, kPrecedenceLowest);
+  if (return_statement->return_value == NULL) {
+    return NULL;
+  }
+  if (PeekToken(parser).type == kMkTokenSemicolon) {
+    ParserNextToken(parser);
+  }
+  return (MkAstStatement*)return_statement;
+}
+
+MkAstStatement* ParseExpressionStatement(MkParser* parser) {
+  MkAstExpressionStatement* expression_statement =
+      NEW_NODE(parser, MkAstExpressionStatement);
+  expression_statement->base.base.type = kMkAstNodeStatement;
+  expression_statement->base.type = kMkAstStatementExpression;
+  expression_statement->token = CurrentToken(parser);
+  expression_statement->expression =
+      ParseExpression(parser, kPrecedenceLowest);
+  if (expression_statement->expression == NULL) {
+    return NULL;
+  }
+  if (PeekToken(parser).type == kMkTokenSemicolon) {
+    ParserNextToken(parser);
+  }
+  return (MkAstStatement*)expression_statement;
+}
+
+// Starts on the '{' and ends on the matching '}'.
+MkAstBlockStatement* ParseBlockStatement(MkParser* parser) {
+  MkAstBlockStatement* block = NEW_NODE(parser, MkAstBlockStatement);
+  block->base.base.type = kMkAstNodeStatement;
+  block->base.type = kMkAstStatementBlock;
+  block->token = CurrentToken(parser);
+  uint64_t start = parser->scratch.size;
+  ParserNextToken(parser);
+  while (CurrentToken(parser).type != kMkTokenRbrace) {
+    if (CurrentToken(parser).type == kMkTokenEof) {
+      TokenError(parser, CurrentToken(parser), kMkTokenRbrace);
+      parser->scratch.size = start;
+      return NULL;
+    }
+    uint64_t statement_start = parser->index;
+    uint64_t node_count = parser->node_count;
+    MkAstStatement* stmt = ParseStatement(parser);
+    if (stmt == NULL) {
+      parser->node_count = node_count;
+      Synchronize(parser, statement_start);
+      continue;
+    }
+    VEC_PUSH(&parser->scratch, stmt);
+    ParserNextToken(parser);
+  }
+  block->statements.data =
+      ScratchToArena(parser, start, &block->statements.size);
+  block->statements.capacity = block->statements.size;
+  return block;
+}
+
+MkAstExpression* ParseExpression(MkParser* parser, Precedence precedence) {
+  PrefixParseFn prefix = kParseRules[CurrentToken(parser).type].prefix;
+  if (prefix == NULL) {
+    ParserError(parser, kMkParseErrorNoPrefix, CurrentToken(parser),
+                kMkTokenIllegal);
+    return NULL;
+  }
+  // Recursion is bounded for the parser's own stack, as on thousands of
+  // nested parentheses, and the height of what it builds for the passes that
+  // recurse on the tree, which the infix loop grows without recursing.
+  // `parser->height` collects the tallest expression nested in the one being
+  // built; a parenthesized one counts a level more than it is, which only
+  // errs on the safe side.
+  uint32_t depth = parser->depth;
+  if (depth == kMkAstMaxHeight) {
+    ParserError(parser, kMkParseErrorTooDeep, CurrentToken(parser),
+                kMkTokenIllegal);
+    return NULL;
+  }
+  uint32_t outer_height = parser->height;
+  parser->height = 0;
+  ++parser->depth;
+  MkAstExpression* left = prefix(parser);
+  uint32_t height = parser->height + 1;
+  while (left != NULL &&
+         precedence < kParseRules[PeekToken(parser).type].precedence) {
+    InfixParseFn infix = kParseRules[PeekToken(parser).type].infix;
+    ParserNextToken(parser);
+    parser->height = 0;
+    MkToken operator_token = CurrentToken(parser);
+    left = infix(parser, left);
+    height = (height > parser->height ? height : parser->height) + 1;
+    if (left != NULL && depth + height > kMkAstMaxHeight) {
+      ParserError(parser, kMkParseErrorTooDeep, operator_token,
+                  kMkTokenIllegal);
+      left = NULL;
+    }
+  }
+  parser->depth = depth;
+  parser->height = outer_height > height ? outer_height : height;
+  return left;
+}
+
+MkAstExpression* ParseIdentifier(MkParser* parser) {
+  return &NewIdentifier(parser, CurrentToken(parser))->base;
+}
+
+MkAstExpression* ParseIntegerLiteral(MkParser* parser) {
+  StringView literal = CurrentToken(parser).literal;
+  int64_t value = 0;
+  for (const char* p = literal.begin; p < literal.end; ++p) {
+    int64_t digit = *p - '0';
+    if (value > (INT64_MAX - digit) / 10) {
+      ParserError(parser, kMkParseErrorIntegerOverflow,
+                  CurrentToken(parser), kMkTokenIllegal);
+      return NULL;
+    }
+    value = value * 10 + digit;
+  }
+  MkAstIntegerLiteral* integer = NEW_NODE(parser, MkAstIntegerLiteral);
+  integer->base.base.type = kMkAstNodeExpression;
+  integer->base.type = kMkAstExpressionIntegerLiteral;
+  integer->token = CurrentToken(parser);
+  integer->value = value;
+  return &integer->base;
+}
+
+MkAstExpression* ParseBoolean(MkParser* parser) {
+  MkAstBoolean* boolean = NEW_NODE(parser, MkAstBoolean);
+  boolean->base.base.type = kMkAstNodeExpression;
+  boolean->base.type = kMkAstExpressionBoolean;
+  boolean->token = CurrentToken(parser);
+  boolean->value = CurrentToken(parser).type == kMkTokenTrue;
+  return &boolean->base;
+}
+
+MkAstExpression* ParsePrefixExpression(MkParser* parser) {
+  MkAstPrefixExpression* expression = NEW_NODE(parser, MkAstPrefixExpression);
+  expression->base.base.type = kMkAstNodeExpression;
+  expression->base.type = kMkAstExpressionPrefix;
+  expression->token = CurrentToken(parser);
+  ParserNextToken(parser);
+  expression->right = ParseExpression(parser, kPrecedencePrefix);
+  if (expression->right == NULL) {
+    return NULL;
+  }
+  return &expression->base;
+}
+
+MkAstExpression* ParseGroupedExpression(MkParser* parser) {
+  ParserNextToken(parser);
+  MkAstExpression* expression = ParseExpression(parser, kPrecedenceLowest);
+  if (expression == NULL) {
+    return NULL;
+  }
+  if (!ExpectPeek(parser, kMkTokenRparen)) {
+    return NULL;
+  }
+  return expression;
+}
+
+MkAstExpression* ParseIfExpression(MkParser* parser) {
+  MkAstIfExpression* expression = NEW_NODE(parser, MkAstIfExpression);
+  expression->base.base.type = kMkAstNodeExpression;
+  expression->base.type = kMkAstExpressionIf;
+  expression->token = CurrentToken(parser);
+  if (!ExpectPeek(parser, kMkTokenLparen)) {
+    return NULL;
+  }
+  ParserNextToken(parser);
+  expression->condition = ParseExpression(parser, kPrecedenceLowest);
+  if (expression->condition == NULL || !ExpectPeek(parser, kMkTokenRparen) ||
+      !ExpectPeek(parser, kMkTokenLbrace)) {
+    return NULL;
+  }
+  expression->consequence = ParseBlockStatement(parser);
+  if (expression->consequence == NULL) {
+    return NULL;
+  }
+  if (PeekToken(parser).type == kMkTokenElse) {
+    ParserNextToken(parser);
+    if (!ExpectPeek(parser, kMkTokenLbrace)) {
+      return NULL;
+    }
+    expression->alternative = ParseBlockStatement(parser);
+    if (expression->alternative == NULL) {
+      return NULL;
+    }
+  }
+  return &expression->base;
+}
+
+MkAstExpression* ParseFunctionLiteral(MkParser* parser) {
+  MkAstFunctionLiteral* function = NEW_NODE(parser, MkAstFunctionLiteral);
+  function->base.base.type = kMkAstNodeExpression;
+  function->base.type = kMkAstExpressionFunctionLiteral;
+  function->token = CurrentToken(parser);
+  if (!ExpectPeek(parser, kMkTokenLparen) ||
+      !ParseFunctionParameters(parser, &function->parameters) ||
+      !ExpectPeek(parser, kMkTokenLbrace)) {
+    return NULL;
+  }
+  function->body = ParseBlockStatement(parser);
+  if (function->body == NULL) {
+    return NULL;
+  }
+  return &function->base;
+}
+
+// Starts on the '(' and ends on the ')'.
+bool ParseFunctionParameters(MkParser* parser, MkAstIdentifiers* parameters) {
+  if (PeekToken(parser).type == kMkTokenRparen) {
+    ParserNextToken(parser);
+    return true;
+  }
+  uint64_t start = parser->scratch.size;
+  do {
+    if (!ExpectPeek(parser, kMkTokenIdent)) {
+      parser->scratch.size = start;
+      return false;
+    }
+    VEC_PUSH(&parser->scratch, NewIdentifier(parser, CurrentToken(parser)));
+  } while (PeekToken(parser).type == kMkTokenComma &&
+           (ParserNextToken(parser), true));
+  parameters->data = ScratchToArena(parser, start, &parameters->size);
+  parameters->capacity = parameters->size;
+  return ExpectPeek(parser, kMkTokenRparen);
+}
+
+MkAstExpression* ParseInfixExpression(MkParser* parser,
+                                      MkAstExpression* left) {
+  MkAstInfixExpression* expression = NEW_NODE(parser, MkAstInfixExpression);
+  expression->base.base.type = kMkAstNodeExpression;
+  expression->base.type = kMkAstExpressionInfix;
+  expression->token = CurrentToken(parser);
+  expression->left = left;
+  Precedence precedence = kParseRules[CurrentToken(parser).type].precedence;
+  ParserNextToken(parser);
+  expression->right = ParseExpression(parser, precedence);
+  if (expression->right == NULL) {
+    return NULL;
+  }
+  return &expression->base;
+}
+
+MkAstExpression* ParseCallExpression(MkParser* parser,
+                                     MkAstExpression* function) {
+  MkAstCallExpression* expression = NEW_NODE(parser, MkAstCallExpression);
+  expression->base.base.type = kMkAstNodeExpression;
+  expression->base.type = kMkAstExpressionCall;
+  expression->token = CurrentToken(parser);
+  expression->function = function;
+  if (!ParseCallArguments(parser, &expression->arguments)) {
+    return NULL;
+  }
+  return &expression->base;
+}
+
+// Starts on the '(' and ends on the ')'.
+bool ParseCallArguments(MkParser* parser, MkAstExpressions* arguments) {
+  if (PeekToken(parser).type == kMkTokenRparen) {
+    ParserNextToken(parser);
+    return true;
+  }
+  uint64_t start = parser->scratch.size;
+  do {
+    ParserNextToken(parser);
+    MkAstExpression* argument = ParseExpression(parser, kPrecedenceLowest);
+    if (argument == NULL) {
+      parser->scratch.size = start;
+      return false;
+    }
+    VEC_PUSH(&parser->scratch, argument);
+  } while (PeekToken(parser).type == kMkTokenComma &&
+           (ParserNextToken(parser), true));
+  arguments->data = ScratchToArena(parser, start, &arguments->size);
+  arguments->capacity = arguments->size;
+  return ExpectPeek(parser, kMkTokenRparen);
+}
+
+MkAstIdentifier* NewIdentifier(MkParser* parser, MkToken token) {
+  MkAstIdentifier* identifier = NEW_NODE(parser, MkAstIdentifier);
+  identifier->base.base.type = kMkAstNodeExpression;
+  identifier->base.type = kMkAstExpressionIdentifier;
+  identifier->token = token;
+  identifier->symbol = MkInternerIntern(parser->symbols, token.literal);
+  identifier->depth = kMkAstUnresolved;
+  return identifier;
+}
+
+// Counts the node for `node_count` as it allocates it.
+void* NewNode(MkParser* parser, uint64_t size) {
+  ++parser->node_count;
+  return ArenaAlloc(parser->arena, size);
+}
+
+// Pops the entries pushed onto the scratch stack since `start` and returns
+// them as an array in the arena. Pointers to every node type have the same
+// representation, so the array can be used as any of the AST list types.
+void* ScratchToArena(MkParser* parser, uint64_t start, uint64_t* size) {
+  *size = parser->scratch.size - start;
+  if (*size == 0) {
+    return NULL;
+  }
+  void** list = ARENA_NEW_ARRAY(parser->arena, void*, *size);
+  memcpy(list, &parser->scratch.data[start], *size * sizeof(void*));
+  parser->scratch.size = start;
+  return list;
+}
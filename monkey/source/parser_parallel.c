@@ -0,0 +1,202 @@
+#include <arena/arena.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vec/vec.h>
+
+#include "monkey/ast.h"
+#include "monkey/intern.h"
+#include "monkey/parser.h"
+#include "monkey/token.h"
+#include "pool/pool.h"
+
+enum {
+  kDefaultMinRangeTokens = 64 * 1024,
+  kRangesPerThread = 4,
+};
+
+typedef struct {
+  const MkParser* parser;
+  uint64_t* bounds;
+  MkAstProgram** programs;
+  MkErrors* errors;
+  // Each range interns into its own table, so that no lock is shared. Merging
+  // them in order numbers the names as a serial parse would, and range i's
+  // symbols are renumbered through `renumber[i]`.
+  MkInterner* symbols;
+  uint32_t** renumber;
+} ParallelParse;
+
+static uint64_t FindBoundaries(const MkTokenBuffer* tokens,
+                               uint64_t begin,
+                               uint64_t end,
+                               uint64_t min_range_tokens,
+                               uint64_t range_count,
+                               uint64_t* bounds);
+static void ParseRange(void* context, uint64_t index);
+static void RenumberRange(void* context, uint64_t index);
+static void FreeParse(ParallelParse* parse, uint64_t range_count);
+
+MkAstProgram* MkParserParseProgramParallel(MkParser* parser,
+                                           ThreadPool* pool,
+                                           uint64_t min_range_tokens) {
+  if (min_range_tokens == 0) {
+    min_range_tokens = kDefaultMinRangeTokens;
+  }
+  uint64_t size = parser->end - parser->index;
+  uint64_t range_count = (uint64_t)pool->thread_count * kRangesPerThread;
+  if (range_count > size / min_range_tokens) {
+    range_count = size / min_range_tokens;
+  }
+  if (pool->thread_count < 2 || range_count < 2) {
+    return MkParserParseProgram(parser);
+  }
+
+  ParallelParse parse = {
+      .parser = parser,
+      .bounds = calloc(range_count + 1, sizeof(uint64_t)),
+  };
+  if (parse.bounds == NULL) {
+    return MkParserParseProgram(parser);
+  }
+  range_count = FindBoundaries(&parser->tokens, parser->index, parser->end,
+                               min_range_tokens, range_count, parse.bounds);
+  parse.programs = calloc(range_count, sizeof(MkAstProgram*));
+  parse.errors = calloc(range_count, sizeof(MkErrors));
+  parse.symbols = calloc(range_count, sizeof(MkInterner));
+  parse.renumber = calloc(range_count, sizeof(uint32_t*));
+  if (range_count < 2 || parse.programs == NULL || parse.errors == NULL ||
+      parse.symbols == NULL || parse.renumber == NULL) {
+    FreeParse(&parse, 0);
+    return MkParserParseProgram(parser);
+  }
+  ThreadPoolRun(pool, ParseRange, &parse, range_count);
+  // Merged in order, so that names are numbered as a serial parse would. One
+  // more entry than there are names keeps malloc from being asked for none.
+  for (uint64_t i = 0; i < range_count; ++i) {
+    parse.renumber[i] =
+        malloc((MkInternerCount(&parse.symbols[i]) + 1) * sizeof(uint32_t));
+    if (parse.renumber[i] == NULL) {
+      for (uint64_t j = 0; j < range_count; ++j) {
+        MkAstNodeFree(&parse.programs[j]->base);
+        free(parse.programs[j]);
+        VEC_FREE(&parse.errors[j]);
+      }
+      FreeParse(&parse, range_count);
+      return MkParserParseProgram(parser);
+    }
+    MkInternerMerge(parser->symbols, &parse.symbols[i], parse.renumber[i]);
+  }
+  ThreadPoolRun(pool, RenumberRange, &parse, range_count);
+
+  MkAstProgram* program = calloc(sizeof(MkAstProgram), 1);
+  program->base.type = kMkAstNodeProgram;
+  ArenaInit(&program->arena);
+  uint64_t statement_count = 0;
+  for (uint64_t i = 0; i < range_count; ++i) {
+    statement_count += parse.programs[i]->statements.size;
+  }
+  if (statement_count > 0) {
+    program->statements.data =
+        ARENA_NEW_ARRAY(&program->arena, MkAstStatement*, statement_count);
+  }
+  for (uint64_t i = 0; i < range_count; ++i) {
+    MkAstProgram* part = parse.programs[i];
+    if (part->statements.size > 0) {
+      memcpy(&program->statements.data[program->statements.size],
+             part->statements.data,
+             part->statements.size * sizeof(MkAstStatement*));
+      program->statements.size += part->statements.size;
+    }
+    program->node_count += part->node_count;
+    ArenaAdopt(&program->arena, &part->arena);
+    free(part);
+    VEC_APPEND(&parser->errors, parse.errors[i].data, parse.errors[i].size);
+    VEC_FREE(&parse.errors[i]);
+  }
+  program->statements.capacity = program->statements.size;
+  program->parsed_size = program->arena.used;
+  // Leaves the parser on the EOF token, as a serial parse would, by emptying
+  // the window so that it is refilled from there.
+  parser->index = parser->end;
+  parser->next = parser->end;
+  parser->head = parser->count = 0;
+  MkParserSetLookahead(parser, parser->lookahead);
+  FreeParse(&parse, range_count);
+  return program;
+}
+
+// Splits [begin, end) into at most `range_count` ranges of at least
+// `min_range_tokens` tokens each, cut after a ';' outside braces. The serial
+// parser starts a new statement after such a ';' no matter what came before.
+// Only a block can contain a ';', so a statement either ends on it or has
+// failed by the time it is reached, and error recovery stops right after the
+// first ';' outside braces it opened. Parentheses do not matter: an unclosed
+// one fails at the ';' like any other error. A '}' without a match would make
+// the braces miscounted, so no cuts are made after one. Returns the number of
+// ranges, with their bounds in `bounds`.
+uint64_t FindBoundaries(const MkTokenBuffer* tokens,
+                        uint64_t begin,
+                        uint64_t end,
+                        uint64_t min_range_tokens,
+                        uint64_t range_count,
+                        uint64_t* bounds) {
+  uint64_t used = 0;
+  bounds[0] = begin;
+  uint64_t target = begin + (end - begin) / range_count;
+  uint64_t braces = 0;
+  for (uint64_t i = begin; i < end && used + 1 < range_count; ++i) {
+    MkTokenType type = tokens->kinds[i];
+    if (type == kMkTokenLbrace) {
+      ++braces;
+    } else if (type == kMkTokenRbrace) {
+      if (braces == 0) {
+        break;
+      }
+      --braces;
+    } else if (type == kMkTokenSemicolon && braces == 0 && i + 1 >= target &&
+               i + 1 - bounds[used] >= min_range_tokens &&
+               end - (i + 1) >= min_range_tokens) {
+      bounds[++used] = i + 1;
+      target = bounds[used] + (end - bounds[used]) / (range_count - used);
+    }
+  }
+  bounds[++used] = end;
+  return used;
+}
+
+void ParseRange(void* context, uint64_t index) {
+  ParallelParse* parse = context;
+  MkParser parser;
+  MkParserInitRange(&parser, parse->parser->source, &parse->parser->tokens,
+                    parse->bounds[index], parse->bounds[index + 1]);
+  MkInternerInit(&parse->symbols[index]);
+  parser.symbols = &parse->symbols[index];
+  parse->programs[index] = MkParserParseProgram(&parser);
+  parse->errors[index] = parser.errors;
+  parser.errors = (MkErrors){0};
+  MkParserFree(parser);
+}
+
+void RenumberRange(void* context, uint64_t index) {
+  ParallelParse* parse = context;
+  MkAstStatements* statements = &parse->programs[index]->statements;
+  for (uint64_t i = 0; i < statements->size; ++i) {
+    MkAstStatementRenumber(statements->data[i], parse->renumber[index]);
+  }
+}
+
+// Frees what `parse` holds for its first `range_count` ranges, other than
+// their programs and errors.
+void FreeParse(ParallelParse* parse, uint64_t range_count) {
+  for (uint64_t i = 0; i < range_count; ++i) {
+    MkInternerFree(&parse->symbols[i]);
+    free(parse->renumber[i]);
+  }
+  free(parse->bounds);
+  free(parse->programs);
+  free(parse->errors);
+  free(parse->symbols);
+  free(parse->renumber);
+}
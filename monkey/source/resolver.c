@@ -0,0 +1,283 @@
+#include "monkey/resolver.h"
+
+#include <arena/arena.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vec/vec.h>
+
+#include "monkey/ast.h"
+
+typedef struct {
+  Arena* arena;
+  // The scopes around the node being resolved, innermost last.
+  VEC_TYPE(const MkAstScope*) scopes;
+  // The identifiers that bind names in the scope being collected.
+  VEC_TYPE(MkAstIdentifier*) bindings;
+  VEC_TYPE(uint32_t) symbols;
+  bool failed;
+} Resolver;
+
+static void ResolveScope(Resolver* resolver,
+                         MkAstScope* scope,
+                         const MkAstIdentifiers* parameters,
+                         const MkAstStatements* statements);
+static void CollectStatements(Resolver* resolver,
+                              MkAstScope* scope,
+                              const MkAstStatements* statements);
+static void CollectExpression(Resolver* resolver,
+                              MkAstScope* scope,
+                              const MkAstExpression* expr);
+static void ResolveStatements(Resolver* resolver,
+                              const MkAstStatements* statements);
+static void ResolveStatement(Resolver* resolver, const MkAstStatement* stmt);
+static void ResolveExpression(Resolver* resolver, MkAstExpression* expr);
+static void ResolveIdentifier(Resolver* resolver, MkAstIdentifier* identifier);
+static void PushBinding(Resolver* resolver, MkAstIdentifier* identifier);
+static int CompareSymbols(const void* a, const void* b);
+
+bool MkResolveProgram(MkAstProgram* program) {
+  MkAstProgramSettle(program);
+  Resolver resolver = {.arena = &program->arena};
+  ResolveScope(&resolver, &program->scope, NULL, &program->statements);
+  VEC_FREE(&resolver.scopes);
+  VEC_FREE(&resolver.bindings);
+  VEC_FREE(&resolver.symbols);
+  return !resolver.failed;
+}
+
+uint32_t MkAstScopeFind(const MkAstScope* scope, uint32_t symbol) {
+  uint32_t lo = 0;
+  uint32_t hi = scope->size;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (scope->symbols[mid] < symbol) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < scope->size && scope->symbols[lo] == symbol) {
+    return lo;
+  }
+  return kMkAstUnresolved;
+}
+
+// Collects the names the scope binds before resolving anything in it, so that
+// a function can refer to variables bound after it, such as itself.
+void ResolveScope(Resolver* resolver,
+                  MkAstScope* scope,
+                  const MkAstIdentifiers* parameters,
+                  const MkAstStatements* statements) {
+  *scope = (MkAstScope){0};
+  uint64_t start = resolver->bindings.size;
+  for (uint64_t i = 0; parameters != NULL && i < parameters->size; ++i) {
+    PushBinding(resolver, parameters->data[i]);
+  }
+  CollectStatements(resolver, scope, statements);
+
+  resolver->symbols.size = 0;
+  for (uint64_t i = start; i < resolver->bindings.size; ++i) {
+    if (!VEC_PUSH(&resolver->symbols, resolver->bindings.data[i]->symbol)) {
+      resolver->failed = true;
+    }
+  }
+  uint64_t size = resolver->symbols.size;
+  if (size > 0) {
+    qsort(resolver->symbols.data, size, sizeof(uint32_t), CompareSymbols);
+    uint64_t unique = 1;
+    for (uint64_t i = 1; i < size; ++i) {
+      if (resolver->symbols.data[i] != resolver->symbols.data[unique - 1]) {
+        resolver->symbols.data[unique++] = resolver->symbols.data[i];
+      }
+    }
+    scope->symbols = ARENA_NEW_ARRAY(resolver->arena, uint32_t, unique);
+    if (scope->symbols == NULL) {
+      resolver->failed = true;
+    } else {
+      memcpy(scope->symbols, resolver->symbols.data,
+             unique * sizeof(uint32_t));
+      scope->size = (uint32_t)unique;
+    }
+  }
+  for (uint64_t i = start; i < resolver->bindings.size; ++i) {
+    MkAstIdentifier* binding = resolver->bindings.data[i];
+    binding->slot = MkAstScopeFind(scope, binding->symbol);
+    binding->depth = binding->slot == kMkAstUnresolved ? kMkAstUnresolved : 0;
+  }
+  resolver->bindings.size = start;
+
+  if (!VEC_PUSH(&resolver->scopes, scope)) {
+    resolver->failed = true;
+    return;
+  }
+  ResolveStatements(resolver, statements);
+  --resolver->scopes.size;
+}
+
+void CollectStatements(Resolver* resolver,
+                       MkAstScope* scope,
+                       const MkAstStatements* statements) {
+  for (uint64_t i = 0; i < statements->size; ++i) {
+    const MkAstStatement* stmt = statements->data[i];
+    switch (stmt->type) {
+      case kMkAstStatementLet: {
+        MkAstLetStatement* let_stmt = (MkAstLetStatement*)stmt;
+        PushBinding(resolver, &let_stmt->name);
+        CollectExpression(resolver, scope, let_stmt->value);
+      } break;
+      case kMkAstStatementReturn:
+        CollectExpression(resolver, scope,
+                          ((const MkAstReturnStatement*)stmt)->return_value);
+        break;
+      case kMkAstStatementExpression:
+        CollectExpression(
+            resolver, scope,
+            ((const MkAstExpressionStatement*)stmt)->expression);
+        break;
+      case kMkAstStatementBlock:
+        CollectStatements(resolver, scope,
+                          &((const MkAstBlockStatement*)stmt)->statements);
+        break;
+    }
+  }
+}
+
+// Only an `if` can contain statements, and so bindings, within an expression;
+// the rest of the walk looks for closures.
+void CollectExpression(Resolver* resolver,
+                       MkAstScope* scope,
+                       const MkAstExpression* expr) {
+  if (expr == NULL) {
+    return;
+  }
+  switch (expr->type) {
+    case kMkAstExpressionIdentifier:
+    case kMkAstExpressionIntegerLiteral:
+    case kMkAstExpressionBoolean:
+      break;
+    case kMkAstExpressionPrefix:
+      CollectExpression(resolver, scope,
+                        ((const MkAstPrefixExpression*)expr)->right);
+      break;
+    case kMkAstExpressionInfix: {
+      const MkAstInfixExpression* infix = (const MkAstInfixExpression*)expr;
+      CollectExpression(resolver, scope, infix->left);
+      CollectExpression(resolver, scope, infix->right);
+    } break;
+    case kMkAstExpressionIf: {
+      const MkAstIfExpression* if_expr = (const MkAstIfExpression*)expr;
+      CollectExpression(resolver, scope, if_expr->condition);
+      CollectStatements(resolver, scope, &if_expr->consequence->statements);
+      if (if_expr->alternative != NULL) {
+        CollectStatements(resolver, scope, &if_expr->alternative->statements);
+      }
+    } break;
+    case kMkAstExpressionFunctionLiteral:
+      scope->captured = true;
+      break;
+    case kMkAstExpressionCall: {
+      const MkAstCallExpression* call = (const MkAstCallExpression*)expr;
+      CollectExpression(resolver, scope, call->function);
+      for (uint64_t i = 0; i < call->arguments.size; ++i) {
+        CollectExpression(resolver, scope, call->arguments.data[i]);
+      }
+    } break;
+  }
+}
+
+void ResolveStatements(Resolver* resolver, const MkAstStatements* statements) {
+  for (uint64_t i = 0; i < statements->size; ++i) {
+    ResolveStatement(resolver, statements->data[i]);
+  }
+}
+
+void ResolveStatement(Resolver* resolver, const MkAstStatement* stmt) {
+  switch (stmt->type) {
+    case kMkAstStatementLet:
+      // The name was bound when the scope was collected.
+      ResolveExpression(resolver, ((const MkAstLetStatement*)stmt)->value);
+      break;
+    case kMkAstStatementReturn:
+      ResolveExpression(resolver,
+                        ((const MkAstReturnStatement*)stmt)->return_value);
+      break;
+    case kMkAstStatementExpression:
+      ResolveExpression(resolver,
+                        ((const MkAstExpressionStatement*)stmt)->expression);
+      break;
+    case kMkAstStatementBlock:
+      ResolveStatements(resolver,
+                        &((const MkAstBlockStatement*)stmt)->statements);
+      break;
+  }
+}
+
+void ResolveExpression(Resolver* resolver, MkAstExpression* expr) {
+  if (expr == NULL) {
+    return;
+  }
+  switch (expr->type) {
+    case kMkAstExpressionIdentifier:
+      ResolveIdentifier(resolver, (MkAstIdentifier*)expr);
+      break;
+    case kMkAstExpressionIntegerLiteral:
+    case kMkAstExpressionBoolean:
+      break;
+    case kMkAstExpressionPrefix:
+      ResolveExpression(resolver, ((MkAstPrefixExpression*)expr)->right);
+      break;
+    case kMkAstExpressionInfix: {
+      MkAstInfixExpression* infix = (MkAstInfixExpression*)expr;
+      ResolveExpression(resolver, infix->left);
+      ResolveExpression(resolver, infix->right);
+    } break;
+    case kMkAstExpressionIf: {
+      MkAstIfExpression* if_expr = (MkAstIfExpression*)expr;
+      ResolveExpression(resolver, if_expr->condition);
+      ResolveStatements(resolver, &if_expr->consequence->statements);
+      if (if_expr->alternative != NULL) {
+        ResolveStatements(resolver, &if_expr->alternative->statements);
+      }
+    } break;
+    case kMkAstExpressionFunctionLiteral: {
+      MkAstFunctionLiteral* function = (MkAstFunctionLiteral*)expr;
+      ResolveScope(resolver, &function->scope, &function->parameters,
+                   &function->body->statements);
+    } break;
+    case kMkAstExpressionCall: {
+      MkAstCallExpression* call = (MkAstCallExpression*)expr;
+      ResolveExpression(resolver, call->function);
+      for (uint64_t i = 0; i < call->arguments.size; ++i) {
+        ResolveExpression(resolver, call->arguments.data[i]);
+      }
+    } break;
+  }
+}
+
+void ResolveIdentifier(Resolver* resolver, MkAstIdentifier* identifier) {
+  identifier->depth = kMkAstUnresolved;
+  uint64_t count = resolver->scopes.size;
+  for (uint64_t depth = 0; depth < count; ++depth) {
+    const MkAstScope* scope = resolver->scopes.data[count - 1 - depth];
+    uint32_t slot = MkAstScopeFind(scope, identifier->symbol);
+    if (slot != kMkAstUnresolved) {
+      identifier->depth = (uint32_t)depth;
+      identifier->slot = slot;
+      return;
+    }
+  }
+}
+
+void PushBinding(Resolver* resolver, MkAstIdentifier* identifier) {
+  if (!VEC_PUSH(&resolver->bindings, identifier)) {
+    resolver->failed = true;
+  }
+}
+
+int CompareSymbols(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return (x > y) - (x < y);
+}
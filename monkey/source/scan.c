@@ -0,0 +1,354 @@
+#include "monkey/scan.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string/string.h>
+#include <vec/vec.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define MK_SCAN_X86_ 1
+#include <immintrin.h>
+#endif
+
+typedef uint64_t (*ScanFn)(const char* data, uint64_t position, uint64_t size);
+typedef bool (*LineStartsFn)(const char* data,
+                             uint64_t size,
+                             MkLineStarts* starts);
+
+typedef struct {
+  MkScanLevel level;
+  ScanFn whitespace;
+  ScanFn letters;
+  ScanFn digits;
+  LineStartsFn line_starts;
+} ScanKernels;
+
+static const char* const kScanLevelNames[] = {
+#define X(x, name) name,
+    MK_SCAN_LEVELS_
+#undef X
+};
+
+static uint64_t ViewSize(StringView view);
+static bool IsWhitespace(uint8_t ch);
+static bool IsLetter(uint8_t ch);
+static bool IsDigit(uint8_t ch);
+static uint64_t ScalarWhitespace(const char* data,
+                                 uint64_t position,
+                                 uint64_t size);
+static uint64_t ScalarLetters(const char* data,
+                              uint64_t position,
+                              uint64_t size);
+static uint64_t ScalarDigits(const char* data,
+                             uint64_t position,
+                             uint64_t size);
+static bool ScalarLineStarts(const char* data,
+                             uint64_t size,
+                             MkLineStarts* starts);
+static bool ScalarLineStartsFrom(const char* data,
+                                 uint64_t position,
+                                 uint64_t size,
+                                 MkLineStarts* starts);
+static bool ReserveLineStarts(MkLineStarts* starts, uint64_t extra);
+static const ScanKernels* ResolveKernels(void);
+static void PickBestLevel(void);
+static const ScanKernels* KernelsFor(MkScanLevel level);
+
+static const ScanKernels kScalarKernels = {
+    .level = kMkScanScalar,
+    .whitespace = ScalarWhitespace,
+    .letters = ScalarLetters,
+    .digits = ScalarDigits,
+    .line_starts = ScalarLineStarts,
+};
+
+#ifdef MK_SCAN_X86_
+
+// Letters and digits are range checks. SSE2 only has signed byte compares, so
+// each range is biased to start at -128 and tested with a single compare.
+#define SCAN_SSE2_WHITESPACE_(V)                                    \
+  _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(V, _mm_set1_epi8(' ')),  \
+                            _mm_cmpeq_epi8(V, _mm_set1_epi8('\t'))), \
+               _mm_or_si128(_mm_cmpeq_epi8(V, _mm_set1_epi8('\n')),  \
+                            _mm_cmpeq_epi8(V, _mm_set1_epi8('\r'))))
+#define SCAN_SSE2_LETTERS_(V)                                             \
+  _mm_cmplt_epi8(_mm_add_epi8(_mm_or_si128(V, _mm_set1_epi8(0x20)),       \
+                              _mm_set1_epi8(0x80 - 'a')),                 \
+                 _mm_set1_epi8(-128 + 26))
+#define SCAN_SSE2_DIGITS_(V)                                  \
+  _mm_cmplt_epi8(_mm_add_epi8(V, _mm_set1_epi8(0x80 - '0')), \
+                 _mm_set1_epi8(-128 + 10))
+
+#define SCAN_AVX2_WHITESPACE_(V)                                            \
+  _mm256_or_si256(                                                          \
+      _mm256_or_si256(_mm256_cmpeq_epi8(V, _mm256_set1_epi8(' ')),          \
+                      _mm256_cmpeq_epi8(V, _mm256_set1_epi8('\t'))),        \
+      _mm256_or_si256(_mm256_cmpeq_epi8(V, _mm256_set1_epi8('\n')),         \
+                      _mm256_cmpeq_epi8(V, _mm256_set1_epi8('\r'))))
+#define SCAN_AVX2_LETTERS_(V)                                              \
+  _mm256_cmpgt_epi8(                                                       \
+      _mm256_set1_epi8(-128 + 26),                                         \
+      _mm256_add_epi8(_mm256_or_si256(V, _mm256_set1_epi8(0x20)),          \
+                      _mm256_set1_epi8(0x80 - 'a')))
+#define SCAN_AVX2_DIGITS_(V)                                              \
+  _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 10),                          \
+                    _mm256_add_epi8(V, _mm256_set1_epi8(0x80 - '0')))
+
+#define SCAN_SSE2_KERNEL_(Name, Classify, Scalar)                           \
+  static uint64_t Name(const char* data, uint64_t position, uint64_t size) { \
+    while (position + 16 <= size) {                                         \
+      __m128i v = _mm_loadu_si128((const __m128i*)&data[position]);         \
+      uint32_t mask = (uint32_t)_mm_movemask_epi8(Classify(v)) ^ 0xFFFF;    \
+      if (mask != 0) {                                                      \
+        return position + (uint64_t)__builtin_ctz(mask);                    \
+      }                                                                     \
+      position += 16;                                                       \
+    }                                                                       \
+    return Scalar(data, position, size);                                    \
+  }
+
+#define SCAN_AVX2_KERNEL_(Name, Classify, Tail)                             \
+  __attribute__((target("avx2"))) static uint64_t Name(                     \
+      const char* data, uint64_t position, uint64_t size) {                 \
+    while (position + 32 <= size) {                                         \
+      __m256i v = _mm256_loadu_si256((const __m256i*)&data[position]);      \
+      uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(Classify(v));         \
+      if (mask != 0) {                                                      \
+        return position + (uint64_t)__builtin_ctz(mask);                    \
+      }                                                                     \
+      position += 32;                                                       \
+    }                                                                       \
+    return Tail(data, position, size);                                      \
+  }
+
+SCAN_SSE2_KERNEL_(Sse2Whitespace, SCAN_SSE2_WHITESPACE_, ScalarWhitespace)
+SCAN_SSE2_KERNEL_(Sse2Letters, SCAN_SSE2_LETTERS_, ScalarLetters)
+SCAN_SSE2_KERNEL_(Sse2Digits, SCAN_SSE2_DIGITS_, ScalarDigits)
+SCAN_AVX2_KERNEL_(Avx2Whitespace, SCAN_AVX2_WHITESPACE_, Sse2Whitespace)
+SCAN_AVX2_KERNEL_(Avx2Letters, SCAN_AVX2_LETTERS_, Sse2Letters)
+SCAN_AVX2_KERNEL_(Avx2Digits, SCAN_AVX2_DIGITS_, Sse2Digits)
+
+// Newlines are sparse, so each block reserves room for a full block of them
+// up front and the bit loop stores without further checks.
+static bool Sse2LineStarts(const char* data,
+                           uint64_t size,
+                           MkLineStarts* starts) {
+  uint64_t position = 0;
+  while (position + 16 <= size) {
+    if (!ReserveLineStarts(starts, 16)) {
+      return false;
+    }
+    __m128i v = _mm_loadu_si128((const __m128i*)&data[position]);
+    uint32_t mask =
+        (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    while (mask != 0) {
+      starts->data[starts->size++] =
+          (uint32_t)(position + (uint64_t)__builtin_ctz(mask) + 1);
+      mask &= mask - 1;
+    }
+    position += 16;
+  }
+  return ScalarLineStartsFrom(data, position, size, starts);
+}
+
+__attribute__((target("avx2"))) static bool Avx2LineStarts(
+    const char* data,
+    uint64_t size,
+    MkLineStarts* starts) {
+  uint64_t position = 0;
+  while (position + 32 <= size) {
+    if (!ReserveLineStarts(starts, 32)) {
+      return false;
+    }
+    __m256i v = _mm256_loadu_si256((const __m256i*)&data[position]);
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    while (mask != 0) {
+      starts->data[starts->size++] =
+          (uint32_t)(position + (uint64_t)__builtin_ctz(mask) + 1);
+      mask &= mask - 1;
+    }
+    position += 32;
+  }
+  return ScalarLineStartsFrom(data, position, size, starts);
+}
+
+static const ScanKernels kSse2Kernels = {
+    .level = kMkScanSse2,
+    .whitespace = Sse2Whitespace,
+    .letters = Sse2Letters,
+    .digits = Sse2Digits,
+    .line_starts = Sse2LineStarts,
+};
+
+static const ScanKernels kAvx2Kernels = {
+    .level = kMkScanAvx2,
+    .whitespace = Avx2Whitespace,
+    .letters = Avx2Letters,
+    .digits = Avx2Digits,
+    .line_starts = Avx2LineStarts,
+};
+
+#endif  // MK_SCAN_X86_
+
+// Read on every scan, from any thread: the lexer runs on pool workers under
+// MkLexerTokenizeParallel. The default is picked once, under `scan_pick`.
+static _Atomic(const ScanKernels*) scan_kernels = NULL;
+static pthread_once_t scan_pick = PTHREAD_ONCE_INIT;
+
+uint64_t MkScanWhitespace(StringView source, uint64_t position) {
+  return ResolveKernels()->whitespace(source.begin, position,
+                                      ViewSize(source));
+}
+
+uint64_t MkScanLetters(StringView source, uint64_t position) {
+  return ResolveKernels()->letters(source.begin, position, ViewSize(source));
+}
+
+uint64_t MkScanDigits(StringView source, uint64_t position) {
+  return ResolveKernels()->digits(source.begin, position, ViewSize(source));
+}
+
+bool MkScanLineStarts(StringView source, MkLineStarts* starts) {
+  uint64_t size = ViewSize(source);
+  if (size >= UINT32_MAX) {
+    return false;
+  }
+  return ResolveKernels()->line_starts(source.begin, size, starts);
+}
+
+bool MkScanLevelSupported(MkScanLevel level) {
+  switch (level) {
+    case kMkScanScalar:
+      return true;
+#ifdef MK_SCAN_X86_
+    case kMkScanSse2:
+      return __builtin_cpu_supports("sse2");
+    case kMkScanAvx2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+bool MkScanSetLevel(MkScanLevel level) {
+  if (!MkScanLevelSupported(level)) {
+    return false;
+  }
+  atomic_store_explicit(&scan_kernels, KernelsFor(level),
+                        memory_order_release);
+  return true;
+}
+
+MkScanLevel MkScanGetLevel(void) {
+  return ResolveKernels()->level;
+}
+
+const char* MkScanLevelName(MkScanLevel level) {
+  if (level >= kMkScanLevelCount) {
+    return "invalid";
+  }
+  return kScanLevelNames[level];
+}
+
+const ScanKernels* ResolveKernels(void) {
+  const ScanKernels* kernels =
+      atomic_load_explicit(&scan_kernels, memory_order_acquire);
+  if (kernels == NULL) {
+    pthread_once(&scan_pick, PickBestLevel);
+    kernels = atomic_load_explicit(&scan_kernels, memory_order_acquire);
+  }
+  return kernels;
+}
+
+// Leaves a level forced by MkScanSetLevel before first use in place.
+void PickBestLevel(void) {
+  MkScanLevel level = kMkScanLevelCount;
+  do {
+    --level;
+  } while (!MkScanLevelSupported(level));
+  const ScanKernels* expected = NULL;
+  atomic_compare_exchange_strong(&scan_kernels, &expected, KernelsFor(level));
+}
+
+const ScanKernels* KernelsFor(MkScanLevel level) {
+  switch (level) {
+#ifdef MK_SCAN_X86_
+    case kMkScanSse2:
+      return &kSse2Kernels;
+    case kMkScanAvx2:
+      return &kAvx2Kernels;
+#endif
+    default:
+      return &kScalarKernels;
+  }
+}
+
+uint64_t ViewSize(StringView view) {
+  return (uint64_t)(view.end - view.begin);
+}
+
+bool IsWhitespace(uint8_t ch) {
+  return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+bool IsLetter(uint8_t ch) {
+  return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+bool IsDigit(uint8_t ch) {
+  return ch >= '0' && ch <= '9';
+}
+
+uint64_t ScalarWhitespace(const char* data, uint64_t position, uint64_t size) {
+  while (position < size && IsWhitespace(data[position])) {
+    ++position;
+  }
+  return position;
+}
+
+uint64_t ScalarLetters(const char* data, uint64_t position, uint64_t size) {
+  while (position < size && IsLetter(data[position])) {
+    ++position;
+  }
+  return position;
+}
+
+uint64_t ScalarDigits(const char* data, uint64_t position, uint64_t size) {
+  while (position < size && IsDigit(data[position])) {
+    ++position;
+  }
+  return position;
+}
+
+bool ScalarLineStarts(const char* data, uint64_t size, MkLineStarts* starts) {
+  return ScalarLineStartsFrom(data, 0, size, starts);
+}
+
+bool ScalarLineStartsFrom(const char* data,
+                          uint64_t position,
+                          uint64_t size,
+                          MkLineStarts* starts) {
+  for (; position < size; ++position) {
+    if (data[position] == '\n' &&
+        !VEC_PUSH(starts, (uint32_t)(position + 1))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ReserveLineStarts(MkLineStarts* starts, uint64_t extra) {
+  if (starts->capacity - starts->size >= extra) {
+    return true;
+  }
+  uint64_t capacity = starts->capacity * 2;
+  if (capacity < starts->size + extra) {
+    capacity = starts->size + extra;
+  }
+  return VEC_RESERVE(starts, capacity);
+}
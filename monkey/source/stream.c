@@ -0,0 +1,110 @@
+#include "monkey/stream.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "monkey/lexer.h"
+#include "monkey/token.h"
+
+enum { kDefaultChunkSize = 64 * 1024 };
+
+static bool StreamFill(MkStreamLexer* lexer);
+
+void MkStreamLexerInit(MkStreamLexer* lexer,
+                       MkStreamRefill refill,
+                       void* context,
+                       uint64_t chunk_size) {
+  *lexer = (MkStreamLexer){
+      .refill = refill,
+      .context = context,
+      .chunk_size = chunk_size ? chunk_size : kDefaultChunkSize,
+  };
+}
+
+// A token is only trusted when at least one byte follows it in the window:
+// otherwise an identifier or number may continue in the next chunk, or a
+// '=' / '!' may turn out to be '==' / '!='. Such tokens are lexed again from
+// their first byte once more input has been read.
+MkToken MkStreamLexerNextToken(MkStreamLexer* lexer) {
+  while (true) {
+    const char* window_end = lexer->buffer + lexer->end;
+    MkLexer window;
+    MkLexerInit(&window, (StringView){.begin = lexer->buffer + lexer->begin,
+                                      .end = window_end});
+    MkToken tok = MkLexerNextToken(&window);
+    if (lexer->eof || tok.literal.end < window_end) {
+      lexer->begin = (uint64_t)(tok.literal.end - lexer->buffer);
+      uint64_t offset =
+          lexer->offset + (uint64_t)(tok.literal.begin - lexer->buffer);
+      tok.offset = offset < UINT32_MAX ? (uint32_t)offset : UINT32_MAX;
+      return tok;
+    }
+    lexer->begin = (uint64_t)(tok.literal.begin - lexer->buffer);
+    if (!StreamFill(lexer)) {
+      lexer->eof = true;
+    }
+  }
+}
+
+void MkStreamLexerFree(MkStreamLexer* lexer) {
+  free(lexer->buffer);
+  *lexer = (MkStreamLexer){0};
+}
+
+int64_t MkStreamRefillFile(void* context, char* buffer, uint64_t capacity) {
+  FILE* fp = context;
+  size_t n = fread(buffer, 1, capacity, fp);
+  if (n == 0 && ferror(fp)) {
+    return -1;
+  }
+  return (int64_t)n;
+}
+
+int64_t MkStreamRefillFd(void* context, char* buffer, uint64_t capacity) {
+  int fd = *(const int*)context;
+  while (true) {
+    ssize_t n = read(fd, buffer, capacity);
+    if (n >= 0 || errno != EINTR) {
+      return n;
+    }
+  }
+}
+
+// Drops consumed bytes, grows the buffer if less than a chunk is free (which
+// only happens while a single token is longer than the space left), and reads
+// one chunk. Returns false at the end of input or on error.
+bool StreamFill(MkStreamLexer* lexer) {
+  uint64_t pending = lexer->end - lexer->begin;
+  if (lexer->begin > 0) {
+    memmove(lexer->buffer, lexer->buffer + lexer->begin, pending);
+    lexer->offset += lexer->begin;
+    lexer->begin = 0;
+    lexer->end = pending;
+  }
+  if (lexer->capacity - pending < lexer->chunk_size) {
+    uint64_t capacity = lexer->capacity * 2;
+    if (capacity < pending + lexer->chunk_size) {
+      capacity = pending + lexer->chunk_size;
+    }
+    char* buffer = realloc(lexer->buffer, capacity);
+    if (buffer == NULL) {
+      lexer->failed = true;
+      return false;
+    }
+    lexer->buffer = buffer;
+    lexer->capacity = capacity;
+  }
+  int64_t n = lexer->refill(lexer->context, lexer->buffer + lexer->end,
+                            lexer->chunk_size);
+  if (n <= 0) {
+    lexer->failed = n < 0;
+    return false;
+  }
+  lexer->end += (uint64_t)n;
+  return true;
+}
@@ -0,0 +1,91 @@
+#include "monkey/value.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string/string.h>
+
+#include "monkey/ast.h"
+#include "monkey/resolver.h"
+
+static const char* const kValueTypeNames[] = {
+#define X(x, name) name,
+    MK_VALUE_TYPES_
+#undef X
+};
+
+const char* MkValueTypeName(MkValueType type) {
+  if ((uint32_t)type >= sizeof(kValueTypeNames) / sizeof(kValueTypeNames[0])) {
+    return "INVALID";
+  }
+  return kValueTypeNames[type];
+}
+
+MkValueType MkValueTypeOf(MkValue value) {
+  if (MK_IS_SMALL_INTEGER(value)) {
+    return kMkValueInteger;
+  }
+  if (MK_IS_BOOLEAN(value)) {
+    return kMkValueBoolean;
+  }
+  if (MK_IS_NULL(value)) {
+    return kMkValueNull;
+  }
+  if (MK_IS_UNSET(value)) {
+    return kMkValueUnset;
+  }
+  return MK_AS_OBJECT(value)->kind == kMkObjectInteger ? kMkValueInteger
+                                                       : kMkValueFunction;
+}
+
+int64_t MkValueInteger(MkValue value) {
+  if (MK_IS_SMALL_INTEGER(value)) {
+    return MK_AS_SMALL_INTEGER(value);
+  }
+  return ((const MkInteger*)MK_AS_OBJECT(value))->value;
+}
+
+bool MkValueTruthy(MkValue value) {
+  return MK_TRUTHY(value);
+}
+
+bool MkValueIdentical(MkValue a, MkValue b) {
+  if (a.bits == b.bits) {
+    return true;
+  }
+  // Boxed integers are never in the small range, so they can only equal
+  // each other.
+  return MK_IS_OBJECT_KIND(a, kMkObjectInteger) &&
+         MK_IS_OBJECT_KIND(b, kMkObjectInteger) &&
+         MkValueInteger(a) == MkValueInteger(b);
+}
+
+String MkValueInspect(MkValue value) {
+  switch (MkValueTypeOf(value)) {
+    case kMkValueNull:
+      return StringFromC("null");
+    case kMkValueInteger:
+      return StringFormat("%" PRId64, MkValueInteger(value));
+    case kMkValueBoolean:
+      return StringFromC(MK_AS_BOOLEAN(value) ? "true" : "false");
+    case kMkValueFunction:
+      return MkAstNodeString(
+          (MkAstNode*)&MK_AS_CLOSURE(value)->function->base.base);
+    case kMkValueUnset:
+      break;
+  }
+  return StringFromC("unset");
+}
+
+bool MkEnvironmentLookup(const MkEnvironment* environment,
+                         uint32_t symbol,
+                         MkValue* out) {
+  for (; environment != NULL; environment = environment->parent) {
+    uint32_t slot = MkAstScopeFind(environment->scope, symbol);
+    if (slot != kMkAstUnresolved && !MK_IS_UNSET(environment->slots[slot])) {
+      *out = environment->slots[slot];
+      return true;
+    }
+  }
+  return false;
+}
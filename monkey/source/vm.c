@@ -0,0 +1,506 @@
+#include "monkey/vm.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string/string.h>
+#include <vec/vec.h>
+
+#include "monkey/ast.h"
+#include "monkey/code.h"
+#include "monkey/token.h"
+#include "monkey/value.h"
+
+// Dispatch jumps straight from one instruction to the next through a table
+// of label addresses where the compiler has them, so that each instruction
+// gets its own indirect branch to predict; elsewhere it is a switch in a loop.
+#if defined(__GNUC__) && !defined(MK_VM_NO_COMPUTED_GOTO)
+#define MK_VM_COMPUTED_GOTO_ 1
+#endif
+
+struct MkVmFrame {
+  const MkFunctionCode* function;
+  // Where to continue once the call this frame made returns.
+  const uint8_t* ip;
+  MkValue* locals;
+  // The environment holding `locals` if the function creates closures, which
+  // is where they capture; NULL otherwise.
+  MkEnvironment* environment;
+  // The environment the function was created in.
+  MkEnvironment* outer;
+  // Where the callee was on the stack, which the result replaces.
+  MkValue* base;
+};
+
+static bool Execute(MkVm* vm,
+                    const MkBytecode* bytecode,
+                    MkEnvironment* globals,
+                    MkValue* result);
+static bool Binary(MkVm* vm,
+                   MkOpcode op,
+                   MkValue left,
+                   MkValue right,
+                   MkValue* out,
+                   String* message);
+static String BinaryError(MkOpcode op, MkValue left, MkValue right);
+static void MarkRoots(MkHeap* heap, void* context);
+
+void MkVmInit(MkVm* vm) {
+  *vm = (MkVm){0};
+}
+
+bool MkVmRun(MkVm* vm, const MkBytecode* bytecode, MkValue* result) {
+  VEC_FREE(&vm->error);
+  vm->error_offset = 0;
+  if (vm->stack == NULL) {
+    vm->stack = malloc(kMkVmStackSize * sizeof(MkValue));
+  }
+  if (vm->frames == NULL) {
+    vm->frames = malloc(kMkVmMaxFrames * sizeof(MkVmFrame));
+  }
+  const MkFunctionCode* program = &bytecode->functions.data[0];
+  vm->heap.mark_roots = MarkRoots;
+  vm->heap.roots = vm;
+  vm->stack_top = vm->stack;
+  vm->frame_top = NULL;
+  MkEnvironment* globals = NULL;
+  if (vm->stack != NULL && vm->frames != NULL) {
+    globals = MkHeapNewEnvironment(&vm->heap, NULL, program->scope);
+  }
+  if (globals == NULL) {
+    vm->error = StringFromC("out of memory");
+    return false;
+  }
+  if (program->max_stack > kMkVmStackSize) {
+    vm->error = StringFromC("stack overflow");
+    return false;
+  }
+  return Execute(vm, bytecode, globals, result);
+}
+
+void MkVmFree(MkVm* vm) {
+  MkHeapFree(&vm->heap);
+  free(vm->stack);
+  free(vm->frames);
+  VEC_FREE(&vm->error);
+  *vm = (MkVm){0};
+}
+
+bool Execute(MkVm* vm,
+             const MkBytecode* bytecode,
+             MkEnvironment* globals,
+             MkValue* result) {
+  const MkValue* constants = bytecode->constants.data;
+  const MkFunctionCode* functions = bytecode->functions.data;
+  MkValue* stack_end = vm->stack + kMkVmStackSize;
+  MkVmFrame* frame = vm->frames;
+  *frame = (MkVmFrame){
+      .function = &functions[0],
+      .locals = globals->slots,
+      .environment = globals,
+      .base = vm->stack,
+  };
+  const uint8_t* ip = functions[0].code.data;
+  MkValue* sp = vm->stack;
+  MkValue* locals = globals->slots;
+  String message = {0};
+  vm->frame_top = frame;
+
+#define READ_OPERAND() (ip += 2, (uint32_t)ip[-2] | (uint32_t)ip[-1] << 8)
+// Before anything that may allocate, and so collect.
+#define SAVE_ROOTS()       \
+  do {                     \
+    vm->stack_top = sp;    \
+    vm->frame_top = frame; \
+  } while (false)
+#define FAIL(Message)   \
+  do {                  \
+    message = Message;  \
+    goto fail;          \
+  } while (false)
+
+#ifdef MK_VM_COMPUTED_GOTO_
+  static const void* const kLabels[] = {
+#define X(x, operands) &&Op##x,
+      MK_OPCODES_
+#undef X
+  };
+#define DISPATCH() goto* kLabels[*ip++]
+#define CASE(x) Op##x:
+  DISPATCH();
+#else
+#define DISPATCH() continue
+#define CASE(x) case kMkOp##x:
+  for (;;) {
+    switch ((MkOpcode)*ip++) {
+#endif
+
+  CASE(Constant) {
+    *sp++ = constants[READ_OPERAND()];
+    DISPATCH();
+  }
+  CASE(Null) {
+    *sp++ = MK_NULL;
+    DISPATCH();
+  }
+  CASE(True) {
+    *sp++ = MK_BOOLEAN(true);
+    DISPATCH();
+  }
+  CASE(False) {
+    *sp++ = MK_BOOLEAN(false);
+    DISPATCH();
+  }
+  CASE(Pop) {
+    --sp;
+    DISPATCH();
+  }
+
+  // Small integer operands take the fast path inline when the result is
+  // small too, and allocate nothing; anything else goes through Binary, which
+  // boxes wide integers and knows the errors. Arithmetic wraps at 64 bits, so
+  // products are taken unsigned. Sums of two small integers cannot overflow,
+  // nor can quotients, and tagging keeps the order of integers.
+#define ARITHMETIC(x, Expression)                                  \
+  CASE(x) {                                                        \
+    MkValue right = *--sp;                                         \
+    MkValue left = sp[-1];                                         \
+    if (MK_IS_SMALL_INTEGER(left) && MK_IS_SMALL_INTEGER(right)) { \
+      int64_t a = MK_AS_SMALL_INTEGER(left);                       \
+      int64_t b = MK_AS_SMALL_INTEGER(right);                      \
+      if (b != 0 || kMkOp##x != kMkOpDiv) {                        \
+        int64_t value = Expression;                                \
+        if (MK_FITS_SMALL_INTEGER(value)) {                        \
+          sp[-1] = MK_SMALL_INTEGER(value);                        \
+          DISPATCH();                                              \
+        }                                                          \
+      }                                                            \
+    }                                                              \
+    SAVE_ROOTS();                                                  \
+    if (!Binary(vm, kMkOp##x, left, right, &sp[-1], &message)) {   \
+      goto fail;                                                   \
+    }                                                              \
+    DISPATCH();                                                    \
+  }
+#define COMPARISON(x, Expression)                                  \
+  CASE(x) {                                                        \
+    MkValue right = *--sp;                                         \
+    MkValue left = sp[-1];                                         \
+    if (MK_IS_SMALL_INTEGER(left) && MK_IS_SMALL_INTEGER(right)) { \
+      sp[-1] = MK_BOOLEAN(Expression);                             \
+    } else if (!Binary(vm, kMkOp##x, left, right, &sp[-1],         \
+                       &message)) {                                \
+      goto fail;                                                   \
+    }                                                              \
+    DISPATCH();                                                    \
+  }
+  ARITHMETIC(Add, a + b)
+  ARITHMETIC(Sub, a - b)
+  ARITHMETIC(Mul, (int64_t)((uint64_t)a * (uint64_t)b))
+  ARITHMETIC(Div, a / b)
+  COMPARISON(Eq, left.bits == right.bits)
+  COMPARISON(NotEq, left.bits != right.bits)
+  COMPARISON(Lt, (int64_t)left.bits < (int64_t)right.bits)
+  COMPARISON(Gt, (int64_t)left.bits > (int64_t)right.bits)
+#undef COMPARISON
+#undef ARITHMETIC
+  CASE(Minus) {
+    MkValue value = sp[-1];
+    if (MK_IS_SMALL_INTEGER(value) &&
+        MK_AS_SMALL_INTEGER(value) != kMkSmallIntegerMin) {
+      sp[-1] = MK_SMALL_INTEGER(-MK_AS_SMALL_INTEGER(value));
+      DISPATCH();
+    }
+    if (!MK_IS_INTEGER(value)) {
+      FAIL(StringFormat("unknown operator: -%s",
+                        MkValueTypeName(MkValueTypeOf(value))));
+    }
+    SAVE_ROOTS();
+    sp[-1] = MkHeapInteger(&vm->heap,
+                           (int64_t)(0 - (uint64_t)MkValueInteger(value)));
+    if (MK_IS_UNSET(sp[-1])) {
+      FAIL(StringFromC("out of memory"));
+    }
+    DISPATCH();
+  }
+  CASE(Bang) {
+    sp[-1] = MK_BOOLEAN(!MK_TRUTHY(sp[-1]));
+    DISPATCH();
+  }
+
+  CASE(Jump) {
+    uint32_t distance = READ_OPERAND();
+    ip += distance;
+    DISPATCH();
+  }
+  CASE(JumpIfFalse) {
+    uint32_t distance = READ_OPERAND();
+    MkValue condition = *--sp;
+    if (!MK_TRUTHY(condition)) {
+      ip += distance;
+    }
+    DISPATCH();
+  }
+
+  // A slot no `let` has assigned yet falls back on the outer scopes, as in
+  // the evaluator.
+  CASE(GetLocal) {
+    uint32_t slot = READ_OPERAND();
+    MkValue value = locals[slot];
+    if (MK_IS_UNSET(value) &&
+        !MkEnvironmentLookup(frame->outer,
+                             frame->function->scope->symbols[slot], &value)) {
+      goto not_found;
+    }
+    *sp++ = value;
+    DISPATCH();
+  }
+  CASE(SetLocal) {
+    MkValue value = *--sp;
+    MK_HEAP_WRITE_BARRIER(&vm->heap, value);
+    locals[READ_OPERAND()] = value;
+    DISPATCH();
+  }
+  CASE(GetOuter) {
+    uint32_t depth = READ_OPERAND();
+    uint32_t slot = READ_OPERAND();
+    MkEnvironment* environment = frame->outer;
+    while (--depth > 0) {
+      environment = environment->parent;
+    }
+    MkValue value = environment->slots[slot];
+    if (MK_IS_UNSET(value) &&
+        !MkEnvironmentLookup(environment->parent,
+                             environment->scope->symbols[slot], &value)) {
+      goto not_found;
+    }
+    *sp++ = value;
+    DISPATCH();
+  }
+  CASE(NotFound) {
+    goto not_found;
+  }
+
+  CASE(Closure) {
+    const MkFunctionCode* function = &functions[READ_OPERAND()];
+    SAVE_ROOTS();
+    MkClosure* closure = MkHeapNewClosure(&vm->heap, function->function,
+                                          function, frame->environment);
+    if (closure == NULL) {
+      FAIL(StringFromC("out of memory"));
+    }
+    *sp++ = MK_OBJECT(closure);
+    DISPATCH();
+  }
+  CASE(Call) {
+    uint32_t argument_count = READ_OPERAND();
+    MkValue* arguments = sp - argument_count;
+    MkValue callee = arguments[-1];
+    if (!MK_IS_FUNCTION(callee)) {
+      FAIL(StringFormat("not a function: %s",
+                        MkValueTypeName(MkValueTypeOf(callee))));
+    }
+    MkClosure* closure = MK_AS_CLOSURE(callee);
+    const MkFunctionCode* function = closure->code;
+    if (argument_count != function->arity) {
+      FAIL(StringFormat("wrong number of arguments: want=%" PRIu32
+                        ", got=%" PRIu32,
+                        function->arity, argument_count));
+    }
+    const MkAstScope* scope = function->scope;
+    uint32_t frame_size = scope->captured ? 0 : scope->size;
+    if (frame + 1 == vm->frames + kMkVmMaxFrames ||
+        (uint64_t)(stack_end - sp) <
+            (uint64_t)frame_size + function->max_stack) {
+      FAIL(StringFromC("stack overflow"));
+    }
+    MkEnvironment* environment = NULL;
+    if (scope->captured) {
+      SAVE_ROOTS();
+      environment =
+          MkHeapNewEnvironment(&vm->heap, closure->environment, scope);
+      if (environment == NULL) {
+        FAIL(StringFromC("out of memory"));
+      }
+      locals = environment->slots;
+    } else {
+      // The slots go above the arguments, which are copied into them.
+      locals = sp;
+      for (uint32_t i = 0; i < frame_size; ++i) {
+        locals[i] = MK_UNSET;
+      }
+      sp += frame_size;
+    }
+    const uint32_t* parameter_slots = function->parameter_slots.data;
+    for (uint32_t i = 0; i < argument_count; ++i) {
+      MK_HEAP_WRITE_BARRIER(&vm->heap, arguments[i]);
+      locals[parameter_slots[i]] = arguments[i];
+    }
+    frame->ip = ip;
+    ++frame;
+    *frame = (MkVmFrame){
+        .function = function,
+        .locals = locals,
+        .environment = environment,
+        .outer = closure->environment,
+        .base = arguments - 1,
+    };
+    ip = function->code.data;
+    ++vm->calls;
+    DISPATCH();
+  }
+  CASE(Return) {
+    MkValue value = sp[-1];
+    if (frame == vm->frames) {
+      *result = value;
+      return true;
+    }
+    sp = frame->base;
+    *sp++ = value;
+    --frame;
+    ip = frame->ip;
+    locals = frame->locals;
+    DISPATCH();
+  }
+
+#ifndef MK_VM_COMPUTED_GOTO_
+      default:
+        FAIL(StringFromC("invalid instruction"));
+    }
+  }
+#endif
+
+#undef CASE
+#undef DISPATCH
+#undef FAIL
+#undef SAVE_ROOTS
+#undef READ_OPERAND
+
+not_found: {
+  // The identifier's token is recorded for the instruction.
+  const MkFunctionCode* function = frame->function;
+  MkToken token =
+      MkFunctionCodeToken(function, (uint32_t)(ip - 1 - function->code.data));
+  message = StringFormat("identifier not found: %" STRING_FMT,
+                         STRING_VIEW_PRINT(token.literal));
+}
+fail: {
+  // `ip` is past the failing instruction, so the byte before it is inside.
+  const MkFunctionCode* function = frame->function;
+  MkToken token =
+      MkFunctionCodeToken(function, (uint32_t)(ip - 1 - function->code.data));
+  vm->error = message;
+  vm->error_offset = token.offset;
+  return false;
+}
+}
+
+// The slow path of the binary operators: integers that are not both small or
+// give a result that is not, and operands that are not both integers. Fails
+// with a message for those the operator does not take.
+bool Binary(MkVm* vm,
+            MkOpcode op,
+            MkValue left,
+            MkValue right,
+            MkValue* out,
+            String* message) {
+  if (op == kMkOpEq) {
+    *out = MK_BOOLEAN(MkValueIdentical(left, right));
+    return true;
+  }
+  if (op == kMkOpNotEq) {
+    *out = MK_BOOLEAN(!MkValueIdentical(left, right));
+    return true;
+  }
+  if (!MK_IS_INTEGER(left) || !MK_IS_INTEGER(right)) {
+    *message = BinaryError(op, left, right);
+    return false;
+  }
+  int64_t a = MkValueInteger(left);
+  int64_t b = MkValueInteger(right);
+  int64_t value;
+  switch (op) {
+    case kMkOpAdd:
+      value = (int64_t)((uint64_t)a + (uint64_t)b);
+      break;
+    case kMkOpSub:
+      value = (int64_t)((uint64_t)a - (uint64_t)b);
+      break;
+    case kMkOpMul:
+      value = (int64_t)((uint64_t)a * (uint64_t)b);
+      break;
+    case kMkOpDiv:
+      if (b == 0) {
+        *message = StringFromC("division by zero");
+        return false;
+      }
+      value = b == -1 ? (int64_t)(0 - (uint64_t)a) : a / b;
+      break;
+    case kMkOpLt:
+      *out = MK_BOOLEAN(a < b);
+      return true;
+    case kMkOpGt:
+      *out = MK_BOOLEAN(a > b);
+      return true;
+    default:
+      *message = BinaryError(op, left, right);
+      return false;
+  }
+  *out = MkHeapInteger(&vm->heap, value);
+  if (MK_IS_UNSET(*out)) {
+    *message = StringFromC("out of memory");
+    return false;
+  }
+  return true;
+}
+
+String BinaryError(MkOpcode op, MkValue left, MkValue right) {
+  MkTokenType token;
+  switch (op) {
+    case kMkOpAdd:
+      token = kMkTokenPlus;
+      break;
+    case kMkOpSub:
+      token = kMkTokenMinus;
+      break;
+    case kMkOpMul:
+      token = kMkTokenAsterisk;
+      break;
+    case kMkOpDiv:
+      token = kMkTokenSlash;
+      break;
+    case kMkOpLt:
+      token = kMkTokenLt;
+      break;
+    case kMkOpGt:
+      token = kMkTokenGt;
+      break;
+    default:
+      token = kMkTokenIllegal;
+      break;
+  }
+  MkValueType left_type = MkValueTypeOf(left);
+  MkValueType right_type = MkValueTypeOf(right);
+  return StringFormat("%s: %s %s %s",
+                      left_type == right_type ? "unknown operator"
+                                              : "type mismatch",
+                      MkValueTypeName(left_type), MkTokenTypeName(token),
+                      MkValueTypeName(right_type));
+}
+
+// The values on the stack, and the environments of the frames. The callee of
+// each call in progress is still on the stack under its arguments.
+void MarkRoots(MkHeap* heap, void* context) {
+  const MkVm* vm = context;
+  for (const MkValue* value = vm->stack; value < vm->stack_top; ++value) {
+    MkHeapMarkValue(heap, *value);
+  }
+  if (vm->frame_top == NULL) {
+    return;
+  }
+  for (const MkVmFrame* frame = vm->frames; frame <= vm->frame_top; ++frame) {
+    MkHeapMarkObject(heap, (MkObject*)frame->environment);
+    MkHeapMarkObject(heap, (MkObject*)frame->outer);
+  }
+}
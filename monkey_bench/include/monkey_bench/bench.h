@@ -0,0 +1,22 @@
+#ifndef MONKEY_BENCH_BENCH_H_
+#define MONKEY_BENCH_BENCH_H_
+
+#include <stdint.h>
+#include <string/string.h>
+
+typedef struct {
+  uint64_t source_size;
+  uint64_t iterations;
+  uint32_t max_threads;
+} BenchConfig;
+
+#define BENCH_FUNC(Name) void Bench##Name(const BenchConfig* config)
+
+double BenchNow(void);
+String BenchGenerateSource(uint64_t size);
+void BenchReport(const char* name,
+                 uint64_t units,
+                 const char* unit_name,
+                 double seconds);
+
+#endif  // MONKEY_BENCH_BENCH_H_
@@ -0,0 +1,15 @@
+#ifndef MONKEY_BENCH_BENCH_EVAL_H_
+#define MONKEY_BENCH_BENCH_EVAL_H_
+
+#include "monkey_bench/bench.h"
+
+BENCH_FUNC(Fib);
+BENCH_FUNC(Loops);
+BENCH_FUNC(Closures);
+BENCH_FUNC(Allocations);
+BENCH_FUNC(Collector);
+BENCH_FUNC(Latency);
+BENCH_FUNC(Folding);
+BENCH_FUNC(Scopes);
+
+#endif  // MONKEY_BENCH_BENCH_EVAL_H_
@@ -0,0 +1,15 @@
+#ifndef MONKEY_BENCH_BENCH_LEXER_H_
+#define MONKEY_BENCH_BENCH_LEXER_H_
+
+#include "monkey_bench/bench.h"
+
+BENCH_FUNC(Lexer);
+BENCH_FUNC(Tokenize);
+BENCH_FUNC(Stream);
+BENCH_FUNC(Parallel);
+BENCH_FUNC(Relex);
+BENCH_FUNC(Scan);
+BENCH_FUNC(Lines);
+BENCH_FUNC(Keywords);
+
+#endif  // MONKEY_BENCH_BENCH_LEXER_H_
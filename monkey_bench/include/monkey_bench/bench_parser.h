@@ -0,0 +1,16 @@
+#ifndef MONKEY_BENCH_BENCH_PARSER_H_
+#define MONKEY_BENCH_BENCH_PARSER_H_
+
+#include "monkey_bench/bench.h"
+
+BENCH_FUNC(Parser);
+BENCH_FUNC(Programs);
+BENCH_FUNC(ParallelParse);
+BENCH_FUNC(Malformed);
+BENCH_FUNC(Expressions);
+BENCH_FUNC(Flat);
+BENCH_FUNC(Reparse);
+BENCH_FUNC(Intern);
+BENCH_FUNC(Cache);
+
+#endif  // MONKEY_BENCH_BENCH_PARSER_H_
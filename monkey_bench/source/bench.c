@@ -0,0 +1,51 @@
+#include "monkey_bench/bench.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vec/vec.h>
+
+static const char kSnippet[] =
+    "let five = 5;\n"
+    "let ten = 10;\n"
+    "\n"
+    "let add = fn(x, y) {\n"
+    "  x + y;\n"
+    "};\n"
+    "\n"
+    "let result = add(five, ten);\n"
+    "!-five / 5 * 5;\n"
+    "5 < 10 > 5;\n"
+    "\n"
+    "if (5 < 10) {\n"
+    "  return true;\n"
+    "} else {\n"
+    "  return false;\n"
+    "}\n"
+    "\n"
+    "10 == 10;\n"
+    "10 != 9;\n";
+
+double BenchNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+String BenchGenerateSource(uint64_t size) {
+  String source = {0};
+  VEC_RESERVE(&source, size + sizeof(kSnippet));
+  while (source.size < size) {
+    VEC_APPEND(&source, kSnippet, sizeof(kSnippet) - 1);
+  }
+  return source;
+}
+
+void BenchReport(const char* name,
+                 uint64_t units,
+                 const char* unit_name,
+                 double seconds) {
+  printf("%-24s %12" PRIu64 " %s in %8.3f ms  (%.2f M%s/s)\n", name, units,
+         unit_name, seconds * 1e3, (double)units / seconds / 1e6, unit_name);
+}
@@ -0,0 +1,512 @@
+#include "monkey_bench/bench_eval.h"
+
+#include <inttypes.h>
+#include <monkey/ast.h>
+#include <monkey/code.h>
+#include <monkey/compiler.h>
+#include <monkey/evaluator.h>
+#include <monkey/heap.h>
+#include <monkey/lexer.h>
+#include <monkey/optimizer.h>
+#include <monkey/parser.h>
+#include <monkey/resolver.h>
+#include <monkey/value.h>
+#include <monkey/vm.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string/string.h>
+
+#include "monkey_bench/bench.h"
+
+// Calls of the body per run of the scopes benchmark, and the variable reads
+// in each.
+enum { kScopeCalls = 1000, kScopeRuns = 100, kScopeReads = 8 };
+
+static const char kFibSource[] =
+    "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };\n"
+    "fib(30);\n";
+
+// Monkey has no loops, so a loop is a function calling itself, kept below the
+// limit on calls in progress and repeated from an outer one.
+static const char kLoopSource[] =
+    "let loop = fn(i, sum) {\n"
+    "  if (i == 0) { sum } else { loop(i - 1, sum + i * 2 - i / 3) }\n"
+    "};\n"
+    "let repeat = fn(n, sum) {\n"
+    "  if (n == 0) { sum } else { repeat(n - 1, sum + loop(1000, 0)) }\n"
+    "};\n"
+    "repeat(1000, 0);\n";
+
+// Makes a closure per step and calls it, so environments and closures are
+// allocated as fast as they are used.
+static const char kClosureSource[] =
+    "let adder = fn(x) { fn(y) { x + y } };\n"
+    "let compose = fn(f, g) { fn(x) { g(f(x)) } };\n"
+    "let loop = fn(i, sum) {\n"
+    "  if (i == 0) { sum } else {\n"
+    "    loop(i - 1, compose(adder(i), adder(1))(sum))\n"
+    "  }\n"
+    "};\n"
+    "let repeat = fn(n, sum) {\n"
+    "  if (n == 0) { sum } else { repeat(n - 1, sum + loop(1000, 0)) }\n"
+    "};\n"
+    "repeat(100, 0);\n";
+
+// Integer arithmetic and comparisons and nothing else, on values that stay
+// within 63 bits and so are never boxed.
+static const char kSmallIntegerSource[] =
+    "let step = fn(i, x) {\n"
+    "  if (i == 0) { x } else {\n"
+    "    step(i - 1, if (x > 1000000) { x / 7 - i } else { x * 31 + i })\n"
+    "  }\n"
+    "};\n"
+    "let repeat = fn(n, sum) {\n"
+    "  if (n == 0) { sum } else { repeat(n - 1, sum + step(1000, n)) }\n"
+    "};\n"
+    "repeat(1000, 0);\n";
+
+// The same shape of loop with half the sums wider than 63 bits, each of
+// which is boxed.
+static const char kWideIntegerSource[] =
+    "let step = fn(i, x) {\n"
+    "  if (i == 0) { x } else { step(i - 1, x + 4611686018427387904 - i) }\n"
+    "};\n"
+    "let repeat = fn(n, sum) {\n"
+    "  if (n == 0) { sum } else { repeat(n - 1, sum + step(1000, n)) }\n"
+    "};\n"
+    "repeat(1000, 0);\n";
+
+// A tree of 2^16 closures that stays live throughout, and the churn of
+// kClosureSource's kind around it: a stop-the-world collection has to mark
+// the whole tree in each pause.
+static const char kLatencySource[] =
+    "let build = fn(d) {\n"
+    "  if (d == 0) { fn() { 1 } } else {\n"
+    "    let l = build(d - 1); let r = build(d - 1); fn() { l() + r() }\n"
+    "  }\n"
+    "};\n"
+    "let tree = build(16);\n"
+    "let make = fn(x) { fn() { x } };\n"
+    "let loop = fn(i, sum) {\n"
+    "  if (i == 0) { sum } else { loop(i - 1, sum + make(i)()) }\n"
+    "};\n"
+    "let repeat = fn(n, sum) {\n"
+    "  if (n == 0) { sum } else { repeat(n - 1, sum + loop(1000, 0)) }\n"
+    "};\n"
+    "repeat(300, tree());\n";
+
+// The kind of code generated scripts are full of: arithmetic on constants,
+// and `if` guards on them, in a loop that also does real work.
+static const char kFoldingSource[] =
+    "let step = fn(i, x) {\n"
+    "  if (i == 0) { x } else {\n"
+    "    let day = 60 * 60 * 24;\n"
+    "    let scale = if (1 > 2) { day * 7 } else { day / (4 * 6) };\n"
+    "    if (false) { return -1; }\n"
+    "    let bias = if (!(2 < 3 == true)) { 1 } else { 0 };\n"
+    "    step(i - 1, x + i * scale - (1 + 2 + 3) * 4 + bias)\n"
+    "  }\n"
+    "};\n"
+    "let repeat = fn(n, sum) {\n"
+    "  if (n == 0) { sum } else { repeat(n - 1, sum + step(1000, n)) }\n"
+    "};\n"
+    "repeat(1000, 0);\n";
+
+typedef struct {
+  MkParser parser;
+  MkAstProgram* program;
+  MkBytecode bytecode;
+  MkOptimizeStats fold_stats;
+  double compile_seconds;
+} Program;
+
+// Parses, resolves and compiles `source`, or returns false with a message if
+// it does not parse cleanly. With `fold`, the program is optimized before it
+// is resolved.
+static bool ProgramInit(Program* program,
+                        const char* name,
+                        StringView source,
+                        bool fold) {
+  *program = (Program){0};
+  MkLexer lexer = {0};
+  MkLexerInit(&lexer, source);
+  MkParserInit(&program->parser, lexer);
+  program->program = MkParserParseProgram(&program->parser);
+  if (program->parser.errors.size > 0 ||
+      (fold && !MkOptimizeProgram(program->program, &program->fold_stats)) ||
+      !MkResolveProgram(program->program)) {
+    fprintf(stderr, "%s: the program does not parse\n", name);
+    MkAstNodeFree(&program->program->base);
+    free(program->program);
+    MkParserFree(program->parser);
+    return false;
+  }
+  double start = BenchNow();
+  String error = {0};
+  bool ok = MkCompileProgram(&program->bytecode, program->program, &error);
+  program->compile_seconds = BenchNow() - start;
+  if (!ok) {
+    fprintf(stderr, "%s: %" STRING_FMT "\n", name, STRING_PRINT(error));
+    VEC_FREE(&error);
+  }
+  return true;
+}
+
+static void ProgramFree(Program* program) {
+  MkBytecodeFree(&program->bytecode);
+  MkAstNodeFree(&program->program->base);
+  free(program->program);
+  MkParserFree(program->parser);
+}
+
+// Runs the program `iterations` times on the evaluator and adds the time
+// taken to `seconds`. Returns false with a message if a run fails.
+static bool TimeEvaluator(const char* name,
+                          const Program* program,
+                          uint64_t iterations,
+                          MkEvaluator* evaluator,
+                          double* seconds) {
+  for (uint64_t i = 0; i < iterations; ++i) {
+    MkValue result;
+    double start = BenchNow();
+    bool ok = MkEvaluatorRun(evaluator, program->program, &result);
+    *seconds += BenchNow() - start;
+    if (!ok) {
+      fprintf(stderr, "%s: %" STRING_FMT "\n", name,
+              STRING_PRINT(evaluator->error));
+      return false;
+    }
+  }
+  return true;
+}
+
+// The same on the VM.
+static bool TimeVm(const char* name,
+                   const Program* program,
+                   uint64_t iterations,
+                   MkVm* vm,
+                   double* seconds) {
+  for (uint64_t i = 0; i < iterations; ++i) {
+    MkValue result;
+    double start = BenchNow();
+    bool ok = MkVmRun(vm, &program->bytecode, &result);
+    *seconds += BenchNow() - start;
+    if (!ok) {
+      fprintf(stderr, "%s: %" STRING_FMT "\n", name, STRING_PRINT(vm->error));
+      return false;
+    }
+  }
+  return true;
+}
+
+// Reports calls per second for `source` on the evaluator and on the VM, and
+// how much faster the VM is.
+static void CompareEngines(const char* name,
+                           const char* source,
+                           uint64_t iterations) {
+  Program program;
+  if (!ProgramInit(&program, name, StringViewFromC(source), false)) {
+    return;
+  }
+  char label[64];
+  MkEvaluator evaluator;
+  MkEvaluatorInit(&evaluator);
+  double eval_seconds = 0;
+  bool evaluated =
+      TimeEvaluator(name, &program, iterations, &evaluator, &eval_seconds);
+  if (evaluated) {
+    snprintf(label, sizeof(label), "%s eval", name);
+    BenchReport(label, evaluator.calls, "calls", eval_seconds);
+  }
+  MkEvaluatorFree(&evaluator);
+
+  MkVm vm;
+  MkVmInit(&vm);
+  double vm_seconds = 0;
+  if (program.bytecode.functions.size > 0 &&
+      TimeVm(name, &program, iterations, &vm, &vm_seconds)) {
+    snprintf(label, sizeof(label), "%s vm", name);
+    BenchReport(label, vm.calls, "calls", vm_seconds);
+    printf("%-24s %12.2fx the evaluator, compiled in %.3f ms to %" PRIu64
+           " functions\n",
+           "", evaluated ? eval_seconds / vm_seconds : 0.0,
+           program.compile_seconds * 1e3, program.bytecode.functions.size);
+  }
+  MkVmFree(&vm);
+  ProgramFree(&program);
+}
+
+// Reports the objects each engine allocates running `source`, per call.
+static void CountAllocations(const char* name,
+                             const char* source,
+                             uint64_t iterations) {
+  Program program;
+  if (!ProgramInit(&program, name, StringViewFromC(source), false)) {
+    return;
+  }
+  char label[64];
+  MkEvaluator evaluator;
+  MkEvaluatorInit(&evaluator);
+  double seconds = 0;
+  if (TimeEvaluator(name, &program, iterations, &evaluator, &seconds)) {
+    snprintf(label, sizeof(label), "%s eval", name);
+    BenchReport(label, evaluator.calls, "calls", seconds);
+    printf("%-24s %12.4f objects per call (%" PRIu64 " in all)\n", "",
+           (double)evaluator.heap.stats.allocations / (double)evaluator.calls,
+           evaluator.heap.stats.allocations);
+  }
+  MkEvaluatorFree(&evaluator);
+
+  MkVm vm;
+  MkVmInit(&vm);
+  seconds = 0;
+  if (program.bytecode.functions.size > 0 &&
+      TimeVm(name, &program, iterations, &vm, &seconds)) {
+    snprintf(label, sizeof(label), "%s vm", name);
+    BenchReport(label, vm.calls, "calls", seconds);
+    printf("%-24s %12.4f objects per call (%" PRIu64 " in all)\n", "",
+           (double)vm.heap.stats.allocations / (double)vm.calls,
+           vm.heap.stats.allocations);
+  }
+  MkVmFree(&vm);
+  ProgramFree(&program);
+}
+
+// Reports how often `heap` collected while running for `seconds`, how long
+// that took, and what it kept.
+static void ReportCollections(const MkHeap* heap, double seconds) {
+  const MkHeapStats* stats = &heap->stats;
+  printf("%-24s %12" PRIu64 " collections, %.1f%% of the time, %.3f ms mean "
+         "pause, %.3f ms max\n",
+         "", stats->collections, stats->pause_seconds / seconds * 100,
+         stats->pauses > 0
+             ? stats->pause_seconds / (double)stats->pauses * 1e3
+             : 0.0,
+         stats->max_pause_seconds * 1e3);
+  printf("%-24s %12" PRIu64 " bytes freed, %" PRIu64 " live at the end\n", "",
+         stats->bytes_freed, heap->bytes);
+}
+
+static int CompareSeconds(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+// Reports the median, 99th percentile and longest of the pauses `heap`
+// logged, which it sorts.
+static void ReportPauses(MkHeap* heap) {
+  uint64_t count = heap->pause_log.size;
+  if (count == 0) {
+    printf("%-24s %12s no pauses\n", "", "");
+    return;
+  }
+  double* pauses = heap->pause_log.data;
+  qsort(pauses, count, sizeof(double), CompareSeconds);
+  printf("%-24s %12" PRIu64 " pauses in %" PRIu64
+         " collections: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+         "", count, heap->stats.collections, pauses[count / 2] * 1e3,
+         pauses[(count - 1) * 99 / 100] * 1e3, pauses[count - 1] * 1e3);
+}
+
+// A name for the `index`th variable that no other index shares.
+static void AppendName(String* source, uint64_t index) {
+  VEC_PUSH(source, 'v');
+  do {
+    VEC_PUSH(source, (char)('a' + index % 26));
+    index /= 26;
+  } while (index > 0);
+}
+
+BENCH_FUNC(Fib) {
+  CompareEngines("fib(30)", kFibSource, config->iterations);
+}
+
+BENCH_FUNC(Loops) {
+  CompareEngines("loops", kLoopSource, config->iterations);
+}
+
+BENCH_FUNC(Closures) {
+  CompareEngines("closures", kClosureSource, config->iterations);
+}
+
+// Integer-heavy programs allocate only their functions and environments as
+// long as the integers fit in a value; wide ones show what boxing costs.
+BENCH_FUNC(Allocations) {
+  CountAllocations("small ints", kSmallIntegerSource, config->iterations);
+  CountAllocations("wide ints", kWideIntegerSource, config->iterations);
+}
+
+// The closures workload on both engines with the default heap, which has to
+// collect to stay bounded.
+BENCH_FUNC(Collector) {
+  Program program;
+  if (!ProgramInit(&program, "collector", StringViewFromC(kClosureSource),
+                   false)) {
+    return;
+  }
+  MkEvaluator evaluator;
+  MkEvaluatorInit(&evaluator);
+  double seconds = 0;
+  if (TimeEvaluator("collector", &program, config->iterations, &evaluator,
+                    &seconds)) {
+    BenchReport("collector eval", evaluator.heap.stats.allocations, "objects",
+                seconds);
+    ReportCollections(&evaluator.heap, seconds);
+  }
+  MkEvaluatorFree(&evaluator);
+  MkVm vm;
+  MkVmInit(&vm);
+  seconds = 0;
+  if (program.bytecode.functions.size > 0 &&
+      TimeVm("collector", &program, config->iterations, &vm, &seconds)) {
+    BenchReport("collector vm", vm.heap.stats.allocations, "objects",
+                seconds);
+    ReportCollections(&vm.heap, seconds);
+  }
+  MkVmFree(&vm);
+  ProgramFree(&program);
+}
+
+// The latency workload on both engines with each kind of collection, for
+// how long the program is stopped at a time rather than in all.
+BENCH_FUNC(Latency) {
+  Program program;
+  if (!ProgramInit(&program, "latency", StringViewFromC(kLatencySource),
+                   false)) {
+    return;
+  }
+  static const struct {
+    const char* name;
+    MkHeapMode mode;
+  } kModes[] = {
+      {"stop", kMkHeapStopTheWorld},
+      {"incremental", kMkHeapIncremental},
+  };
+  char label[64];
+  for (uint64_t m = 0; m < sizeof(kModes) / sizeof(kModes[0]); ++m) {
+    MkEvaluator evaluator;
+    MkEvaluatorInit(&evaluator);
+    evaluator.heap.mode = kModes[m].mode;
+    evaluator.heap.record_pauses = true;
+    double seconds = 0;
+    if (TimeEvaluator("latency", &program, config->iterations, &evaluator,
+                      &seconds)) {
+      snprintf(label, sizeof(label), "latency eval %s", kModes[m].name);
+      BenchReport(label, evaluator.heap.stats.allocations, "objects",
+                  seconds);
+      ReportPauses(&evaluator.heap);
+    }
+    MkEvaluatorFree(&evaluator);
+
+    MkVm vm;
+    MkVmInit(&vm);
+    vm.heap.mode = kModes[m].mode;
+    vm.heap.record_pauses = true;
+    seconds = 0;
+    if (program.bytecode.functions.size > 0 &&
+        TimeVm("latency", &program, config->iterations, &vm, &seconds)) {
+      snprintf(label, sizeof(label), "latency vm %s", kModes[m].name);
+      BenchReport(label, vm.heap.stats.allocations, "objects", seconds);
+      ReportPauses(&vm.heap);
+    }
+    MkVmFree(&vm);
+  }
+  ProgramFree(&program);
+}
+
+// The folding workload as parsed and as MkOptimizeProgram leaves it, on
+// both engines.
+BENCH_FUNC(Folding) {
+  static const char* const kVariants[] = {"as parsed", "folded"};
+  double eval_seconds[2] = {0};
+  double vm_seconds[2] = {0};
+  char label[64];
+  for (uint64_t f = 0; f < 2; ++f) {
+    Program program;
+    if (!ProgramInit(&program, "folding", StringViewFromC(kFoldingSource),
+                     f == 1)) {
+      return;
+    }
+    MkEvaluator evaluator;
+    MkEvaluatorInit(&evaluator);
+    if (TimeEvaluator("folding", &program, config->iterations, &evaluator,
+                      &eval_seconds[f])) {
+      snprintf(label, sizeof(label), "folding eval %s", kVariants[f]);
+      BenchReport(label, evaluator.calls, "calls", eval_seconds[f]);
+    }
+    MkEvaluatorFree(&evaluator);
+    MkVm vm;
+    MkVmInit(&vm);
+    if (program.bytecode.functions.size > 0 &&
+        TimeVm("folding", &program, config->iterations, &vm, &vm_seconds[f])) {
+      snprintf(label, sizeof(label), "folding vm %s", kVariants[f]);
+      BenchReport(label, vm.calls, "calls", vm_seconds[f]);
+    }
+    MkVmFree(&vm);
+    if (f == 1) {
+      const MkOptimizeStats* stats = &program.fold_stats;
+      printf("%-24s %12" PRIu64 " nodes removed (%" PRIu64 " folded, %" PRIu64
+             " ifs pruned); %.2fx on the evaluator, %.2fx on the VM\n",
+             "", stats->removed, stats->folded, stats->pruned,
+             eval_seconds[1] > 0 ? eval_seconds[0] / eval_seconds[1] : 0.0,
+             vm_seconds[1] > 0 ? vm_seconds[0] / vm_seconds[1] : 0.0);
+    }
+    ProgramFree(&program);
+  }
+}
+
+// Reads one variable of the program's scope from a function, with more and
+// more other variables in scope. A read is a parent link and an array index
+// however many there are, so the rate should hold steady.
+BENCH_FUNC(Scopes) {
+  static const uint64_t kBindings[] = {1, 64, 4096, 32768};
+  for (uint64_t b = 0; b < sizeof(kBindings) / sizeof(kBindings[0]); ++b) {
+    String source = {0};
+    for (uint64_t i = 0; i < kBindings[b]; ++i) {
+      VEC_APPEND(&source, "let ", 4);
+      AppendName(&source, i);
+      VEC_APPEND(&source, " = 1;\n", 6);
+    }
+    VEC_APPEND(&source, "let f = fn(n) { if (n == 0) { 0 } else { ", 41);
+    for (uint64_t i = 0; i < kScopeReads; ++i) {
+      AppendName(&source, kBindings[b] / 2);
+      VEC_APPEND(&source, " + ", 3);
+    }
+    VEC_APPEND(&source, "f(n - 1) } };\n", 14);
+    for (uint64_t i = 0; i < kScopeRuns; ++i) {
+      String call = StringFormat("f(%d);\n", kScopeCalls);
+      VEC_APPEND(&source, call.data, call.size);
+      VEC_FREE(&call);
+    }
+    VEC_PUSH(&source, '\0');
+
+    Program program;
+    if (ProgramInit(&program, "scopes", StringViewFromC(source.data), false)) {
+      char name[32];
+      MkEvaluator evaluator;
+      MkEvaluatorInit(&evaluator);
+      double seconds = 0;
+      if (TimeEvaluator("scopes", &program, config->iterations, &evaluator,
+                        &seconds)) {
+        snprintf(name, sizeof(name), "scope of %" PRIu64 " eval",
+                 kBindings[b]);
+        BenchReport(name, evaluator.calls * kScopeReads, "reads", seconds);
+      }
+      MkEvaluatorFree(&evaluator);
+      MkVm vm;
+      MkVmInit(&vm);
+      seconds = 0;
+      if (program.bytecode.functions.size > 0 &&
+          TimeVm("scopes", &program, config->iterations, &vm, &seconds)) {
+        snprintf(name, sizeof(name), "scope of %" PRIu64 " vm", kBindings[b]);
+        BenchReport(name, vm.calls * kScopeReads, "reads", seconds);
+      }
+      MkVmFree(&vm);
+      ProgramFree(&program);
+    }
+    VEC_FREE(&source);
+  }
+}
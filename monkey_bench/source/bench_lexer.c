@@ -0,0 +1,275 @@
+#include "monkey_bench/bench_lexer.h"
+
+#include <inttypes.h>
+#include <monkey/lexer.h>
+#include <monkey/line_index.h>
+#include <monkey/scan.h>
+#include <monkey/stream.h>
+#include <monkey/token.h>
+#include <pool/pool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string/string.h>
+
+#include "monkey_bench/bench.h"
+
+static StringView SourceView(const String* source) {
+  return (StringView){.begin = source->data,
+                      .end = source->data + source->size};
+}
+
+static const char kIndentedLine[] =
+    "                        let accumulatedGeneratedValueForRow = "
+    "previousGeneratedValueForRow + 1234567890123;\n";
+
+static String GenerateIndentedSource(uint64_t size) {
+  String source = {0};
+  VEC_RESERVE(&source, size + sizeof(kIndentedLine));
+  while (source.size < size) {
+    VEC_APPEND(&source, kIndentedLine, sizeof(kIndentedLine) - 1);
+  }
+  return source;
+}
+
+typedef struct {
+  const String* source;
+  uint64_t position;
+} MemoryStream;
+
+static int64_t RefillMemory(void* context, char* buffer, uint64_t capacity) {
+  MemoryStream* stream = context;
+  uint64_t left = stream->source->size - stream->position;
+  uint64_t n = capacity < left ? capacity : left;
+  memcpy(buffer, stream->source->data + stream->position, n);
+  stream->position += n;
+  return (int64_t)n;
+}
+
+static uint64_t LexAll(StringView source) {
+  MkLexer lexer;
+  MkLexerInit(&lexer, source);
+  uint64_t count = 0;
+  for (MkToken tok = MkLexerNextToken(&lexer); tok.type != kMkTokenEof;
+       tok = MkLexerNextToken(&lexer)) {
+    ++count;
+  }
+  return count;
+}
+
+BENCH_FUNC(Lexer) {
+  String source = BenchGenerateSource(config->source_size);
+  uint64_t tokens = 0;
+  double start = BenchNow();
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    tokens += LexAll(SourceView(&source));
+  }
+  BenchReport("lex", tokens, "tokens", BenchNow() - start);
+  VEC_FREE(&source);
+}
+
+BENCH_FUNC(Tokenize) {
+  String source = BenchGenerateSource(config->source_size);
+  MkTokenBuffer tokens = {0};
+  uint64_t count = 0;
+  double start = BenchNow();
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    MkLexerTokenizeAll(SourceView(&source), &tokens);
+    count += tokens.size - 1;
+  }
+  BenchReport("tokenize all", count, "tokens", BenchNow() - start);
+  MkTokenBufferFree(&tokens);
+  VEC_FREE(&source);
+}
+
+BENCH_FUNC(Stream) {
+  String source = BenchGenerateSource(config->source_size);
+  uint64_t tokens = 0;
+  uint64_t peak = 0;
+  double start = BenchNow();
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    MemoryStream memory = {.source = &source};
+    MkStreamLexer lexer;
+    MkStreamLexerInit(&lexer, RefillMemory, &memory, 0);
+    for (MkToken tok = MkStreamLexerNextToken(&lexer); tok.type != kMkTokenEof;
+         tok = MkStreamLexerNextToken(&lexer)) {
+      ++tokens;
+    }
+    if (lexer.capacity > peak) {
+      peak = lexer.capacity;
+    }
+    MkStreamLexerFree(&lexer);
+  }
+  BenchReport("stream lex", tokens, "tokens", BenchNow() - start);
+  printf("%-24s %12" PRIu64 " bytes buffered at most\n", "", peak);
+  VEC_FREE(&source);
+}
+
+BENCH_FUNC(Parallel) {
+  String source = BenchGenerateSource(config->source_size);
+  MkTokenBuffer tokens = {0};
+  double serial = 0;
+  for (uint32_t threads = 1; threads <= config->max_threads; threads *= 2) {
+    ThreadPool pool;
+    ThreadPoolInit(&pool, threads);
+    uint64_t count = 0;
+    double start = BenchNow();
+    for (uint64_t i = 0; i < config->iterations; ++i) {
+      MkLexerTokenizeParallel(SourceView(&source), &tokens, &pool, 0);
+      count += tokens.size - 1;
+    }
+    double elapsed = BenchNow() - start;
+    if (threads == 1) {
+      serial = elapsed;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "parallel lex x%" PRIu32, threads);
+    BenchReport(name, count, "tokens", elapsed);
+    printf("%-24s %12.2fx speedup\n", "", serial / elapsed);
+    ThreadPoolFree(&pool);
+    if (threads < config->max_threads && threads * 2 > config->max_threads) {
+      threads = config->max_threads / 2;
+    }
+  }
+  MkTokenBufferFree(&tokens);
+  VEC_FREE(&source);
+}
+
+BENCH_FUNC(Relex) {
+  String source = BenchGenerateSource(config->source_size);
+  MkTokenBuffer tokens = {0};
+  double start = BenchNow();
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    MkLexerTokenizeAll(SourceView(&source), &tokens);
+  }
+  double full = (BenchNow() - start) / (double)config->iterations;
+
+  enum { kEditsPerIteration = 1000 };
+  const char kReplacements[] = "x1 =;(";
+  uint64_t state = 0x2545F4914F6CDD1D;
+  uint64_t edits = 0;
+  start = BenchNow();
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    for (int j = 0; j < kEditsPerIteration; ++j) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      uint64_t offset = state % source.size;
+      // Overwrite one byte in place, so the source keeps its size.
+      source.data[offset] = kReplacements[(state >> 32) % 6];
+      MkEdit edit = {
+          .offset = offset,
+          .removed = 1,
+          .inserted = {.begin = &source.data[offset],
+                       .end = &source.data[offset + 1]},
+      };
+      MkLexerRelex(SourceView(&source), &tokens, edit);
+      ++edits;
+    }
+  }
+  double elapsed = BenchNow() - start;
+  BenchReport("relex one byte", edits, "edits", elapsed);
+  printf("%-24s %12.2f us per edit, %.2f ms per full lex\n", "",
+         elapsed / (double)edits * 1e6, full * 1e3);
+  MkTokenBufferFree(&tokens);
+  VEC_FREE(&source);
+}
+
+BENCH_FUNC(Scan) {
+  String sources[] = {
+      BenchGenerateSource(config->source_size),
+      GenerateIndentedSource(config->source_size),
+  };
+  const char* names[] = {"mixed", "indented"};
+  MkScanLevel initial = MkScanGetLevel();
+  for (uint64_t s = 0; s < sizeof(sources) / sizeof(sources[0]); ++s) {
+    for (MkScanLevel level = kMkScanScalar; level < kMkScanLevelCount;
+         ++level) {
+      if (!MkScanSetLevel(level)) {
+        continue;
+      }
+      uint64_t tokens = 0;
+      double start = BenchNow();
+      for (uint64_t i = 0; i < config->iterations; ++i) {
+        tokens += LexAll(SourceView(&sources[s]));
+      }
+      char name[64];
+      snprintf(name, sizeof(name), "lex %s/%s", names[s],
+               MkScanLevelName(level));
+      BenchReport(name, tokens, "tokens", BenchNow() - start);
+    }
+    VEC_FREE(&sources[s]);
+  }
+  MkScanSetLevel(initial);
+}
+
+// Building the index is the cost of the first diagnostic in a file; each one
+// after that is a binary search.
+BENCH_FUNC(Lines) {
+  String source = BenchGenerateSource(config->source_size);
+  MkScanLevel initial = MkScanGetLevel();
+  for (MkScanLevel level = kMkScanScalar; level < kMkScanLevelCount;
+       ++level) {
+    if (!MkScanSetLevel(level)) {
+      continue;
+    }
+    double start = BenchNow();
+    for (uint64_t i = 0; i < config->iterations; ++i) {
+      MkLineIndex index;
+      MkLineIndexInit(&index, SourceView(&source));
+      MkLineIndexLookup(&index, 0);
+      MkLineIndexFree(&index);
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "line index/%s", MkScanLevelName(level));
+    BenchReport(name, source.size * config->iterations, "bytes",
+                BenchNow() - start);
+  }
+  MkScanSetLevel(initial);
+
+  MkTokenBuffer tokens = {0};
+  MkLexerTokenizeAll(SourceView(&source), &tokens);
+  MkLineIndex index;
+  MkLineIndexInit(&index, SourceView(&source));
+  MkLineIndexLookup(&index, 0);
+  uint64_t checksum = 0;
+  double start = BenchNow();
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    for (uint64_t j = 0; j < tokens.size; ++j) {
+      checksum += MkLineIndexLookup(&index, tokens.offsets[j]).column;
+    }
+  }
+  BenchReport("line lookup", tokens.size * config->iterations, "lookups",
+              BenchNow() - start);
+  printf("%-24s %12" PRIu64 " lines, checksum %" PRIu64 "\n", "",
+         index.starts.size, checksum);
+  MkLineIndexFree(&index);
+  MkTokenBufferFree(&tokens);
+  VEC_FREE(&source);
+}
+
+BENCH_FUNC(Keywords) {
+  static const char* const kWords[] = {
+      "fn",      "let",   "if",     "else",      "return",
+      "true",    "false", "five",   "result",    "add",
+      "x",       "y",     "foobar", "ten",       "iff",
+      "lettuce", "truth", "falsey", "elsewhere", "fun",
+  };
+  enum { kWordCount = sizeof(kWords) / sizeof(kWords[0]) };
+  StringView words[kWordCount];
+  for (uint64_t i = 0; i < kWordCount; ++i) {
+    words[i] = StringViewFromC(kWords[i]);
+  }
+
+  uint64_t lookups = config->source_size * config->iterations;
+  uint64_t keywords = 0;
+  double start = BenchNow();
+  for (uint64_t i = 0; i < lookups; ++i) {
+    keywords += MkLookupIdent(words[i % kWordCount]) != kMkTokenIdent;
+  }
+  BenchReport("keyword lookup", lookups, "lookups", BenchNow() - start);
+  if (keywords == 0) {
+    printf("no keywords found\n");
+  }
+}
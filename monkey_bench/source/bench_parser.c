@@ -0,0 +1,603 @@
+#include "monkey_bench/bench_parser.h"
+
+#include <inttypes.h>
+#include <hash/hash.h>
+#include <monkey/ast.h>
+#include <monkey/ast_cache.h>
+#include <monkey/flat_ast.h>
+#include <monkey/intern.h>
+#include <monkey/lexer.h>
+#include <monkey/parser.h>
+#include <monkey/token.h>
+#include <pool/pool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string/string.h>
+#include <unistd.h>
+
+#include "monkey_bench/bench.h"
+
+// Parentheses per nested expression, and operands per chain, both kept within
+// the kMkAstMaxHeight levels that the parser accepts.
+enum { kNestingDepth = 1000, kChainLength = 2000 };
+
+static StringView SourceView(const String* source) {
+  return (StringView){.begin = source->data,
+                      .end = source->data + source->size};
+}
+
+// Each statement is `(((1 + 1) * 1) - 1 ...)` with kNestingDepth groups, which
+// is 2 * kNestingDepth + 1 expression nodes.
+static String GenerateNestedSource(uint64_t size, uint64_t* nodes) {
+  static const char kOperators[] = "+*-/";
+  String source = {0};
+  *nodes = 0;
+  while (source.size < size) {
+    for (int i = 0; i < kNestingDepth; ++i) {
+      VEC_PUSH(&source, '(');
+    }
+    VEC_PUSH(&source, '1');
+    for (int i = 0; i < kNestingDepth; ++i) {
+      char group[] = " + 1)";
+      group[1] = kOperators[i % 4];
+      VEC_APPEND(&source, group, sizeof(group) - 1);
+    }
+    VEC_APPEND(&source, ";\n", 2);
+    *nodes += 2 * kNestingDepth + 1;
+  }
+  return source;
+}
+
+// Each statement is `a + b * 2 - c / 3 ...` with kChainLength operands, which
+// is 2 * kChainLength - 1 expression nodes.
+static String GenerateChainSource(uint64_t size, uint64_t* nodes) {
+  static const char* const kTerms[] = {"a + ", "b * ", "2 - ", "c / ", "3 + "};
+  String source = {0};
+  *nodes = 0;
+  while (source.size < size) {
+    for (int i = 0; i < kChainLength - 1; ++i) {
+      VEC_APPEND(&source, kTerms[i % 5], 4);
+    }
+    VEC_APPEND(&source, "x;\n", 3);
+    *nodes += 2 * kChainLength - 1;
+  }
+  return source;
+}
+
+// Parses and frees `source` once per iteration from a token buffer lexed up
+// front, so only the parser is timed. Returns false if the source does not
+// parse cleanly.
+static bool TimeParse(const String* source,
+                      uint64_t iterations,
+                      double* seconds) {
+  MkTokenBuffer tokens = {0};
+  MkLexerTokenizeAll(SourceView(source), &tokens);
+  bool ok = true;
+  double start = BenchNow();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    MkParser parser;
+    MkParserInitTokens(&parser, SourceView(source), &tokens);
+    MkAstProgram* program = MkParserParseProgram(&parser);
+    ok = ok && parser.errors.size == 0;
+    MkAstNodeFree(&program->base);
+    free(program);
+    MkParserFree(parser);
+  }
+  *seconds = BenchNow() - start;
+  MkTokenBufferFree(&tokens);
+  return ok;
+}
+
+typedef struct {
+  uint64_t nodes;
+  int64_t sum;
+} WalkTotals;
+
+static void WalkExpression(const MkAstExpression* expr, WalkTotals* totals);
+
+// The pointer AST has no way to reach every node but recursion; the walk does
+// the same work as the flat scan below, counting nodes and summing integers.
+static void WalkStatement(const MkAstStatement* stmt, WalkTotals* totals) {
+  ++totals->nodes;
+  switch (stmt->type) {
+    case kMkAstStatementLet:
+      ++totals->nodes;
+      WalkExpression(((const MkAstLetStatement*)stmt)->value, totals);
+      break;
+    case kMkAstStatementReturn:
+      WalkExpression(((const MkAstReturnStatement*)stmt)->return_value,
+                     totals);
+      break;
+    case kMkAstStatementExpression:
+      WalkExpression(((const MkAstExpressionStatement*)stmt)->expression,
+                     totals);
+      break;
+    case kMkAstStatementBlock: {
+      const MkAstStatements* statements =
+          &((const MkAstBlockStatement*)stmt)->statements;
+      for (uint64_t i = 0; i < statements->size; ++i) {
+        WalkStatement(statements->data[i], totals);
+      }
+    } break;
+  }
+}
+
+static void WalkExpression(const MkAstExpression* expr, WalkTotals* totals) {
+  ++totals->nodes;
+  switch (expr->type) {
+    case kMkAstExpressionIdentifier:
+    case kMkAstExpressionBoolean:
+      break;
+    case kMkAstExpressionIntegerLiteral:
+      totals->sum += ((const MkAstIntegerLiteral*)expr)->value;
+      break;
+    case kMkAstExpressionPrefix:
+      WalkExpression(((const MkAstPrefixExpression*)expr)->right, totals);
+      break;
+    case kMkAstExpressionInfix: {
+      const MkAstInfixExpression* infix = (const MkAstInfixExpression*)expr;
+      WalkExpression(infix->left, totals);
+      WalkExpression(infix->right, totals);
+    } break;
+    case kMkAstExpressionIf: {
+      const MkAstIfExpression* if_expr = (const MkAstIfExpression*)expr;
+      WalkExpression(if_expr->condition, totals);
+      WalkStatement(&if_expr->consequence->base, totals);
+      if (if_expr->alternative != NULL) {
+        WalkStatement(&if_expr->alternative->base, totals);
+      }
+    } break;
+    case kMkAstExpressionFunctionLiteral: {
+      const MkAstFunctionLiteral* function =
+          (const MkAstFunctionLiteral*)expr;
+      totals->nodes += function->parameters.size;
+      WalkStatement(&function->body->base, totals);
+    } break;
+    case kMkAstExpressionCall: {
+      const MkAstCallExpression* call = (const MkAstCallExpression*)expr;
+      WalkExpression(call->function, totals);
+      for (uint64_t i = 0; i < call->arguments.size; ++i) {
+        WalkExpression(call->arguments.data[i], totals);
+      }
+    } break;
+  }
+}
+
+BENCH_FUNC(Parser) {
+  String source = BenchGenerateSource(config->source_size);
+  MkTokenBuffer buffer = {0};
+  MkLexerTokenizeAll(SourceView(&source), &buffer);
+  uint64_t tokens = (buffer.size - 1) * config->iterations;
+  double start = BenchNow();
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    MkLexerTokenizeAll(SourceView(&source), &buffer);
+    MkParser parser;
+    MkParserInitTokens(&parser, SourceView(&source), &buffer);
+    MkAstProgram* program = MkParserParseProgram(&parser);
+    MkAstNodeFree(&program->base);
+    free(program);
+    MkParserFree(parser);
+  }
+  BenchReport("parse", tokens, "tokens", BenchNow() - start);
+  MkTokenBufferFree(&buffer);
+  VEC_FREE(&source);
+}
+
+// Many small programs, each lexed, parsed and freed on its own, as a REPL or
+// a test runner would. Allocation and teardown dominate at this size.
+BENCH_FUNC(Programs) {
+  String source = BenchGenerateSource(1);
+  uint64_t count = config->source_size / source.size * config->iterations;
+  MkTokenBuffer tokens = {0};
+  double start = BenchNow();
+  for (uint64_t i = 0; i < count; ++i) {
+    MkLexerTokenizeAll(SourceView(&source), &tokens);
+    MkParser parser;
+    MkParserInitTokens(&parser, SourceView(&source), &tokens);
+    MkAstProgram* program = MkParserParseProgram(&parser);
+    MkAstNodeFree(&program->base);
+    free(program);
+    MkParserFree(parser);
+  }
+  BenchReport("parse small programs", count, "programs", BenchNow() - start);
+  MkTokenBufferFree(&tokens);
+  VEC_FREE(&source);
+}
+
+// The generated source is a long run of top-level statements, the shape the
+// parallel parser is for. Threads that run past the core count show up as
+// no speedup rather than a slowdown.
+BENCH_FUNC(ParallelParse) {
+  String source = BenchGenerateSource(config->source_size);
+  MkTokenBuffer tokens = {0};
+  MkLexerTokenizeAll(SourceView(&source), &tokens);
+  double serial = 0;
+  for (uint32_t threads = 1; threads <= config->max_threads; threads *= 2) {
+    ThreadPool pool;
+    ThreadPoolInit(&pool, threads);
+    double start = BenchNow();
+    for (uint64_t i = 0; i < config->iterations; ++i) {
+      MkParser parser;
+      MkParserInitTokens(&parser, SourceView(&source), &tokens);
+      MkAstProgram* program =
+          MkParserParseProgramParallel(&parser, &pool, 0);
+      MkAstNodeFree(&program->base);
+      free(program);
+      MkParserFree(parser);
+    }
+    double elapsed = BenchNow() - start;
+    if (threads == 1) {
+      serial = elapsed;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "parallel parse x%" PRIu32, threads);
+    BenchReport(name, (tokens.size - 1) * config->iterations, "tokens",
+                elapsed);
+    printf("%-24s %12.2fx speedup\n", "", serial / elapsed);
+    ThreadPoolFree(&pool);
+    if (threads < config->max_threads && threads * 2 > config->max_threads) {
+      threads = config->max_threads / 2;
+    }
+  }
+  MkTokenBufferFree(&tokens);
+  VEC_FREE(&source);
+}
+
+// The generated source with a stray ')' every 64 bytes, as a fuzzer would
+// produce. Each one costs a statement and an error, which should not make the
+// parser much slower per token.
+BENCH_FUNC(Malformed) {
+  String source = BenchGenerateSource(config->source_size);
+  for (uint64_t i = 63; i < source.size; i += 64) {
+    source.data[i] = ')';
+  }
+  MkTokenBuffer buffer = {0};
+  MkLexerTokenizeAll(SourceView(&source), &buffer);
+  uint64_t tokens = (buffer.size - 1) * config->iterations;
+  uint64_t errors = 0;
+  double start = BenchNow();
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    MkParser parser;
+    MkParserInitTokens(&parser, SourceView(&source), &buffer);
+    MkAstProgram* program = MkParserParseProgram(&parser);
+    errors += parser.errors.size;
+    MkAstNodeFree(&program->base);
+    free(program);
+    MkParserFree(parser);
+  }
+  BenchReport("parse malformed", tokens, "tokens", BenchNow() - start);
+  printf("%-24s %12" PRIu64 " errors\n", "", errors / config->iterations);
+  MkTokenBufferFree(&buffer);
+  VEC_FREE(&source);
+}
+
+BENCH_FUNC(Expressions) {
+  struct {
+    const char* name;
+    String (*generate)(uint64_t size, uint64_t* nodes);
+  } shapes[] = {
+      {"parse nested", GenerateNestedSource},
+      {"parse chain", GenerateChainSource},
+  };
+  for (uint64_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); ++s) {
+    uint64_t nodes = 0;
+    String source = shapes[s].generate(config->source_size, &nodes);
+    double seconds = 0;
+    if (!TimeParse(&source, config->iterations, &seconds)) {
+      fprintf(stderr, "%s: source did not parse\n", shapes[s].name);
+    }
+    BenchReport(shapes[s].name, nodes * config->iterations, "exprs", seconds);
+    VEC_FREE(&source);
+  }
+}
+
+// Memory per node and the cost of visiting every node, pointer AST against
+// flat AST, over the same program.
+BENCH_FUNC(Flat) {
+  String source = BenchGenerateSource(config->source_size);
+  MkTokenBuffer tokens = {0};
+  MkLexerTokenizeAll(SourceView(&source), &tokens);
+  MkParser parser;
+  MkParserInitTokens(&parser, SourceView(&source), &tokens);
+  MkAstProgram* program = MkParserParseProgram(&parser);
+  MkFlatAst flat = {0};
+  double start = BenchNow();
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    MkFlatAstFromProgram(&flat, program, &tokens);
+  }
+  double seconds = BenchNow() - start;
+  // The program node is the one the walk below does not count.
+  uint64_t nodes = flat.nodes.size - 1;
+  BenchReport("flatten", nodes * config->iterations, "nodes", seconds);
+
+  uint64_t flat_bytes = flat.nodes.size * sizeof(MkFlatNode) +
+                        flat.extra.size * sizeof(uint32_t);
+  printf("%-24s %12.2f bytes per node (%" PRIu64 " bytes)\n", "pointer ast",
+         (double)program->arena.used / (double)nodes, program->arena.used);
+  printf("%-24s %12.2f bytes per node (%" PRIu64 " bytes)\n", "flat ast",
+         (double)flat_bytes / (double)nodes, flat_bytes);
+
+  WalkTotals pointer_totals = {0};
+  start = BenchNow();
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    for (uint64_t j = 0; j < program->statements.size; ++j) {
+      WalkStatement(program->statements.data[j], &pointer_totals);
+    }
+  }
+  BenchReport("walk pointer ast", pointer_totals.nodes, "nodes",
+              BenchNow() - start);
+
+  WalkTotals flat_totals = {0};
+  start = BenchNow();
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    // Post-order makes a full traversal a linear scan.
+    for (uint64_t j = 0; j < nodes; ++j) {
+      MkFlatNode node = flat.nodes.data[j];
+      if (node.kind == kMkFlatIntegerLiteral) {
+        flat_totals.sum += MkFlatIntegerValue(node);
+      }
+    }
+    flat_totals.nodes += nodes;
+  }
+  BenchReport("scan flat ast", flat_totals.nodes, "nodes", BenchNow() - start);
+  if (flat_totals.nodes != pointer_totals.nodes ||
+      flat_totals.sum != pointer_totals.sum) {
+    fprintf(stderr, "flat ast: walks disagree\n");
+  }
+
+  MkFlatAstFree(&flat);
+  MkAstNodeFree(&program->base);
+  free(program);
+  MkParserFree(parser);
+  MkTokenBufferFree(&tokens);
+  VEC_FREE(&source);
+}
+
+// Brings `tokens` and `program` up to date after `edit` and returns how long
+// that took, adding what was reused and parsed to `totals`.
+static double TimeReparse(MkParser* parser,
+                          MkAstProgram* program,
+                          const String* source,
+                          MkTokenBuffer* tokens,
+                          MkEdit edit,
+                          MkReparseStats* totals) {
+  MkReparseStats stats;
+  double start = BenchNow();
+  MkLexerRelex(SourceView(source), tokens, edit);
+  MkParserReparse(parser, program, SourceView(source), tokens, edit, &stats);
+  double seconds = BenchNow() - start;
+  totals->reused_statements += stats.reused_statements;
+  totals->reused_nodes += stats.reused_nodes;
+  totals->parsed_statements += stats.parsed_statements;
+  totals->parsed_nodes += stats.parsed_nodes;
+  return seconds;
+}
+
+// Edits a generated program one byte at a time and brings its tokens and AST
+// up to date after each edit, against lexing and parsing all of it again.
+// Overwriting a byte keeps every offset; inserting one, and deleting it again
+// right after, shifts every statement after it, which the reparse only
+// records. Settling makes the moves still pending at the end all at once.
+BENCH_FUNC(Reparse) {
+  enum { kEditsPerIteration = 1000 };
+  String source = BenchGenerateSource(config->source_size);
+  uint64_t lines = 0;
+  for (uint64_t i = 0; i < source.size; ++i) {
+    lines += source.data[i] == '\n';
+  }
+  MkTokenBuffer tokens = {0};
+  double start = BenchNow();
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    MkLexerTokenizeAll(SourceView(&source), &tokens);
+    MkParser parser;
+    MkParserInitTokens(&parser, SourceView(&source), &tokens);
+    MkAstProgram* program = MkParserParseProgram(&parser);
+    MkAstNodeFree(&program->base);
+    free(program);
+    MkParserFree(parser);
+  }
+  double full = (BenchNow() - start) / (double)config->iterations;
+
+  MkLexerTokenizeAll(SourceView(&source), &tokens);
+  MkParser parser;
+  MkParserInitTokens(&parser, SourceView(&source), &tokens);
+  MkAstProgram* program = MkParserParseProgram(&parser);
+  const char kReplacements[] = "x1 =;(";
+  uint64_t state = 0x2545F4914F6CDD1D;
+  for (int insert = 0; insert < 2; ++insert) {
+    uint64_t edits = 0;
+    MkReparseStats stats = {0};
+    double seconds = 0;
+    for (uint64_t i = 0; i < config->iterations; ++i) {
+      for (int j = 0; j < kEditsPerIteration; ++j) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        uint64_t offset = state % source.size;
+        // A lost brace would leave the rest of the file inside a block, which
+        // makes every edit after it a parse to the end.
+        if (source.data[offset] == '{' || source.data[offset] == '}') {
+          continue;
+        }
+        if (insert) {
+          // The generated source has room for a few more bytes.
+          memmove(&source.data[offset + 1], &source.data[offset],
+                  source.size - offset);
+          source.data[offset] = 'x';
+          ++source.size;
+          MkEdit edit = {.offset = offset,
+                         .inserted = {.begin = &source.data[offset],
+                                      .end = &source.data[offset + 1]}};
+          seconds += TimeReparse(&parser, program, &source, &tokens, edit,
+                                 &stats);
+          memmove(&source.data[offset], &source.data[offset + 1],
+                  source.size - offset - 1);
+          --source.size;
+          edit = (MkEdit){.offset = offset, .removed = 1};
+          seconds += TimeReparse(&parser, program, &source, &tokens, edit,
+                                 &stats);
+          edits += 2;
+        } else {
+          source.data[offset] = kReplacements[(state >> 32) % 6];
+          MkEdit edit = {.offset = offset,
+                         .removed = 1,
+                         .inserted = {.begin = &source.data[offset],
+                                      .end = &source.data[offset + 1]}};
+          seconds += TimeReparse(&parser, program, &source, &tokens, edit,
+                                 &stats);
+          ++edits;
+        }
+      }
+    }
+    BenchReport(insert ? "reparse insert/delete" : "reparse overwrite", edits,
+                "edits", seconds);
+    printf("%-24s %12.2f us per edit, %.3f%% of nodes reused\n", "",
+           seconds / (double)edits * 1e6,
+           100.0 * (double)stats.reused_nodes /
+               (double)(stats.reused_nodes + stats.parsed_nodes));
+  }
+  start = BenchNow();
+  MkAstProgramSettle(program);
+  printf("%-24s %12.2f ms to settle the program\n", "",
+         (BenchNow() - start) * 1e3);
+  printf("%-24s %12.2f ms per full lex and parse of %" PRIu64 " lines\n", "",
+         full * 1e3, lines);
+
+  MkAstNodeFree(&program->base);
+  free(program);
+  MkParserFree(parser);
+  MkTokenBufferFree(&tokens);
+  VEC_FREE(&source);
+}
+
+BENCH_FUNC(Intern) {
+  String source = BenchGenerateSource(config->source_size);
+  MkTokenBuffer tokens = {0};
+  MkLexerTokenizeAll(SourceView(&source), &tokens);
+  MkInterner symbols;
+  double seconds = 0;
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    MkInternerInit(&symbols);
+    double start = BenchNow();
+    MkParser parser;
+    MkParserInitTokens(&parser, SourceView(&source), &tokens);
+    parser.symbols = &symbols;
+    MkAstProgram* program = MkParserParseProgram(&parser);
+    seconds += BenchNow() - start;
+    MkAstNodeFree(&program->base);
+    free(program);
+    MkParserFree(parser);
+    if (i + 1 < config->iterations) {
+      MkInternerFree(&symbols);
+    }
+  }
+  BenchReport("parse with interning", tokens.size * config->iterations,
+              "tokens", seconds);
+
+  // Without the interner, each identifier would hold a copy of its name.
+  uint64_t table_bytes = symbols.capacity * sizeof(*symbols.slots) +
+                         symbols.text.size + symbols.starts.size * 4 +
+                         symbols.hashes.size * 4;
+  uint64_t name_bytes = symbols.hit_bytes + symbols.text.size;
+  printf("%-24s %12.2f%% hit rate (%" PRIu64 " lookups, %" PRIu32
+         " names)\n",
+         "interner", 100.0 * (double)symbols.hits / (double)symbols.lookups,
+         symbols.lookups, MkInternerCount(&symbols));
+  printf("%-24s %12" PRIu64 " bytes of names, %" PRIu64
+         " stored once in %" PRIu64 " bytes of tables\n",
+         "", name_bytes, symbols.text.size, table_bytes);
+  printf("%-24s %12" PRIu64 " bytes saved over a copy per identifier\n", "",
+         name_bytes - table_bytes);
+
+  MkInternerFree(&symbols);
+  MkTokenBufferFree(&tokens);
+  VEC_FREE(&source);
+}
+
+BENCH_FUNC(Cache) {
+  String source = BenchGenerateSource(config->source_size);
+  char directory[] = "/tmp/monkey_bench_cache_XXXXXX";
+  MkAstCache cache;
+  if (mkdtemp(directory) == NULL || !MkAstCacheInit(&cache, directory)) {
+    fprintf(stderr, "cache: cannot create %s\n", directory);
+    VEC_FREE(&source);
+    return;
+  }
+  MkTokenBuffer tokens = {0};
+  MkFlatAst flat = {0};
+  MkErrors errors = {0};
+  double parse_seconds = 0;
+  double flatten_seconds = 0;
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    double start = BenchNow();
+    MkLexerTokenizeAll(SourceView(&source), &tokens);
+    MkParser parser;
+    MkParserInitTokens(&parser, SourceView(&source), &tokens);
+    MkAstProgram* program = MkParserParseProgram(&parser);
+    double parsed = BenchNow();
+    MkFlatAstFromProgram(&flat, program, &tokens);
+    flatten_seconds += BenchNow() - parsed;
+    parse_seconds += parsed - start;
+    VEC_FREE(&errors);
+    errors = parser.errors;
+    parser.errors = (MkErrors){0};
+    MkAstNodeFree(&program->base);
+    free(program);
+    MkParserFree(parser);
+  }
+  BenchReport("cold lex+parse", source.size * config->iterations, "bytes",
+              parse_seconds);
+  BenchReport("flatten for cache", source.size * config->iterations, "bytes",
+              flatten_seconds);
+
+  double start = BenchNow();
+  bool stored = MkAstCacheStore(&cache, SourceView(&source), &flat, &tokens,
+                                &errors);
+  double store_seconds = BenchNow() - start;
+
+  uint64_t hash = 0;
+  start = BenchNow();
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    hash += HashFnv1a(source.data, source.size);
+  }
+  BenchReport("hash source", source.size * config->iterations, "bytes",
+              BenchNow() - start);
+
+  MkAstImage image = {0};
+  uint64_t hits = 0;
+  start = BenchNow();
+  for (uint64_t i = 0; i < config->iterations; ++i) {
+    hits += MkAstCacheLoad(&cache, SourceView(&source), &image);
+    MkAstImageFree(&image);
+  }
+  double load_seconds = BenchNow() - start;
+  BenchReport("warm cache load", source.size * config->iterations, "bytes",
+              load_seconds);
+  if (!stored || hits != config->iterations) {
+    fprintf(stderr, "cache: %" PRIu64 " of %" PRIu64 " loads hit\n", hits,
+            config->iterations);
+  }
+  uint64_t image_size = 0;
+  String path = MkAstCachePath(&cache, SourceView(&source));
+  FILE* fp = fopen(path.data, "rb");
+  if (fp != NULL) {
+    fseek(fp, 0, SEEK_END);
+    image_size = (uint64_t)ftell(fp);
+    fclose(fp);
+  }
+  printf("%-24s %12.2f ms to store an image of %.2f bytes per source byte\n",
+         "", store_seconds * 1e3, (double)image_size / (double)source.size);
+  printf("%-24s %12.2fx faster than lex+parse (hash %016" PRIx64 ")\n", "",
+         parse_seconds / load_seconds, hash);
+
+  unlink(path.data);
+  rmdir(directory);
+  VEC_FREE(&path);
+  VEC_FREE(&errors);
+  MkFlatAstFree(&flat);
+  MkTokenBufferFree(&tokens);
+  MkAstCacheFree(&cache);
+  VEC_FREE(&source);
+}
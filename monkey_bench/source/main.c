@@ -0,0 +1,99 @@
+#include <argparse.h>
+#include <pool/pool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "monkey_bench/bench.h"
+#include "monkey_bench/bench_eval.h"
+#include "monkey_bench/bench_lexer.h"
+#include "monkey_bench/bench_parser.h"
+
+static const char* const kUsage[] = {
+    "monkey_bench [options] [BENCH...]",
+    NULL,
+};
+
+static const struct {
+  const char* name;
+  void (*run)(const BenchConfig* config);
+} kBenches[] = {
+    {"lexer", BenchLexer},
+    {"tokenize", BenchTokenize},
+    {"stream", BenchStream},
+    {"parallel", BenchParallel},
+    {"relex", BenchRelex},
+    {"parser", BenchParser},
+    {"programs", BenchPrograms},
+    {"parallel-parse", BenchParallelParse},
+    {"malformed", BenchMalformed},
+    {"expressions", BenchExpressions},
+    {"flat", BenchFlat},
+    {"reparse", BenchReparse},
+    {"intern", BenchIntern},
+    {"cache", BenchCache},
+    {"fib", BenchFib},
+    {"loops", BenchLoops},
+    {"closures", BenchClosures},
+    {"allocations", BenchAllocations},
+    {"collector", BenchCollector},
+    {"latency", BenchLatency},
+    {"folding", BenchFolding},
+    {"scopes", BenchScopes},
+    {"scan", BenchScan},
+    {"lines", BenchLines},
+    {"keywords", BenchKeywords},
+};
+
+enum { kBenchCount = sizeof(kBenches) / sizeof(kBenches[0]) };
+
+int main(int argc, const char** argv) {
+  int size_kb = 4096;
+  int iterations = 10;
+  int threads = (int)ThreadPoolDefaultSize();
+  struct argparse_option options[] = {
+      OPT_HELP(),
+      OPT_GROUP("Basic options"),
+      OPT_INTEGER('s', "size", &size_kb,
+                  "size of the generated source in KiB (default 4096)"),
+      OPT_INTEGER('n', "iterations", &iterations,
+                  "iterations per benchmark (default 10)"),
+      OPT_INTEGER('t', "threads", &threads,
+                  "most threads for parallel benchmarks (default: cores)"),
+      OPT_END(),
+  };
+  struct argparse argp;
+  argparse_init(&argp, options, kUsage, 0);
+  argparse_describe(&argp, "Runs the Monkey micro-benchmarks", "");
+  argc = argparse_parse(&argp, argc, argv);
+
+  if (size_kb <= 0 || iterations <= 0 || threads <= 0) {
+    fprintf(stderr, "size, iterations and threads must be positive\n");
+    return 1;
+  }
+  BenchConfig config = {
+      .source_size = (uint64_t)size_kb * 1024,
+      .iterations = (uint64_t)iterations,
+      .max_threads = (uint32_t)threads,
+  };
+
+  if (argc == 0) {
+    for (int i = 0; i < kBenchCount; ++i) {
+      kBenches[i].run(&config);
+    }
+    return 0;
+  }
+
+  for (int j = 0; j < argc; ++j) {
+    int i = 0;
+    while (i < kBenchCount && strcmp(argv[j], kBenches[i].name) != 0) {
+      ++i;
+    }
+    if (i == kBenchCount) {
+      fprintf(stderr, "unknown benchmark: %s\n", argv[j]);
+      return 1;
+    }
+    kBenches[i].run(&config);
+  }
+  return 0;
+}
@@ -13,17 +13,17 @@ void ReplStart(FILE* in, FILE* out) {
   size_t line_len = 0;
   while (true) {
     fprintf(out, "%s", kPrompt);
-    if (getline(&line, &line_len, in) == -1) {
+    ssize_t line_size = getline(&line, &line_len, in);
+    if (line_size == -1) {
       free(line);
       break;
     }
     MkLexer lexer;
-    MkLexerInit(&lexer, (StringView){.begin = line, .end = line + line_len});
+    MkLexerInit(&lexer, (StringView){.begin = line, .end = line + line_size});
     for (MkToken tok = MkLexerNextToken(&lexer);
-         !StringEqual(tok.type, mk_token_eof); tok = MkLexerNextToken(&lexer)) {
+         tok.type != kMkTokenEof; tok = MkLexerNextToken(&lexer)) {
       MkTokenPrint(out, tok);
       fprintf(out, "\n");
-      MkTokenFree(tok);
     }
   }
 }
@@ -37,8 +37,6 @@ int main(void) {
   printf("Hello, %s! This is the Monkey programming language!\n", name);
   printf("Feel free to type in commands\n");
 
-  MkTokenTypesManage(kTokenTypesInit);
   ReplStart(stdin, stdout);
-  MkTokenTypesManage(kTokenTypesFree);
   return 0;
 }
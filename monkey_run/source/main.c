@@ -0,0 +1,397 @@
+#include <argparse.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <monkey/ast.h>
+#include <monkey/ast_cache.h>
+#include <monkey/code.h>
+#include <monkey/compiler.h>
+#include <monkey/evaluator.h>
+#include <monkey/flat_ast.h>
+#include <monkey/heap.h>
+#include <monkey/lexer.h>
+#include <monkey/optimizer.h>
+#include <monkey/parser.h>
+#include <monkey/resolver.h>
+#include <monkey/token.h>
+#include <monkey/value.h>
+#include <monkey/vm.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char* const kUsage[] = {
+    "monkey_run <FILE> [options]",
+    NULL,
+};
+
+typedef struct {
+  const char* data;
+  uint64_t size;
+} MappedFile;
+
+static double Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Maps the whole file read-only. Empty files are not mapped at all, since
+// mmap rejects zero-length mappings.
+static bool MapFile(const char* path, MappedFile* out_file) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "could not open %s for reading: %s\n", path,
+            strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    fprintf(stderr, "could not stat %s: %s\n", path, strerror(errno));
+    close(fd);
+    return false;
+  }
+  *out_file = (MappedFile){.data = NULL, .size = (uint64_t)st.st_size};
+  if (out_file->size > 0) {
+    void* data = mmap(NULL, out_file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      fprintf(stderr, "could not map %s: %s\n", path, strerror(errno));
+      close(fd);
+      return false;
+    }
+    madvise(data, out_file->size, MADV_SEQUENTIAL);
+    out_file->data = data;
+  }
+  close(fd);
+  return true;
+}
+
+static void UnmapFile(MappedFile file) {
+  if (file.data != NULL) {
+    munmap((void*)file.data, file.size);
+  }
+}
+
+static void PrintErrors(const char* path, MkParser* parser) {
+  for (uint64_t i = 0; i < parser->errors.size; ++i) {
+    String error = MkParserErrorString(parser, parser->errors.data[i]);
+    fprintf(stderr, "%s: %" STRING_FMT "\n", path, STRING_PRINT(error));
+    VEC_FREE(&error);
+  }
+}
+
+static void PrintCacheHit(const MkAstImage* image, double load_time) {
+  const MkFlatAst* flat = &image->flat;
+  uint32_t statements = flat->extra.data[flat->nodes.data[flat->root].a];
+  fprintf(stderr, "cache: %10.3f ms  (hit, %" PRIu64 " tokens, %" PRIu32
+          " statements)\n",
+          load_time * 1e3, image->tokens.size, statements);
+}
+
+// Reports the errors of a cached parse, with a parser over the cached tokens
+// standing in for the one that found them. Returns the exit status.
+static int ReportCached(const char* path,
+                        StringView source,
+                        MkAstImage* image,
+                        bool stats,
+                        double load_time) {
+  MkParser parser;
+  MkParserInitTokens(&parser, source, &image->tokens);
+  VEC_APPEND(&parser.errors, image->errors.data, image->errors.size);
+  PrintErrors(path, &parser);
+  if (stats) {
+    PrintCacheHit(image, load_time);
+  }
+  MkParserFree(parser);
+  return 1;
+}
+
+typedef struct {
+  // The VM, or else the evaluator.
+  bool vm;
+  bool stats;
+  // Run MkOptimizeProgram first.
+  bool fold;
+  // Heap tunables; zero picks the default.
+  MkHeapMode gc_mode;
+  uint64_t initial_bytes;
+  double growth_factor;
+  uint64_t step_bytes;
+} RunOptions;
+
+// Resolves and runs a program that parsed cleanly, printing its value unless
+// it is null. Returns the exit status.
+static int Run(const char* path,
+               MkParser* parser,
+               MkAstProgram* program,
+               const RunOptions* options) {
+  bool vm = options->vm;
+  double fold_start = Now();
+  MkOptimizeStats fold_stats = {0};
+  if (options->fold && !MkOptimizeProgram(program, &fold_stats)) {
+    fprintf(stderr, "%s: out of memory\n", path);
+    return 1;
+  }
+  double resolve_start = Now();
+  if (!MkResolveProgram(program)) {
+    fprintf(stderr, "%s: out of memory\n", path);
+    return 1;
+  }
+  double compile_start = Now();
+  MkBytecode bytecode = {0};
+  if (vm) {
+    String error = {0};
+    if (!MkCompileProgram(&bytecode, program, &error)) {
+      fprintf(stderr, "%s: %" STRING_FMT "\n", path, STRING_PRINT(error));
+      VEC_FREE(&error);
+      return 1;
+    }
+  }
+
+  double run_start = Now();
+  MkEvaluator evaluator;
+  MkEvaluatorInit(&evaluator);
+  MkVm machine;
+  MkVmInit(&machine);
+  MkHeap* heap = vm ? &machine.heap : &evaluator.heap;
+  heap->mode = options->gc_mode;
+  heap->initial_bytes = options->initial_bytes;
+  heap->growth_factor = options->growth_factor;
+  heap->step_bytes = options->step_bytes;
+  MkValue result;
+  bool ok = vm ? MkVmRun(&machine, &bytecode, &result)
+               : MkEvaluatorRun(&evaluator, program, &result);
+  double run_end = Now();
+
+  if (!ok) {
+    const String* error = vm ? &machine.error : &evaluator.error;
+    MkSourcePosition position = MkLineIndexLookup(
+        &parser->lines, vm ? machine.error_offset : evaluator.error_offset);
+    fprintf(stderr, "%s: %" PRIu32 ":%" PRIu32 ": %" STRING_FMT "\n", path,
+            position.line, position.column, STRING_PRINT(*error));
+  } else if (!MK_IS_NULL(result)) {
+    String inspected = MkValueInspect(result);
+    printf("%" STRING_FMT "\n", STRING_PRINT(inspected));
+    VEC_FREE(&inspected);
+  }
+  if (options->stats) {
+    if (options->fold) {
+      fprintf(stderr, "fold:    %8.3f ms  (%" PRIu64 " folded, %" PRIu64
+              " ifs pruned, %" PRIu64 " nodes removed)\n",
+              (resolve_start - fold_start) * 1e3, fold_stats.folded,
+              fold_stats.pruned, fold_stats.removed);
+    }
+    fprintf(stderr, "resolve: %8.3f ms\n",
+            (compile_start - resolve_start) * 1e3);
+    if (vm) {
+      fprintf(stderr, "compile: %8.3f ms  (%" PRIu64 " functions)\n",
+              (run_start - compile_start) * 1e3, bytecode.functions.size);
+    }
+    fprintf(stderr, "%s  %10.3f ms  (%" PRIu64 " calls, %" PRIu64
+            " objects)\n",
+            vm ? "vm:  " : "eval:", (run_end - run_start) * 1e3,
+            vm ? machine.calls : evaluator.calls, heap->stats.allocations);
+    fprintf(stderr, "gc:      %8.3f ms  (%" PRIu64 " collections, %" PRIu64
+            " pauses, %.3f ms max, %" PRIu64 " bytes freed, %" PRIu64
+            " live)\n",
+            heap->stats.pause_seconds * 1e3, heap->stats.collections,
+            heap->stats.pauses, heap->stats.max_pause_seconds * 1e3,
+            heap->stats.bytes_freed, heap->bytes);
+  }
+  MkVmFree(&machine);
+  MkEvaluatorFree(&evaluator);
+  MkBytecodeFree(&bytecode);
+  return ok ? 0 : 1;
+}
+
+int main(int argc, const char** argv) {
+  int stats = 0;
+  int no_fold = 0;
+  const char* cache_directory = NULL;
+  const char* engine = "vm";
+  const char* gc = "stop";
+  int heap_kb = 0;
+  float growth_factor = 0;
+  int step_kb = 0;
+  struct argparse_option options[] = {
+      OPT_HELP(),
+      OPT_GROUP("Basic options"),
+      OPT_BOOLEAN('s', "stats", &stats, "report timings of each phase"),
+      OPT_STRING('c', "cache", &cache_directory,
+                 "reuse parses stored in DIR, keyed by the source bytes"),
+      OPT_STRING('e', "engine", &engine,
+                 "run on the bytecode VM (vm, the default) or on the AST "
+                 "(eval)"),
+      OPT_BOOLEAN(0, "no-fold", &no_fold,
+                  "run the program as parsed, without folding constants and "
+                  "dead branches"),
+      OPT_GROUP("Heap options"),
+      OPT_STRING(0, "gc", &gc,
+                 "collect in one pause (stop, the default) or a step at a "
+                 "time as the program allocates (incremental)"),
+      OPT_INTEGER(0, "heap-initial", &heap_kb,
+                  "KB to allocate before the first collection (default 1024)"),
+      OPT_FLOAT(0, "heap-growth", &growth_factor,
+                "collect again once the heap is this many times what the "
+                "last collection kept (default 2)"),
+      OPT_INTEGER(0, "gc-step", &step_kb,
+                  "KB to allocate between incremental steps (default 32)"),
+      OPT_END(),
+  };
+  struct argparse argp;
+  argparse_init(&argp, options, kUsage, 0);
+  argparse_describe(&argp, "Runs a Monkey script", "");
+  argc = argparse_parse(&argp, argc, argv);
+
+  if (argc < 1) {
+    fprintf(stderr, "required argument not passed: <FILE>\n");
+    argparse_usage(&argp);
+    return 1;
+  }
+  RunOptions run_options = {
+      .vm = strcmp(engine, "vm") == 0,
+      .stats = stats,
+      .fold = !no_fold,
+      .gc_mode = strcmp(gc, "incremental") == 0 ? kMkHeapIncremental
+                                                : kMkHeapStopTheWorld,
+      .initial_bytes = (uint64_t)(heap_kb > 0 ? heap_kb : 0) * 1024,
+      .growth_factor = growth_factor,
+      .step_bytes = (uint64_t)(step_kb > 0 ? step_kb : 0) * 1024,
+  };
+  if (!run_options.vm && strcmp(engine, "eval") != 0) {
+    fprintf(stderr, "unknown engine: %s\n", engine);
+    return 1;
+  }
+  if (run_options.gc_mode == kMkHeapStopTheWorld &&
+      strcmp(gc, "stop") != 0) {
+    fprintf(stderr, "unknown collector: %s\n", gc);
+    return 1;
+  }
+  if (heap_kb < 0 || step_kb < 0 || (growth_factor != 0 && growth_factor < 1)) {
+    fprintf(stderr, "the heap needs a positive size and a growth of 1 or "
+                    "more\n");
+    return 1;
+  }
+
+  double map_start = Now();
+  MappedFile file;
+  if (!MapFile(argv[0], &file)) {
+    return 1;
+  }
+  StringView source = {.begin = file.data, .end = file.data + file.size};
+
+  // A hit for a script with errors needs nothing but the errors. Any other
+  // hit skips lexing, parsing and the store: the pointer AST to run is built
+  // back from the image.
+  MkAstCache cache = {0};
+  MkAstImage image = {0};
+  bool hit = false;
+  double load_start = Now();
+  double load_end = load_start;
+  if (cache_directory != NULL) {
+    if (!MkAstCacheInit(&cache, cache_directory)) {
+      fprintf(stderr, "could not create %s: %s\n", cache_directory,
+              strerror(errno));
+      UnmapFile(file);
+      return 1;
+    }
+    load_start = Now();
+    hit = MkAstCacheLoad(&cache, source, &image);
+    load_end = Now();
+    if (hit && image.errors.size > 0) {
+      if (stats) {
+        fprintf(stderr, "map:   %10.3f ms  (%" PRIu64 " bytes)\n",
+                (load_start - map_start) * 1e3, file.size);
+      }
+      int status =
+          ReportCached(argv[0], source, &image, stats, load_end - load_start);
+      MkAstImageFree(&image);
+      MkAstCacheFree(&cache);
+      UnmapFile(file);
+      return status;
+    }
+  }
+
+  double lex_start = Now();
+  MkTokenBuffer lexed = {0};
+  const MkTokenBuffer* tokens = &image.tokens;
+  if (!hit) {
+    tokens = &lexed;
+    if (!MkLexerTokenizeAll(source, &lexed)) {
+      fprintf(stderr, "could not tokenize %s\n", argv[0]);
+      MkTokenBufferFree(&lexed);
+      MkAstCacheFree(&cache);
+      UnmapFile(file);
+      return 1;
+    }
+  }
+
+  // An image that does not build back is parsed again from its tokens.
+  double parse_start = Now();
+  MkParser parser;
+  MkParserInitTokens(&parser, source, tokens);
+  MkAstProgram* program = NULL;
+  if (hit) {
+    program = MkFlatAstToProgram(&image.flat, tokens, source, parser.symbols);
+  }
+  bool built = program != NULL;
+  if (!built) {
+    program = MkParserParseProgram(&parser);
+  }
+  double parse_end = Now();
+
+  PrintErrors(argv[0], &parser);
+
+  // A store that fails only costs the next run its cache hit.
+  double store_start = Now();
+  if (cache_directory != NULL && !hit) {
+    MkFlatAst flat = {0};
+    if (MkFlatAstFromProgram(&flat, program, tokens)) {
+      MkAstCacheStore(&cache, source, &flat, tokens, &parser.errors);
+    }
+    MkFlatAstFree(&flat);
+  }
+  double store_end = Now();
+
+  if (stats) {
+    fprintf(stderr, "map:   %10.3f ms  (%" PRIu64 " bytes)\n",
+            (load_start - map_start) * 1e3, file.size);
+    if (hit) {
+      PrintCacheHit(&image, load_end - load_start);
+    } else {
+      if (cache_directory != NULL) {
+        fprintf(stderr, "cache: %10.3f ms  (miss)\n",
+                (load_end - load_start) * 1e3);
+      }
+      fprintf(stderr, "lex:   %10.3f ms  (%" PRIu64 " tokens)\n",
+              (parse_start - lex_start) * 1e3, tokens->size);
+    }
+    fprintf(stderr, "%s %10.3f ms  (%" PRIu64 " statements)\n",
+            built ? "build:" : "parse:", (parse_end - parse_start) * 1e3,
+            program->statements.size);
+    if (cache_directory != NULL && !hit) {
+      fprintf(stderr, "store: %10.3f ms  (miss)\n",
+              (store_end - store_start) * 1e3);
+    }
+  }
+
+  int status = 1;
+  if (parser.errors.size == 0) {
+    status = Run(argv[0], &parser, program, &run_options);
+  }
+
+  MkAstNodeFree(&program->base);
+  free(program);
+  MkParserFree(parser);
+  MkTokenBufferFree(&lexed);
+  MkAstImageFree(&image);
+  MkAstCacheFree(&cache);
+  UnmapFile(file);
+  return status;
+}
@@ -0,0 +1,9 @@
+#ifndef MONKEY_TEST_AST_CACHE_H_
+#define MONKEY_TEST_AST_CACHE_H_
+
+#include <test/test.h>
+
+TEST_FUNC(AstCacheRoundTrip);
+TEST_FUNC(AstCacheRejectsDamage);
+
+#endif  // MONKEY_TEST_AST_CACHE_H_
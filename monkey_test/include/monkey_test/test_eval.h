@@ -0,0 +1,18 @@
+#ifndef MONKEY_TEST_EVAL_H_
+#define MONKEY_TEST_EVAL_H_
+
+#include <test/test.h>
+
+TEST_FUNC(EvalExpressions);
+TEST_FUNC(EvalErrors);
+TEST_FUNC(EvalResolver);
+TEST_FUNC(EvalFrames);
+TEST_FUNC(EvalValues);
+TEST_FUNC(EvalCollector);
+TEST_FUNC(EvalIncrementalCollector);
+TEST_FUNC(EvalCollectMidSweep);
+TEST_FUNC(EvalBytecode);
+TEST_FUNC(EvalCompileDepth);
+TEST_FUNC(EvalFolding);
+
+#endif  // MONKEY_TEST_EVAL_H_
@@ -4,5 +4,9 @@
 #include <test/test.h>
 
 TEST_FUNC(LexerNextToken);
+TEST_FUNC(LexerLookupIdent);
+TEST_FUNC(LexerTokenizeAll);
+TEST_FUNC(LexerTokenizeParallel);
+TEST_FUNC(LexerRelex);
 
 #endif  // MONKEY_TEST_LEXER_H_
@@ -4,5 +4,19 @@
 #include <test/test.h>
 
 TEST_FUNC(ParserLetStatements);
+TEST_FUNC(ParserReturnStatements);
+TEST_FUNC(ParserOperatorPrecedence);
+TEST_FUNC(ParserLiterals);
+TEST_FUNC(ParserIfExpressions);
+TEST_FUNC(ParserFunctions);
+TEST_FUNC(ParserNestingLimit);
+TEST_FUNC(ParserArena);
+TEST_FUNC(ParserErrorPositions);
+TEST_FUNC(ParserLookahead);
+TEST_FUNC(ParserRecovery);
+TEST_FUNC(ParserParallel);
+TEST_FUNC(ParserReparse);
+TEST_FUNC(ParserFlatAst);
+TEST_FUNC(ParserInterning);
 
 #endif  // MONKEY_TEST_PARSER_H_
@@ -0,0 +1,10 @@
+#ifndef MONKEY_TEST_SCAN_H_
+#define MONKEY_TEST_SCAN_H_
+
+#include <test/test.h>
+
+TEST_FUNC(ScanKernelsMatchScalar);
+TEST_FUNC(ScanLexerMatchesScalar);
+TEST_FUNC(ScanLineStarts);
+
+#endif  // MONKEY_TEST_SCAN_H_
@@ -0,0 +1,9 @@
+#ifndef MONKEY_TEST_STREAM_H_
+#define MONKEY_TEST_STREAM_H_
+
+#include <test/test.h>
+
+TEST_FUNC(StreamChunkBoundaries);
+TEST_FUNC(StreamFile);
+
+#endif  // MONKEY_TEST_STREAM_H_
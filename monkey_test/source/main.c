@@ -1,26 +1,83 @@
 #include <inttypes.h>
-#include <monkey/token.h>
 #include <test/test.h>
 
+#include "monkey_test/test_ast_cache.h"
+#include "monkey_test/test_eval.h"
 #include "monkey_test/test_lexer.h"
 #include "monkey_test/test_parser.h"
+#include "monkey_test/test_scan.h"
+#include "monkey_test/test_stream.h"
 
 TEST_SUITE_FUNC(LexerTests) {
   TEST_RUN(LexerNextToken);
+  TEST_RUN(LexerLookupIdent);
+  TEST_RUN(LexerTokenizeAll);
+  TEST_RUN(LexerTokenizeParallel);
+  TEST_RUN(LexerRelex);
+  TEST_SUITE_PASS();
+}
+
+TEST_SUITE_FUNC(ScanTests) {
+  TEST_RUN(ScanKernelsMatchScalar);
+  TEST_RUN(ScanLexerMatchesScalar);
+  TEST_RUN(ScanLineStarts);
+  TEST_SUITE_PASS();
+}
+
+TEST_SUITE_FUNC(StreamTests) {
+  TEST_RUN(StreamChunkBoundaries);
+  TEST_RUN(StreamFile);
   TEST_SUITE_PASS();
 }
 
 TEST_SUITE_FUNC(ParserTests) {
   TEST_RUN(ParserLetStatements);
+  TEST_RUN(ParserReturnStatements);
+  TEST_RUN(ParserOperatorPrecedence);
+  TEST_RUN(ParserLiterals);
+  TEST_RUN(ParserIfExpressions);
+  TEST_RUN(ParserFunctions);
+  TEST_RUN(ParserNestingLimit);
+  TEST_RUN(ParserArena);
+  TEST_RUN(ParserErrorPositions);
+  TEST_RUN(ParserLookahead);
+  TEST_RUN(ParserRecovery);
+  TEST_RUN(ParserParallel);
+  TEST_RUN(ParserReparse);
+  TEST_RUN(ParserFlatAst);
+  TEST_RUN(ParserInterning);
+  TEST_SUITE_PASS();
+}
+
+TEST_SUITE_FUNC(AstCacheTests) {
+  TEST_RUN(AstCacheRoundTrip);
+  TEST_RUN(AstCacheRejectsDamage);
+  TEST_SUITE_PASS();
+}
+
+TEST_SUITE_FUNC(EvalTests) {
+  TEST_RUN(EvalExpressions);
+  TEST_RUN(EvalErrors);
+  TEST_RUN(EvalResolver);
+  TEST_RUN(EvalFrames);
+  TEST_RUN(EvalValues);
+  TEST_RUN(EvalCollector);
+  TEST_RUN(EvalIncrementalCollector);
+  TEST_RUN(EvalCollectMidSweep);
+  TEST_RUN(EvalBytecode);
+  TEST_RUN(EvalCompileDepth);
+  TEST_RUN(EvalFolding);
   TEST_SUITE_PASS();
 }
 
 int main(void) {
   uint64_t test_count = 0;
-  MkTokenTypesManage(kTokenTypesInit);
   TEST_RUN_SUITE(LexerTests, &test_count);
+  TEST_RUN_SUITE(ScanTests, &test_count);
+  TEST_RUN_SUITE(StreamTests, &test_count);
   TEST_RUN_SUITE(ParserTests, &test_count);
-  MkTokenTypesManage(kTokenTypesFree);
+  TEST_RUN_SUITE(AstCacheTests, &test_count);
+  TEST_RUN_SUITE(EvalTests, &test_count);
   printf("[PASS] %" PRIu64 " tests\n", test_count);
   return 0;
 }
@@ -0,0 +1,197 @@
+#include "monkey_test/test_ast_cache.h"
+
+#include <inttypes.h>
+#include <monkey/ast.h>
+#include <monkey/ast_cache.h>
+#include <monkey/flat_ast.h>
+#include <monkey/lexer.h>
+#include <monkey/parser.h>
+#include <monkey/token.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string/string.h>
+#include <test/test.h>
+#include <unistd.h>
+#include <vec/vec.h>
+
+// What a cache image holds, produced the usual way.
+typedef struct {
+  MkTokenBuffer tokens;
+  MkFlatAst flat;
+  MkErrors errors;
+} Parsed;
+
+static const char kSource[] =
+    "let f = fn(a, b) {\n"
+    "  if (a < b) { return add(a, b * 2); } else { b }\n"
+    "};\n"
+    "let = 3;\n"
+    "f(1, 2)(-3, !true);";
+
+static bool Parse(Parsed* parsed, StringView source);
+static void ParsedFree(Parsed* parsed);
+static bool SameImage(const MkAstImage* image, const Parsed* parsed);
+
+TEST_FUNC(AstCacheRoundTrip) {
+  char directory[] = "/tmp/monkey_test_cache_XXXXXX";
+  TEST_ASSERT(mkdtemp(directory) != NULL, (void)0, "mkdtemp failed");
+  MkAstCache cache;
+  TEST_ASSERT(MkAstCacheInit(&cache, directory), rmdir(directory),
+              "cannot use %s", directory);
+  StringView source = StringViewFromC(kSource);
+  String path = MkAstCachePath(&cache, source);
+  Parsed parsed;
+  MkAstImage image = {0};
+#define CLEANUP             \
+  do {                      \
+    MkAstImageFree(&image); \
+    ParsedFree(&parsed);    \
+    unlink(path.data);      \
+    VEC_FREE(&path);        \
+    MkAstCacheFree(&cache); \
+    rmdir(directory);       \
+  } while (false)
+  TEST_ASSERT(Parse(&parsed, source) && parsed.errors.size == 1, CLEANUP,
+              "expected one parse error, got %" PRIu64, parsed.errors.size);
+  TEST_ASSERT(!MkAstCacheLoad(&cache, source, &image), CLEANUP,
+              "hit in an empty cache");
+  TEST_ASSERT(MkAstCacheStore(&cache, source, &parsed.flat, &parsed.tokens,
+                              &parsed.errors),
+              CLEANUP, "store failed");
+  TEST_ASSERT(MkAstCacheLoad(&cache, source, &image), CLEANUP,
+              "miss after a store");
+  TEST_ASSERT(SameImage(&image, &parsed), CLEANUP,
+              "loaded image differs from the parse");
+  String expected =
+      MkFlatAstString(&parsed.flat, &parsed.tokens, source, parsed.flat.root);
+  String actual =
+      MkFlatAstString(&image.flat, &image.tokens, source, image.flat.root);
+  bool same = StringEqual(expected, actual);
+  VEC_FREE(&expected);
+  VEC_FREE(&actual);
+  TEST_ASSERT(same, CLEANUP, "loaded program prints differently");
+  MkAstImageFree(&image);
+
+  // Same length, different bytes: a different file, so a miss.
+  char edited[sizeof(kSource)];
+  memcpy(edited, kSource, sizeof(kSource));
+  edited[4] = 'g';
+  TEST_ASSERT(!MkAstCacheLoad(&cache, StringViewFromC(edited), &image),
+              CLEANUP, "hit for an edited source");
+  CLEANUP;
+#undef CLEANUP
+  TEST_PASS();
+}
+
+TEST_FUNC(AstCacheRejectsDamage) {
+  StringView source = StringViewFromC(kSource);
+  Parsed parsed;
+  String bytes = {0};
+  char* copy = NULL;
+  MkAstImage image;
+#define CLEANUP          \
+  do {                   \
+    free(copy);          \
+    VEC_FREE(&bytes);    \
+    ParsedFree(&parsed); \
+  } while (false)
+  TEST_ASSERT(Parse(&parsed, source), CLEANUP, "parse failed");
+  TEST_ASSERT(MkAstImageEncode(&bytes, source, &parsed.flat, &parsed.tokens,
+                               &parsed.errors),
+              CLEANUP, "encode failed");
+  TEST_ASSERT(MkAstImageDecode(&image, bytes.data, bytes.size, source) &&
+                  SameImage(&image, &parsed),
+              CLEANUP, "encoded image does not decode to the parse");
+  TEST_ASSERT(!MkAstImageDecode(&image, bytes.data, bytes.size,
+                                StringViewFromC("let x = 1;")),
+              CLEANUP, "image decodes for another source");
+
+  // Each copy is allocated at its exact size, so that a read past the end is
+  // caught by the address sanitizer.
+  for (uint64_t size = 0; size < bytes.size; ++size) {
+    copy = malloc(size + 1);
+    memcpy(copy, bytes.data, size);
+    bool decoded = MkAstImageDecode(&image, copy, size, source);
+    free(copy);
+    copy = NULL;
+    TEST_ASSERT(!decoded, CLEANUP,
+                "image truncated to %" PRIu64 " bytes decodes", size);
+  }
+  // A damaged image that still decodes must be safe to use.
+  for (uint64_t i = 0; i < bytes.size; ++i) {
+    copy = malloc(bytes.size);
+    memcpy(copy, bytes.data, bytes.size);
+    copy[i] ^= (char)0xff;
+    bool decoded = MkAstImageDecode(&image, copy, bytes.size, source);
+    // The magic, the hash and the size of the source are always checked.
+    TEST_ASSERT(!decoded || i >= 24, CLEANUP,
+                "damaged header byte %" PRIu64 " is accepted", i);
+    if (decoded) {
+      String printed =
+          MkFlatAstString(&image.flat, &image.tokens, source, image.flat.root);
+      VEC_FREE(&printed);
+    }
+    free(copy);
+    copy = NULL;
+  }
+  CLEANUP;
+#undef CLEANUP
+  TEST_PASS();
+}
+
+bool Parse(Parsed* parsed, StringView source) {
+  *parsed = (Parsed){0};
+  if (!MkLexerTokenizeAll(source, &parsed->tokens)) {
+    return false;
+  }
+  MkParser parser;
+  MkParserInitTokens(&parser, source, &parsed->tokens);
+  MkAstProgram* program = MkParserParseProgram(&parser);
+  bool ok = MkFlatAstFromProgram(&parsed->flat, program, &parsed->tokens);
+  parsed->errors = parser.errors;
+  parser.errors = (MkErrors){0};
+  MkAstNodeFree(&program->base);
+  free(program);
+  MkParserFree(parser);
+  return ok;
+}
+
+void ParsedFree(Parsed* parsed) {
+  MkTokenBufferFree(&parsed->tokens);
+  MkFlatAstFree(&parsed->flat);
+  VEC_FREE(&parsed->errors);
+}
+
+bool SameImage(const MkAstImage* image, const Parsed* parsed) {
+  const MkFlatAst* a = &image->flat;
+  const MkFlatAst* b = &parsed->flat;
+  if (a->root != b->root || a->nodes.size != b->nodes.size ||
+      a->extra.size != b->extra.size ||
+      memcmp(a->nodes.data, b->nodes.data,
+             a->nodes.size * sizeof(MkFlatNode)) != 0 ||
+      (a->extra.size > 0 &&
+       memcmp(a->extra.data, b->extra.data,
+              a->extra.size * sizeof(uint32_t)) != 0)) {
+    return false;
+  }
+  const MkTokenBuffer* ta = &image->tokens;
+  const MkTokenBuffer* tb = &parsed->tokens;
+  if (ta->size != tb->size ||
+      memcmp(ta->kinds, tb->kinds, ta->size) != 0 ||
+      memcmp(ta->offsets, tb->offsets, ta->size * sizeof(uint32_t)) != 0 ||
+      memcmp(ta->lengths, tb->lengths, ta->size * sizeof(uint32_t)) != 0 ||
+      image->errors.size != parsed->errors.size) {
+    return false;
+  }
+  for (uint64_t i = 0; i < image->errors.size; ++i) {
+    MkParseError ea = image->errors.data[i];
+    MkParseError eb = parsed->errors.data[i];
+    if (ea.kind != eb.kind || ea.expected != eb.expected || ea.got != eb.got ||
+        ea.offset != eb.offset) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,632 @@
+#include "monkey_test/test_eval.h"
+
+#include <inttypes.h>
+#include <monkey/ast.h>
+#include <monkey/code.h>
+#include <monkey/compiler.h>
+#include <monkey/evaluator.h>
+#include <monkey/heap.h>
+#include <monkey/lexer.h>
+#include <monkey/optimizer.h>
+#include <monkey/parser.h>
+#include <monkey/resolver.h>
+#include <monkey/value.h>
+#include <monkey/vm.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string/string.h>
+
+TEST_SUBTEST_FUNC(EvaluatesTo, const char* input, const char* expected);
+static MkAstProgram* Parse(MkParser* parser, const char* input, bool fold);
+static void ProgramFree(MkAstProgram* program, MkParser parser);
+static String Evaluate(const char* input, bool fold, MkEvaluator* evaluator);
+static String Execute(const char* input, bool fold, MkVm* vm);
+
+TEST_FUNC(EvalExpressions) {
+  struct {
+    const char* input;
+    const char* expected;
+  } tests[] = {
+      {"5", "5"},
+      {"-10", "-10"},
+      {"5 + 5 + 5 + 5 - 10", "10"},
+      {"2 * (5 + 10) / 3 - -1", "11"},
+      {"7 / 2; -7 / 2", "-3"},
+      {"9223372036854775807 + 1", "-9223372036854775808"},
+      {"(-9223372036854775807 - 1) / -1", "-9223372036854775808"},
+      {"4611686018427387903 + 1", "4611686018427387904"},
+      {"4611686018427387904 - 1", "4611686018427387903"},
+      {"-4611686018427387904 - 1", "-4611686018427387905"},
+      {"-(-4611686018427387903 - 1)", "4611686018427387904"},
+      {"(-4611686018427387903 - 1) / -1", "4611686018427387904"},
+      {"4611686018427387904 * 2", "-9223372036854775808"},
+      {"4611686018427387904 == 2 * 2305843009213693952", "true"},
+      {"4611686018427387904 < 4611686018427387905", "true"},
+      {"4611686018427387904 > 4611686018427387903", "true"},
+      {"4611686018427387904 + fn() { 1 }()", "4611686018427387905"},
+      {"1 < 2 == true", "true"},
+      {"(1 > 2) != false", "false"},
+      {"!true", "false"},
+      {"!!5", "true"},
+      {"!0", "false"},
+      {"if (false) { 10 }", "null"},
+      {"if (1) { 10 } else { 20 }", "10"},
+      {"if (1 > 2) { 10 } else { 20 }", "20"},
+      {"9; return 2 * 5; 9;", "10"},
+      {"if (true) { if (true) { return 10; } return 1; }", "10"},
+      {"let a = 5; let b = a * 2; b + a", "15"},
+      {"let a = 5;", "null"},
+      {"let identity = fn(x) { x; }; identity(5);", "5"},
+      {"let early = fn(x) { return x; 0 }; early(5);", "5"},
+      {"fn(x) { x * 2 }(fn(){ 4 }())", "8"},
+      {"fn(x) { x == 1 }", "fn(x) (x == 1)"},
+      {"let add = fn(a, b) { a + b }; add(5 + 5, add(5, 5));", "20"},
+      {"let adder = fn(x) { fn(y) { x + y } }; let two = adder(2); two(3)",
+       "5"},
+      {"let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };"
+       "fib(15)",
+       "610"},
+      {"let x = 1; let f = fn() { let x = x + 1; x }; f() * 10 + x", "21"},
+      {"let even = fn(n) { if (n == 0) { true } else { odd(n - 1) } };"
+       "let odd = fn(n) { if (n == 0) { false } else { even(n - 1) } };"
+       "even(10)",
+       "true"},
+      {"let f = fn() { if (true) { let y = 3; } y }; f()", "3"},
+      {"let counter = fn(n) { let step = fn() { n + 1 }; step() }; "
+       "counter(counter(1))",
+       "3"},
+      {"let compose = fn(f, g) { fn(x) { g(f(x)) } };"
+       "let inc = fn(x) { x + 1 }; compose(inc, fn(x) { x * 3 })(2)",
+       "9"},
+      // Rebinding x leaves the first closure only in the environment of
+      // keep, which an incremental collection started in the call may have
+      // made marked; the big environment of call is traced in the step
+      // before make's is, by which time x is rebound.
+      {"let call = fn(f) { let a = 1; let b = 2; let c = 3; let d = 4;"
+       "  let e = 5; let g = 6; let h = 7; let i = 8; let j = 9; let k = 10;"
+       "  let l = 11; let m = 12; let o = 13; let p = 14; let q = 15;"
+       "  let r = 16; let s = 17; let t = 18; let u = 19; let v = 20;"
+       "  let w = fn() { a + b + c + d + e + g + h + i + j + k + l + m + o + p"
+       "    + q + r + s + t + u + v }; f() };"
+       "let make = fn(n) { let x = fn() { n };"
+       "  let keep = fn() { let y = x; fn() { y() } };"
+       "  let k = call(keep); let x = 0; k };"
+       "let loop = fn(i, sum) { if (i == 0) { sum() } else {"
+       "  let k = make(i); loop(i - 1, fn() { k() + sum() }) } };"
+       "loop(100, fn() { 0 })",
+       "5050"},
+  };
+  for (uint64_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    TEST_RUN_SUBTEST(EvaluatesTo, (void)0, tests[i].input, tests[i].expected);
+  }
+  TEST_PASS();
+}
+
+TEST_FUNC(EvalErrors) {
+  struct {
+    const char* input;
+    const char* expected;
+  } tests[] = {
+      {"5 + true;", "error: type mismatch: INTEGER + BOOLEAN"},
+      {"5 + true; 5;", "error: type mismatch: INTEGER + BOOLEAN"},
+      {"-true", "error: unknown operator: -BOOLEAN"},
+      {"true + false;", "error: unknown operator: BOOLEAN + BOOLEAN"},
+      {"if (10 > 1) { return true < false; }",
+       "error: unknown operator: BOOLEAN < BOOLEAN"},
+      {"foobar", "error: identifier not found: foobar"},
+      {"let f = fn() { y }; f(); let y = 1;",
+       "error: identifier not found: y"},
+      {"1 / (2 - 2)", "error: division by zero"},
+      {"let x = 5; x(1)", "error: not a function: INTEGER"},
+      {"fn(a, b) { a }(1)", "error: wrong number of arguments: want=2, got=1"},
+      {"fn(a, b) { a }(1 / 0)", "error: division by zero"},
+      {"let x = 1; x(-true)", "error: unknown operator: -BOOLEAN"},
+      {"let f = fn(n) { f(n + 1) }; f(0)", "error: stack overflow"},
+      {"if (false) { let y = 1; } y", "error: identifier not found: y"},
+      {"let f = fn() { return 1; let z = 2; z }; f() + z",
+       "error: identifier not found: z"},
+      {"-(1 < 2)", "error: unknown operator: -BOOLEAN"},
+      {"true > false == true", "error: unknown operator: BOOLEAN > BOOLEAN"},
+  };
+  for (uint64_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    TEST_RUN_SUBTEST(EvaluatesTo, (void)0, tests[i].input, tests[i].expected);
+  }
+  TEST_PASS();
+}
+
+TEST_FUNC(EvalResolver) {
+  MkParser parser;
+  MkAstProgram* program =
+      Parse(&parser, "let b = 1; let a = fn(x) { let y = fn() { x + b }; y };",
+            false);
+#define CLEANUP ProgramFree(program, parser)
+  TEST_ASSERT(program != NULL, CLEANUP, "program does not parse");
+  TEST_ASSERT(program->scope.size == 2, CLEANUP,
+              "program scope has %" PRIu32 " slots", program->scope.size);
+  MkAstLetStatement* let_a = (MkAstLetStatement*)program->statements.data[1];
+  MkAstLetStatement* let_b = (MkAstLetStatement*)program->statements.data[0];
+  TEST_ASSERT(let_a->name.depth == 0 && let_b->name.depth == 0 &&
+                  let_a->name.slot != let_b->name.slot &&
+                  let_a->name.slot < 2 && let_b->name.slot < 2,
+              CLEANUP, "globals are not given distinct slots");
+  MkAstFunctionLiteral* outer = (MkAstFunctionLiteral*)let_a->value;
+  TEST_ASSERT(outer->scope.size == 2 && outer->scope.captured, CLEANUP,
+              "outer function scope has %" PRIu32 " slots, captured %d",
+              outer->scope.size, outer->scope.captured);
+  MkAstLetStatement* let_y =
+      (MkAstLetStatement*)outer->body->statements.data[0];
+  MkAstFunctionLiteral* inner = (MkAstFunctionLiteral*)let_y->value;
+  TEST_ASSERT(inner->scope.size == 0 && !inner->scope.captured, CLEANUP,
+              "inner function binds %" PRIu32 " names", inner->scope.size);
+  MkAstExpressionStatement* sum =
+      (MkAstExpressionStatement*)inner->body->statements.data[0];
+  MkAstInfixExpression* infix = (MkAstInfixExpression*)sum->expression;
+  MkAstIdentifier* x = (MkAstIdentifier*)infix->left;
+  MkAstIdentifier* b = (MkAstIdentifier*)infix->right;
+  TEST_ASSERT(x->depth == 1 && x->slot == outer->parameters.data[0]->slot,
+              CLEANUP, "x resolved to (%" PRIu32 ", %" PRIu32 ")", x->depth,
+              x->slot);
+  TEST_ASSERT(b->depth == 2 && b->slot == let_b->name.slot, CLEANUP,
+              "b resolved to (%" PRIu32 ", %" PRIu32 ")", b->depth, b->slot);
+  CLEANUP;
+#undef CLEANUP
+  TEST_PASS();
+}
+
+TEST_FUNC(EvalFrames) {
+  MkEvaluator evaluator;
+  MkEvaluatorInit(&evaluator);
+  // Functions that create no closures run on the stack, so a thousand calls
+  // of one allocate nothing but the program's environment.
+  String result = Evaluate(
+      "let sum = fn(n) { if (n == 0) { 0 } else { n + sum(n - 1) } };"
+      "sum(1000)",
+      false, &evaluator);
+#define CLEANUP                  \
+  do {                           \
+    VEC_FREE(&result);           \
+    MkEvaluatorFree(&evaluator); \
+  } while (false)
+  TEST_ASSERT(StringEqualView(result, StringViewFromC("500500")), CLEANUP,
+              "sum(1000) is %" STRING_FMT, STRING_PRINT(result));
+  TEST_ASSERT(evaluator.calls == 1001 && evaluator.heap.object_count == 2,
+              CLEANUP, "%" PRIu64 " calls made %" PRIu64 " objects",
+              evaluator.calls, evaluator.heap.object_count);
+  TEST_ASSERT(evaluator.stack_size == 0 && evaluator.depth == 0, CLEANUP,
+              "frames are left after the run");
+  CLEANUP;
+#undef CLEANUP
+  TEST_PASS();
+}
+
+TEST_FUNC(EvalValues) {
+  TEST_ASSERT(sizeof(MkValue) == 8, (void)0, "values take %zu bytes",
+              sizeof(MkValue));
+  // Integers that fit in 63 bits are held in the value, so this allocates
+  // only the program's environment and the function on either engine.
+  static const char kInput[] =
+      "let f = fn(n, x) {"
+      "  if (n == 0) { x } else { f(n - 1, (x + n * n) / 2 - -1) }"
+      "}; f(1000, 0)";
+  MkEvaluator evaluator;
+  MkEvaluatorInit(&evaluator);
+  MkVm vm;
+  MkVmInit(&vm);
+  String evaluated = Evaluate(kInput, false, &evaluator);
+  String executed = Execute(kInput, false, &vm);
+#define CLEANUP                  \
+  do {                           \
+    VEC_FREE(&evaluated);        \
+    VEC_FREE(&executed);         \
+    MkEvaluatorFree(&evaluator); \
+    MkVmFree(&vm);               \
+  } while (false)
+  TEST_ASSERT(StringEqualView(evaluated, StringViewFromC("7")) &&
+                  StringEqualView(executed, StringViewFromC("7")),
+              CLEANUP, "evaluated to %" STRING_FMT ", ran to %" STRING_FMT,
+              STRING_PRINT(evaluated), STRING_PRINT(executed));
+  TEST_ASSERT(evaluator.heap.object_count == 2 && vm.heap.object_count == 2,
+              CLEANUP,
+              "the evaluator made %" PRIu64 " objects, the VM %" PRIu64,
+              evaluator.heap.object_count, vm.heap.object_count);
+  CLEANUP;
+#undef CLEANUP
+  TEST_PASS();
+}
+
+TEST_FUNC(EvalCollector) {
+  // Each step makes an environment and a closure that are garbage once it
+  // returns; the heap must free them as it goes on both engines.
+  static const char kInput[] =
+      "let make = fn(x) { fn() { x } };"
+      "let loop = fn(i, sum) {"
+      "  if (i == 0) { sum } else { loop(i - 1, sum + make(i)()) }"
+      "}; loop(1000, 0)";
+  MkEvaluator evaluator;
+  MkEvaluatorInit(&evaluator);
+  evaluator.heap.initial_bytes = 4096;
+  MkVm vm;
+  MkVmInit(&vm);
+  vm.heap.initial_bytes = 4096;
+  String evaluated = Evaluate(kInput, false, &evaluator);
+  String executed = Execute(kInput, false, &vm);
+#define CLEANUP                  \
+  do {                           \
+    VEC_FREE(&evaluated);        \
+    VEC_FREE(&executed);         \
+    MkEvaluatorFree(&evaluator); \
+    MkVmFree(&vm);               \
+  } while (false)
+  TEST_ASSERT(StringEqualView(evaluated, StringViewFromC("500500")) &&
+                  StringEqualView(executed, StringViewFromC("500500")),
+              CLEANUP, "evaluated to %" STRING_FMT ", ran to %" STRING_FMT,
+              STRING_PRINT(evaluated), STRING_PRINT(executed));
+  const MkHeap* heaps[] = {&evaluator.heap, &vm.heap};
+  for (uint64_t i = 0; i < 2; ++i) {
+    const MkHeap* heap = heaps[i];
+    // The program's environment, two functions, and two objects a step.
+    TEST_ASSERT(heap->stats.allocations == 2003, CLEANUP,
+                "heap %" PRIu64 " made %" PRIu64 " objects", i,
+                heap->stats.allocations);
+    TEST_ASSERT(heap->stats.collections > 0 && heap->bytes <= 4096 &&
+                    heap->stats.objects_freed + heap->object_count == 2003,
+                CLEANUP,
+                "heap %" PRIu64 " collected %" PRIu64 " times, freeing %" PRIu64
+                " objects and keeping %" PRIu64 " bytes",
+                i, heap->stats.collections, heap->stats.objects_freed,
+                heap->bytes);
+  }
+  CLEANUP;
+#undef CLEANUP
+  TEST_PASS();
+}
+
+TEST_FUNC(EvalIncrementalCollector) {
+  // The program of EvalCollector, collected a step every 256 bytes. A
+  // collection then takes several pauses, and lets the heap grow a little
+  // past its threshold before it is done.
+  static const char kInput[] =
+      "let make = fn(x) { fn() { x } };"
+      "let loop = fn(i, sum) {"
+      "  if (i == 0) { sum } else { loop(i - 1, sum + make(i)()) }"
+      "}; loop(1000, 0)";
+  MkEvaluator evaluator;
+  MkEvaluatorInit(&evaluator);
+  MkVm vm;
+  MkVmInit(&vm);
+  MkHeap* heaps[] = {&evaluator.heap, &vm.heap};
+  for (uint64_t i = 0; i < 2; ++i) {
+    heaps[i]->mode = kMkHeapIncremental;
+    heaps[i]->initial_bytes = 4096;
+    heaps[i]->step_bytes = 256;
+  }
+  String evaluated = Evaluate(kInput, false, &evaluator);
+  String executed = Execute(kInput, false, &vm);
+#define CLEANUP                  \
+  do {                           \
+    VEC_FREE(&evaluated);        \
+    VEC_FREE(&executed);         \
+    MkEvaluatorFree(&evaluator); \
+    MkVmFree(&vm);               \
+  } while (false)
+  TEST_ASSERT(StringEqualView(evaluated, StringViewFromC("500500")) &&
+                  StringEqualView(executed, StringViewFromC("500500")),
+              CLEANUP, "evaluated to %" STRING_FMT ", ran to %" STRING_FMT,
+              STRING_PRINT(evaluated), STRING_PRINT(executed));
+  for (uint64_t i = 0; i < 2; ++i) {
+    const MkHeap* heap = heaps[i];
+    TEST_ASSERT(heap->stats.collections > 0 &&
+                    heap->stats.pauses > 2 * heap->stats.collections,
+                CLEANUP,
+                "heap %" PRIu64 " paused %" PRIu64 " times in %" PRIu64
+                " collections",
+                i, heap->stats.pauses, heap->stats.collections);
+    TEST_ASSERT(heap->bytes <= 8192 &&
+                    heap->stats.objects_freed + heap->object_count == 2003,
+                CLEANUP,
+                "heap %" PRIu64 " freed %" PRIu64 " objects and kept %" PRIu64
+                " bytes",
+                i, heap->stats.objects_freed, heap->bytes);
+  }
+  CLEANUP;
+#undef CLEANUP
+  TEST_PASS();
+}
+
+static void MarkEnvironment(MkHeap* heap, void* context) {
+  MkHeapMarkObject(heap, context);
+}
+
+TEST_FUNC(EvalCollectMidSweep) {
+  // The root is the oldest object, so an incremental sweep reaches it last;
+  // a closure made while the sweep is short of it and stored in it has to
+  // survive a full collection started then.
+  uint32_t symbol = 0;
+  MkAstScope scope = {.symbols = &symbol, .size = 1};
+  MkHeap heap = {
+      .mode = kMkHeapIncremental,
+      .initial_bytes = 1024,
+      .step_bytes = 16,
+  };
+  MkEnvironment* root = MkHeapNewEnvironment(&heap, NULL, &scope);
+  heap.mark_roots = MarkEnvironment;
+  heap.roots = root;
+  while (heap.phase != kMkHeapSweeping) {
+    MkHeapNewEnvironment(&heap, NULL, &scope);
+  }
+  MkClosure* closure = MkHeapNewClosure(&heap, NULL, NULL, NULL);
+  MK_HEAP_WRITE_BARRIER(&heap, MK_OBJECT(closure));
+  root->slots[0] = MK_OBJECT(closure);
+  bool swept_root = heap.phase != kMkHeapSweeping;
+  MkHeapCollect(&heap);
+  bool kept = false;
+  for (MkObject* object = heap.objects; object != NULL; object = object->next) {
+    kept = kept || object == &closure->object;
+  }
+  MkHeapFree(&heap);
+  TEST_ASSERT(!swept_root, (void)0, "the sweep finished too early");
+  TEST_ASSERT(kept, (void)0, "the closure in the root was freed");
+  TEST_PASS();
+}
+
+TEST_FUNC(EvalBytecode) {
+  MkParser parser;
+  MkAstProgram* program = Parse(
+      &parser, "let k = fn(x) { fn(y) { if (y < x) { y } else { 1 } } };"
+               "k(1)(2)",
+      false);
+  MkBytecode bytecode = {0};
+  String error = {0};
+  String listing = {0};
+#define CLEANUP                   \
+  do {                            \
+    VEC_FREE(&listing);           \
+    VEC_FREE(&error);             \
+    MkBytecodeFree(&bytecode);    \
+    ProgramFree(program, parser); \
+  } while (false)
+  TEST_ASSERT(program != NULL, CLEANUP, "program does not parse");
+  TEST_ASSERT(MkCompileProgram(&bytecode, program, &error), CLEANUP,
+              "compile failed: %" STRING_FMT, STRING_PRINT(error));
+  // Every scope binds one name, so all slots are 0 whatever the symbols are;
+  // the literal 1 is in the pool once.
+  static const char kExpected[] =
+      "fn 0 (0 args, 1 slots, 2 stack)\n"
+      "0000 Closure 1\n"
+      "0003 SetLocal 0\n"
+      "0006 GetLocal 0\n"
+      "0009 Constant 0\n"
+      "0012 Call 1\n"
+      "0015 Constant 1\n"
+      "0018 Call 1\n"
+      "0021 Return\n"
+      "fn 1 (1 args, 1 slots, 1 stack)\n"
+      "0000 Closure 2\n"
+      "0003 Return\n"
+      "fn 2 (1 args, 1 slots, 2 stack)\n"
+      "0000 GetLocal 0\n"
+      "0003 GetOuter 1 0\n"
+      "0008 Lt\n"
+      "0009 JumpIfFalse 6\n"
+      "0012 GetLocal 0\n"
+      "0015 Jump 3\n"
+      "0018 Constant 0\n"
+      "0021 Return\n";
+  listing = MkBytecodeDisassemble(&bytecode);
+  TEST_ASSERT(StringEqualView(listing, StringViewFromC(kExpected)), CLEANUP,
+              "compiled to\n%" STRING_FMT, STRING_PRINT(listing));
+  TEST_ASSERT(bytecode.constants.size == 2, CLEANUP,
+              "%" PRIu64 " constants", bytecode.constants.size);
+  CLEANUP;
+#undef CLEANUP
+  TEST_PASS();
+}
+
+// The tallest chain the parser allows compiles, and one more level on it,
+// which only a program built by hand can have, fails instead of overflowing
+// the stack.
+TEST_FUNC(EvalCompileDepth) {
+  String source = {0};
+  for (int i = 0; i < kMkAstMaxHeight - 1; ++i) {
+    VEC_APPEND(&source, "1+", 2);
+  }
+  VEC_APPEND(&source, "1", 2);
+  MkParser parser;
+  MkAstProgram* program = Parse(&parser, source.data, false);
+  MkBytecode bytecode = {0};
+  String error = {0};
+#define CLEANUP                   \
+  do {                            \
+    VEC_FREE(&error);             \
+    MkBytecodeFree(&bytecode);    \
+    ProgramFree(program, parser); \
+    VEC_FREE(&source);            \
+  } while (false)
+  TEST_ASSERT(program != NULL, CLEANUP, "the chain does not parse");
+  TEST_ASSERT(MkCompileProgram(&bytecode, program, &error), CLEANUP,
+              "compile failed: %" STRING_FMT, STRING_PRINT(error));
+  MkBytecodeFree(&bytecode);
+  MkAstExpressionStatement* stmt =
+      (MkAstExpressionStatement*)program->statements.data[0];
+  MkAstPrefixExpression* minus =
+      ARENA_NEW(&program->arena, MkAstPrefixExpression);
+  TEST_ASSERT(minus != NULL, CLEANUP, "out of memory");
+  minus->base = (MkAstExpression){.base = {kMkAstNodeExpression},
+                                  .type = kMkAstExpressionPrefix};
+  minus->token = (MkToken){.type = kMkTokenMinus};
+  minus->right = stmt->expression;
+  stmt->expression = &minus->base;
+  TEST_ASSERT(!MkCompileProgram(&bytecode, program, &error) &&
+                  StringEqualView(error, StringViewFromC(
+                                             "expression nested too deep")),
+              CLEANUP, "compiled to '%" STRING_FMT "'",
+              STRING_PRINT(error));
+  CLEANUP;
+#undef CLEANUP
+  TEST_PASS();
+}
+
+TEST_FUNC(EvalFolding) {
+  MkParser parser;
+  MkAstProgram* program = Parse(
+      &parser,
+      "let x = 2 * 3 + -4; if (false) { x };"
+      "let f = fn() { if (true) { return x; } x };"
+      "f(if (1 < 2) { 1 } else { 2 }) + 1 / (2 - 2)",
+      false);
+  String optimized = {0};
+#define CLEANUP                   \
+  do {                            \
+    VEC_FREE(&optimized);         \
+    ProgramFree(program, parser); \
+  } while (false)
+  TEST_ASSERT(program != NULL, CLEANUP, "program does not parse");
+  uint64_t node_count = program->node_count;
+  MkOptimizeStats stats;
+  TEST_ASSERT(MkOptimizeProgram(program, &stats), CLEANUP,
+              "optimizing failed");
+  // The division by zero is kept for the error; the `if` statements became
+  // their live blocks, and the `if` argument its expression.
+  optimized = MkAstNodeString(&program->base);
+  TEST_ASSERT(StringEqualView(optimized,
+                              StringViewFromC("let x = 2;let f = fn() return "
+                                              "x;;(f(1) + (1 / 0))")),
+              CLEANUP, "optimized to %" STRING_FMT, STRING_PRINT(optimized));
+  TEST_ASSERT(stats.folded == 5 && stats.pruned == 3, CLEANUP,
+              "folded %" PRIu64 " expressions and pruned %" PRIu64 " ifs",
+              stats.folded, stats.pruned);
+  TEST_ASSERT(stats.removed == node_count - program->node_count &&
+                  program->node_count == MkAstNodeCount(&program->base) &&
+                  stats.removed == 27,
+              CLEANUP,
+              "removed %" PRIu64 " of %" PRIu64 " nodes, leaving %" PRIu64,
+              stats.removed, node_count, program->node_count);
+  CLEANUP;
+#undef CLEANUP
+  TEST_PASS();
+}
+
+// Runs `input` on both the evaluator and the VM, which must agree. Both
+// collect at every allocation, so that an object either engine fails to
+// keep as a root is freed while still in use, which the sanitizers catch.
+// Then both run again with incremental collections stepping at every
+// allocation, which catches stores missing a write barrier the same way.
+// Each is done on the program as parsed and as MkOptimizeProgram leaves it,
+// which must fail at the same token if at all.
+TEST_SUBTEST_FUNC(EvaluatesTo, const char* input, const char* expected) {
+  static const MkHeapMode kModes[] = {kMkHeapStopTheWorld, kMkHeapIncremental};
+  uint32_t error_offset = 0;
+  for (uint64_t run = 0; run < 4; ++run) {
+    bool fold = run >= 2;
+    MkEvaluator evaluator;
+    MkEvaluatorInit(&evaluator);
+    MkVm vm;
+    MkVmInit(&vm);
+    MkHeap* heaps[] = {&evaluator.heap, &vm.heap};
+    for (uint64_t i = 0; i < 2; ++i) {
+      heaps[i]->mode = kModes[run % 2];
+      heaps[i]->initial_bytes = 1;
+      heaps[i]->growth_factor = 1;
+      heaps[i]->step_bytes = 1;
+    }
+    String evaluated = Evaluate(input, fold, &evaluator);
+    String executed = Execute(input, fold, &vm);
+    if (run == 0) {
+      error_offset = evaluator.error_offset;
+    }
+    bool same_offset = evaluator.error_offset == error_offset &&
+                       vm.error_offset == error_offset;
+    MkEvaluatorFree(&evaluator);
+    MkVmFree(&vm);
+#define CLEANUP           \
+  do {                    \
+    VEC_FREE(&evaluated); \
+    VEC_FREE(&executed);  \
+  } while (false)
+    TEST_ASSERT(StringEqualView(evaluated, StringViewFromC(expected)),
+                CLEANUP,
+                "'%s' evaluated%s to '%" STRING_FMT "', expected '%s'", input,
+                fold ? " folded" : "", STRING_PRINT(evaluated), expected);
+    TEST_ASSERT(StringEqualView(executed, StringViewFromC(expected)), CLEANUP,
+                "'%s' ran%s on the VM to '%" STRING_FMT "', expected '%s'",
+                input, fold ? " folded" : "", STRING_PRINT(executed),
+                expected);
+    TEST_ASSERT(same_offset, CLEANUP,
+                "'%s' fails at different tokens on the evaluator and the VM, "
+                "or folded and not",
+                input);
+    CLEANUP;
+#undef CLEANUP
+  }
+  TEST_PASS();
+}
+
+// Returns NULL unless `input` parses without errors and resolves. With
+// `fold`, the program is optimized before it is resolved.
+MkAstProgram* Parse(MkParser* parser, const char* input, bool fold) {
+  MkLexer lexer = {0};
+  MkLexerInit(&lexer, StringViewFromC(input));
+  MkParserInit(parser, lexer);
+  MkAstProgram* program = MkParserParseProgram(parser);
+  MkOptimizeStats stats;
+  if (parser->errors.size > 0 ||
+      (fold && !MkOptimizeProgram(program, &stats)) ||
+      !MkResolveProgram(program)) {
+    ProgramFree(program, *parser);
+    *parser = (MkParser){0};
+    return NULL;
+  }
+  return program;
+}
+
+void ProgramFree(MkAstProgram* program, MkParser parser) {
+  if (program != NULL) {
+    MkAstNodeFree(&program->base);
+    free(program);
+    MkParserFree(parser);
+  }
+}
+
+// The value of `input` as the REPL shows it, or its error after "error: ".
+// Execute is the same on the VM.
+String Evaluate(const char* input, bool fold, MkEvaluator* evaluator) {
+  MkParser parser;
+  MkAstProgram* program = Parse(&parser, input, fold);
+  if (program == NULL) {
+    return StringFromC("parse error");
+  }
+  MkValue value;
+  String result;
+  if (MkEvaluatorRun(evaluator, program, &value)) {
+    result = MkValueInspect(value);
+  } else {
+    result =
+        StringFormat("error: %" STRING_FMT, STRING_PRINT(evaluator->error));
+  }
+  ProgramFree(program, parser);
+  return result;
+}
+
+String Execute(const char* input, bool fold, MkVm* vm) {
+  MkParser parser;
+  MkAstProgram* program = Parse(&parser, input, fold);
+  if (program == NULL) {
+    return StringFromC("parse error");
+  }
+  MkBytecode bytecode;
+  String error = {0};
+  MkValue value;
+  String result;
+  if (!MkCompileProgram(&bytecode, program, &error)) {
+    result = StringFormat("compile error: %" STRING_FMT, STRING_PRINT(error));
+    VEC_FREE(&error);
+  } else if (MkVmRun(vm, &bytecode, &value)) {
+    result = MkValueInspect(value);
+  } else {
+    result = StringFormat("error: %" STRING_FMT, STRING_PRINT(vm->error));
+  }
+  MkBytecodeFree(&bytecode);
+  ProgramFree(program, parser);
+  return result;
+}
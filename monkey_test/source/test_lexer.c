@@ -3,7 +3,13 @@
 #include <inttypes.h>
 #include <monkey/lexer.h>
 #include <monkey/token.h>
+#include <pool/pool.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <string/string.h>
 #include <test/test.h>
+#include <vec/vec.h>
 
 #include "monkey_test/input/next_token_test.h"
 
@@ -12,43 +18,43 @@ TEST_FUNC(LexerNextToken) {
     MkTokenType expected_type;
     const char* expected_literal;
   } tests[] = {
-      {mk_token_let, "let"},     {mk_token_ident, "five"},
-      {mk_token_assign, "="},    {mk_token_int, "5"},
-      {mk_token_semicolon, ";"}, {mk_token_let, "let"},
-      {mk_token_ident, "ten"},   {mk_token_assign, "="},
-      {mk_token_int, "10"},      {mk_token_semicolon, ";"},
-      {mk_token_let, "let"},     {mk_token_ident, "add"},
-      {mk_token_assign, "="},    {mk_token_function, "fn"},
-      {mk_token_lparen, "("},    {mk_token_ident, "x"},
-      {mk_token_comma, ","},     {mk_token_ident, "y"},
-      {mk_token_rparen, ")"},    {mk_token_lbrace, "{"},
-      {mk_token_ident, "x"},     {mk_token_plus, "+"},
-      {mk_token_ident, "y"},     {mk_token_semicolon, ";"},
-      {mk_token_rbrace, "}"},    {mk_token_semicolon, ";"},
-      {mk_token_let, "let"},     {mk_token_ident, "result"},
-      {mk_token_assign, "="},    {mk_token_ident, "add"},
-      {mk_token_lparen, "("},    {mk_token_ident, "five"},
-      {mk_token_comma, ","},     {mk_token_ident, "ten"},
-      {mk_token_rparen, ")"},    {mk_token_semicolon, ";"},
-      {mk_token_bang, "!"},      {mk_token_minus, "-"},
-      {mk_token_slash, "/"},     {mk_token_asterisk, "*"},
-      {mk_token_int, "5"},       {mk_token_semicolon, ";"},
-      {mk_token_int, "5"},       {mk_token_lt, "<"},
-      {mk_token_int, "10"},      {mk_token_gt, ">"},
-      {mk_token_int, "5"},       {mk_token_semicolon, ";"},
-      {mk_token_if, "if"},       {mk_token_lparen, "("},
-      {mk_token_int, "5"},       {mk_token_lt, "<"},
-      {mk_token_int, "10"},      {mk_token_rparen, ")"},
-      {mk_token_lbrace, "{"},    {mk_token_return, "return"},
-      {mk_token_true, "true"},   {mk_token_semicolon, ";"},
-      {mk_token_rbrace, "}"},    {mk_token_else, "else"},
-      {mk_token_lbrace, "{"},    {mk_token_return, "return"},
-      {mk_token_false, "false"}, {mk_token_semicolon, ";"},
-      {mk_token_rbrace, "}"},    {mk_token_int, "10"},
-      {mk_token_eq, "=="},       {mk_token_int, "10"},
-      {mk_token_semicolon, ";"}, {mk_token_int, "10"},
-      {mk_token_not_eq, "!="},   {mk_token_int, "9"},
-      {mk_token_semicolon, ";"}, {mk_token_eof, ""},
+      {kMkTokenLet, "let"},     {kMkTokenIdent, "five"},
+      {kMkTokenAssign, "="},    {kMkTokenInt, "5"},
+      {kMkTokenSemicolon, ";"}, {kMkTokenLet, "let"},
+      {kMkTokenIdent, "ten"},   {kMkTokenAssign, "="},
+      {kMkTokenInt, "10"},      {kMkTokenSemicolon, ";"},
+      {kMkTokenLet, "let"},     {kMkTokenIdent, "add"},
+      {kMkTokenAssign, "="},    {kMkTokenFunction, "fn"},
+      {kMkTokenLparen, "("},    {kMkTokenIdent, "x"},
+      {kMkTokenComma, ","},     {kMkTokenIdent, "y"},
+      {kMkTokenRparen, ")"},    {kMkTokenLbrace, "{"},
+      {kMkTokenIdent, "x"},     {kMkTokenPlus, "+"},
+      {kMkTokenIdent, "y"},     {kMkTokenSemicolon, ";"},
+      {kMkTokenRbrace, "}"},    {kMkTokenSemicolon, ";"},
+      {kMkTokenLet, "let"},     {kMkTokenIdent, "result"},
+      {kMkTokenAssign, "="},    {kMkTokenIdent, "add"},
+      {kMkTokenLparen, "("},    {kMkTokenIdent, "five"},
+      {kMkTokenComma, ","},     {kMkTokenIdent, "ten"},
+      {kMkTokenRparen, ")"},    {kMkTokenSemicolon, ";"},
+      {kMkTokenBang, "!"},      {kMkTokenMinus, "-"},
+      {kMkTokenSlash, "/"},     {kMkTokenAsterisk, "*"},
+      {kMkTokenInt, "5"},       {kMkTokenSemicolon, ";"},
+      {kMkTokenInt, "5"},       {kMkTokenLt, "<"},
+      {kMkTokenInt, "10"},      {kMkTokenGt, ">"},
+      {kMkTokenInt, "5"},       {kMkTokenSemicolon, ";"},
+      {kMkTokenIf, "if"},       {kMkTokenLparen, "("},
+      {kMkTokenInt, "5"},       {kMkTokenLt, "<"},
+      {kMkTokenInt, "10"},      {kMkTokenRparen, ")"},
+      {kMkTokenLbrace, "{"},    {kMkTokenReturn, "return"},
+      {kMkTokenTrue, "true"},   {kMkTokenSemicolon, ";"},
+      {kMkTokenRbrace, "}"},    {kMkTokenElse, "else"},
+      {kMkTokenLbrace, "{"},    {kMkTokenReturn, "return"},
+      {kMkTokenFalse, "false"}, {kMkTokenSemicolon, ";"},
+      {kMkTokenRbrace, "}"},    {kMkTokenInt, "10"},
+      {kMkTokenEq, "=="},       {kMkTokenInt, "10"},
+      {kMkTokenSemicolon, ";"}, {kMkTokenInt, "10"},
+      {kMkTokenNotEq, "!="},    {kMkTokenInt, "9"},
+      {kMkTokenSemicolon, ";"}, {kMkTokenEof, ""},
   };
 
   MkLexer l = {0};
@@ -59,23 +65,232 @@ TEST_FUNC(LexerNextToken) {
   for (uint64_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
     MkToken t = MkLexerNextToken(&l);
     TEST_ASSERT(
-        StringEqual(t.type, tests[i].expected_type),
-        do {
-          MkTokenFree(t);
-          MkTokenTypesManage(kTokenTypesFree);
-        } while (false),
-        "tests[%" PRIu64 "].expected_type: %" STRING_FMT
-        ", t.type: %" STRING_FMT,
-        i, STRING_PRINT(tests[i].expected_type), STRING_PRINT(t.type));
+        t.type == tests[i].expected_type, (void)0,
+        "tests[%" PRIu64 "].expected_type: %s, t.type: %s", i,
+        MkTokenTypeName(tests[i].expected_type), MkTokenTypeName(t.type));
     TEST_ASSERT(
-        StringEqualView(t.literal, StringViewFromC(tests[i].expected_literal)),
+        StringViewEqual(t.literal, StringViewFromC(tests[i].expected_literal)),
+        (void)0,
+        "tests[%" PRIu64 "].expected_literal: %s, t.literal: %" STRING_FMT, i,
+        tests[i].expected_literal, STRING_VIEW_PRINT(t.literal));
+    TEST_ASSERT(t.offset == (uint64_t)(t.literal.begin - next_token_test),
+                (void)0, "tests[%" PRIu64 "]: t.offset %" PRIu32
+                " does not match the literal",
+                i, t.offset);
+  }
+  TEST_PASS();
+}
+TEST_FUNC(LexerLookupIdent) {
+  struct {
+    const char* ident;
+    MkTokenType expected_type;
+  } tests[] = {
+      {"fn", kMkTokenFunction},   {"let", kMkTokenLet},
+      {"if", kMkTokenIf},         {"else", kMkTokenElse},
+      {"return", kMkTokenReturn}, {"true", kMkTokenTrue},
+      {"false", kMkTokenFalse},   {"f", kMkTokenIdent},
+      {"fnn", kMkTokenIdent},     {"lt", kMkTokenIdent},
+      {"iff", kMkTokenIdent},     {"elsee", kMkTokenIdent},
+      {"returns", kMkTokenIdent}, {"tree", kMkTokenIdent},
+      {"fase", kMkTokenIdent},    {"Let", kMkTokenIdent},
+      {"x", kMkTokenIdent},       {"foobar", kMkTokenIdent},
+  };
+
+  for (uint64_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    MkTokenType type = MkLookupIdent(StringViewFromC(tests[i].ident));
+    TEST_ASSERT(type == tests[i].expected_type, (void)0,
+                "tests[%" PRIu64 "]: '%s' is %s, expected %s", i,
+                tests[i].ident, MkTokenTypeName(type),
+                MkTokenTypeName(tests[i].expected_type));
+  }
+  TEST_PASS();
+}
+
+TEST_FUNC(LexerTokenizeAll) {
+  StringView source = {
+      .begin = next_token_test,
+      .end = next_token_test + next_token_test_size,
+  };
+  MkTokenBuffer tokens = {0};
+  TEST_ASSERT(MkLexerTokenizeAll(source, &tokens), MkTokenBufferFree(&tokens),
+              "MkLexerTokenizeAll failed");
+  uint8_t* kinds = tokens.kinds;
+  uint64_t capacity = tokens.capacity;
+
+  for (int run = 0; run < 2; ++run) {
+    MkLexer l = {0};
+    MkLexerInit(&l, source);
+    for (uint64_t i = 0; i < tokens.size; i++) {
+      MkToken expected = MkLexerNextToken(&l);
+      MkToken t = MkTokenBufferGet(&tokens, source, i);
+      TEST_ASSERT(t.type == expected.type &&
+                      t.literal.begin == expected.literal.begin &&
+                      t.literal.end == expected.literal.end,
+                  MkTokenBufferFree(&tokens),
+                  "run %d, tokens[%" PRIu64 "]: %s '%" STRING_FMT
+                  "', expected %s '%" STRING_FMT "'",
+                  run, i, MkTokenTypeName(t.type),
+                  STRING_VIEW_PRINT(t.literal), MkTokenTypeName(expected.type),
+                  STRING_VIEW_PRINT(expected.literal));
+    }
+    TEST_ASSERT(tokens.kinds[tokens.size - 1] == kMkTokenEof,
+                MkTokenBufferFree(&tokens), "run %d: last token is not EOF",
+                run);
+    TEST_ASSERT(MkLexerTokenizeAll(source, &tokens),
+                MkTokenBufferFree(&tokens), "MkLexerTokenizeAll failed");
+  }
+  TEST_ASSERT(tokens.kinds == kinds && tokens.capacity == capacity,
+              MkTokenBufferFree(&tokens),
+              "reusing the buffer reallocated it");
+  MkTokenBufferFree(&tokens);
+  TEST_PASS();
+}
+
+TEST_SUBTEST_FUNC(TokenBuffersEqual,
+                  const MkTokenBuffer* actual,
+                  const MkTokenBuffer* expected,
+                  const char* what) {
+  TEST_ASSERT(actual->size == expected->size, (void)0,
+              "%s: %" PRIu64 " tokens, expected %" PRIu64, what, actual->size,
+              expected->size);
+  for (uint64_t i = 0; i < expected->size; ++i) {
+    TEST_ASSERT(actual->kinds[i] == expected->kinds[i] &&
+                    actual->offsets[i] == expected->offsets[i] &&
+                    actual->lengths[i] == expected->lengths[i],
+                (void)0,
+                "%s: token %" PRIu64 " is %s@%" PRIu32 "+%" PRIu32
+                ", expected %s@%" PRIu32 "+%" PRIu32,
+                what, i, MkTokenTypeName(actual->kinds[i]),
+                actual->offsets[i], actual->lengths[i],
+                MkTokenTypeName(expected->kinds[i]), expected->offsets[i],
+                expected->lengths[i]);
+  }
+  TEST_PASS();
+}
+
+TEST_FUNC(LexerTokenizeParallel) {
+  String sources[3] = {0};
+  for (int i = 0; i < 200; ++i) {
+    VEC_APPEND(&sources[0], next_token_test, next_token_test_size);
+  }
+  const char kPieces[][8] = {"a",  "bc", "12", "=",  "==", "!",  "!=",
+                             " ",  "\t", "\n", ";",  "(",  "@",  "let"};
+  uint64_t state = 0x2545F4914F6CDD1D;
+  while (sources[1].size < 64 * 1024) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    const char* piece = kPieces[state % (sizeof(kPieces) / sizeof(kPieces[0]))];
+    VEC_APPEND(&sources[1], piece, strlen(piece));
+  }
+  VEC_APPEND(&sources[2], sources[0].data, sources[0].size / 2);
+  VEC_PUSH(&sources[2], '\0');
+  VEC_APPEND(&sources[2], sources[0].data, sources[0].size / 2);
+
+  uint32_t thread_counts[] = {1, 2, 3, 8};
+  uint64_t min_chunk_sizes[] = {16, 100, 4096};
+  MkTokenBuffer expected = {0};
+  MkTokenBuffer actual = {0};
+  for (uint64_t s = 0; s < sizeof(sources) / sizeof(sources[0]); ++s) {
+    StringView source = {.begin = sources[s].data,
+                         .end = sources[s].data + sources[s].size};
+    MkLexerTokenizeAll(source, &expected);
+    for (uint64_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]);
+         ++t) {
+      ThreadPool pool;
+      ThreadPoolInit(&pool, thread_counts[t]);
+      for (uint64_t c = 0;
+           c < sizeof(min_chunk_sizes) / sizeof(min_chunk_sizes[0]); ++c) {
+        bool ok = MkLexerTokenizeParallel(source, &actual, &pool,
+                                          min_chunk_sizes[c]);
+        char what[64];
+        snprintf(what, sizeof(what), "source %" PRIu64 ", %" PRIu32
+                 " threads, chunk %" PRIu64, s, thread_counts[t],
+                 min_chunk_sizes[c]);
+        TEST_RUN_SUBTEST(
+            TokenBuffersEqual,
+            do {
+              ThreadPoolFree(&pool);
+              MkTokenBufferFree(&expected);
+              MkTokenBufferFree(&actual);
+              for (uint64_t i = 0; i < sizeof(sources) / sizeof(sources[0]);
+                   ++i) {
+                VEC_FREE(&sources[i]);
+              }
+            } while (false),
+            &actual, &expected, ok ? what : "MkLexerTokenizeParallel failed");
+      }
+      ThreadPoolFree(&pool);
+    }
+  }
+  MkTokenBufferFree(&expected);
+  MkTokenBufferFree(&actual);
+  for (uint64_t i = 0; i < sizeof(sources) / sizeof(sources[0]); ++i) {
+    VEC_FREE(&sources[i]);
+  }
+  TEST_PASS();
+}
+
+TEST_FUNC(LexerRelex) {
+  String source = {0};
+  for (int i = 0; i < 8; ++i) {
+    VEC_APPEND(&source, next_token_test, next_token_test_size);
+  }
+  const char kPieces[][8] = {"",  "a", "bc", "12", "=",  "==", "!", "!=",
+                             " ", "\n", ";", "(",  "@",  "let", "\0"};
+  MkTokenBuffer actual = {0};
+  MkTokenBuffer expected = {0};
+  String edited = {0};
+  MkLexerTokenizeAll((StringView){.begin = source.data,
+                                  .end = source.data + source.size},
+                     &actual);
+  uint64_t state = 0x9E3779B97F4A7C15;
+  for (int i = 0; i < 2000; ++i) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    uint64_t piece_count = sizeof(kPieces) / sizeof(kPieces[0]);
+    uint64_t piece_index = (state >> 8) % piece_count;
+    const char* piece = kPieces[piece_index];
+    // The last piece is a lone NUL byte, which strlen cannot measure.
+    uint64_t piece_size = piece_index == piece_count - 1 ? 1 : strlen(piece);
+    MkEdit edit = {
+        .offset = (state >> 16) % (source.size + 1),
+        .inserted = {.begin = piece, .end = piece + piece_size},
+    };
+    edit.removed = (state >> 40) % 4;
+    if (edit.removed > source.size - edit.offset) {
+      edit.removed = source.size - edit.offset;
+    }
+
+    edited.size = 0;
+    VEC_APPEND(&edited, source.data, edit.offset);
+    VEC_APPEND(&edited, piece, piece_size);
+    VEC_APPEND(&edited, source.data + edit.offset + edit.removed,
+               source.size - edit.offset - edit.removed);
+    VEC_FREE(&source);
+    source = edited;
+    edited = (String){0};
+
+    StringView view = {.begin = source.data,
+                       .end = source.data + source.size};
+    bool ok = MkLexerRelex(view, &actual, edit);
+    MkLexerTokenizeAll(view, &expected);
+    char what[96];
+    snprintf(what, sizeof(what),
+             "edit %d (%" PRIu64 " bytes at %" PRIu64 " -> piece %" PRIu64 ")",
+             i, edit.removed, edit.offset, piece_index);
+    TEST_RUN_SUBTEST(
+        TokenBuffersEqual,
         do {
-          MkTokenFree(t);
-          MkTokenTypesManage(kTokenTypesFree);
+          MkTokenBufferFree(&actual);
+          MkTokenBufferFree(&expected);
+          VEC_FREE(&source);
         } while (false),
-        "tests[%" PRIu64 "].expected_literal: %s, t.literal: %" STRING_FMT, i,
-        tests[i].expected_literal, STRING_PRINT(t.literal));
-    MkTokenFree(t);
+        &actual, &expected, ok ? what : "MkLexerRelex failed");
   }
+  MkTokenBufferFree(&actual);
+  MkTokenBufferFree(&expected);
+  VEC_FREE(&source);
   TEST_PASS();
-}
\ No newline at end of file
+}
@@ -2,9 +2,12 @@
 
 #include <inttypes.h>
 #include <monkey/ast.h>
+#include <monkey/flat_ast.h>
+#include <monkey/intern.h>
 #include <monkey/lexer.h>
 #include <monkey/parser.h>
 #include <monkey/token.h>
+#include <pool/pool.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -14,16 +17,37 @@
 TEST_SUBTEST_FUNC(TestLetStatement,
                   MkAstLetStatement* statement,
                   const char* expected_name);
-TEST_SUBTEST_FUNC(CheckParserErrors, MkParser parser);
+TEST_SUBTEST_FUNC(CheckParserErrors, MkParser* parser);
+TEST_SUBTEST_FUNC(ParsesTo, const char* input, const char* expected);
+TEST_SUBTEST_FUNC(FailsWith, const char* input, const char* expected_error);
+TEST_SUBTEST_FUNC(FlattensLike, const char* input);
+TEST_SUBTEST_FUNC(ParsesInParallel,
+                  StringView source,
+                  ThreadPool* pool,
+                  uint64_t min_range_tokens);
+TEST_SUBTEST_FUNC(RecoversTo,
+                  const char* input,
+                  const char* expected,
+                  uint64_t expected_errors);
+TEST_SUBTEST_FUNC(ReparsesLike,
+                  MkParser* parser,
+                  MkAstProgram* program,
+                  StringView source,
+                  const MkTokenBuffer* tokens,
+                  uint64_t edit_index);
+static bool ChildrenPrecede(const MkFlatAst* flat, uint32_t node);
+static bool SameFlatAst(const MkFlatAst* a, const MkFlatAst* b);
+static StringView ViewOf(const String* string);
 
 TEST_FUNC(ParserLetStatements) {
   struct {
     const char* input;
     const char* expected_identifier;
+    const char* expected_value;
   } tests[] = {
-      {"let x = 5;", "x"},
-      {"let y = true;", "y"},
-      {"let foobar = y;", "foobar"},
+      {"let x = 5;", "x", "5"},
+      {"let y = true;", "y", "true"},
+      {"let foobar = y;", "foobar", "y"},
   };
 
   for (uint64_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
@@ -34,10 +58,7 @@ TEST_FUNC(ParserLetStatements) {
     MkAstProgram* program = MkParserParseProgram(&parser);
     TEST_ASSERT(
         program != NULL,
-        do {
-          MkParserFree(parser);
-          MkTokenTypesManage(kTokenTypesFree);
-        } while (false),
+        MkParserFree(parser),
         "tests[%" PRIu64 "]: program is null", i);
     TEST_RUN_SUBTEST(
         CheckParserErrors,
@@ -45,16 +66,14 @@ TEST_FUNC(ParserLetStatements) {
           MkAstNodeFree(&program->base);
           free(program);
           MkParserFree(parser);
-          MkTokenTypesManage(kTokenTypesFree);
         } while (false),
-        parser);
+        &parser);
     TEST_ASSERT(
         program->statements.size == 1,
         do {
           MkAstNodeFree(&program->base);
           free(program);
           MkParserFree(parser);
-          MkTokenTypesManage(kTokenTypesFree);
         } while (false),
         "tests[%" PRIu64 "]: program->statements.size != 1", i);
     MkAstStatement* statement = program->statements.data[0];
@@ -64,7 +83,6 @@ TEST_FUNC(ParserLetStatements) {
           MkAstNodeFree(&program->base);
           free(program);
           MkParserFree(parser);
-          MkTokenTypesManage(kTokenTypesFree);
         } while (false),
         "tests[%" PRIu64 "]: statement->type != Let", i);
     TEST_RUN_SUBTEST(
@@ -73,13 +91,688 @@ TEST_FUNC(ParserLetStatements) {
           MkAstNodeFree(&program->base);
           free(program);
           MkParserFree(parser);
-          MkTokenTypesManage(kTokenTypesFree);
         } while (false),
         (MkAstLetStatement*)statement, tests[i].expected_identifier);
+    String value =
+        MkAstNodeString(&((MkAstLetStatement*)statement)->value->base);
+    TEST_ASSERT(
+        StringEqualView(value, StringViewFromC(tests[i].expected_value)),
+        do {
+          VEC_FREE(&value);
+          MkAstNodeFree(&program->base);
+          free(program);
+          MkParserFree(parser);
+        } while (false),
+        "tests[%" PRIu64 "]: value is '%" STRING_FMT "', expected '%s'", i,
+        STRING_PRINT(value), tests[i].expected_value);
+    VEC_FREE(&value);
+    MkAstNodeFree(&program->base);
+    free(program);
+    MkParserFree(parser);
+  }
+  TEST_PASS();
+}
+
+TEST_FUNC(ParserReturnStatements) {
+  MkLexer lexer = {0};
+  MkLexerInit(&lexer,
+              StringViewFromC("return 5;\nreturn 10;\nreturn add(15);"));
+  MkParser parser = {0};
+  MkParserInit(&parser, lexer);
+  MkAstProgram* program = MkParserParseProgram(&parser);
+  TEST_RUN_SUBTEST(
+      CheckParserErrors,
+      do {
+        MkAstNodeFree(&program->base);
+        free(program);
+        MkParserFree(parser);
+      } while (false),
+      &parser);
+  uint64_t count = program->statements.size;
+  bool all_return = true;
+  for (uint64_t i = 0; i < count; ++i) {
+    MkAstStatement* statement = program->statements.data[i];
+    String toklit = MkAstNodeTokenLiteral(&statement->base);
+    all_return = all_return && statement->type == kMkAstStatementReturn &&
+                 StringEqualView(toklit, StringViewFromC("return"));
+    VEC_FREE(&toklit);
+  }
+  MkAstNodeFree(&program->base);
+  free(program);
+  MkParserFree(parser);
+  TEST_ASSERT(count == 3, (void)0, "program has %" PRIu64 " statements",
+              count);
+  TEST_ASSERT(all_return, (void)0, "not every statement is a return");
+  TEST_PASS();
+}
+
+TEST_FUNC(ParserOperatorPrecedence) {
+  struct {
+    const char* input;
+    const char* expected;
+  } tests[] = {
+      {"-a * b", "((-a) * b)"},
+      {"!-a", "(!(-a))"},
+      {"a + b + c", "((a + b) + c)"},
+      {"a + b - c", "((a + b) - c)"},
+      {"a * b * c", "((a * b) * c)"},
+      {"a * b / c", "((a * b) / c)"},
+      {"a + b / c", "(a + (b / c))"},
+      {"a + b * c + d / e - f", "(((a + (b * c)) + (d / e)) - f)"},
+      {"3 + 4; -5 * 5", "(3 + 4)((-5) * 5)"},
+      {"5 > 4 == 3 < 4", "((5 > 4) == (3 < 4))"},
+      {"5 < 4 != 3 > 4", "((5 < 4) != (3 > 4))"},
+      {"3 + 4 * 5 == 3 * 1 + 4 * 5",
+       "((3 + (4 * 5)) == ((3 * 1) + (4 * 5)))"},
+      {"true", "true"},
+      {"3 > 5 == false", "((3 > 5) == false)"},
+      {"1 + (2 + 3) + 4", "((1 + (2 + 3)) + 4)"},
+      {"(5 + 5) * 2", "((5 + 5) * 2)"},
+      {"2 / (5 + 5)", "(2 / (5 + 5))"},
+      {"-(5 + 5)", "(-(5 + 5))"},
+      {"!(true == true)", "(!(true == true))"},
+      {"a + add(b * c) + d", "((a + add((b * c))) + d)"},
+      {"add(a, b, 1, 2 * 3, 4 + 5, add(6, 7 * 8))",
+       "add(a, b, 1, (2 * 3), (4 + 5), add(6, (7 * 8)))"},
+      {"add(a + b + c * d / f + g)", "add((((a + b) + ((c * d) / f)) + g))"},
+      {"fn(x) { x }(5)", "fn(x) x(5)"},
+  };
+  for (uint64_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    TEST_RUN_SUBTEST(ParsesTo, (void)0, tests[i].input, tests[i].expected);
+  }
+  TEST_PASS();
+}
+
+TEST_FUNC(ParserLiterals) {
+  TEST_RUN_SUBTEST(ParsesTo, (void)0, "foobar;", "foobar");
+  TEST_RUN_SUBTEST(ParsesTo, (void)0, "9223372036854775807;",
+                   "9223372036854775807");
+  TEST_RUN_SUBTEST(FailsWith, (void)0, "9223372036854775808;",
+                   "1:1: could not parse 9223372036854775808 as integer");
+
+  MkLexer lexer = {0};
+  MkLexerInit(&lexer, StringViewFromC("5; false;"));
+  MkParser parser = {0};
+  MkParserInit(&parser, lexer);
+  MkAstProgram* program = MkParserParseProgram(&parser);
+  bool ok = parser.errors.size == 0 && program->statements.size == 2;
+  if (ok) {
+    MkAstExpression* integer =
+        ((MkAstExpressionStatement*)program->statements.data[0])->expression;
+    MkAstExpression* boolean =
+        ((MkAstExpressionStatement*)program->statements.data[1])->expression;
+    ok = integer->type == kMkAstExpressionIntegerLiteral &&
+         ((MkAstIntegerLiteral*)integer)->value == 5 &&
+         boolean->type == kMkAstExpressionBoolean &&
+         !((MkAstBoolean*)boolean)->value;
+  }
+  MkAstNodeFree(&program->base);
+  free(program);
+  MkParserFree(parser);
+  TEST_ASSERT(ok, (void)0, "'5; false;' did not parse to 5 and false");
+  TEST_PASS();
+}
+
+TEST_FUNC(ParserIfExpressions) {
+  TEST_RUN_SUBTEST(ParsesTo, (void)0, "if (x < y) { x }", "if(x < y) x");
+  TEST_RUN_SUBTEST(ParsesTo, (void)0, "if (x < y) { x } else { y }",
+                   "if(x < y) xelse y");
+  TEST_RUN_SUBTEST(ParsesTo, (void)0, "if (a) { let b = 1; return b; }",
+                   "ifa let b = 1;return b;");
+  TEST_RUN_SUBTEST(FailsWith, (void)0, "if (x) { x",
+                   "1:11: expected next token to be }, got EOF instead");
+  TEST_RUN_SUBTEST(FailsWith, (void)0, "if x { x }",
+                   "1:4: expected next token to be (, got IDENT instead");
+  TEST_PASS();
+}
+
+TEST_FUNC(ParserFunctions) {
+  TEST_RUN_SUBTEST(ParsesTo, (void)0, "fn(x, y) { x + y; }",
+                   "fn(x, y) (x + y)");
+  TEST_RUN_SUBTEST(ParsesTo, (void)0, "fn() {};", "fn() ");
+  TEST_RUN_SUBTEST(ParsesTo, (void)0, "fn(x, y, z) {};", "fn(x, y, z) ");
+  TEST_RUN_SUBTEST(ParsesTo, (void)0, "add(1, 2 * 3, 4 + 5);",
+                   "add(1, (2 * 3), (4 + 5))");
+  TEST_RUN_SUBTEST(ParsesTo, (void)0, "f()()", "f()()");
+  TEST_RUN_SUBTEST(FailsWith, (void)0, "fn(x, 1) {}",
+                   "1:7: expected next token to be IDENT, got INT instead");
+  TEST_RUN_SUBTEST(FailsWith, (void)0, "add(1, 2",
+                   "1:9: expected next token to be ), got EOF instead");
+  TEST_PASS();
+}
+
+TEST_FUNC(ParserNestingLimit) {
+  String source = {0};
+  for (int i = 0; i < 100000; ++i) {
+    VEC_PUSH(&source, '(');
+  }
+  VEC_PUSH(&source, '\0');
+  TEST_RUN_SUBTEST(FailsWith, VEC_FREE(&source), source.data,
+                   "1:2049: expression nested more than 2048 deep");
+  VEC_FREE(&source);
+  // Chains grow taller without nesting, and are held to the same height:
+  // 2048 operands is as long as `1 + 1 + ...` may get.
+  const char* const kTerms[] = {"1", "f(1, 2)"};
+  const char* const kErrors[] = {
+      "1:4096: expression nested more than 2048 deep",
+      "1:16376: expression nested more than 2048 deep",
+  };
+  for (int t = 0; t < 2; ++t) {
+    for (int i = 0; i < 100000; ++i) {
+      if (i > 0) {
+        VEC_PUSH(&source, '+');
+      }
+      VEC_APPEND(&source, kTerms[t], strlen(kTerms[t]));
+    }
+    VEC_PUSH(&source, '\0');
+    TEST_RUN_SUBTEST(FailsWith, VEC_FREE(&source), source.data, kErrors[t]);
+    VEC_FREE(&source);
+  }
+  String expected = {0};
+  for (int i = 0; i < 2047; ++i) {
+    VEC_APPEND(&source, "1+", 2);
+    VEC_PUSH(&expected, '(');
+  }
+  VEC_APPEND(&source, "1", 2);
+  VEC_PUSH(&expected, '1');
+  for (int i = 0; i < 2047; ++i) {
+    VEC_APPEND(&expected, " + 1)", 5);
+  }
+  VEC_PUSH(&expected, '\0');
+  TEST_RUN_SUBTEST(ParsesTo,
+                   do {
+                     VEC_FREE(&source);
+                     VEC_FREE(&expected);
+                   } while (false),
+                   source.data, expected.data);
+  VEC_FREE(&source);
+  VEC_FREE(&expected);
+  TEST_PASS();
+}
+
+TEST_FUNC(ParserArena) {
+  String source = {0};
+  for (int i = 0; i < 2000; ++i) {
+    const char kStatement[] =
+        "let f = fn(a, b) {\n"
+        "  if (a < b) { return add(a, b * 2); } else { b }\n"
+        "};\n";
+    VEC_APPEND(&source, kStatement, sizeof(kStatement) - 1);
+  }
+  MkLexer lexer = {0};
+  MkLexerInit(&lexer, (StringView){.begin = source.data,
+                                   .end = source.data + source.size});
+  MkParser parser = {0};
+  MkParserInit(&parser, lexer);
+  MkAstProgram* program = MkParserParseProgram(&parser);
+  uint64_t statements = program->statements.size;
+  uint64_t used = program->arena.used;
+  uint64_t reserved = program->arena.reserved;
+  MkAstNodeFree(&program->base);
+  bool released = program->arena.head == NULL &&
+                  program->statements.data == NULL;
+  free(program);
+  uint64_t errors = parser.errors.size;
+  MkParserFree(parser);
+  VEC_FREE(&source);
+  TEST_ASSERT(errors == 0 && statements == 2000, (void)0,
+              "%" PRIu64 " statements, %" PRIu64 " errors", statements,
+              errors);
+  // Doubling blocks waste at most about as much as is used, plus the first
+  // few small blocks.
+  TEST_ASSERT(reserved <= 2 * used + 16 * 1024, (void)0,
+              "arena reserved %" PRIu64 " bytes for %" PRIu64, reserved,
+              used);
+  TEST_ASSERT(released, (void)0, "freeing the program kept its arena");
+  TEST_PASS();
+}
+
+TEST_FUNC(ParserErrorPositions) {
+  const char* expected[] = {
+      "1:7: expected next token to be =, got INT instead",
+      "3:5: expected next token to be IDENT, got = instead",
+      "4:6: no prefix parse function for ; found",
+  };
+  MkLexer lexer = {0};
+  MkLexerInit(&lexer, StringViewFromC("let x 5;\n\nlet = 10;\n  5 +;"));
+  MkParser parser = {0};
+  MkParserInit(&parser, lexer);
+  MkAstProgram* program = MkParserParseProgram(&parser);
+  MkAstNodeFree(&program->base);
+  free(program);
+  TEST_ASSERT(parser.errors.size == sizeof(expected) / sizeof(expected[0]),
+              MkParserFree(parser), "parser has %" PRIu64 " errors",
+              parser.errors.size);
+  for (uint64_t i = 0; i < parser.errors.size; ++i) {
+    String error = MkParserErrorString(&parser, parser.errors.data[i]);
+    TEST_ASSERT(StringEqualView(error, StringViewFromC(expected[i])),
+                do {
+                  VEC_FREE(&error);
+                  MkParserFree(parser);
+                } while (false),
+                "errors[%" PRIu64 "]: '%" STRING_FMT "', expected '%s'", i,
+                STRING_PRINT(error), expected[i]);
+    VEC_FREE(&error);
+  }
+  MkParserFree(parser);
+  TEST_PASS();
+}
+
+TEST_FUNC(ParserLookahead) {
+  const char* input = "let add = fn(a, b) { a + b; }; add(1, 2 * 3);";
+  const char* expected = "let add = fn(a, b) (a + b);add(1, (2 * 3))";
+  MkTokenBuffer tokens = {0};
+  MkLexerTokenizeAll(StringViewFromC(input), &tokens);
+  MkParser parser = {0};
+  MkParserInitTokens(&parser, StringViewFromC(input), &tokens);
+  bool rejected = !MkParserSetLookahead(&parser, 0) &&
+                  !MkParserSetLookahead(&parser, kMkParserMaxLookahead + 1);
+  MkParserSetLookahead(&parser, kMkParserMaxLookahead);
+  // Every token of the input, then EOF for each position past the end.
+  for (uint32_t n = 0; n < kMkParserMaxLookahead; ++n) {
+    uint64_t index = n < tokens.size ? n : tokens.size - 1;
+    MkToken token = MkParserPeekToken(&parser, n);
+    TEST_ASSERT(token.type == tokens.kinds[index] &&
+                    token.offset == tokens.offsets[index],
+                do {
+                  MkParserFree(parser);
+                  MkTokenBufferFree(&tokens);
+                } while (false),
+                "token %" PRIu32 " ahead is %s at %" PRIu32, n,
+                MkTokenTypeName(token.type), token.offset);
+  }
+  MkAstProgram* program = MkParserParseProgram(&parser);
+  String actual = MkAstNodeString(&program->base);
+  MkAstNodeFree(&program->base);
+  free(program);
+  uint64_t errors = parser.errors.size;
+  MkParserFree(parser);
+  MkTokenBufferFree(&tokens);
+  TEST_ASSERT(rejected, VEC_FREE(&actual),
+              "lookahead depths 0 and %d were accepted",
+              kMkParserMaxLookahead + 1);
+  TEST_ASSERT(
+      errors == 0 && StringEqualView(actual, StringViewFromC(expected)),
+      VEC_FREE(&actual), "parsed to '%" STRING_FMT "', expected '%s'",
+      STRING_PRINT(actual), expected);
+  VEC_FREE(&actual);
+
+  // Enough statements that the window is refilled many times over, at every
+  // depth; the grammar's own peek must stay inside it even at depth 1.
+  String long_input = {0};
+  for (uint64_t i = 0; i < 50; ++i) {
+    VEC_APPEND(&long_input, "let x = 1 + 2;", 14);
+  }
+  for (uint32_t depth = 1; depth <= kMkParserMaxLookahead; ++depth) {
+    StringView source = {.begin = long_input.data,
+                         .end = long_input.data + long_input.size};
+    MkTokenBufferClear(&tokens);
+    MkLexerTokenizeAll(source, &tokens);
+    parser = (MkParser){0};
+    MkParserInitTokens(&parser, source, &tokens);
+    MkParserSetLookahead(&parser, depth);
+    program = MkParserParseProgram(&parser);
+    uint64_t statements = program->statements.size;
+    MkAstNodeFree(&program->base);
+    free(program);
+    errors = parser.errors.size;
+    MkParserFree(parser);
+    TEST_ASSERT(statements == 50 && errors == 0,
+                do {
+                  VEC_FREE(&long_input);
+                  MkTokenBufferFree(&tokens);
+                } while (false),
+                "at depth %" PRIu32 ", parsed %" PRIu64
+                " statements with %" PRIu64 " errors",
+                depth, statements, errors);
+  }
+  VEC_FREE(&long_input);
+  MkTokenBufferFree(&tokens);
+  TEST_PASS();
+}
+
+TEST_FUNC(ParserRecovery) {
+  struct {
+    const char* input;
+    const char* expected;
+    uint64_t errors;
+  } tests[] = {
+      {"let = 1; let x = 2;", "let x = 2;", 1},
+      {"let x = 1 +; return x;", "return x;", 1},
+      {"let = 1; return ); let y = fn( { 1 }; x + y;", "(x + y)", 3},
+      {"if (a) { let = 1; b } c", "ifa bc", 1},
+      {"let f = fn(x) { x +; let y = 2; y }; f", "let f = fn(x) let y = 2;y;f",
+       1},
+      {"} ) x; y", "y", 1},
+      {"let x = if (a) { b", "", 1},
+      {"1 2 3 ; ; 4", "1234", 1},
+      {"if (a) { f( } else { b }; c", "ifa else bc", 1},
+      {"let x = let y = 2; y", "let y = 2;y", 1},
+  };
+  for (uint64_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    TEST_RUN_SUBTEST(RecoversTo, (void)0, tests[i].input, tests[i].expected,
+                     tests[i].errors);
+  }
+  TEST_PASS();
+}
+
+TEST_FUNC(ParserParallel) {
+  // Statements, some malformed, with braces balanced, so that ranges can be
+  // cut anywhere. A stray '}' halfway through the second source stops the
+  // cuts there.
+  const char* const kPieces[] = {
+      "let x = 5;\n",
+      "let add = fn(a, b) { if (a < b) { return a; } else { b + 1 } };\n",
+      "add(1, 2 * 3)\n",
+      "x + y; z\n",
+      "let = 1;\n",
+      "f(1;\n",
+      "if (a { b; c };\n",
+      "fn(x) { x +; let y = 2; y };\n",
+      "let y = (1 + 2;\n",
+      ";\n",
+      "99999999999999999999;\n",
+  };
+  const uint32_t kThreadCounts[] = {2, 4};
+  const uint64_t kMinRangeTokens[] = {1, 7, 64};
+  uint64_t piece_count = sizeof(kPieces) / sizeof(kPieces[0]);
+  for (int unmatched = 0; unmatched < 2; ++unmatched) {
+    String source = {0};
+    uint64_t state = 0x2545F4914F6CDD1D;
+    for (int i = 0; i < 3000; ++i) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      const char* piece = kPieces[(state >> 8) % piece_count];
+      VEC_APPEND(&source, piece, strlen(piece));
+      if (unmatched && i == 1500) {
+        VEC_APPEND(&source, "} let a = 1;\n", 13);
+      }
+    }
+    StringView view = {.begin = source.data,
+                       .end = source.data + source.size};
+    for (uint64_t t = 0; t < sizeof(kThreadCounts) / sizeof(kThreadCounts[0]);
+         ++t) {
+      ThreadPool pool;
+      ThreadPoolInit(&pool, kThreadCounts[t]);
+      for (uint64_t r = 0;
+           r < sizeof(kMinRangeTokens) / sizeof(kMinRangeTokens[0]); ++r) {
+        TEST_RUN_SUBTEST(ParsesInParallel,
+                         do {
+                           ThreadPoolFree(&pool);
+                           VEC_FREE(&source);
+                         } while (false),
+                         view, &pool, kMinRangeTokens[r]);
+      }
+      ThreadPoolFree(&pool);
+    }
+    VEC_FREE(&source);
+  }
+  TEST_PASS();
+}
+
+TEST_FUNC(ParserReparse) {
+  // Replacing the 2 of the middle statement parses only that statement.
+  {
+    String before = StringFromC("let a = 1;\nlet b = 2;\nlet c = 3;\n");
+    MkTokenBuffer tokens = {0};
+    MkLexerTokenizeAll(ViewOf(&before), &tokens);
+    MkParser parser;
+    MkParserInitTokens(&parser, ViewOf(&before), &tokens);
+    MkAstProgram* program = MkParserParseProgram(&parser);
+    String after = StringFromC("let a = 1;\nlet b = 20 + 2;\nlet c = 3;\n");
+    MkEdit edit = {.offset = 19, .removed = 1,
+                   .inserted = StringViewFromC("20 + 2")};
+    MkLexerRelex(ViewOf(&after), &tokens, edit);
+    MkReparseStats stats;
+    MkParserReparse(&parser, program, ViewOf(&after), &tokens, edit, &stats);
+    VEC_FREE(&before);
+    MkAstProgramSettle(program);
+    String actual = MkAstNodeString(&program->base);
+    bool same = StringEqualView(
+        actual, StringViewFromC("let a = 1;let b = (20 + 2);let c = 3;"));
+    VEC_FREE(&actual);
     MkAstNodeFree(&program->base);
     free(program);
     MkParserFree(parser);
+    MkTokenBufferFree(&tokens);
+    VEC_FREE(&after);
+    TEST_ASSERT(same, (void)0, "the edited program parsed differently");
+    TEST_ASSERT(stats.reused_statements == 2 && stats.reused_nodes == 6 &&
+                    stats.parsed_statements == 1 && stats.parsed_nodes == 5,
+                (void)0,
+                "reused %" PRIu64 " statements and %" PRIu64
+                " nodes, parsed %" PRIu64 " and %" PRIu64,
+                stats.reused_statements, stats.reused_nodes,
+                stats.parsed_statements, stats.parsed_nodes);
+  }
+
+  // Random edits to a program with malformed statements, some of which add
+  // stray braces, each checked against a full parse of the result.
+  const char* const kPieces[] = {
+      "let x = 5;\n",
+      "let add = fn(a, b) { if (a < b) { return a; } else { b + 1 } };\n",
+      "add(1, 2 * 3)\n",
+      "x + y; z\n",
+      "let = 1;\n",
+      "let x\n",
+      "f(1;\n",
+      "if (a { b; c };\n",
+      "99999999999999999999;\n",
+  };
+  const char* const kInserts[] = {"", "1", "x", ";", "{ y }", "}", "(", " ",
+                                  "let", "==", "fn(a) { a }", "\n"};
+  uint64_t piece_count = sizeof(kPieces) / sizeof(kPieces[0]);
+  uint64_t insert_count = sizeof(kInserts) / sizeof(kInserts[0]);
+  uint64_t state = 0x9E3779B97F4A7C15;
+#define NEXT_RANDOM_() \
+  (state ^= state << 13, state ^= state >> 7, state ^= state << 17, state >> 8)
+  String source = {0};
+  for (int i = 0; i < 400; ++i) {
+    const char* piece = kPieces[NEXT_RANDOM_() % piece_count];
+    VEC_APPEND(&source, piece, strlen(piece));
+  }
+  MkTokenBuffer tokens = {0};
+  MkLexerTokenizeAll(ViewOf(&source), &tokens);
+  MkParser parser;
+  MkParserInitTokens(&parser, ViewOf(&source), &tokens);
+  MkAstProgram* program = MkParserParseProgram(&parser);
+  uint64_t reused = 0;
+  for (uint64_t i = 0; i < 500; ++i) {
+    const char* insert = kInserts[NEXT_RANDOM_() % insert_count];
+    MkEdit edit = {.offset = NEXT_RANDOM_() % (source.size + 1),
+                   .removed = NEXT_RANDOM_() % 4};
+    if (edit.removed > source.size - edit.offset) {
+      edit.removed = source.size - edit.offset;
+    }
+    String edited = {0};
+    VEC_APPEND(&edited, source.data, edit.offset);
+    VEC_APPEND(&edited, insert, strlen(insert));
+    VEC_APPEND(&edited, &source.data[edit.offset + edit.removed],
+               source.size - edit.offset - edit.removed);
+    edit.inserted = (StringView){.begin = &edited.data[edit.offset],
+                                 .end = &edited.data[edit.offset] +
+                                        strlen(insert)};
+    MkLexerRelex(ViewOf(&edited), &tokens, edit);
+    MkReparseStats stats;
+    MkParserReparse(&parser, program, ViewOf(&edited), &tokens, edit, &stats);
+    // Scribbles over the old text, so that anything still pointing into it
+    // shows.
+    memset(source.data, '#', source.size);
+    VEC_FREE(&source);
+    source = edited;
+    reused += stats.reused_statements;
+    // Moves pile up over a few edits, each onto a new buffer, before they are
+    // made and the program is checked.
+    if (i % 4 != 3) {
+      continue;
+    }
+    MkAstProgramSettle(program);
+    TEST_RUN_SUBTEST(ReparsesLike,
+                     do {
+                       MkAstNodeFree(&program->base);
+                       free(program);
+                       MkParserFree(parser);
+                       MkTokenBufferFree(&tokens);
+                       VEC_FREE(&source);
+                     } while (false),
+                     &parser, program, ViewOf(&source), &tokens, i);
+  }
+#undef NEXT_RANDOM_
+  MkAstNodeFree(&program->base);
+  free(program);
+  MkParserFree(parser);
+  MkTokenBufferFree(&tokens);
+  VEC_FREE(&source);
+  TEST_ASSERT(reused > 0, (void)0, "no statement was ever reused");
+  TEST_PASS();
+}
+
+TEST_FUNC(ParserFlatAst) {
+  const char* inputs[] = {
+      "let x = 5; let y = true; return x;",
+      "-a * b + c / d - !e",
+      "5 > 4 == 3 < 4",
+      "if (x < y) { x }",
+      "if (x < y) { x } else { y; return z; }",
+      "fn() {}; fn(x, y) { x + y; }",
+      "add(a, b, 1, 2 * 3, 4 + 5, add(6, 7 * 8))",
+      "fn(x) { x }(5)",
+      "9223372036854775807; 0",
+      "",
+      "let f = fn(a, b) {\n"
+      "  if (a < b) { return add(a, b * 2); } else { b }\n"
+      "};\n"
+      "f(1, 2)(3);",
+  };
+  for (uint64_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+    TEST_RUN_SUBTEST(FlattensLike, (void)0, inputs[i]);
+  }
+  // `-...-1` with as many signs as the height allows builds back, and with
+  // one more, which the parser would have refused, does not.
+  StringView source = StringViewFromC("-1");
+  MkTokenBuffer tokens = {0};
+  MkLexerTokenizeAll(source, &tokens);
+  MkInterner symbols;
+  MkInternerInit(&symbols);
+  for (uint32_t signs = kMkAstMaxHeight - 1; signs <= kMkAstMaxHeight;
+       ++signs) {
+    MkFlatAst flat = {0};
+    VEC_PUSH(&flat.nodes,
+             ((MkFlatNode){.kind = kMkFlatIntegerLiteral, .token = 1, .a = 1}));
+    for (uint32_t i = 0; i < signs; ++i) {
+      VEC_PUSH(&flat.nodes, ((MkFlatNode){.kind = kMkFlatPrefix, .a = i}));
+    }
+    VEC_PUSH(&flat.nodes,
+             ((MkFlatNode){.kind = kMkFlatExpression, .a = signs}));
+    VEC_PUSH(&flat.extra, 1);
+    VEC_PUSH(&flat.extra, signs + 1);
+    flat.root = signs + 2;
+    VEC_PUSH(&flat.nodes, ((MkFlatNode){.kind = kMkFlatProgram, .a = 0}));
+    MkAstProgram* program =
+        MkFlatAstToProgram(&flat, &tokens, source, &symbols);
+    bool built = program != NULL;
+    if (built) {
+      MkAstNodeFree(&program->base);
+      free(program);
+    }
+    MkFlatAstFree(&flat);
+    TEST_ASSERT(built == (signs < kMkAstMaxHeight),
+                do {
+                  MkInternerFree(&symbols);
+                  MkTokenBufferFree(&tokens);
+                } while (false),
+                "%" PRIu32 " signs %s", signs,
+                built ? "built back" : "did not build back");
+  }
+  MkInternerFree(&symbols);
+  MkTokenBufferFree(&tokens);
+  TEST_PASS();
+}
+
+TEST_FUNC(ParserInterning) {
+  enum { kChainLength = 200 };
+  String source = StringFromC(
+      "let apple = 1; let banana = apple;\n"
+      "fn(apple, cherry) { apple + cherry + banana };\n");
+  // More names than the table starts with, so that it has to grow. Each
+  // names the one before; identifiers cannot contain digits.
+  char previous_name[] = "apple";
+  for (int i = 0; i < kChainLength; ++i) {
+    char name[] = {'n', (char)('a' + i / 26), (char)('a' + i % 26), '\0'};
+    String line = StringFormat("let %s = %s;\n", name, previous_name);
+    VEC_APPEND(&source, line.data, line.size);
+    VEC_FREE(&line);
+    memcpy(previous_name, name, sizeof(name));
+  }
+  MkInterner symbols;
+  MkInternerInit(&symbols);
+  MkLexer lexer;
+  MkLexerInit(&lexer, ViewOf(&source));
+  MkParser parser;
+  MkParserInit(&parser, lexer);
+  parser.symbols = &symbols;
+  MkAstProgram* program = MkParserParseProgram(&parser);
+#define CLEANUP                     \
+  do {                              \
+    MkAstNodeFree(&program->base);  \
+    free(program);                  \
+    MkParserFree(parser);           \
+    MkInternerFree(&symbols);       \
+    VEC_FREE(&source);              \
+  } while (false)
+  TEST_ASSERT(parser.errors.size == 0 &&
+                  program->statements.size == 3 + kChainLength,
+              CLEANUP, "%" PRIu64 " errors, %" PRIu64 " statements",
+              parser.errors.size, program->statements.size);
+  MkAstStatement** statements = program->statements.data;
+  uint32_t apple = ((MkAstLetStatement*)statements[0])->name.symbol;
+  MkAstLetStatement* banana = (MkAstLetStatement*)statements[1];
+  MkAstFunctionLiteral* function =
+      (MkAstFunctionLiteral*)((MkAstExpressionStatement*)statements[2])
+          ->expression;
+  MkAstInfixExpression* sum =
+      (MkAstInfixExpression*)((MkAstExpressionStatement*)
+                                  function->body->statements.data[0])
+          ->expression;
+  MkAstInfixExpression* inner = (MkAstInfixExpression*)sum->left;
+  // Symbols are numbered in the order the names first appear.
+  TEST_ASSERT(apple == 0 && banana->name.symbol == 1 &&
+                  ((MkAstIdentifier*)banana->value)->symbol == apple &&
+                  function->parameters.data[0]->symbol == apple &&
+                  function->parameters.data[1]->symbol == 2 &&
+                  ((MkAstIdentifier*)inner->left)->symbol == apple &&
+                  ((MkAstIdentifier*)inner->right)->symbol == 2 &&
+                  ((MkAstIdentifier*)sum->right)->symbol == 1,
+              CLEANUP, "names and symbols disagree");
+  uint32_t previous = apple;
+  for (uint64_t i = 3; i < program->statements.size; ++i) {
+    MkAstLetStatement* let_stmt = (MkAstLetStatement*)statements[i];
+    StringView name = MkInternerName(&symbols, let_stmt->name.symbol);
+    TEST_ASSERT(let_stmt->name.symbol == i &&
+                    ((MkAstIdentifier*)let_stmt->value)->symbol == previous &&
+                    StringViewEqual(name, let_stmt->name.token.literal),
+                CLEANUP, "statements[%" PRIu64 "]: symbol %" PRIu32 " is '%"
+                STRING_FMT "'", i, let_stmt->name.symbol,
+                STRING_VIEW_PRINT(name));
+    previous = let_stmt->name.symbol;
   }
+  // Every identifier is looked up once, and all but the first of each name
+  // are hits.
+  uint64_t lookups = 8 + 2 * kChainLength;
+  uint64_t count = 3 + kChainLength;
+  TEST_ASSERT(MkInternerCount(&symbols) == count &&
+                  symbols.lookups == lookups &&
+                  symbols.hits == lookups - count,
+              CLEANUP,
+              "%" PRIu32 " symbols, %" PRIu64 " lookups, %" PRIu64 " hits",
+              MkInternerCount(&symbols), symbols.lookups, symbols.hits);
+  TEST_ASSERT(MkInternerIntern(&symbols, StringViewFromC("cherry")) == 2 &&
+                  MkInternerIntern(&symbols, StringViewFromC("")) ==
+                      kMkSymbolNone,
+              CLEANUP, "interning again changed symbols");
+  CLEANUP;
+#undef CLEANUP
   TEST_PASS();
 }
 
@@ -91,8 +784,12 @@ TEST_SUBTEST_FUNC(TestLetStatement,
               VEC_FREE(&toklit), "statement TokenLiteral != 'let'");
   VEC_FREE(&toklit);
   TEST_ASSERT(
-      StringEqualView(statement->name.value, StringViewFromC(expected_name)),
-      (void)0, "statement name.value != '%s'", expected_name);
+      StringViewEqual(statement->name.token.literal,
+                      StringViewFromC(expected_name)) &&
+          StringViewEqual(
+              MkInternerName(MkInternerGlobal(), statement->name.symbol),
+              StringViewFromC(expected_name)),
+      (void)0, "statement name != '%s'", expected_name);
   toklit = MkAstNodeTokenLiteral(&statement->name.base.base);
   TEST_ASSERT(StringEqualView(toklit, StringViewFromC(expected_name)),
               VEC_FREE(&toklit), "statement name TokenLiteral != '%s'",
@@ -101,14 +798,358 @@ TEST_SUBTEST_FUNC(TestLetStatement,
   TEST_PASS();
 }
 
-TEST_SUBTEST_FUNC(CheckParserErrors, MkParser parser) {
-  if (parser.errors.size == 0) {
+TEST_SUBTEST_FUNC(CheckParserErrors, MkParser* parser) {
+  if (parser->errors.size == 0) {
     TEST_PASS();
   }
 
-  for (uint64_t i = 0; i < parser.errors.size; ++i) {
-    String error = parser.errors.data[i];
+  for (uint64_t i = 0; i < parser->errors.size; ++i) {
+    String error = MkParserErrorString(parser, parser->errors.data[i]);
     fprintf(stderr, "[PARSER ERROR] %" STRING_FMT "\n", STRING_PRINT(error));
+    VEC_FREE(&error);
   }
-  TEST_FAIL("parser has %" PRIu64 " errors", parser.errors.size);
+  TEST_FAIL("parser has %" PRIu64 " errors", parser->errors.size);
+}
+
+TEST_SUBTEST_FUNC(ParsesTo, const char* input, const char* expected) {
+  MkLexer lexer = {0};
+  MkLexerInit(&lexer, StringViewFromC(input));
+  MkParser parser = {0};
+  MkParserInit(&parser, lexer);
+  MkAstProgram* program = MkParserParseProgram(&parser);
+  TEST_RUN_SUBTEST(
+      CheckParserErrors,
+      do {
+        MkAstNodeFree(&program->base);
+        free(program);
+        MkParserFree(parser);
+      } while (false),
+      &parser);
+  String actual = MkAstNodeString(&program->base);
+  MkAstNodeFree(&program->base);
+  free(program);
+  MkParserFree(parser);
+  TEST_ASSERT(StringEqualView(actual, StringViewFromC(expected)),
+              VEC_FREE(&actual),
+              "'%s' parsed to '%" STRING_FMT "', expected '%s'", input,
+              STRING_PRINT(actual), expected);
+  VEC_FREE(&actual);
+  TEST_PASS();
+}
+
+TEST_SUBTEST_FUNC(FailsWith, const char* input, const char* expected_error) {
+  MkLexer lexer = {0};
+  MkLexerInit(&lexer, StringViewFromC(input));
+  MkParser parser = {0};
+  MkParserInit(&parser, lexer);
+  MkAstProgram* program = MkParserParseProgram(&parser);
+  MkAstNodeFree(&program->base);
+  free(program);
+  TEST_ASSERT(parser.errors.size > 0, MkParserFree(parser),
+              "'%s' parsed without errors", input);
+  String error = MkParserErrorString(&parser, parser.errors.data[0]);
+  MkParserFree(parser);
+  TEST_ASSERT(StringEqualView(error, StringViewFromC(expected_error)),
+              VEC_FREE(&error),
+              "'%s' failed with '%" STRING_FMT "', expected '%s'", input,
+              STRING_PRINT(error), expected_error);
+  VEC_FREE(&error);
+  TEST_PASS();
+}
+
+TEST_SUBTEST_FUNC(FlattensLike, const char* input) {
+  StringView source = StringViewFromC(input);
+  MkLexer lexer = {0};
+  MkLexerInit(&lexer, source);
+  MkParser parser = {0};
+  MkParserInit(&parser, lexer);
+  MkAstProgram* program = MkParserParseProgram(&parser);
+  MkFlatAst flat = {0};
+  bool lowered = parser.errors.size == 0 &&
+                 MkFlatAstFromProgram(&flat, program, &parser.tokens);
+  String expected = MkAstNodeString(&program->base);
+  String expected_literal = MkAstNodeTokenLiteral(&program->base);
+  uint64_t expected_count = program->node_count;
+  MkAstNodeFree(&program->base);
+  free(program);
+  MkInterner symbols;
+  MkInternerInit(&symbols);
+#define CLEANUP_                 \
+  do {                           \
+    VEC_FREE(&expected);         \
+    VEC_FREE(&expected_literal); \
+    MkFlatAstFree(&flat);        \
+    MkInternerFree(&symbols);    \
+    MkParserFree(parser);        \
+  } while (false)
+  TEST_ASSERT(lowered, CLEANUP_, "could not flatten '%s'", input);
+  TEST_ASSERT(flat.root == flat.nodes.size - 1 &&
+                  flat.nodes.data[flat.root].kind == kMkFlatProgram,
+              CLEANUP_, "'%s': the program is not the last node", input);
+  for (uint32_t i = 0; i < flat.nodes.size; ++i) {
+    TEST_ASSERT(ChildrenPrecede(&flat, i), CLEANUP_,
+                "'%s': %s node %" PRIu32 " comes before a child", input,
+                MkFlatNodeKindName(flat.nodes.data[i].kind), i);
+  }
+  String actual = MkFlatAstString(&flat, &parser.tokens, source, flat.root);
+  String literal =
+      MkFlatAstTokenLiteral(&flat, &parser.tokens, source, flat.root);
+  bool same = StringEqual(actual, expected) &&
+              StringEqual(literal, expected_literal);
+  TEST_ASSERT(same,
+              do {
+                VEC_FREE(&actual);
+                VEC_FREE(&literal);
+                CLEANUP_;
+              } while (false),
+              "'%s' flattened to '%" STRING_FMT "', expected '%" STRING_FMT
+              "'",
+              input, STRING_PRINT(actual), STRING_PRINT(expected));
+  VEC_FREE(&actual);
+  VEC_FREE(&literal);
+  // Building the pointer AST back gives the program that was parsed.
+  program = MkFlatAstToProgram(&flat, &parser.tokens, source, &symbols);
+  TEST_ASSERT(program != NULL, CLEANUP_, "could not build '%s' back", input);
+  actual = MkAstNodeString(&program->base);
+  uint64_t count = MkAstNodeCount(&program->base);
+  uint64_t node_count = program->node_count;
+  MkAstNodeFree(&program->base);
+  free(program);
+  same = StringEqual(actual, expected) && count == expected_count &&
+         node_count == expected_count;
+  TEST_ASSERT(same,
+              do {
+                VEC_FREE(&actual);
+                CLEANUP_;
+              } while (false),
+              "'%s' built back to '%" STRING_FMT "' with %" PRIu64
+              " nodes (%" PRIu64 " counted), expected '%" STRING_FMT
+              "' with %" PRIu64,
+              input, STRING_PRINT(actual), node_count, count,
+              STRING_PRINT(expected), expected_count);
+  VEC_FREE(&actual);
+  CLEANUP_;
+#undef CLEANUP_
+  TEST_PASS();
+}
+
+bool ChildrenPrecede(const MkFlatAst* flat, uint32_t node) {
+  MkFlatNode n = flat->nodes.data[node];
+  const uint32_t* extra = flat->extra.data;
+  uint32_t children[2] = {kMkFlatNone, kMkFlatNone};
+  uint32_t list = kMkFlatNone;
+  switch ((MkFlatNodeKind)n.kind) {
+    case kMkFlatProgram:
+    case kMkFlatBlock:
+      list = n.a;
+      break;
+    case kMkFlatLet:
+    case kMkFlatInfix:
+      children[0] = n.a;
+      children[1] = n.b;
+      break;
+    case kMkFlatReturn:
+    case kMkFlatExpression:
+    case kMkFlatPrefix:
+      children[0] = n.a;
+      break;
+    case kMkFlatIf:
+      children[0] = n.a;
+      children[1] = extra[n.b];
+      if (extra[n.b + 1] != kMkFlatNone && extra[n.b + 1] >= node) {
+        return false;
+      }
+      break;
+    case kMkFlatFunctionLiteral:
+      list = n.a;
+      children[0] = n.b;
+      break;
+    case kMkFlatCall:
+      children[0] = n.a;
+      list = n.b;
+      break;
+    case kMkFlatIdentifier:
+    case kMkFlatIntegerLiteral:
+    case kMkFlatBoolean:
+    case kMkFlatNodeKindCount:
+      break;
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (children[i] != kMkFlatNone && children[i] >= node) {
+      return false;
+    }
+  }
+  if (list != kMkFlatNone) {
+    for (uint32_t i = 1; i <= extra[list]; ++i) {
+      if (extra[list + i] >= node) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+TEST_SUBTEST_FUNC(RecoversTo,
+                  const char* input,
+                  const char* expected,
+                  uint64_t expected_errors) {
+  MkLexer lexer = {0};
+  MkLexerInit(&lexer, StringViewFromC(input));
+  MkParser parser = {0};
+  MkParserInit(&parser, lexer);
+  MkAstProgram* program = MkParserParseProgram(&parser);
+  String actual = MkAstNodeString(&program->base);
+  MkAstNodeFree(&program->base);
+  free(program);
+  uint64_t errors = parser.errors.size;
+  MkParserFree(parser);
+  TEST_ASSERT(errors == expected_errors, VEC_FREE(&actual),
+              "'%s' reported %" PRIu64 " errors, expected %" PRIu64, input,
+              errors, expected_errors);
+  TEST_ASSERT(StringEqualView(actual, StringViewFromC(expected)),
+              VEC_FREE(&actual),
+              "'%s' recovered to '%" STRING_FMT "', expected '%s'", input,
+              STRING_PRINT(actual), expected);
+  VEC_FREE(&actual);
+  TEST_PASS();
+}
+
+TEST_SUBTEST_FUNC(ParsesInParallel,
+                  StringView source,
+                  ThreadPool* pool,
+                  uint64_t min_range_tokens) {
+  MkTokenBuffer tokens = {0};
+  MkLexerTokenizeAll(source, &tokens);
+  MkInterner serial_symbols;
+  MkInternerInit(&serial_symbols);
+  MkInterner parallel_symbols;
+  MkInternerInit(&parallel_symbols);
+  MkParser serial;
+  MkParserInitTokens(&serial, source, &tokens);
+  serial.symbols = &serial_symbols;
+  MkAstProgram* expected_program = MkParserParseProgram(&serial);
+  MkParser parallel;
+  MkParserInitTokens(&parallel, source, &tokens);
+  parallel.symbols = &parallel_symbols;
+  MkAstProgram* actual_program =
+      MkParserParseProgramParallel(&parallel, pool, min_range_tokens);
+  String expected = MkAstNodeString(&expected_program->base);
+  String actual = MkAstNodeString(&actual_program->base);
+  bool same_statements = expected_program->statements.size ==
+                         actual_program->statements.size;
+  bool at_end = MkParserPeekToken(&parallel, 0).type == kMkTokenEof;
+  // Ranges intern into tables of their own, merged afterwards, and the names
+  // must still be numbered as the serial parse numbers them.
+  bool same_symbols =
+      MkInternerCount(&serial_symbols) == MkInternerCount(&parallel_symbols) &&
+      serial_symbols.lookups == parallel_symbols.lookups &&
+      serial_symbols.hits == parallel_symbols.hits;
+  for (uint32_t i = 0; same_symbols && i < MkInternerCount(&serial_symbols);
+       ++i) {
+    same_symbols = StringViewEqual(MkInternerName(&serial_symbols, i),
+                                   MkInternerName(&parallel_symbols, i));
+  }
+  for (uint64_t i = 0;
+       same_symbols && same_statements && i < actual_program->statements.size;
+       ++i) {
+    MkAstStatement* a = expected_program->statements.data[i];
+    MkAstStatement* b = actual_program->statements.data[i];
+    same_symbols = a->type != kMkAstStatementLet ||
+                   ((MkAstLetStatement*)a)->name.symbol ==
+                       ((MkAstLetStatement*)b)->name.symbol;
+  }
+  MkInternerFree(&serial_symbols);
+  MkInternerFree(&parallel_symbols);
+  MkAstNodeFree(&expected_program->base);
+  free(expected_program);
+  MkAstNodeFree(&actual_program->base);
+  free(actual_program);
+  bool same_errors = serial.errors.size == parallel.errors.size;
+  for (uint64_t i = 0; same_errors && i < serial.errors.size; ++i) {
+    MkParseError a = serial.errors.data[i];
+    MkParseError b = parallel.errors.data[i];
+    same_errors = a.kind == b.kind && a.expected == b.expected &&
+                  a.got == b.got && a.offset == b.offset;
+  }
+  uint64_t error_count = serial.errors.size;
+  MkParserFree(serial);
+  MkParserFree(parallel);
+  MkTokenBufferFree(&tokens);
+  bool same = same_statements && same_errors && same_symbols && at_end &&
+              StringEqual(expected, actual);
+  VEC_FREE(&expected);
+  VEC_FREE(&actual);
+  TEST_ASSERT(same, (void)0,
+              "parallel parse with %" PRIu32 " threads and ranges of %" PRIu64
+              " tokens differs (statements %s, errors %s of %" PRIu64
+              ", symbols %s, at end %s)",
+              pool->thread_count, min_range_tokens,
+              same_statements ? "same" : "differ",
+              same_errors ? "same" : "differ", error_count,
+              same_symbols ? "same" : "differ", at_end ? "yes" : "no");
+  TEST_PASS();
+}
+
+TEST_SUBTEST_FUNC(ReparsesLike,
+                  MkParser* parser,
+                  MkAstProgram* program,
+                  StringView source,
+                  const MkTokenBuffer* tokens,
+                  uint64_t edit_index) {
+  MkParser full;
+  MkParserInitTokens(&full, source, tokens);
+  MkAstProgram* expected_program = MkParserParseProgram(&full);
+  String expected = MkAstNodeString(&expected_program->base);
+  String actual = MkAstNodeString(&program->base);
+  // Lowering looks every token up by offset, so the flat ASTs only match if
+  // the moved statements point at the right tokens.
+  MkFlatAst expected_flat = {0};
+  MkFlatAst actual_flat = {0};
+  bool same_tokens =
+      MkFlatAstFromProgram(&expected_flat, expected_program, tokens) &&
+      MkFlatAstFromProgram(&actual_flat, program, tokens) &&
+      SameFlatAst(&expected_flat, &actual_flat);
+  MkFlatAstFree(&expected_flat);
+  MkFlatAstFree(&actual_flat);
+  bool same_counts =
+      program->node_count == expected_program->node_count &&
+      program->node_count == MkAstNodeCount(&program->base);
+  MkAstNodeFree(&expected_program->base);
+  free(expected_program);
+  bool same_errors = full.errors.size == parser->errors.size;
+  for (uint64_t i = 0; same_errors && i < full.errors.size; ++i) {
+    MkParseError a = full.errors.data[i];
+    MkParseError b = parser->errors.data[i];
+    same_errors = a.kind == b.kind && a.expected == b.expected &&
+                  a.got == b.got && a.offset == b.offset;
+  }
+  MkParserFree(full);
+  bool same_text = StringEqual(expected, actual);
+  VEC_FREE(&expected);
+  VEC_FREE(&actual);
+  TEST_ASSERT(same_text && same_tokens && same_counts && same_errors,
+              (void)0,
+              "edit %" PRIu64 " reparsed differently (text %s, tokens %s, "
+              "node counts %s, errors %s)",
+              edit_index, same_text ? "same" : "differ",
+              same_tokens ? "same" : "differ",
+              same_counts ? "same" : "differ",
+              same_errors ? "same" : "differ");
+  TEST_PASS();
+}
+
+bool SameFlatAst(const MkFlatAst* a, const MkFlatAst* b) {
+  return a->root == b->root && a->nodes.size == b->nodes.size &&
+         a->extra.size == b->extra.size &&
+         (a->nodes.size == 0 ||
+          memcmp(a->nodes.data, b->nodes.data,
+                 a->nodes.size * sizeof(MkFlatNode)) == 0) &&
+         (a->extra.size == 0 ||
+          memcmp(a->extra.data, b->extra.data,
+                 a->extra.size * sizeof(uint32_t)) == 0);
+}
+
+StringView ViewOf(const String* string) {
+  return (StringView){.begin = string->data,
+                      .end = string->data + string->size};
 }
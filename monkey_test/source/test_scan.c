@@ -0,0 +1,199 @@
+#include "monkey_test/test_scan.h"
+
+#include <inttypes.h>
+#include <monkey/lexer.h>
+#include <monkey/line_index.h>
+#include <monkey/scan.h>
+#include <monkey/token.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <string/string.h>
+#include <test/test.h>
+#include <vec/vec.h>
+
+#include "monkey_test/input/next_token_test.h"
+
+enum { kRandomInputs = 64, kRandomInputSize = 1024 };
+
+static const char kAlphabet[] = " \t\r\nazAZ09mM5_=!+-*/<>;,(){}\x80\xff@[`{";
+
+static uint64_t NextRandom(uint64_t* state) {
+  // xorshift64
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+// Runs of a single class are what the vector kernels skip over, so the
+// generator favours them over uniformly random bytes.
+static String RandomSource(uint64_t* state) {
+  String source = {0};
+  while (source.size < kRandomInputSize) {
+    char ch = kAlphabet[NextRandom(state) % (sizeof(kAlphabet) - 1)];
+    uint64_t run = NextRandom(state) % 48;
+    for (uint64_t i = 0; i <= run; ++i) {
+      VEC_PUSH(&source, ch);
+    }
+  }
+  return source;
+}
+
+TEST_SUBTEST_FUNC(ScanTokensMatch, StringView source, MkScanLevel level) {
+  MkLexer expected = {0};
+  MkLexer actual = {0};
+  MkScanSetLevel(kMkScanScalar);
+  MkLexerInit(&expected, source);
+  MkScanSetLevel(level);
+  MkLexerInit(&actual, source);
+  for (uint64_t i = 0;; ++i) {
+    MkScanSetLevel(kMkScanScalar);
+    MkToken e = MkLexerNextToken(&expected);
+    MkScanSetLevel(level);
+    MkToken a = MkLexerNextToken(&actual);
+    TEST_ASSERT(e.type == a.type && e.literal.begin == a.literal.begin &&
+                    e.literal.end == a.literal.end,
+                (void)0,
+                "%s: token %" PRIu64 " is %s '%" STRING_FMT
+                "', expected %s '%" STRING_FMT "'",
+                MkScanLevelName(level), i, MkTokenTypeName(a.type),
+                STRING_VIEW_PRINT(a.literal), MkTokenTypeName(e.type),
+                STRING_VIEW_PRINT(e.literal));
+    if (e.type == kMkTokenEof) {
+      break;
+    }
+  }
+  TEST_PASS();
+}
+
+TEST_FUNC(ScanKernelsMatchScalar) {
+  MkScanLevel initial = MkScanGetLevel();
+  uint64_t state = 0x9E3779B97F4A7C15;
+  for (uint64_t n = 0; n < kRandomInputs; ++n) {
+    String source = RandomSource(&state);
+    StringView view = {.begin = source.data,
+                       .end = source.data + source.size};
+    for (MkScanLevel level = kMkScanSse2; level < kMkScanLevelCount;
+         ++level) {
+      if (!MkScanLevelSupported(level)) {
+        continue;
+      }
+      for (uint64_t i = 0; i < source.size; ++i) {
+        MkScanSetLevel(kMkScanScalar);
+        uint64_t whitespace = MkScanWhitespace(view, i);
+        uint64_t letters = MkScanLetters(view, i);
+        uint64_t digits = MkScanDigits(view, i);
+        MkScanSetLevel(level);
+        TEST_ASSERT(MkScanWhitespace(view, i) == whitespace &&
+                        MkScanLetters(view, i) == letters &&
+                        MkScanDigits(view, i) == digits,
+                    do {
+                      VEC_FREE(&source);
+                      MkScanSetLevel(initial);
+                    } while (false),
+                    "%s kernels disagree with scalar at input %" PRIu64
+                    ", offset %" PRIu64,
+                    MkScanLevelName(level), n, i);
+      }
+    }
+    VEC_FREE(&source);
+  }
+  MkScanSetLevel(initial);
+  TEST_PASS();
+}
+
+TEST_FUNC(ScanLexerMatchesScalar) {
+  MkScanLevel initial = MkScanGetLevel();
+  StringView corpus = {
+      .begin = next_token_test,
+      .end = next_token_test + next_token_test_size,
+  };
+  uint64_t state = 0xD1B54A32D192ED03;
+  for (MkScanLevel level = kMkScanSse2; level < kMkScanLevelCount; ++level) {
+    if (!MkScanLevelSupported(level)) {
+      continue;
+    }
+    TEST_RUN_SUBTEST(ScanTokensMatch, MkScanSetLevel(initial), corpus, level);
+    for (uint64_t n = 0; n < kRandomInputs; ++n) {
+      String source = RandomSource(&state);
+      TEST_RUN_SUBTEST(
+          ScanTokensMatch,
+          do {
+            VEC_FREE(&source);
+            MkScanSetLevel(initial);
+          } while (false),
+          ((StringView){.begin = source.data,
+                        .end = source.data + source.size}),
+          level);
+      VEC_FREE(&source);
+    }
+  }
+  MkScanSetLevel(initial);
+  TEST_PASS();
+}
+
+TEST_FUNC(ScanLineStarts) {
+  MkScanLevel initial = MkScanGetLevel();
+  uint64_t state = 0x94D049BB133111EB;
+  MkLineStarts expected = {0};
+  MkLineStarts actual = {0};
+  for (uint64_t n = 0; n < kRandomInputs; ++n) {
+    String source = RandomSource(&state);
+    StringView view = {.begin = source.data,
+                       .end = source.data + source.size};
+    expected.size = 0;
+    MkScanSetLevel(kMkScanScalar);
+    MkScanLineStarts(view, &expected);
+    for (MkScanLevel level = kMkScanSse2; level < kMkScanLevelCount;
+         ++level) {
+      if (!MkScanLevelSupported(level)) {
+        continue;
+      }
+      actual.size = 0;
+      MkScanSetLevel(level);
+      bool ok = MkScanLineStarts(view, &actual);
+      TEST_ASSERT(ok && actual.size == expected.size &&
+                      memcmp(actual.data, expected.data,
+                             expected.size * sizeof(uint32_t)) == 0,
+                  do {
+                    VEC_FREE(&source);
+                    VEC_FREE(&expected);
+                    VEC_FREE(&actual);
+                    MkScanSetLevel(initial);
+                  } while (false),
+                  "%s line starts disagree with scalar at input %" PRIu64,
+                  MkScanLevelName(level), n);
+    }
+    MkScanSetLevel(initial);
+
+    MkLineIndex index;
+    MkLineIndexInit(&index, view);
+    uint32_t line = 1;
+    uint32_t column = 1;
+    for (uint64_t i = 0; i <= source.size; ++i) {
+      MkSourcePosition position = MkLineIndexLookup(&index, i);
+      TEST_ASSERT(position.line == line && position.column == column,
+                  do {
+                    MkLineIndexFree(&index);
+                    VEC_FREE(&source);
+                    VEC_FREE(&expected);
+                    VEC_FREE(&actual);
+                  } while (false),
+                  "input %" PRIu64 ", offset %" PRIu64 ": %" PRIu32
+                  ":%" PRIu32 ", expected %" PRIu32 ":%" PRIu32,
+                  n, i, position.line, position.column, line, column);
+      if (i < source.size && source.data[i] == '\n') {
+        ++line;
+        column = 1;
+      } else {
+        ++column;
+      }
+    }
+    MkLineIndexFree(&index);
+    VEC_FREE(&source);
+  }
+  VEC_FREE(&expected);
+  VEC_FREE(&actual);
+  TEST_PASS();
+}
@@ -0,0 +1,106 @@
+#include "monkey_test/test_stream.h"
+
+#include <inttypes.h>
+#include <monkey/lexer.h>
+#include <monkey/stream.h>
+#include <monkey/token.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string/string.h>
+#include <test/test.h>
+
+#include "monkey_test/input/next_token_test.h"
+
+typedef struct {
+  StringView source;
+  uint64_t position;
+} ChunkedSource;
+
+static int64_t RefillChunked(void* context, char* buffer, uint64_t capacity) {
+  ChunkedSource* chunked = context;
+  uint64_t left = SPAN_SIZE(&chunked->source) - chunked->position;
+  uint64_t n = capacity < left ? capacity : left;
+  memcpy(buffer, chunked->source.begin + chunked->position, n);
+  chunked->position += n;
+  return (int64_t)n;
+}
+
+TEST_SUBTEST_FUNC(StreamMatchesLexer,
+                  StringView source,
+                  MkStreamLexer* stream,
+                  uint64_t chunk_size) {
+  MkLexer lexer;
+  MkLexerInit(&lexer, source);
+  for (uint64_t i = 0;; ++i) {
+    MkToken expected = MkLexerNextToken(&lexer);
+    MkToken t = MkStreamLexerNextToken(stream);
+    TEST_ASSERT(t.type == expected.type && t.offset == expected.offset &&
+                    StringViewEqual(t.literal, expected.literal),
+                (void)0,
+                "chunk size %" PRIu64 ", token %" PRIu64 ": %s '%" STRING_FMT
+                "'@%" PRIu32 ", expected %s '%" STRING_FMT "'@%" PRIu32,
+                chunk_size, i, MkTokenTypeName(t.type),
+                STRING_VIEW_PRINT(t.literal), t.offset,
+                MkTokenTypeName(expected.type),
+                STRING_VIEW_PRINT(expected.literal), expected.offset);
+    if (expected.type == kMkTokenEof) {
+      break;
+    }
+  }
+  TEST_ASSERT(!stream->failed, (void)0, "chunk size %" PRIu64 ": stream failed",
+              chunk_size);
+  TEST_PASS();
+}
+
+TEST_FUNC(StreamChunkBoundaries) {
+  StringView sources[] = {
+      {.begin = next_token_test,
+       .end = next_token_test + next_token_test_size},
+      StringViewFromC("let averyveryveryverylongidentifiername = 1234567890123;"
+                      "a==b!=c=!d;   \n\t  x"),
+      StringViewFromC("="),
+      StringViewFromC("   "),
+      StringViewFromC(""),
+  };
+  uint64_t chunk_sizes[] = {1, 2, 3, 5, 7, 16, 64, 4096};
+  for (uint64_t s = 0; s < sizeof(sources) / sizeof(sources[0]); ++s) {
+    for (uint64_t c = 0; c < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]);
+         ++c) {
+      ChunkedSource chunked = {.source = sources[s]};
+      MkStreamLexer stream;
+      MkStreamLexerInit(&stream, RefillChunked, &chunked, chunk_sizes[c]);
+      TEST_RUN_SUBTEST(StreamMatchesLexer, MkStreamLexerFree(&stream),
+                       sources[s], &stream, chunk_sizes[c]);
+      TEST_ASSERT(stream.capacity <= 2 * chunk_sizes[c] + 64,
+                  MkStreamLexerFree(&stream),
+                  "source %" PRIu64 ", chunk size %" PRIu64
+                  ": buffer grew to %" PRIu64,
+                  s, chunk_sizes[c], stream.capacity);
+      MkStreamLexerFree(&stream);
+    }
+  }
+  TEST_PASS();
+}
+
+TEST_FUNC(StreamFile) {
+  FILE* fp = tmpfile();
+  TEST_ASSERT(fp != NULL, (void)0, "could not create a temporary file");
+  fwrite(next_token_test, 1, next_token_test_size, fp);
+  rewind(fp);
+
+  MkStreamLexer stream;
+  MkStreamLexerInit(&stream, MkStreamRefillFile, fp, 8);
+  TEST_RUN_SUBTEST(
+      StreamMatchesLexer,
+      do {
+        MkStreamLexerFree(&stream);
+        fclose(fp);
+      } while (false),
+      ((StringView){.begin = next_token_test,
+                    .end = next_token_test + next_token_test_size}),
+      &stream, 8);
+  MkStreamLexerFree(&stream);
+  fclose(fp);
+  TEST_PASS();
+}
@@ -12,8 +12,8 @@ char* NonstdStringPointBreak(const char* s, const char* accept)
             {
                 return (char*)s;
             }
-            ++s;
         }
+        ++s;
     }
     return NULL;
 }
@@ -0,0 +1,40 @@
+#ifndef POOL_POOL_H_
+#define POOL_POOL_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*ThreadPoolTask)(void* context, uint64_t index);
+
+// A fixed set of worker threads that run batches of indexed tasks. The
+// calling thread takes part in every batch, so a pool of N threads starts
+// N - 1 workers.
+typedef struct {
+  pthread_t* workers;
+  uint32_t thread_count;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t work_ready;
+  pthread_cond_t work_done;
+  uint64_t generation;
+  uint32_t busy;
+  bool stopping;
+
+  ThreadPoolTask task;
+  void* context;
+  uint64_t task_count;
+  uint64_t next_task;
+} ThreadPool;
+
+bool ThreadPoolInit(ThreadPool* pool, uint32_t thread_count);
+// Runs task(context, i) for every i in [0, task_count) and returns once all of
+// them have finished.
+void ThreadPoolRun(ThreadPool* pool,
+                   ThreadPoolTask task,
+                   void* context,
+                   uint64_t task_count);
+void ThreadPoolFree(ThreadPool* pool);
+uint32_t ThreadPoolDefaultSize(void);
+
+#endif  // POOL_POOL_H_
@@ -0,0 +1,114 @@
+#include "pool/pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void* WorkerMain(void* arg);
+static void RunTasks(ThreadPool* pool);
+
+bool ThreadPoolInit(ThreadPool* pool, uint32_t thread_count) {
+  *pool = (ThreadPool){
+      .thread_count = thread_count ? thread_count : 1,
+  };
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->work_ready, NULL);
+  pthread_cond_init(&pool->work_done, NULL);
+  if (pool->thread_count == 1) {
+    return true;
+  }
+  pool->workers = calloc(pool->thread_count - 1, sizeof(pthread_t));
+  if (pool->workers == NULL) {
+    pool->thread_count = 1;
+    return false;
+  }
+  for (uint32_t i = 0; i + 1 < pool->thread_count; ++i) {
+    if (pthread_create(&pool->workers[i], NULL, WorkerMain, pool) != 0) {
+      // Keep the workers that did start.
+      pool->thread_count = i + 1;
+      return false;
+    }
+  }
+  return true;
+}
+
+void ThreadPoolRun(ThreadPool* pool,
+                   ThreadPoolTask task,
+                   void* context,
+                   uint64_t task_count) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->task = task;
+  pool->context = context;
+  pool->task_count = task_count;
+  pool->next_task = 0;
+  pool->busy = pool->thread_count;
+  ++pool->generation;
+  pthread_cond_broadcast(&pool->work_ready);
+  pthread_mutex_unlock(&pool->mutex);
+
+  RunTasks(pool);
+
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->busy > 0) {
+    pthread_cond_wait(&pool->work_done, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+void ThreadPoolFree(ThreadPool* pool) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->work_ready);
+  pthread_mutex_unlock(&pool->mutex);
+  for (uint32_t i = 0; i + 1 < pool->thread_count; ++i) {
+    pthread_join(pool->workers[i], NULL);
+  }
+  free(pool->workers);
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->work_ready);
+  pthread_cond_destroy(&pool->work_done);
+  *pool = (ThreadPool){0};
+}
+
+uint32_t ThreadPoolDefaultSize(void) {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (uint32_t)count : 1;
+}
+
+void* WorkerMain(void* arg) {
+  ThreadPool* pool = arg;
+  uint64_t seen = 0;
+  pthread_mutex_lock(&pool->mutex);
+  while (true) {
+    while (!pool->stopping && pool->generation == seen) {
+      pthread_cond_wait(&pool->work_ready, &pool->mutex);
+    }
+    if (pool->stopping) {
+      break;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->mutex);
+    RunTasks(pool);
+    pthread_mutex_lock(&pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+// Tasks are claimed one index at a time under the mutex; batches are a few
+// dozen coarse tasks, so the lock is nowhere near hot.
+void RunTasks(ThreadPool* pool) {
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->next_task < pool->task_count) {
+    uint64_t index = pool->next_task++;
+    pthread_mutex_unlock(&pool->mutex);
+    pool->task(pool->context, index);
+    pthread_mutex_lock(&pool->mutex);
+  }
+  if (--pool->busy == 0) {
+    pthread_cond_signal(&pool->work_done);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+}
@@ -21,8 +21,10 @@ String StringDuplicate(const String s);
 String StringFormat(const char* format, ...) STRING_ATTR_PRINTF;
 bool StringEqual(const String a, const String b);
 bool StringEqualView(const String a, StringView b);
+bool StringViewEqual(StringView a, StringView b);
 
 #define STRING_PRINT(S) (int)(S).size, (S).data
+#define STRING_VIEW_PRINT(S) (int)((S).end - (S).begin), (S).begin
 #define STRING_FMT ".*s"
 
 #endif  // STRING_STRING_H_
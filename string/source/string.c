@@ -52,3 +52,8 @@ bool StringEqual(const String a, const String b) {
 bool StringEqualView(const String a, StringView b) {
   return a.size == SPAN_SIZE(&b) && memcmp(a.data, b.begin, a.size) == 0;
 }
+
+bool StringViewEqual(StringView a, StringView b) {
+  return SPAN_SIZE(&a) == SPAN_SIZE(&b) &&
+         memcmp(a.begin, b.begin, SPAN_SIZE(&a)) == 0;
+}